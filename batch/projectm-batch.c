@@ -0,0 +1,864 @@
+/*
+ * projectm-batch: render many audio files to video in one process.
+ *
+ * Every input runs through its own decodebin ! projectm ! x264enc ! mp4mux
+ * pipeline, at most --jobs of them at a time. The pipelines share what a
+ * gst-launch per file pays for again and again: the plugin is loaded once,
+ * the elements take their GL contexts from one pool on one GL display
+ * (shared-contexts), and the preset directory is scanned once into a preset
+ * index the others read.
+ *
+ * With --segment-length, a long input is cut into segments rendered by
+ * separate pipelines like any other job. Each one decodes the file from the
+ * start but only feeds projectM the --preroll seconds before its segment, to
+ * warm up beat detection and the preset, and encodes the frames of the
+ * segment alone. A preset seed makes every segment show the presets of the
+ * whole file at the same times. Once all are done, the parts, which start on
+ * a keyframe each, are joined without re-encoding and the audio of the whole
+ * file is added.
+ *
+ * Example:
+ *   projectm-batch --surfaceless -j 4 -p /usr/share/projectM/presets \
+ *     -o videos music/*.mp3
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#ifdef G_OS_UNIX
+#include <glib-unix.h>
+#endif
+
+typedef enum {
+  BATCH_JOB_PENDING,
+  BATCH_JOB_RUNNING,
+  BATCH_JOB_DONE,
+  BATCH_JOB_FAILED,
+  BATCH_JOB_SKIPPED,
+} BatchJobState;
+
+typedef struct _BatchJob BatchJob;
+
+struct _BatchJob {
+  gchar *input;
+  gchar *output;
+  guint number;
+  BatchJobState state;
+  GstElement *pipeline;
+  gint64 start_time;
+  gint64 wall_us;
+  GstClockTime position;
+  GstClockTime duration;
+
+  /* a segment of the file, its end is GST_CLOCK_TIME_NONE for the last */
+  BatchJob *file;
+  GstClockTime segment_start;
+  GstClockTime segment_end;
+  gboolean segment_eos; /* the audio after the segment was cut off */
+
+  /* segments of a file, joined into its output once all are done */
+  GPtrArray *parts; /* BatchJob */
+  guint parts_left;
+  gboolean parts_failed;
+};
+
+typedef struct {
+  GPtrArray *jobs; /* BatchJob */
+  GQueue queue;    /* files and segments not started yet */
+  guint running;
+  guint done;
+  guint failed;
+  guint skipped;
+  /* only the first job runs until it wrote the preset index */
+  gboolean warming;
+  gboolean interrupted;
+  guint ticks;
+  gint64 start_time;
+  GMainLoop *loop;
+} Batch;
+
+static gint jobs = 2;
+static gint contexts = 0;
+static gint width = 1920;
+static gint height = 1080;
+static gint fps = 60;
+static gint bitrate = 8000;
+static gchar *speed_preset = NULL;
+static gchar *mesh_size = NULL;
+static gdouble preset_duration = 4.0;
+static gchar *preset_path = NULL;
+static gchar *texture_dir = NULL;
+static gchar *preset_index = NULL;
+static gchar *output_dir = NULL;
+static gchar *input_list = NULL;
+static gchar *plugin_dir = NULL;
+static gint progress_interval = 5;
+static gdouble segment_length = 0.0;
+static gdouble preroll = 10.0;
+static gint preset_seed = 0;
+static gboolean surfaceless = FALSE;
+static gboolean overwrite = FALSE;
+static gchar **inputs = NULL;
+
+static Batch batch;
+
+static GOptionEntry entries[] = {
+    {"jobs", 'j', 0, G_OPTION_ARG_INT, &jobs,
+     "Files rendered at the same time (default 2)", "N"},
+    {"contexts", 'c', 0, G_OPTION_ARG_INT, &contexts,
+     "GL contexts shared by the pipelines (default one per job)", "N"},
+    {"output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &output_dir,
+     "Directory the .mp4 files are written to (default .)", "DIR"},
+    {"input-list", 'i', 0, G_OPTION_ARG_FILENAME, &input_list,
+     "File with one input per line, - for stdin", "FILE"},
+    {"preset", 'p', 0, G_OPTION_ARG_FILENAME, &preset_path,
+     "Preset file or directory", "PATH"},
+    {"texture-dir", 't', 0, G_OPTION_ARG_FILENAME, &texture_dir,
+     "Texture directory", "DIR"},
+    {"preset-index", 0, 0, G_OPTION_ARG_FILENAME, &preset_index,
+     "Preset index shared by the pipelines (default in the user cache "
+     "directory)",
+     "FILE"},
+    {"preset-duration", 'd', 0, G_OPTION_ARG_DOUBLE, &preset_duration,
+     "Preset duration in seconds (default 4)", "SEC"},
+    {"mesh-size", 'm', 0, G_OPTION_ARG_STRING, &mesh_size,
+     "Mesh size (default 256,144)", "W,H"},
+    {"width", 0, 0, G_OPTION_ARG_INT, &width, "Video width (default 1920)",
+     "W"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &height, "Video height (default 1080)",
+     "H"},
+    {"fps", 'r', 0, G_OPTION_ARG_INT, &fps, "Video framerate (default 60)",
+     "FPS"},
+    {"bitrate", 'b', 0, G_OPTION_ARG_INT, &bitrate,
+     "Video bitrate in kbps (default 8000)", "KBPS"},
+    {"speed", 0, 0, G_OPTION_ARG_STRING, &speed_preset,
+     "x264 speed preset (default medium)", "PRESET"},
+    {"segment-length", 'l', 0, G_OPTION_ARG_DOUBLE, &segment_length,
+     "Render files longer than this in segments of this length in parallel, "
+     "0 for whole files (default 0)",
+     "SEC"},
+    {"preroll", 0, 0, G_OPTION_ARG_DOUBLE, &preroll,
+     "Audio fed to a segment before its start to warm up (default 10)",
+     "SEC"},
+    {"seed", 0, 0, G_OPTION_ARG_INT, &preset_seed,
+     "Preset schedule seed, the same seed renders the same presets (default "
+     "none, 1 with segments)",
+     "N"},
+    {"surfaceless", 's', 0, G_OPTION_ARG_NONE, &surfaceless,
+     "Render without a window system", NULL},
+    {"overwrite", 'f', 0, G_OPTION_ARG_NONE, &overwrite,
+     "Render files whose output already exists", NULL},
+    {"progress", 0, 0, G_OPTION_ARG_INT, &progress_interval,
+     "Seconds between progress reports, 0 for none (default 5)", "SEC"},
+    {"plugin-dir", 0, 0, G_OPTION_ARG_FILENAME, &plugin_dir,
+     "Directory containing the projectm plugin", "DIR"},
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &inputs, NULL,
+     "FILE..."},
+    {NULL}};
+
+static void batch_start_jobs(void);
+
+static gdouble batch_seconds(GstClockTime time) {
+  return GST_CLOCK_TIME_IS_VALID(time) ? (gdouble)time / GST_SECOND : 0.0;
+}
+
+static void batch_add_job(const gchar *input) {
+  BatchJob *job = g_new0(BatchJob, 1);
+  gchar *base, *dot, *name;
+
+  base = g_path_get_basename(input);
+  dot = strrchr(base, '.');
+  if (dot && dot != base)
+    *dot = '\0';
+  name = g_strconcat(base, ".mp4", NULL);
+
+  job->input = g_strdup(input);
+  job->output = g_build_filename(output_dir ? output_dir : ".", name, NULL);
+  job->number = batch.jobs->len + 1;
+  job->position = GST_CLOCK_TIME_NONE;
+  job->duration = GST_CLOCK_TIME_NONE;
+  job->segment_start = 0;
+  job->segment_end = GST_CLOCK_TIME_NONE;
+  g_ptr_array_add(batch.jobs, job);
+  g_queue_push_tail(&batch.queue, job);
+
+  g_free(name);
+  g_free(base);
+}
+
+static void batch_free_job(gpointer data) {
+  BatchJob *job = data;
+
+  if (job->pipeline) {
+    gst_element_set_state(job->pipeline, GST_STATE_NULL);
+    gst_object_unref(job->pipeline);
+  }
+  if (job->parts)
+    g_ptr_array_unref(job->parts);
+  g_free(job->input);
+  g_free(job->output);
+  g_free(job);
+}
+
+static gboolean batch_read_input_list(const gchar *filename) {
+  FILE *file;
+  gchar line[4096];
+
+  file = g_strcmp0(filename, "-") ? g_fopen(filename, "r") : stdin;
+  if (!file) {
+    g_printerr("could not open %s\n", filename);
+    return FALSE;
+  }
+
+  while (fgets(line, sizeof(line), file)) {
+    g_strstrip(line);
+    if (line[0] != '\0' && line[0] != '#')
+      batch_add_job(line);
+  }
+
+  if (file != stdin)
+    fclose(file);
+
+  return TRUE;
+}
+
+#define BATCH_AUDIO_ENCODE                                                     \
+  "audioconvert ! audioresample ! "                                            \
+  "audio/x-raw,format=F32LE,channels=2,rate=44100 ! "                          \
+  "avenc_aac bitrate=320000"
+
+static gchar *batch_pipeline_description(BatchJob *job) {
+  gchar *video, *description;
+
+  // the parts of a file are joined as they are, the audio is encoded once
+  if (job->parts)
+    return g_strdup("splitmuxsrc name=parts ! h264parse ! queue ! mux. "
+                    "filesrc name=src ! decodebin ! " BATCH_AUDIO_ENCODE " ! "
+                    "queue ! mux. "
+                    "mp4mux name=mux ! filesink name=sink");
+
+  video = g_strdup_printf(
+      "audioconvert ! "
+      "projectm name=pm offline=true surfaceless=%s shared-contexts=%d "
+      "mesh-size=%s ! "
+      "video/x-raw,format=NV12,width=%d,height=%d,framerate=%d/1 ! "
+      "x264enc bitrate=%d key-int-max=200 speed-preset=%s ! "
+      "video/x-h264,stream-format=avc,alignment=au",
+      surfaceless ? "true" : "false", contexts,
+      mesh_size ? mesh_size : "256,144", width, height, fps, bitrate,
+      speed_preset ? speed_preset : "medium");
+
+  if (job->file)
+    description = g_strdup_printf("filesrc name=src ! decodebin ! queue ! %s ! "
+                                  "mp4mux ! filesink name=sink",
+                                  video);
+  else
+    description = g_strdup_printf(
+        "filesrc name=src ! decodebin ! tee name=t "
+        "t. ! queue ! " BATCH_AUDIO_ENCODE " ! queue ! mux. "
+        "t. ! queue ! %s ! queue ! mux. "
+        "mp4mux name=mux ! filesink name=sink",
+        video);
+
+  g_free(video);
+  return description;
+}
+
+/* length of the segments, a whole number of frames */
+static GstClockTime batch_segment_duration(void) {
+  guint64 frames = (guint64)(segment_length * fps + 0.5);
+
+  return gst_util_uint64_scale_int(MAX(frames, 1), GST_SECOND, fps);
+}
+
+/* the duration of a file, read by prerolling a pipeline decoding it */
+static GstClockTime batch_probe_duration(const gchar *input) {
+  GstClockTime duration = GST_CLOCK_TIME_NONE;
+  GstElement *pipeline, *src;
+  gint64 value;
+
+  pipeline = gst_parse_launch(
+      "filesrc name=src ! decodebin ! audioconvert ! fakesink", NULL);
+  if (!pipeline)
+    return GST_CLOCK_TIME_NONE;
+
+  src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+  g_object_set(src, "location", input, NULL);
+  gst_object_unref(src);
+
+  if (gst_element_set_state(pipeline, GST_STATE_PAUSED) !=
+          GST_STATE_CHANGE_FAILURE &&
+      gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND) ==
+          GST_STATE_CHANGE_SUCCESS &&
+      gst_element_query_duration(pipeline, GST_FORMAT_TIME, &value))
+    duration = value;
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(pipeline);
+
+  return duration;
+}
+
+/* cut a file longer than a segment into parts, queued in its place */
+static gboolean batch_split_job(BatchJob *job) {
+  GstClockTime length = batch_segment_duration();
+  gchar *stem;
+  guint i, n;
+
+  job->duration = batch_probe_duration(job->input);
+  if (!GST_CLOCK_TIME_IS_VALID(job->duration) || job->duration <= length)
+    return FALSE;
+
+  n = (guint)((job->duration + length - 1) / length);
+  stem = g_strndup(job->output, strlen(job->output) - strlen(".mp4"));
+  job->parts = g_ptr_array_new_with_free_func(batch_free_job);
+  job->parts_left = n;
+
+  for (i = n; i-- > 0;) {
+    BatchJob *part = g_new0(BatchJob, 1);
+
+    part->input = g_strdup(job->input);
+    part->output = g_strdup_printf("%s.part%03u.mp4", stem, i + 1);
+    part->number = i + 1;
+    part->position = GST_CLOCK_TIME_NONE;
+    part->duration = GST_CLOCK_TIME_NONE;
+    part->file = job;
+    part->segment_start = i * length;
+    part->segment_end = i + 1 < n ? (i + 1) * length : GST_CLOCK_TIME_NONE;
+    g_ptr_array_insert(job->parts, 0, part);
+    g_queue_push_head(&batch.queue, part);
+  }
+
+  g_print("[%u/%u] splitting %s into %u segments\n", job->number,
+          batch.jobs->len, job->input, n);
+
+  g_free(stem);
+  return TRUE;
+}
+
+/* feed a segment the audio of the pre-roll and of the segment, cut the rest
+ * of the file off once the last frame has its audio */
+static GstPadProbeReturn batch_segment_audio_probe(GstPad *pad,
+                                                   GstPadProbeInfo *info,
+                                                   gpointer data) {
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  GstClockTime start = GST_BUFFER_PTS(buffer), end, warm_up;
+  BatchJob *job = data;
+
+  if (!GST_CLOCK_TIME_IS_VALID(start))
+    return GST_PAD_PROBE_OK;
+
+  end = start;
+  if (GST_BUFFER_DURATION_IS_VALID(buffer))
+    end += GST_BUFFER_DURATION(buffer);
+
+  warm_up = (GstClockTime)(preroll * GST_SECOND);
+  warm_up = job->segment_start > warm_up ? job->segment_start - warm_up : 0;
+  if (end <= warm_up)
+    return GST_PAD_PROBE_DROP;
+
+  // a frame can need audio a bit past its timestamp
+  if (!GST_CLOCK_TIME_IS_VALID(job->segment_end) ||
+      start < job->segment_end + GST_SECOND)
+    return GST_PAD_PROBE_OK;
+
+  // once the pad is EOS upstream stops at the next buffer
+  if (!job->segment_eos) {
+    job->segment_eos = TRUE;
+    gst_pad_send_event(pad, gst_event_new_eos());
+  }
+  return GST_PAD_PROBE_DROP;
+}
+
+/* keep the frames of the segment, the pad offset moves the first to zero */
+static GstPadProbeReturn batch_segment_video_probe(GstPad *pad,
+                                                   GstPadProbeInfo *info,
+                                                   gpointer data) {
+  GstClockTime pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+  BatchJob *job = data;
+
+  if (!GST_CLOCK_TIME_IS_VALID(pts))
+    return GST_PAD_PROBE_OK;
+
+  if (pts < job->segment_start || (GST_CLOCK_TIME_IS_VALID(job->segment_end) &&
+                                   pts >= job->segment_end))
+    return GST_PAD_PROBE_DROP;
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void batch_setup_segment(BatchJob *job, GstElement *pm) {
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad(pm, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, batch_segment_audio_probe,
+                    job, NULL);
+  gst_object_unref(pad);
+
+  pad = gst_element_get_static_pad(pm, "src");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, batch_segment_video_probe,
+                    job, NULL);
+  gst_pad_set_offset(pad, -(gint64)job->segment_start);
+  gst_object_unref(pad);
+}
+
+static gchar **batch_part_locations(GstElement *splitmux, gpointer data) {
+  BatchJob *job = data;
+  gchar **locations = g_new0(gchar *, job->parts->len + 1);
+  guint i;
+
+  for (i = 0; i < job->parts->len; i++) {
+    BatchJob *part = g_ptr_array_index(job->parts, i);
+    locations[i] = g_strdup(part->output);
+  }
+
+  return locations;
+}
+
+static void batch_remove_parts(BatchJob *job) {
+  guint i;
+
+  for (i = 0; i < job->parts->len; i++) {
+    BatchJob *part = g_ptr_array_index(job->parts, i);
+    g_unlink(part->output);
+  }
+}
+
+static void batch_update_position(BatchJob *job) {
+  gint64 value;
+
+  if (gst_element_query_position(job->pipeline, GST_FORMAT_TIME, &value))
+    job->position = value;
+  if (!GST_CLOCK_TIME_IS_VALID(job->duration) &&
+      gst_element_query_duration(job->pipeline, GST_FORMAT_TIME, &value))
+    job->duration = value;
+}
+
+/* count a segment as done, its file is joined once all of them are */
+static void batch_finish_part(BatchJob *part, gboolean ok) {
+  BatchJob *job = part->file;
+
+  part->state = ok ? BATCH_JOB_DONE : BATCH_JOB_FAILED;
+  if (!ok)
+    job->parts_failed = TRUE;
+  if (--job->parts_left > 0)
+    return;
+
+  // segments cut short by an interruption can't be joined either
+  if (job->parts_failed || batch.interrupted) {
+    job->wall_us = g_get_monotonic_time() - job->start_time;
+    job->state = BATCH_JOB_FAILED;
+    batch.failed++;
+    g_print("[%u/%u] failed %s\n", job->number, batch.jobs->len, job->input);
+    batch_remove_parts(job);
+    return;
+  }
+
+  // ahead of the other files, the parts only take up disk space
+  g_queue_push_head(&batch.queue, job);
+}
+
+static void batch_finish_job(BatchJob *job, gboolean ok) {
+  gdouble audio, wall;
+
+  batch_update_position(job);
+  // at EOS the whole file went through, even if the position lags behind
+  if (ok && GST_CLOCK_TIME_IS_VALID(job->duration))
+    job->position = job->duration;
+
+  gst_element_set_state(job->pipeline, GST_STATE_NULL);
+  gst_clear_object(&job->pipeline);
+
+  job->wall_us = g_get_monotonic_time() - job->start_time;
+  batch.running--;
+
+  audio = batch_seconds(job->position);
+  wall = job->wall_us / (gdouble)G_USEC_PER_SEC;
+
+  if (job->file) {
+    g_print("[%u/%u] segment %u/%u of %s %s after %.1f s\n",
+            job->file->number, batch.jobs->len, job->number,
+            job->file->parts->len, job->input, ok ? "done" : "failed", wall);
+    batch_finish_part(job, ok);
+  } else if (ok) {
+    job->state = BATCH_JOB_DONE;
+    batch.done++;
+    g_print("[%u/%u] done %s: %.1f s in %.1f s, %.1fx realtime, %.0f fps\n",
+            job->number, batch.jobs->len, job->output, audio, wall,
+            wall > 0 ? audio / wall : 0.0,
+            wall > 0 ? audio * fps / wall : 0.0);
+    if (job->parts)
+      batch_remove_parts(job);
+  } else {
+    job->state = BATCH_JOB_FAILED;
+    batch.failed++;
+    g_print("[%u/%u] failed %s after %.1f s\n", job->number, batch.jobs->len,
+            job->input, wall);
+    // don't leave a truncated file that looks finished
+    g_unlink(job->output);
+    if (job->parts)
+      batch_remove_parts(job);
+  }
+
+  // the first job scanned the presets by now, or never will
+  batch.warming = FALSE;
+  batch_start_jobs();
+}
+
+static gboolean batch_bus_message(GstBus *bus, GstMessage *message,
+                                  gpointer data) {
+  BatchJob *job = data;
+  GError *err = NULL;
+  gchar *debug = NULL;
+
+  switch (GST_MESSAGE_TYPE(message)) {
+  case GST_MESSAGE_EOS:
+    batch_finish_job(job, TRUE);
+    return G_SOURCE_REMOVE;
+
+  case GST_MESSAGE_ERROR:
+    gst_message_parse_error(message, &err, &debug);
+    g_printerr("%s: %s\n", job->input, err->message);
+    if (debug)
+      g_printerr("  %s\n", debug);
+    g_clear_error(&err);
+    g_free(debug);
+    batch_finish_job(job, FALSE);
+    return G_SOURCE_REMOVE;
+
+  case GST_MESSAGE_WARNING:
+    gst_message_parse_warning(message, &err, &debug);
+    g_printerr("%s: warning: %s\n", job->input, err->message);
+    g_clear_error(&err);
+    g_free(debug);
+    break;
+
+  default:
+    break;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean batch_start_job(BatchJob *job) {
+  GstElement *element;
+  GError *err = NULL;
+  gchar *description;
+  GstBus *bus;
+
+  description = batch_pipeline_description(job);
+  job->pipeline = gst_parse_launch(description, &err);
+  g_free(description);
+
+  // a pipeline with missing elements comes back together with an error
+  if (err) {
+    g_printerr("%s: could not create pipeline: %s\n", job->input,
+               err->message);
+    g_clear_error(&err);
+    gst_clear_object(&job->pipeline);
+    return FALSE;
+  }
+
+  element = gst_bin_get_by_name(GST_BIN(job->pipeline), "src");
+  g_object_set(element, "location", job->input, NULL);
+  gst_object_unref(element);
+
+  element = gst_bin_get_by_name(GST_BIN(job->pipeline), "sink");
+  g_object_set(element, "location", job->output, NULL);
+  gst_object_unref(element);
+
+  if (job->parts) {
+    element = gst_bin_get_by_name(GST_BIN(job->pipeline), "parts");
+    g_signal_connect(element, "format-location",
+                     G_CALLBACK(batch_part_locations), job);
+    gst_object_unref(element);
+  } else {
+    element = gst_bin_get_by_name(GST_BIN(job->pipeline), "pm");
+    g_object_set(element, "preset-duration", preset_duration, "preset-seed",
+                 (guint)preset_seed, NULL);
+    if (preset_path)
+      g_object_set(element, "preset", preset_path, "preset-index",
+                   preset_index, NULL);
+    if (texture_dir)
+      g_object_set(element, "texture-dir", texture_dir, NULL);
+    if (job->file)
+      batch_setup_segment(job, element);
+    gst_object_unref(element);
+  }
+
+  // a file rendered in segments is timed from its first segment on
+  if (!job->parts)
+    job->start_time = g_get_monotonic_time();
+  if (job->file && job->file->start_time == 0)
+    job->file->start_time = job->start_time;
+
+  if (gst_element_set_state(job->pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_printerr("%s: could not start pipeline\n", job->input);
+    gst_element_set_state(job->pipeline, GST_STATE_NULL);
+    gst_clear_object(&job->pipeline);
+    return FALSE;
+  }
+
+  // messages posted while starting wait on the bus until the loop runs
+  bus = gst_pipeline_get_bus(GST_PIPELINE(job->pipeline));
+  gst_bus_add_watch(bus, batch_bus_message, job);
+  gst_object_unref(bus);
+  job->state = BATCH_JOB_RUNNING;
+
+  if (job->file)
+    g_print("[%u/%u] rendering segment %u/%u of %s\n", job->file->number,
+            batch.jobs->len, job->number, job->file->parts->len, job->input);
+  else if (job->parts)
+    g_print("[%u/%u] joining %u segments of %s\n", job->number,
+            batch.jobs->len, job->parts->len, job->input);
+  else
+    g_print("[%u/%u] rendering %s\n", job->number, batch.jobs->len,
+            job->input);
+
+  return TRUE;
+}
+
+/* start pending jobs up to the limit, quit once nothing is left running */
+static void batch_start_jobs(void) {
+  guint limit = batch.warming ? 1 : (guint)jobs;
+  BatchJob *job;
+
+  while (!batch.interrupted && batch.running < limit &&
+         (job = g_queue_pop_head(&batch.queue))) {
+    if (job->file) {
+      // the other segments of a failed file aren't worth rendering
+      if (job->file->parts_failed) {
+        batch_finish_part(job, FALSE);
+        continue;
+      }
+    } else if (!job->parts) {
+      if (!overwrite && g_file_test(job->output, G_FILE_TEST_EXISTS)) {
+        g_print("[%u/%u] skipping %s, %s exists\n", job->number,
+                batch.jobs->len, job->input, job->output);
+        job->state = BATCH_JOB_SKIPPED;
+        batch.skipped++;
+        continue;
+      }
+
+      if (segment_length > 0 && batch_split_job(job))
+        continue;
+    }
+
+    if (batch_start_job(job)) {
+      batch.running++;
+    } else if (job->file) {
+      batch_finish_part(job, FALSE);
+    } else {
+      job->state = BATCH_JOB_FAILED;
+      batch.failed++;
+      if (job->parts)
+        batch_remove_parts(job);
+    }
+  }
+
+  if (batch.running == 0)
+    g_main_loop_quit(batch.loop);
+}
+
+static void batch_print_job_progress(BatchJob *job) {
+  gdouble position, duration, wall;
+  GstClockTime end;
+
+  batch_update_position(job);
+  position = batch_seconds(job->position);
+  duration = batch_seconds(job->duration);
+  wall = (g_get_monotonic_time() - job->start_time) / (gdouble)G_USEC_PER_SEC;
+
+  if (!job->file) {
+    g_print("[%u/%u] %s: %3.0f%% %.1f/%.1f s, %.1fx realtime\n", job->number,
+            batch.jobs->len, job->input,
+            duration > 0 ? 100.0 * position / duration : 0.0, position,
+            duration, wall > 0 ? position / wall : 0.0);
+    return;
+  }
+
+  // a segment counts from its start, the pre-roll before is not its own
+  end = GST_CLOCK_TIME_IS_VALID(job->segment_end) ? job->segment_end
+                                                  : job->file->duration;
+  duration = batch_seconds(end) - batch_seconds(job->segment_start);
+  position = CLAMP(position - batch_seconds(job->segment_start), 0.0, duration);
+
+  g_print("[%u/%u] %s segment %u/%u: %3.0f%% %.1f/%.1f s, %.1fx realtime\n",
+          job->file->number, batch.jobs->len, job->input, job->number,
+          job->file->parts->len,
+          duration > 0 ? 100.0 * position / duration : 0.0, position, duration,
+          wall > 0 ? position / wall : 0.0);
+}
+
+static void batch_print_progress(void) {
+  BatchJob *job, *part;
+  guint i, j;
+
+  for (i = 0; i < batch.jobs->len; i++) {
+    job = g_ptr_array_index(batch.jobs, i);
+    if (job->state == BATCH_JOB_RUNNING)
+      batch_print_job_progress(job);
+
+    for (j = 0; job->parts && j < job->parts->len; j++) {
+      part = g_ptr_array_index(job->parts, j);
+      if (part->state == BATCH_JOB_RUNNING)
+        batch_print_job_progress(part);
+    }
+  }
+}
+
+static gboolean batch_tick(gpointer data) {
+  // the index is written once the first job finished its scan, the others
+  // read it instead of scanning the preset directory themselves
+  if (batch.warming && preset_index &&
+      g_file_test(preset_index, G_FILE_TEST_EXISTS)) {
+    batch.warming = FALSE;
+    batch_start_jobs();
+  }
+
+  batch.ticks++;
+  if (progress_interval > 0 && batch.ticks % progress_interval == 0)
+    batch_print_progress();
+
+  return G_SOURCE_CONTINUE;
+}
+
+#ifdef G_OS_UNIX
+static gboolean batch_interrupt(gpointer data) {
+  BatchJob *job, *part;
+  guint i, j;
+
+  if (batch.interrupted) {
+    g_main_loop_quit(batch.loop);
+    return G_SOURCE_REMOVE;
+  }
+
+  // finish the files being rendered so they are playable, start no others
+  g_print("interrupted, finishing %u running files, again to abort\n",
+          batch.running);
+  batch.interrupted = TRUE;
+  for (i = 0; i < batch.jobs->len; i++) {
+    job = g_ptr_array_index(batch.jobs, i);
+    if (job->state == BATCH_JOB_RUNNING)
+      gst_element_send_event(job->pipeline, gst_event_new_eos());
+
+    for (j = 0; job->parts && j < job->parts->len; j++) {
+      part = g_ptr_array_index(job->parts, j);
+      if (part->state == BATCH_JOB_RUNNING)
+        gst_element_send_event(part->pipeline, gst_event_new_eos());
+    }
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  GOptionContext *ctx;
+  GError *err = NULL;
+  gdouble wall, audio = 0.0;
+  BatchJob *job;
+  guint i, tick;
+  gboolean ok;
+
+  ctx = g_option_context_new("FILE... - render audio files with projectM");
+  g_option_context_add_main_entries(ctx, entries, NULL);
+  g_option_context_add_group(ctx, gst_init_get_option_group());
+  if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+    g_printerr("%s\n", err->message);
+    g_clear_error(&err);
+    g_option_context_free(ctx);
+    return 2;
+  }
+  g_option_context_free(ctx);
+
+  if (jobs <= 0 || contexts < 0 || width <= 0 || height <= 0 || fps <= 0 ||
+      bitrate <= 0) {
+    g_printerr("jobs, size, fps and bitrate must be positive\n");
+    return 2;
+  }
+  if (segment_length < 0 || preroll < 0 || preset_seed < 0) {
+    g_printerr("segment length, preroll and seed can't be negative\n");
+    return 2;
+  }
+  if (contexts == 0)
+    contexts = jobs;
+  // segments only match up with a preset schedule
+  if (segment_length > 0 && preset_seed == 0)
+    preset_seed = 1;
+
+  if (plugin_dir)
+    gst_registry_scan_path(gst_registry_get(), plugin_dir);
+
+  batch.jobs = g_ptr_array_new_with_free_func(batch_free_job);
+  g_queue_init(&batch.queue);
+  for (i = 0; inputs && inputs[i]; i++)
+    batch_add_job(inputs[i]);
+  if (input_list && !batch_read_input_list(input_list))
+    return 2;
+  if (batch.jobs->len == 0) {
+    g_printerr("no input files\n");
+    return 2;
+  }
+
+  if (output_dir && g_mkdir_with_parents(output_dir, 0755) != 0) {
+    g_printerr("could not create %s\n", output_dir);
+    return 2;
+  }
+
+  if (preset_path && !preset_index)
+    preset_index = g_build_filename(g_get_user_cache_dir(), "projectm",
+                                    "batch-presets.index", NULL);
+  batch.warming =
+      preset_path && !g_file_test(preset_index, G_FILE_TEST_EXISTS);
+
+  batch.loop = g_main_loop_new(NULL, FALSE);
+  batch.start_time = g_get_monotonic_time();
+
+  tick = g_timeout_add_seconds(1, batch_tick, NULL);
+#ifdef G_OS_UNIX
+  g_unix_signal_add(SIGINT, batch_interrupt, NULL);
+#endif
+
+  batch_start_jobs();
+  if (batch.running > 0)
+    g_main_loop_run(batch.loop);
+
+  g_source_remove(tick);
+
+  wall = (g_get_monotonic_time() - batch.start_time) / (gdouble)G_USEC_PER_SEC;
+  for (i = 0; i < batch.jobs->len; i++) {
+    job = g_ptr_array_index(batch.jobs, i);
+    if (job->state == BATCH_JOB_DONE)
+      audio += batch_seconds(job->position);
+    // segments of files that were never joined
+    else if (job->parts && job->state != BATCH_JOB_FAILED)
+      batch_remove_parts(job);
+  }
+
+  g_print("%u done, %u failed, %u skipped: %.1f s of audio in %.1f s, %.1fx "
+          "realtime\n",
+          batch.done, batch.failed, batch.skipped, audio, wall,
+          wall > 0 ? audio / wall : 0.0);
+
+  ok = batch.failed == 0 && !batch.interrupted;
+
+  g_queue_clear(&batch.queue);
+  g_ptr_array_unref(batch.jobs);
+  g_main_loop_unref(batch.loop);
+  g_free(speed_preset);
+  g_free(mesh_size);
+  g_free(preset_path);
+  g_free(texture_dir);
+  g_free(preset_index);
+  g_free(output_dir);
+  g_free(input_list);
+  g_free(plugin_dir);
+  g_strfreev(inputs);
+
+  return ok ? 0 : 1;
+}
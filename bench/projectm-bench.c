@@ -0,0 +1,468 @@
+/*
+ * projectm-bench: throughput and latency benchmark for the projectm element.
+ *
+ * Synthetic audio is pushed through appsrc ! projectm ! appsink one video
+ * frame at a time, so each output frame can be matched with the audio that
+ * produced it. Every combination of the given resolutions, mesh sizes, output
+ * formats and preset paths is run in turn. A second section measures the
+ * audio downmix stage on its own.
+ *
+ * Runs on software GL (llvmpipe) as well, e.g. with
+ *   LIBGL_ALWAYS_SOFTWARE=1 projectm-bench --surfaceless
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gst/app/app.h>
+#include <gst/audio/audio.h>
+#include <gst/gst.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "src/pcm.h"
+
+#define BENCH_RATE 44100
+#define BENCH_CHANNELS 2
+
+#ifndef BENCH_PLUGIN_DIR
+#define BENCH_PLUGIN_DIR NULL
+#endif
+
+#ifndef BENCH_PRESET_DIR
+#define BENCH_PRESET_DIR "none"
+#endif
+
+static gint frames = 600;
+static gint warmup = 30;
+static gint fps = 60;
+static gint readback_depth = 0;
+static gboolean surfaceless = FALSE;
+static gboolean csv = FALSE;
+static gboolean skip_pcm = FALSE;
+static gboolean skip_render = FALSE;
+static gchar *plugin_dir = NULL;
+static gchar **resolutions = NULL;
+static gchar **mesh_sizes = NULL;
+static gchar **formats = NULL;
+static gchar **presets = NULL;
+
+static const gchar *default_resolutions[] = {"1280x720", "1920x1080", NULL};
+static const gchar *default_mesh_sizes[] = {"48,32", "128,96", NULL};
+static const gchar *default_formats[] = {"system", "gl", NULL};
+static const gchar *default_presets[] = {"none", BENCH_PRESET_DIR, NULL};
+
+static GOptionEntry entries[] = {
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &frames,
+     "Frames measured per case (default 600)", "N"},
+    {"warmup", 'w', 0, G_OPTION_ARG_INT, &warmup,
+     "Frames rendered before measuring (default 30)", "N"},
+    {"fps", 0, 0, G_OPTION_ARG_INT, &fps, "Output framerate (default 60)",
+     "FPS"},
+    {"readback-depth", 'd', 0, G_OPTION_ARG_INT, &readback_depth,
+     "readback-depth of the element (default 0)", "N"},
+    {"resolution", 'r', 0, G_OPTION_ARG_STRING_ARRAY, &resolutions,
+     "Output resolution, repeatable (default 1280x720 and 1920x1080)",
+     "WxH"},
+    {"mesh-size", 'm', 0, G_OPTION_ARG_STRING_ARRAY, &mesh_sizes,
+     "Mesh size, repeatable (default 48,32 and 128,96)", "W,H"},
+    {"format", 'f', 0, G_OPTION_ARG_STRING_ARRAY, &formats,
+     "Output format, 'system' or 'gl', repeatable (default both)", "FORMAT"},
+    {"preset", 'p', 0, G_OPTION_ARG_STRING_ARRAY, &presets,
+     "Preset file or directory, 'none' for the idle preset, repeatable "
+     "(default none and the test presets)",
+     "PATH"},
+    {"surfaceless", 's', 0, G_OPTION_ARG_NONE, &surfaceless,
+     "Render without a window system", NULL},
+    {"plugin-dir", 0, 0, G_OPTION_ARG_FILENAME, &plugin_dir,
+     "Directory containing the projectm plugin", "DIR"},
+    {"csv", 0, 0, G_OPTION_ARG_NONE, &csv, "Print comma separated values",
+     NULL},
+    {"skip-pcm", 0, 0, G_OPTION_ARG_NONE, &skip_pcm,
+     "Skip the audio downmix benchmark", NULL},
+    {"skip-render", 0, 0, G_OPTION_ARG_NONE, &skip_render,
+     "Skip the render benchmark", NULL},
+    {NULL}};
+
+typedef struct {
+  gint64 cpu_us;
+  gint64 peak_rss_kb;
+} BenchUsage;
+
+static void bench_get_usage(BenchUsage *usage) {
+#ifdef G_OS_UNIX
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  usage->cpu_us = (gint64)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) *
+                      G_USEC_PER_SEC +
+                  ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#ifdef __APPLE__
+  usage->peak_rss_kb = ru.ru_maxrss / 1024;
+#else
+  usage->peak_rss_kb = ru.ru_maxrss;
+#endif
+#else
+  usage->cpu_us = -1;
+  usage->peak_rss_kb = -1;
+#endif
+}
+
+/* first sample of the given video frame, same boundaries as the element */
+static guint64 bench_frame_start(guint64 frame) {
+  return gst_util_uint64_scale(frame, BENCH_RATE, fps);
+}
+
+/* Deterministic test signal: two tones, a kick every half second so the beat
+ * detection has something to do, and a bit of noise. */
+static void bench_generate_audio(gfloat *data, guint64 offset, guint n) {
+  guint32 seed = (guint32)offset * 1664525u + 1013904223u;
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    gdouble t = (gdouble)(offset + i) / BENCH_RATE;
+    gdouble beat = t * 2.0 - (gint64)(t * 2.0);
+    gdouble kick = (beat < 0.1 ? 1.0 - beat * 10.0 : 0.0) *
+                   sin(2.0 * G_PI * 60.0 * t);
+    gfloat noise;
+
+    seed = seed * 1664525u + 1013904223u;
+    noise = ((gfloat)(seed >> 8) / (1 << 24) - 0.5f) * 0.1f;
+
+    data[i * 2] =
+        (gfloat)(0.3 * sin(2.0 * G_PI * 440.0 * t) + 0.4 * kick) + noise;
+    data[i * 2 + 1] =
+        (gfloat)(0.3 * sin(2.0 * G_PI * 660.0 * t) + 0.4 * kick) - noise;
+  }
+}
+
+static GstBuffer *bench_audio_buffer(guint64 frame) {
+  guint64 start = bench_frame_start(frame);
+  guint n = (guint)(bench_frame_start(frame + 1) - start);
+  GstBuffer *buffer =
+      gst_buffer_new_allocate(NULL, n * BENCH_CHANNELS * sizeof(gfloat), NULL);
+  GstMapInfo map;
+
+  gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+  bench_generate_audio((gfloat *)map.data, start, n);
+  gst_buffer_unmap(buffer, &map);
+
+  GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(start, GST_SECOND, BENCH_RATE);
+  GST_BUFFER_DURATION(buffer) =
+      gst_util_uint64_scale(start + n, GST_SECOND, BENCH_RATE) -
+      GST_BUFFER_PTS(buffer);
+  GST_BUFFER_OFFSET(buffer) = start;
+  GST_BUFFER_OFFSET_END(buffer) = start + n;
+
+  return buffer;
+}
+
+static gint bench_compare_latency(gconstpointer a, gconstpointer b) {
+  gint64 la = *(const gint64 *)a;
+  gint64 lb = *(const gint64 *)b;
+
+  return la < lb ? -1 : la > lb;
+}
+
+static gdouble bench_percentile(gint64 *sorted, guint n, guint percent) {
+  if (n == 0)
+    return 0.0;
+
+  return sorted[(n - 1) * percent / 100] / 1000.0;
+}
+
+static void bench_report_error(GstElement *pipeline) {
+  GstBus *bus = gst_element_get_bus(pipeline);
+  GstMessage *msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+
+  if (msg) {
+    GError *err = NULL;
+    gchar *debug = NULL;
+
+    gst_message_parse_error(msg, &err, &debug);
+    g_printerr("  error: %s\n  %s\n", err->message, debug ? debug : "");
+    g_clear_error(&err);
+    g_free(debug);
+    gst_message_unref(msg);
+  } else {
+    g_printerr("  timed out waiting for a frame\n");
+  }
+
+  gst_object_unref(bus);
+}
+
+static gboolean bench_render_case(const gchar *resolution,
+                                  const gchar *mesh_size, const gchar *format,
+                                  const gchar *preset) {
+  GstElement *pipeline, *src, *sink;
+  GError *err = NULL;
+  GstCaps *caps;
+  gchar *preset_arg, *launch;
+  gint width, height;
+  guint total = warmup + frames;
+  gint64 *push_time, *latency;
+  guint pushed = 0, pulled = 0;
+  gint64 start_time = 0, wall_us;
+  BenchUsage usage_start = {0}, usage_end;
+  gboolean ok = TRUE;
+
+  if (sscanf(resolution, "%dx%d", &width, &height) != 2 || width <= 0 ||
+      height <= 0) {
+    g_printerr("invalid resolution '%s'\n", resolution);
+    return FALSE;
+  }
+
+  if (g_strcmp0(format, "system") && g_strcmp0(format, "gl")) {
+    g_printerr("invalid format '%s'\n", format);
+    return FALSE;
+  }
+
+  preset_arg = g_strcmp0(preset, "none")
+                   ? g_strdup_printf("preset=\"%s\"", preset)
+                   : g_strdup("");
+  launch = g_strdup_printf(
+      "appsrc name=src format=time ! "
+      "projectm offline=true surfaceless=%s mesh-size=%s readback-depth=%d "
+      "%s ! "
+      "%s,width=%d,height=%d,framerate=%d/1 ! "
+      "appsink name=sink sync=false",
+      surfaceless ? "true" : "false", mesh_size, readback_depth, preset_arg,
+      g_strcmp0(format, "gl") ? "video/x-raw,format=ABGR"
+                              : "video/x-raw(memory:GLMemory),format=RGBA",
+      width, height, fps);
+  g_free(preset_arg);
+
+  pipeline = gst_parse_launch(launch, &err);
+  g_free(launch);
+  if (!pipeline) {
+    g_printerr("could not create pipeline: %s\n", err->message);
+    g_clear_error(&err);
+    return FALSE;
+  }
+
+  src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+  sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+
+  caps = gst_caps_new_simple(
+      "audio/x-raw", "format", G_TYPE_STRING, GST_AUDIO_NE(F32), "layout",
+      G_TYPE_STRING, "interleaved", "rate", G_TYPE_INT, BENCH_RATE,
+      "channels", G_TYPE_INT, BENCH_CHANNELS, NULL);
+  gst_app_src_set_caps(GST_APP_SRC(src), caps);
+  gst_caps_unref(caps);
+
+  push_time = g_new0(gint64, total);
+  latency = g_new0(gint64, total);
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  /* lock step: frame N comes out after the audio of frame N + readback-depth
+   * went in, which gives the per-frame latency */
+  while (pulled < total) {
+    GstSample *sample;
+
+    if (pushed < total) {
+      if (pushed == (guint)warmup) {
+        start_time = g_get_monotonic_time();
+        bench_get_usage(&usage_start);
+      }
+
+      push_time[pushed] = g_get_monotonic_time();
+      gst_app_src_push_buffer(GST_APP_SRC(src), bench_audio_buffer(pushed));
+      if (++pushed == total)
+        gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+      if (pushed <= (guint)readback_depth && pushed < total)
+        continue;
+    }
+
+    sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), 10 * GST_SECOND);
+    if (!sample) {
+      bench_report_error(pipeline);
+      ok = FALSE;
+      break;
+    }
+
+    latency[pulled] = g_get_monotonic_time() - push_time[pulled];
+    pulled++;
+    gst_sample_unref(sample);
+  }
+
+  wall_us = g_get_monotonic_time() - start_time;
+  bench_get_usage(&usage_end);
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(src);
+  gst_object_unref(sink);
+  gst_object_unref(pipeline);
+
+  if (ok) {
+    guint measured = total - warmup;
+    gint64 *sorted = latency + warmup;
+    gdouble seconds = wall_us / (gdouble)G_USEC_PER_SEC;
+    gdouble cpu = usage_start.cpu_us < 0
+                      ? -1.0
+                      : (usage_end.cpu_us - usage_start.cpu_us) /
+                            (gdouble)G_USEC_PER_SEC;
+
+    qsort(sorted, measured, sizeof(gint64), bench_compare_latency);
+
+    g_print(csv ? "render,%s,%s,%s,%s,%.1f,%.2f,%.2f,%.2f,%" G_GINT64_FORMAT
+                  "\n"
+                : "%-10s %-8s %-7s %-24s %9.1f %9.2f %9.2f %9.2f %9" G_GINT64_FORMAT
+                  "\n",
+            resolution, mesh_size, format, preset,
+            seconds > 0 ? measured / seconds : 0.0,
+            bench_percentile(sorted, measured, 50),
+            bench_percentile(sorted, measured, 99), cpu,
+            usage_end.peak_rss_kb / 1024);
+  }
+
+  g_free(push_time);
+  g_free(latency);
+
+  return ok;
+}
+
+static gboolean bench_render(void) {
+  const gchar *const *res =
+      resolutions ? (const gchar *const *)resolutions : default_resolutions;
+  const gchar *const *mesh =
+      mesh_sizes ? (const gchar *const *)mesh_sizes : default_mesh_sizes;
+  const gchar *const *fmt =
+      formats ? (const gchar *const *)formats : default_formats;
+  const gchar *const *pre =
+      presets ? (const gchar *const *)presets : default_presets;
+  gboolean ok = TRUE;
+  guint r, m, f, p;
+
+  if (!gst_registry_check_feature_version(gst_registry_get(), "projectm", 0, 0,
+                                          0)) {
+    g_printerr("projectm element not found, use --plugin-dir\n");
+    return FALSE;
+  }
+
+  if (csv)
+    g_print("stage,resolution,mesh,format,preset,fps,p50_ms,p99_ms,cpu_s,"
+            "peak_rss_mb\n");
+  else
+    g_print("%-10s %-8s %-7s %-24s %9s %9s %9s %9s %9s\n", "resolution",
+            "mesh", "format", "preset", "fps", "p50 ms", "p99 ms", "cpu s",
+            "rss MB");
+
+  for (r = 0; res[r]; r++)
+    for (m = 0; mesh[m]; m++)
+      for (f = 0; fmt[f]; f++)
+        for (p = 0; pre[p]; p++)
+          ok &= bench_render_case(res[r], mesh[m], fmt[f], pre[p]);
+
+  return ok;
+}
+
+/* downmix throughput for every supported input layout, in frames per second
+ * of audio processed */
+static void bench_pcm(void) {
+  static const GstAudioFormat pcm_formats[] = {
+      GST_AUDIO_FORMAT_F32, GST_AUDIO_FORMAT_S16, GST_AUDIO_FORMAT_S32};
+  static const gint pcm_channels[] = {1, 2, 6, 8};
+  const guint block = 1024, iterations = 20000;
+  gfloat *stereo = g_new(gfloat, block * BENCH_CHANNELS);
+  guint8 *input = g_malloc(block * PCM_MAX_CHANNELS * sizeof(gint32));
+  guint f, c, i;
+
+  bench_generate_audio(stereo, 0, block);
+
+  if (csv)
+    g_print("stage,format,channels,mframes_per_s\n");
+  else
+    g_print("\n%-10s %-8s %14s\n", "format", "channels", "Mframes/s");
+
+  for (f = 0; f < G_N_ELEMENTS(pcm_formats); f++) {
+    for (c = 0; c < G_N_ELEMENTS(pcm_channels); c++) {
+      GstAudioInfo info;
+      PcmDownmix downmix = {0};
+      gint64 start, elapsed;
+      volatile gfloat sink = 0.0f;
+
+      gst_audio_info_set_format(&info, pcm_formats[f], BENCH_RATE,
+                                pcm_channels[c], NULL);
+
+      /* spread the test signal over all channels */
+      for (i = 0; i < block * pcm_channels[c]; i++) {
+        gfloat v = stereo[i % (block * BENCH_CHANNELS)];
+
+        switch (pcm_formats[f]) {
+        case GST_AUDIO_FORMAT_S16:
+          ((gint16 *)input)[i] = (gint16)(v * G_MAXINT16);
+          break;
+        case GST_AUDIO_FORMAT_S32:
+          ((gint32 *)input)[i] = (gint32)(v * G_MAXINT32);
+          break;
+        default:
+          ((gfloat *)input)[i] = v;
+          break;
+        }
+      }
+
+      pcm_downmix_init(&downmix, &info);
+
+      start = g_get_monotonic_time();
+      for (i = 0; i < iterations; i++)
+        sink += pcm_downmix_process(&downmix, input, block)[i % block];
+      elapsed = MAX(1, g_get_monotonic_time() - start);
+
+      pcm_downmix_clear(&downmix);
+
+      g_print(csv ? "pcm,%s,%d,%.1f\n" : "%-10s %-8d %14.1f\n",
+              gst_audio_format_to_string(pcm_formats[f]), pcm_channels[c],
+              (gdouble)block * iterations / elapsed);
+    }
+  }
+
+  g_free(stereo);
+  g_free(input);
+}
+
+int main(int argc, char *argv[]) {
+  GOptionContext *ctx;
+  GError *err = NULL;
+  const gchar *dir;
+  gboolean ok = TRUE;
+
+  ctx = g_option_context_new("- benchmark the projectm element");
+  g_option_context_add_main_entries(ctx, entries, NULL);
+  g_option_context_add_group(ctx, gst_init_get_option_group());
+  if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+    g_printerr("%s\n", err->message);
+    g_clear_error(&err);
+    g_option_context_free(ctx);
+    return 2;
+  }
+  g_option_context_free(ctx);
+
+  if (frames <= 0 || warmup < 0 || fps <= 0 || readback_depth < 0) {
+    g_printerr("frames and fps must be positive, warmup and readback-depth "
+               "must not be negative\n");
+    return 2;
+  }
+
+  dir = plugin_dir ? plugin_dir : BENCH_PLUGIN_DIR;
+  if (dir)
+    gst_registry_scan_path(gst_registry_get(), dir);
+
+  if (!skip_render)
+    ok = bench_render();
+
+  if (!skip_pcm)
+    bench_pcm();
+
+  g_free(plugin_dir);
+  g_strfreev(resolutions);
+  g_strfreev(mesh_sizes);
+  g_strfreev(formats);
+  g_strfreev(presets);
+
+  return ok ? 0 : 1;
+}
@@ -34,6 +34,11 @@ find_library(GLIB2_GOBJECT_LIBRARIES
              NAMES gobject-2.0
              HINTS ${PKG_GLIB_LIBRARY_DIRS} ${PKG_GLIB_LIBDIR})
 
+# Additional library: gio-2.0
+find_library(GLIB2_GIO_LIBRARIES
+             NAMES gio-2.0
+             HINTS ${PKG_GLIB_LIBRARY_DIRS} ${PKG_GLIB_LIBDIR})
+
 find_path(GLIB2_INTERNAL_INCLUDE_DIR glibconfig.h
           PATH_SUFFIXES glib-2.0/include ../lib/glib-2.0/include
           HINTS ${PKG_GLIB_INCLUDE_DIRS} ${PKG_GLIB_LIBRARIES} ${CMAKE_SYSTEM_LIBRARY_PATH})
@@ -47,9 +52,9 @@ if(GLIB2_INTERNAL_INCLUDE_DIR)
 endif(GLIB2_INTERNAL_INCLUDE_DIR)
 
 include(FindPackageHandleStandardArgs)
-find_package_handle_standard_args(GLIB2  DEFAULT_MSG  GLIB2_LIBRARIES GLIB2_MAIN_INCLUDE_DIR GLIB2_GOBJECT_LIBRARIES)
+find_package_handle_standard_args(GLIB2  DEFAULT_MSG  GLIB2_LIBRARIES GLIB2_MAIN_INCLUDE_DIR GLIB2_GOBJECT_LIBRARIES GLIB2_GIO_LIBRARIES)
 
-mark_as_advanced(GLIB2_INCLUDE_DIR GLIB2_LIBRARIES GLIB2_GOBJECT_LIBRARIES)
+mark_as_advanced(GLIB2_INCLUDE_DIR GLIB2_LIBRARIES GLIB2_GOBJECT_LIBRARIES GLIB2_GIO_LIBRARIES)
 
 find_program(GLIB2_GENMARSHAL_UTIL glib-genmarshal)
 
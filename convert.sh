@@ -27,9 +27,6 @@ cleanup() {
         kill -TERM $GST_PID 2>/dev/null || true
     fi
 
-    # Kill Xvfb if running
-    pkill Xvfb || true
-
     exit 0
 }
 
@@ -129,9 +126,6 @@ fi
 # If running in Docker, use the environment
 if [ -z "$INSIDE_DOCKER" ]; then
     # Display conversion parameters
-    echo "Starting Xvfb..."
-    Xvfb :99 -screen 0 ${VIDEO_WIDTH}x${VIDEO_HEIGHT}x24 &
-    export DISPLAY=:99
     export INSIDE_DOCKER=1
 
     echo "Converting $INPUT_FILE to $OUTPUT_FILE"
@@ -144,9 +138,6 @@ if [ -z "$INSIDE_DOCKER" ]; then
     echo "Encoding speed: $SPEED_PRESET"
 fi
 
-# Wait a moment for Xvfb to start
-sleep 1
-
 # Run the actual conversion
 gst-launch-1.0 -e \
   filesrc location=$INPUT_FILE ! \
@@ -155,11 +146,13 @@ gst-launch-1.0 -e \
             capsfilter caps="audio/x-raw, format=F32LE, channels=2, rate=44100" ! \
             avenc_aac bitrate=320000 ! queue ! mux. \
       t. ! queue ! audioconvert ! projectm \
+            surfaceless=true \
             preset=$PRESET_PATH \
             texture-dir=$TEXTURE_DIR \
             preset-duration=$PRESET_DURATION \
-            mesh-size=${MESH_X},${MESH_Y} ! \
-            identity sync=false ! videoconvert ! videorate ! \
+            mesh-size=${MESH_X},${MESH_Y} \
+            offline=true ! \
+            videorate ! \
             video/x-raw,framerate=$FRAMERATE/1,width=$VIDEO_WIDTH,height=$VIDEO_HEIGHT ! \
             x264enc bitrate=$(($BITRATE * 1000)) key-int-max=200 speed-preset=$SPEED_PRESET ! \
             video/x-h264,stream-format=avc,alignment=au ! queue ! mux. \
@@ -0,0 +1,474 @@
+/*
+ * projectm-profile: measure what each preset costs to render.
+ *
+ * Every preset found in the given files and directories is rendered on its
+ * own through audiotestsrc ! projectm ! fakesink for a number of frames at
+ * the target size. The time between frames reaching the sink, which includes
+ * waiting for the GPU to read each frame back, and the CPU time per frame are
+ * written to a cost database, along with the presets projectM failed to load
+ * or that caused GL errors. The projectm element reads the database with
+ * preset-costs and leaves those presets out, and the ones slower than its
+ * frame-budget.
+ *
+ * Presets already in the database for the same file and size are skipped, so
+ * an interrupted run carries on where it stopped. A preset that takes the
+ * process down stays marked as failed.
+ *
+ * Runs on software GL (llvmpipe) as well, and GST_GL_API=gles2 checks the
+ * presets against GLES2, e.g.
+ *   LIBGL_ALWAYS_SOFTWARE=1 projectm-profile --surfaceless -o costs.txt \
+ *     /usr/share/projectM/presets
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "src/presetcost.h"
+
+#define PROFILE_RATE 44100
+
+static gchar *output = NULL;
+static gint width = 1280;
+static gint height = 720;
+static gint fps = 60;
+static gint frames = 300;
+static gint warmup = 30;
+static gint timeout = 60;
+static gdouble budget = 0.0;
+static gchar *mesh_size = NULL;
+static gchar *texture_dir = NULL;
+static gchar *plugin_dir = NULL;
+static gboolean surfaceless = FALSE;
+static gboolean overwrite = FALSE;
+static gchar **inputs = NULL;
+
+static GOptionEntry entries[] = {
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+     "Cost database to write, presets already in it are skipped", "FILE"},
+    {"width", 0, 0, G_OPTION_ARG_INT, &width, "Render width (default 1280)",
+     "W"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &height,
+     "Render height (default 720)", "H"},
+    {"fps", 'r', 0, G_OPTION_ARG_INT, &fps, "Video framerate (default 60)",
+     "FPS"},
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &frames,
+     "Frames measured per preset (default 300)", "N"},
+    {"warmup", 'w', 0, G_OPTION_ARG_INT, &warmup,
+     "Frames rendered before measuring (default 30)", "N"},
+    {"timeout", 0, 0, G_OPTION_ARG_INT, &timeout,
+     "Seconds after which a preset counts as failed (default 60)", "SEC"},
+    {"budget", 'b', 0, G_OPTION_ARG_DOUBLE, &budget,
+     "Report presets slower than this many milliseconds per frame", "MS"},
+    {"mesh-size", 'm', 0, G_OPTION_ARG_STRING, &mesh_size,
+     "Mesh size (default the element's)", "W,H"},
+    {"texture-dir", 't', 0, G_OPTION_ARG_FILENAME, &texture_dir,
+     "Texture directory", "DIR"},
+    {"surfaceless", 's', 0, G_OPTION_ARG_NONE, &surfaceless,
+     "Render without a window system", NULL},
+    {"overwrite", 'f', 0, G_OPTION_ARG_NONE, &overwrite,
+     "Profile presets that are already in the database", NULL},
+    {"plugin-dir", 0, 0, G_OPTION_ARG_FILENAME, &plugin_dir,
+     "Directory containing the projectm plugin", "DIR"},
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &inputs, NULL,
+     "PRESET..."},
+    {NULL}};
+
+/* times frames reached the sink, written by the streaming thread */
+typedef struct {
+  gint64 *times;
+  guint count;
+  guint total;
+  gint64 cpu_start_us;
+  gint64 cpu_end_us;
+} ProfileRun;
+
+static gint64 profile_cpu_time(void) {
+#ifdef G_OS_UNIX
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return (gint64)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * G_USEC_PER_SEC +
+         ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#else
+  return -1;
+#endif
+}
+
+static gboolean profile_is_preset(const gchar *name) {
+  gchar *lower = g_ascii_strdown(name, -1);
+  gboolean ret =
+      g_str_has_suffix(lower, ".milk") || g_str_has_suffix(lower, ".prjm");
+
+  g_free(lower);
+  return ret;
+}
+
+/* add the presets of a file or directory, recursively */
+static void profile_collect(const gchar *path, GPtrArray *presets) {
+  const gchar *name;
+  GDir *dir;
+
+  if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+    if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+      g_ptr_array_add(presets, g_strdup(path));
+    else
+      g_printerr("skipping %s: not a file or directory\n", path);
+    return;
+  }
+
+  dir = g_dir_open(path, 0, NULL);
+  if (!dir) {
+    g_printerr("skipping %s: can't read the directory\n", path);
+    return;
+  }
+
+  while ((name = g_dir_read_name(dir))) {
+    gchar *child = g_build_filename(path, name, NULL);
+
+    // symlinked directories could loop
+    if (g_file_test(child, G_FILE_TEST_IS_DIR)) {
+      if (!g_file_test(child, G_FILE_TEST_IS_SYMLINK))
+        profile_collect(child, presets);
+    } else if (profile_is_preset(name)) {
+      g_ptr_array_add(presets, g_strdup(child));
+    }
+    g_free(child);
+  }
+
+  g_dir_close(dir);
+}
+
+static gint profile_compare_path(gconstpointer a, gconstpointer b) {
+  return strcmp(*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+static gint profile_compare_time(gconstpointer a, gconstpointer b) {
+  gint64 ta = *(const gint64 *)a;
+  gint64 tb = *(const gint64 *)b;
+
+  return ta < tb ? -1 : ta > tb;
+}
+
+static void profile_handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad,
+                            gpointer user_data) {
+  ProfileRun *run = user_data;
+
+  if (run->count >= run->total)
+    return;
+
+  run->times[run->count] = g_get_monotonic_time();
+  if (run->count == (guint)warmup)
+    run->cpu_start_us = profile_cpu_time();
+  run->cpu_end_us = profile_cpu_time();
+  run->count++;
+}
+
+/* the message of an error or warning, with what projectM said if the debug
+ * string has it after the location */
+static gchar *profile_message_text(GstMessage *msg) {
+  GError *err = NULL;
+  gchar *debug = NULL, *text;
+  const gchar *detail;
+
+  if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    gst_message_parse_error(msg, &err, &debug);
+  else
+    gst_message_parse_warning(msg, &err, &debug);
+
+  detail = debug ? strchr(debug, '\n') : NULL;
+  text = detail && detail[1] ? g_strdup_printf("%s: %s", err->message,
+                                               detail + 1)
+                             : g_strdup(err->message);
+
+  g_clear_error(&err);
+  g_free(debug);
+
+  return text;
+}
+
+/* render one preset, fills in the cost and returns FALSE if the pipeline
+ * could not be created at all */
+static gboolean profile_preset(const gchar *path, PresetCost *cost) {
+  GstElement *pipeline, *projectm, *sink;
+  GstBus *bus;
+  GError *err = NULL;
+  ProfileRun run = {0};
+  gint samples_per_buffer = MAX(1, PROFILE_RATE / fps);
+  guint64 samples;
+  gint64 deadline, *intervals;
+  gboolean done = FALSE;
+  gchar *launch;
+  guint i, n;
+
+  run.total = warmup + frames + 1;
+  run.times = g_new0(gint64, run.total);
+  run.cpu_start_us = -1;
+
+  // enough audio for every frame, the element renders it all offline
+  samples = gst_util_uint64_scale_int(run.total + 1, PROFILE_RATE, fps);
+  launch = g_strdup_printf(
+      "audiotestsrc wave=pink-noise samplesperbuffer=%d num-buffers=%u ! "
+      "audio/x-raw,rate=%d,channels=2 ! "
+      "projectm name=pm offline=true surfaceless=%s preset-duration=3600 "
+      "hard-cut-enabled=false ! "
+      "video/x-raw,format=RGBA,width=%d,height=%d,framerate=%d/1 ! "
+      "fakesink name=sink sync=false signal-handoffs=true",
+      samples_per_buffer, (guint)(samples / samples_per_buffer + 1),
+      PROFILE_RATE, surfaceless ? "true" : "false", width, height, fps);
+
+  pipeline = gst_parse_launch(launch, &err);
+  g_free(launch);
+  if (!pipeline) {
+    g_printerr("could not create pipeline: %s\n", err->message);
+    g_clear_error(&err);
+    g_free(run.times);
+    return FALSE;
+  }
+
+  // set here rather than in the launch line, paths need no quoting
+  projectm = gst_bin_get_by_name(GST_BIN(pipeline), "pm");
+  g_object_set(projectm, "preset", path, NULL);
+  if (texture_dir)
+    g_object_set(projectm, "texture-dir", texture_dir, NULL);
+  if (mesh_size)
+    g_object_set(projectm, "mesh-size", mesh_size, NULL);
+
+  sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  g_signal_connect(sink, "handoff", G_CALLBACK(profile_handoff), &run);
+
+  bus = gst_element_get_bus(pipeline);
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  deadline = g_get_monotonic_time() + (gint64)timeout * G_USEC_PER_SEC;
+  while (!done) {
+    gint64 left = deadline - g_get_monotonic_time();
+    GstMessage *msg;
+
+    msg = left > 0 ? gst_bus_timed_pop_filtered(
+                         bus, left * GST_USECOND,
+                         GST_MESSAGE_EOS | GST_MESSAGE_ERROR |
+                             GST_MESSAGE_WARNING)
+                   : NULL;
+    if (!msg) {
+      cost->failed = TRUE;
+      cost->error = g_strdup_printf("no result after %d seconds", timeout);
+      break;
+    }
+
+    switch (GST_MESSAGE_TYPE(msg)) {
+    case GST_MESSAGE_EOS:
+      done = TRUE;
+      break;
+    case GST_MESSAGE_WARNING:
+      // a preset that failed to load or caused GL errors, the element
+      // carries on with another preset
+      if (GST_MESSAGE_SRC(msg) != GST_OBJECT(projectm))
+        break;
+      /* fall through */
+    case GST_MESSAGE_ERROR:
+      cost->failed = TRUE;
+      cost->error = profile_message_text(msg);
+      done = TRUE;
+      break;
+    default:
+      break;
+    }
+
+    gst_message_unref(msg);
+  }
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(bus);
+  gst_object_unref(sink);
+  gst_object_unref(projectm);
+  gst_object_unref(pipeline);
+
+  // frame times are the gaps between the measured frames
+  n = run.count > (guint)warmup + 1 ? run.count - warmup - 1 : 0;
+  if (!cost->failed && n == 0) {
+    cost->failed = TRUE;
+    cost->error = g_strdup("no frames rendered");
+  }
+
+  if (!cost->failed) {
+    gint64 sum = 0;
+
+    intervals = g_new(gint64, n);
+    for (i = 0; i < n; i++) {
+      intervals[i] = run.times[warmup + i + 1] - run.times[warmup + i];
+      sum += intervals[i];
+    }
+    qsort(intervals, n, sizeof(gint64), profile_compare_time);
+
+    cost->frame_ms = sum / 1000.0 / n;
+    cost->frame_p99_ms = intervals[(n - 1) * 99 / 100] / 1000.0;
+    cost->cpu_ms = run.cpu_start_us < 0 || run.cpu_end_us < 0
+                       ? -1.0
+                       : (run.cpu_end_us - run.cpu_start_us) / 1000.0 / n;
+
+    g_free(intervals);
+  }
+
+  g_free(run.times);
+
+  return TRUE;
+}
+
+static gboolean profile_save(PresetCosts *costs) {
+  GError *err = NULL;
+
+  if (preset_costs_save(costs, output, &err))
+    return TRUE;
+
+  g_printerr("could not save %s: %s\n", output, err->message);
+  g_clear_error(&err);
+  return FALSE;
+}
+
+int main(int argc, char *argv[]) {
+  GOptionContext *ctx;
+  GError *err = NULL;
+  PresetCosts *costs;
+  GPtrArray *presets;
+  guint i, profiled = 0, skipped = 0, failed = 0, over_budget = 0;
+  gboolean ok = TRUE;
+
+  ctx = g_option_context_new("PRESET... - measure the cost of presets");
+  g_option_context_add_main_entries(ctx, entries, NULL);
+  g_option_context_add_group(ctx, gst_init_get_option_group());
+  if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+    g_printerr("%s\n", err->message);
+    g_clear_error(&err);
+    g_option_context_free(ctx);
+    return 2;
+  }
+  g_option_context_free(ctx);
+
+  if (!output) {
+    g_printerr("no cost database given, use --output\n");
+    return 2;
+  }
+  if (width <= 0 || height <= 0 || fps <= 0 || frames <= 0 || timeout <= 0) {
+    g_printerr("size, fps, frames and timeout must be positive\n");
+    return 2;
+  }
+  if (warmup < 0 || budget < 0) {
+    g_printerr("warmup and budget can't be negative\n");
+    return 2;
+  }
+
+  if (plugin_dir)
+    gst_registry_scan_path(gst_registry_get(), plugin_dir);
+
+  if (!gst_registry_check_feature_version(gst_registry_get(), "projectm", 0, 0,
+                                          0)) {
+    g_printerr("projectm element not found, use --plugin-dir\n");
+    return 2;
+  }
+
+  presets = g_ptr_array_new_with_free_func(g_free);
+  for (i = 0; inputs && inputs[i]; i++)
+    profile_collect(inputs[i], presets);
+  if (presets->len == 0) {
+    g_printerr("no presets found\n");
+    g_ptr_array_unref(presets);
+    return 2;
+  }
+  g_ptr_array_sort(presets, profile_compare_path);
+
+  costs = g_file_test(output, G_FILE_TEST_EXISTS)
+              ? preset_costs_load(output, &err)
+              : preset_costs_new();
+  if (!costs) {
+    g_printerr("could not load %s: %s\n", output, err->message);
+    g_clear_error(&err);
+    g_ptr_array_unref(presets);
+    return 2;
+  }
+
+  for (i = 0; i < presets->len && ok; i++) {
+    const gchar *path = g_ptr_array_index(presets, i);
+    const PresetCost *known;
+    PresetCost cost = {0};
+    GStatBuf st;
+
+    if (g_stat(path, &st) != 0) {
+      g_printerr("[%u/%u] %s: can't stat the file\n", i + 1, presets->len,
+                 path);
+      continue;
+    }
+
+    known = preset_costs_get(costs, path, st.st_size, st.st_mtime);
+    if (known && known->width == width && known->height == height &&
+        !overwrite) {
+      skipped++;
+      continue;
+    }
+
+    cost.path = (gchar *)path;
+    cost.size = st.st_size;
+    cost.mtime = st.st_mtime;
+    cost.width = width;
+    cost.height = height;
+
+    // saved as failed first, if the preset takes the process down the next
+    // run skips it
+    cost.failed = TRUE;
+    cost.error = (gchar *)"profiling did not finish";
+    preset_costs_set(costs, &cost);
+    if (!profile_save(costs)) {
+      ok = FALSE;
+      break;
+    }
+
+    cost.failed = FALSE;
+    cost.error = NULL;
+    if (!profile_preset(path, &cost)) {
+      ok = FALSE;
+      break;
+    }
+
+    preset_costs_set(costs, &cost);
+    profiled++;
+
+    if (cost.failed) {
+      failed++;
+      g_print("[%u/%u] %s: failed, %s\n", i + 1, presets->len, path,
+              cost.error);
+    } else {
+      gboolean over = budget > 0 && cost.frame_p99_ms > budget;
+
+      over_budget += over;
+      g_print("[%u/%u] %s: %.2f ms per frame, p99 %.2f ms, cpu %.2f ms%s\n",
+              i + 1, presets->len, path, cost.frame_ms, cost.frame_p99_ms,
+              cost.cpu_ms, over ? ", over budget" : "");
+    }
+
+    g_free(cost.error);
+  }
+
+  if (!profile_save(costs))
+    ok = FALSE;
+
+  g_print("%u profiled, %u failed, %u skipped", profiled, failed, skipped);
+  if (budget > 0)
+    g_print(", %u over the budget of %.2f ms", over_budget, budget);
+  g_print("\n");
+
+  preset_costs_free(costs);
+  g_ptr_array_unref(presets);
+  g_free(output);
+  g_free(mesh_size);
+  g_free(texture_dir);
+  g_free(plugin_dir);
+  g_strfreev(inputs);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,283 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "analysis.h"
+
+#define N AUDIO_ANALYSIS_FFT_SIZE
+
+/* limits of bass, mid and treble in Hz */
+static const gdouble analysis_ranges[4] = {20.0, 250.0, 4000.0, 16000.0};
+
+/* spectrum bands between these frequencies in Hz */
+#define ANALYSIS_LOWEST 40.0
+#define ANALYSIS_HIGHEST 16000.0
+
+/* seconds the averages of bass, mid and treble span and how fast the _att
+ * values follow */
+#define ANALYSIS_AVERAGE_TIME 5.0
+#define ANALYSIS_ATT_TIME 0.3
+
+/* bass above this much of its average is a beat, at most one per interval */
+#define ANALYSIS_BEAT_THRESHOLD 1.5f
+#define ANALYSIS_BEAT_INTERVAL 0.25
+
+/* energies below are silence, nothing is relative to them */
+#define ANALYSIS_SILENCE 1e-6f
+
+static guint analysis_bin(const AudioAnalysis *analysis, gdouble frequency) {
+  gdouble bin = frequency * N / analysis->rate;
+
+  return (guint)CLAMP(bin + 0.5, 1.0, N / 2.0);
+}
+
+void audio_analysis_init(AudioAnalysis *analysis, const GstAudioInfo *info) {
+  gdouble highest;
+  guint i;
+
+  memset(analysis, 0, sizeof(AudioAnalysis));
+  analysis->rate = MAX(GST_AUDIO_INFO_RATE(info), 1);
+
+  for (i = 0; i < N; i++)
+    analysis->window[i] = 0.5f - 0.5f * (gfloat)cos(2.0 * G_PI * i / (N - 1));
+  for (i = 0; i < N / 2; i++) {
+    analysis->cos_table[i] = (gfloat)cos(2.0 * G_PI * i / N);
+    analysis->sin_table[i] = (gfloat)-sin(2.0 * G_PI * i / N);
+  }
+
+  for (i = 0; i < 4; i++)
+    analysis->range_edges[i] = analysis_bin(analysis, analysis_ranges[i]);
+
+  highest = MIN(ANALYSIS_HIGHEST, analysis->rate / 2.0);
+  for (i = 0; i <= AUDIO_ANALYSIS_BANDS; i++) {
+    analysis->band_edges[i] = analysis_bin(
+        analysis, ANALYSIS_LOWEST * pow(highest / ANALYSIS_LOWEST,
+                                        (gdouble)i / AUDIO_ANALYSIS_BANDS));
+    // every band gets at least one bin
+    if (i > 0 && analysis->band_edges[i] <= analysis->band_edges[i - 1])
+      analysis->band_edges[i] = MIN(analysis->band_edges[i - 1] + 1, N / 2);
+  }
+}
+
+/* mix @count samples of the frame from @first on to mono */
+static void analysis_load(const GstAudioInfo *info, gconstpointer data,
+                          guint first, guint count, gfloat *out) {
+  gint channels = GST_AUDIO_INFO_CHANNELS(info);
+  gfloat scale = 1.0f / channels;
+  guint i, offset = first * channels;
+
+  memset(out, 0, count * sizeof(gfloat));
+  count *= channels;
+
+  switch (GST_AUDIO_INFO_FORMAT(info)) {
+  case GST_AUDIO_FORMAT_F32:
+    for (i = 0; i < count; i++)
+      out[i / channels] += ((const gfloat *)data)[offset + i] * scale;
+    break;
+  case GST_AUDIO_FORMAT_S16:
+    scale /= 32768.0f;
+    for (i = 0; i < count; i++)
+      out[i / channels] += ((const gint16 *)data)[offset + i] * scale;
+    break;
+  case GST_AUDIO_FORMAT_S32:
+    scale /= 2147483648.0f;
+    for (i = 0; i < count; i++)
+      out[i / channels] += ((const gint32 *)data)[offset + i] * scale;
+    break;
+  default:
+    break;
+  }
+}
+
+/* in place radix-2 FFT */
+static void analysis_fft(const AudioAnalysis *analysis, gfloat *re,
+                         gfloat *im) {
+  guint i, j, k, len, step;
+
+  for (i = 1, j = 0; i < N; i++) {
+    guint bit = N >> 1;
+
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j |= bit;
+
+    if (i < j) {
+      gfloat t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+
+  for (len = 2; len <= N; len <<= 1) {
+    step = N / len;
+    for (i = 0; i < N; i += len) {
+      for (k = 0; k < len / 2; k++) {
+        gfloat wr = analysis->cos_table[k * step];
+        gfloat wi = analysis->sin_table[k * step];
+        guint a = i + k, b = i + k + len / 2;
+        gfloat tr = re[b] * wr - im[b] * wi;
+        gfloat ti = re[b] * wi + im[b] * wr;
+
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+      }
+    }
+  }
+}
+
+/* the N samples from @start on, relative to the start of the frame. Negative
+ * positions are taken from the history */
+static void analysis_segment(const AudioAnalysis *analysis,
+                             const GstAudioInfo *info, gconstpointer data,
+                             gint start, gfloat *out) {
+  guint from_history = start < 0 ? (guint)-start : 0;
+
+  memcpy(out, analysis->history + N - from_history,
+         from_history * sizeof(gfloat));
+  analysis_load(info, data, start + from_history, N - from_history,
+                out + from_history);
+}
+
+/* keep the last N samples of the history followed by the frame */
+static void analysis_update_history(AudioAnalysis *analysis,
+                                    const GstAudioInfo *info,
+                                    gconstpointer data, guint n_frames) {
+  guint count = MIN(n_frames, N);
+
+  memmove(analysis->history, analysis->history + count,
+          (N - count) * sizeof(gfloat));
+  analysis_load(info, data, n_frames - count, count,
+                analysis->history + N - count);
+}
+
+void audio_analysis_process(AudioAnalysis *analysis, const GstAudioInfo *info,
+                            gconstpointer data, guint n_frames,
+                            GstClockTime duration) {
+  AudioAnalysisResult *result = &analysis->result;
+  gfloat re[N], im[N], power[N / 2 + 1];
+  gfloat *relative[3] = {&result->bass, &result->mid, &result->treble};
+  gfloat *att[3] = {&result->bass_att, &result->mid_att, &result->treble_att};
+  gdouble seconds, average_rate, att_rate;
+  guint i, k, s, n_segments;
+
+  // windows overlapping by half, the last one ending with the frame, cover
+  // all of it. A short frame is completed by the audio before it
+  n_segments =
+      n_frames > N ? (n_frames - N + N / 2 - 1) / (N / 2) + 1 : 1;
+
+  memset(power, 0, sizeof(power));
+  for (s = 0; s < n_segments; s++) {
+    analysis_segment(analysis, info, data,
+                     (gint)n_frames - N - (gint)(s * (N / 2)), re);
+    for (i = 0; i < N; i++) {
+      re[i] *= analysis->window[i];
+      im[i] = 0.0f;
+    }
+    analysis_fft(analysis, re, im);
+
+    // a full scale sine peaks at N / 4 with the window
+    for (k = 0; k <= N / 2; k++)
+      power[k] += (re[k] * re[k] + im[k] * im[k]) *
+                  (16.0f / ((gfloat)N * N * n_segments));
+  }
+
+  analysis_update_history(analysis, info, data, n_frames);
+
+  for (i = 0; i < AUDIO_ANALYSIS_BANDS; i++) {
+    gfloat peak = 0.0f;
+
+    for (k = analysis->band_edges[i]; k < analysis->band_edges[i + 1]; k++)
+      peak = MAX(peak, power[k]);
+    result->spectrum[i] = sqrtf(peak);
+  }
+
+  // the averages follow at the same speed whatever the framerate
+  seconds = GST_CLOCK_TIME_IS_VALID(duration) && duration > 0
+                ? (gdouble)duration / GST_SECOND
+                : 1.0 / 60.0;
+  average_rate = 1.0 - exp(-seconds / ANALYSIS_AVERAGE_TIME);
+  att_rate = 1.0 - exp(-seconds / ANALYSIS_ATT_TIME);
+
+  for (i = 0; i < 3; i++) {
+    gfloat energy = 0.0f;
+
+    for (k = analysis->range_edges[i]; k < analysis->range_edges[i + 1]; k++)
+      energy += power[k];
+
+    if (!analysis->has_average)
+      analysis->average[i] = energy;
+    else
+      analysis->average[i] += (energy - analysis->average[i]) * average_rate;
+
+    *relative[i] = analysis->average[i] > ANALYSIS_SILENCE
+                       ? energy / analysis->average[i]
+                       : 0.0f;
+    *att[i] += (*relative[i] - *att[i]) * att_rate;
+  }
+  analysis->has_average = TRUE;
+
+  analysis->since_beat += seconds;
+  result->beat = result->bass > ANALYSIS_BEAT_THRESHOLD &&
+                 analysis->since_beat >= ANALYSIS_BEAT_INTERVAL;
+  if (result->beat)
+    analysis->since_beat = 0.0;
+}
+
+static void analysis_fill_structure(const AudioAnalysisResult *result,
+                                    GstStructure *s) {
+  GValue spectrum = G_VALUE_INIT, value = G_VALUE_INIT;
+  guint i;
+
+  gst_structure_set(s, "bass", G_TYPE_FLOAT, result->bass, "mid",
+                    G_TYPE_FLOAT, result->mid, "treble", G_TYPE_FLOAT,
+                    result->treble, "bass-att", G_TYPE_FLOAT, result->bass_att,
+                    "mid-att", G_TYPE_FLOAT, result->mid_att, "treble-att",
+                    G_TYPE_FLOAT, result->treble_att, "beat", G_TYPE_BOOLEAN,
+                    result->beat, NULL);
+
+  g_value_init(&spectrum, GST_TYPE_ARRAY);
+  g_value_init(&value, G_TYPE_FLOAT);
+  for (i = 0; i < AUDIO_ANALYSIS_BANDS; i++) {
+    g_value_set_float(&value, result->spectrum[i]);
+    gst_value_array_append_value(&spectrum, &value);
+  }
+  gst_structure_take_value(s, "spectrum", &spectrum);
+  g_value_unset(&value);
+}
+
+GstStructure *audio_analysis_to_structure(const AudioAnalysisResult *result,
+                                          const gchar *name) {
+  GstStructure *s = gst_structure_new_empty(name);
+
+  analysis_fill_structure(result, s);
+
+  return s;
+}
+
+void audio_analysis_meta_register(void) {
+#ifdef AUDIO_ANALYSIS_HAVE_META
+  static const gchar *tags[] = {NULL};
+
+  // copied along with the buffer, kept through any video transformation
+  gst_meta_register_custom(AUDIO_ANALYSIS_META_NAME, tags, NULL, NULL, NULL);
+#endif
+}
+
+void audio_analysis_meta_add(GstBuffer *buffer,
+                             const AudioAnalysisResult *result) {
+#ifdef AUDIO_ANALYSIS_HAVE_META
+  GstCustomMeta *meta;
+
+  meta = gst_buffer_add_custom_meta(buffer, AUDIO_ANALYSIS_META_NAME);
+  if (meta)
+    analysis_fill_structure(result, gst_custom_meta_get_structure(meta));
+#endif
+}
@@ -0,0 +1,132 @@
+#ifndef __GST_PROJECTM_ANALYSIS_H__
+#define __GST_PROJECTM_ANALYSIS_H__
+
+#include <glib.h>
+#include <gst/audio/audio.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Name of the custom buffer meta and of the element message carrying
+ * the analysis of a frame.
+ */
+#define AUDIO_ANALYSIS_META_NAME "GstProjectMAnalysisMeta"
+#define AUDIO_ANALYSIS_MESSAGE_NAME "projectm-analysis"
+
+/**
+ * @brief Custom buffer metas (GstCustomMeta) need GStreamer 1.20.
+ */
+#if GST_CHECK_VERSION(1, 20, 0)
+#define AUDIO_ANALYSIS_HAVE_META 1
+#endif
+
+/**
+ * @brief Number of samples of each FFT window.
+ *
+ * Longer frames are covered by windows overlapping by half, whose spectra are
+ * averaged. Shorter frames are analysed together with the end of the audio
+ * before them.
+ */
+#define AUDIO_ANALYSIS_FFT_SIZE 1024
+
+/**
+ * @brief Number of logarithmically spaced spectrum bands.
+ */
+#define AUDIO_ANALYSIS_BANDS 16
+
+/**
+ * @brief Analysis of the audio of one frame.
+ *
+ * Bass, mid and treble are the energy of the band relative to its average
+ * over the last seconds, so 1 is an average level, like the bass, mid and
+ * treb preset variables. The _att values follow them more slowly.
+ */
+typedef struct {
+  gfloat bass;
+  gfloat mid;
+  gfloat treble;
+  gfloat bass_att;
+  gfloat mid_att;
+  gfloat treble_att;
+  gboolean beat;
+  /* magnitude of each band, 1 for a full scale sine */
+  gfloat spectrum[AUDIO_ANALYSIS_BANDS];
+} AudioAnalysisResult;
+
+/**
+ * @brief State of the analysis, carried from frame to frame.
+ */
+typedef struct {
+  gint rate;
+
+  /* Hann window and twiddle factors of the FFT */
+  gfloat window[AUDIO_ANALYSIS_FFT_SIZE];
+  gfloat cos_table[AUDIO_ANALYSIS_FFT_SIZE / 2];
+  gfloat sin_table[AUDIO_ANALYSIS_FFT_SIZE / 2];
+
+  /* the last mono samples of the audio analysed so far, oldest first */
+  gfloat history[AUDIO_ANALYSIS_FFT_SIZE];
+
+  /* FFT bins at the edges of bass, mid and treble and of the spectrum bands */
+  guint range_edges[4];
+  guint band_edges[AUDIO_ANALYSIS_BANDS + 1];
+
+  /* long term energy of bass, mid and treble */
+  gfloat average[3];
+  gboolean has_average;
+  /* time since the last beat, in seconds */
+  gdouble since_beat;
+
+  AudioAnalysisResult result;
+} AudioAnalysis;
+
+/**
+ * @brief Reset the analysis for the negotiated audio format.
+ */
+void audio_analysis_init(AudioAnalysis *analysis, const GstAudioInfo *info);
+
+/**
+ * @brief Analyse the audio of a frame into analysis->result.
+ *
+ * @param analysis The analysis state.
+ * @param info The audio info, F32, S16 or S32 in native endianness.
+ * @param data Interleaved samples starting at the time of the frame.
+ * @param n_frames Number of samples per channel, all are analysed.
+ * @param duration Duration of the frame, for the averages.
+ */
+void audio_analysis_process(AudioAnalysis *analysis, const GstAudioInfo *info,
+                            gconstpointer data, guint n_frames,
+                            GstClockTime duration);
+
+/**
+ * @brief Describe a result in a structure.
+ *
+ * The structure has the float fields "bass", "mid", "treble", "bass-att",
+ * "mid-att" and "treble-att", the boolean "beat" and the "spectrum" array of
+ * floats.
+ *
+ * @param result The result.
+ * @param name The name of the structure.
+ * @return A new structure.
+ */
+GstStructure *audio_analysis_to_structure(const AudioAnalysisResult *result,
+                                          const gchar *name);
+
+/**
+ * @brief Register the AUDIO_ANALYSIS_META_NAME custom meta, once per process.
+ */
+void audio_analysis_meta_register(void);
+
+/**
+ * @brief Attach a result to a buffer as an AUDIO_ANALYSIS_META_NAME meta.
+ *
+ * Elements read it with gst_buffer_get_custom_meta() and
+ * gst_custom_meta_get_structure(), without any header from this plugin.
+ */
+void audio_analysis_meta_add(GstBuffer *buffer,
+                             const AudioAnalysisResult *result);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_ANALYSIS_H__ */
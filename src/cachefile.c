@@ -0,0 +1,63 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "cachefile.h"
+
+gboolean cache_file_load(const gchar *filename, const gchar *header,
+                         const gchar *what, guint max_fields,
+                         CacheFileRecordFunc func, gpointer user_data,
+                         GError **error) {
+  gchar *contents, *line, *next;
+  gsize header_len = strlen(header);
+
+  if (!g_file_get_contents(filename, &contents, NULL, error))
+    return FALSE;
+
+  if (!g_str_has_prefix(contents, header) || contents[header_len] != '\n') {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not %s",
+                filename, what);
+    g_free(contents);
+    return FALSE;
+  }
+
+  for (line = contents + header_len + 1; *line; line = next) {
+    gchar **fields;
+
+    next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+    else
+      next = line + strlen(line);
+
+    fields = g_strsplit(line, "\t", max_fields);
+    func(fields, g_strv_length(fields), user_data);
+    g_strfreev(fields);
+  }
+
+  g_free(contents);
+
+  return TRUE;
+}
+
+gboolean cache_file_save(const gchar *filename, const GString *contents,
+                         GError **error) {
+  gchar *parent = g_path_get_dirname(filename);
+
+  if (g_mkdir_with_parents(parent, 0755) != 0) {
+    int errsv = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv),
+                "can't create %s: %s", parent, g_strerror(errsv));
+    g_free(parent);
+    return FALSE;
+  }
+  g_free(parent);
+
+  // written to a temporary file and renamed
+  return g_file_set_contents(filename, contents->str, contents->len, error);
+}
@@ -0,0 +1,58 @@
+#ifndef __GST_PROJECTM_CACHEFILE_H__
+#define __GST_PROJECTM_CACHEFILE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Text files caching what was learned about presets between runs.
+ *
+ * A file starts with a header line naming its format and version, followed
+ * by one record per line with fields separated by tabs. Strings in fields are
+ * escaped with g_strescape().
+ */
+
+/**
+ * @brief Called for each record of a cache file.
+ *
+ * @param fields The fields of the record, modifiable.
+ * @param n_fields Number of @fields.
+ * @param user_data Passed to cache_file_load().
+ */
+typedef void (*CacheFileRecordFunc)(gchar **fields, guint n_fields,
+                                    gpointer user_data);
+
+/**
+ * @brief Read the records of a cache file.
+ *
+ * @param filename The file.
+ * @param header The header line the file must start with, without newline.
+ * @param what What the file is, for the error message.
+ * @param max_fields Fields a record is split into at most, the last one keeps
+ * any further tabs.
+ * @param func Called for each record, in order.
+ * @param user_data Passed to @func.
+ * @param error Set if the file can't be read or has another header.
+ * @return TRUE on success.
+ */
+gboolean cache_file_load(const gchar *filename, const gchar *header,
+                         const gchar *what, guint max_fields,
+                         CacheFileRecordFunc func, gpointer user_data,
+                         GError **error);
+
+/**
+ * @brief Replace a cache file atomically, other processes either see the old
+ * or the new one.
+ *
+ * @param filename The file, missing parent directories are created.
+ * @param contents The header line and the records.
+ * @param error Set if the file can't be written.
+ * @return TRUE on success.
+ */
+gboolean cache_file_save(const gchar *filename, const GString *contents,
+                         GError **error);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_CACHEFILE_H__ */
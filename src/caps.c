@@ -4,6 +4,7 @@
 #endif
 
 #include <gst/audio/audio-format.h>
+#include <gst/gl/gl.h>
 #include <gst/video/video-format.h>
 
 #include "caps.h"
@@ -17,14 +18,14 @@ const gchar *get_audio_sink_cap(unsigned int type) {
 
   switch (type) {
   case 0:
-    format =
-        GST_AUDIO_CAPS_MAKE("audio/x-raw, "
-                            "format = (string) " GST_AUDIO_NE(
-                                S16) ", "
-                                     "layout = (string) interleaved, "
-                                     "channels = (int) { 2 }, "
-                                     "rate = (int) { 44100 }, "
-                                     "channel-mask = (bitmask) { 0x0003 }");
+    // anything projectM can consume without a conversion element in front;
+    // the element downmixes to stereo itself
+    format = "audio/x-raw, "
+             "format = (string) { " GST_AUDIO_NE(F32) ", " GST_AUDIO_NE(
+                 S16) ", " GST_AUDIO_NE(S32) " }, "
+                                             "layout = (string) interleaved, "
+                                             "rate = (int) [ 1, MAX ], "
+                                             "channels = (int) [ 1, 8 ]";
     break;
   default:
     format = NULL;
@@ -39,8 +40,13 @@ const gchar *get_video_src_cap(unsigned int type) {
 
   switch (type) {
   case 0:
-    format = GST_VIDEO_CAPS_MAKE("video/x-raw, format = (string) { ABGR }, "
-                                 "framerate=(fraction)[0/1,MAX]");
+    // GL memory first: preferred whenever downstream can consume textures, as
+    // it avoids reading back every frame into system memory
+    format = GST_VIDEO_CAPS_MAKE_WITH_FEATURES(
+        GST_CAPS_FEATURE_MEMORY_GL_MEMORY,
+        "RGBA") ", texture-target = (string) " GST_GL_TEXTURE_TARGET_2D_STR
+                "; " GST_VIDEO_CAPS_MAKE(
+                    "{ ABGR, RGBA, RGBx, BGRx, RGB, NV12, I420 }");
     break;
   default:
     format = NULL;
@@ -0,0 +1,394 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+
+#include "colorconvert.h"
+
+GST_DEBUG_CATEGORY_STATIC(colorconvert_debug);
+#define GST_CAT_DEFAULT colorconvert_debug
+
+/* what each output texel holds, see the fragment shader */
+typedef enum {
+  CONVERT_MODE_SWIZZLE = 0, /* one 4 byte pixel */
+  CONVERT_MODE_RGB = 1,     /* 4 bytes of packed 3 byte pixels */
+  CONVERT_MODE_LUMA = 2,    /* 4 luma samples */
+  CONVERT_MODE_CHROMA = 3,  /* 2 interleaved chroma pairs */
+  CONVERT_MODE_PLANAR = 4,  /* 4 samples of the U or V plane */
+} ConvertMode;
+
+struct _ColorConvert {
+  GstGLContext *context;
+  GstGLShader *shader;
+  GLuint vao;
+  GLuint vbo;
+};
+
+/* position and texture coordinates of a full viewport triangle strip */
+static const GLfloat convert_vertices[] = {
+    -1.0f, -1.0f, 0.0f, 0.0f, /* */
+    1.0f,  -1.0f, 1.0f, 0.0f, /* */
+    -1.0f, 1.0f,  0.0f, 1.0f, /* */
+    1.0f,  1.0f,  1.0f, 1.0f,
+};
+
+/* Pixel coordinates are in the order glReadPixels returns rows, texel
+ * coordinates are relative to the plane being drawn. GL renders bottom up, so
+ * fetch() flips rows to put the top of the frame first, as GStreamer expects.
+ * Chroma is sampled at the center of each 2x2 block, linear filtering averages
+ * the block. */
+static const gchar *convert_fragment =
+    "varying vec2 v_texcoord;\n"
+    "uniform sampler2D tex;\n"
+    "uniform vec2 size;\n"
+    "uniform vec2 plane_size;\n"
+    "uniform int mode;\n"
+    "uniform mat4 swizzle;\n"
+    "uniform vec4 coeff_y;\n"
+    "uniform vec4 coeff_u;\n"
+    "uniform vec4 coeff_v;\n"
+    "uniform float chroma;\n"
+    "vec4 fetch(vec2 p) {\n"
+    "  return texture2D(tex, vec2(p.x, size.y - p.y) / size);\n"
+    "}\n"
+    "float apply(vec4 coeff, vec4 c) {\n"
+    "  return dot(c.rgb, coeff.rgb) + coeff.w;\n"
+    "}\n"
+    "float sample_byte(float b, float row) {\n"
+    "  if (mode == 1) {\n"
+    "    float px = floor(b / 3.0);\n"
+    "    vec4 channel = vec4(b - px * 3.0);\n"
+    "    vec4 sel = vec4(equal(channel, vec4(0.0, 1.0, 2.0, 3.0)));\n"
+    "    return dot(fetch(vec2(px + 0.5, row + 0.5)), sel);\n"
+    "  } else if (mode == 2) {\n"
+    "    return apply(coeff_y, fetch(vec2(b + 0.5, row + 0.5)));\n"
+    "  } else if (mode == 3) {\n"
+    "    float pair = floor(b / 2.0);\n"
+    "    vec4 c = fetch(vec2(pair * 2.0 + 1.0, row * 2.0 + 1.0));\n"
+    "    return mix(apply(coeff_u, c), apply(coeff_v, c), b - pair * 2.0);\n"
+    "  }\n"
+    "  return apply(mix(coeff_u, coeff_v, chroma),\n"
+    "               fetch(vec2(b * 2.0 + 1.0, row * 2.0 + 1.0)));\n"
+    "}\n"
+    "void main() {\n"
+    "  vec2 t = floor(v_texcoord * plane_size);\n"
+    "  if (mode == 0) {\n"
+    "    gl_FragColor = swizzle * fetch(t + 0.5);\n"
+    "    return;\n"
+    "  }\n"
+    "  float b = t.x * 4.0;\n"
+    "  gl_FragColor = vec4(sample_byte(b, t.y), sample_byte(b + 1.0, t.y),\n"
+    "                      sample_byte(b + 2.0, t.y),\n"
+    "                      sample_byte(b + 3.0, t.y));\n"
+    "}\n";
+
+gboolean color_convert_supports_format(GstVideoFormat format) {
+  switch (format) {
+  case GST_VIDEO_FORMAT_RGBA:
+  case GST_VIDEO_FORMAT_ABGR:
+  case GST_VIDEO_FORMAT_RGBx:
+  case GST_VIDEO_FORMAT_BGRx:
+  case GST_VIDEO_FORMAT_RGB:
+  case GST_VIDEO_FORMAT_NV12:
+  case GST_VIDEO_FORMAT_I420:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+static void color_convert_add_plane(ReadbackLayout *layout, gsize bytes,
+                                    gint rows) {
+  ReadbackPlane *plane = &layout->planes[layout->n_planes++];
+
+  plane->y = layout->height;
+  plane->rows = rows;
+  plane->width = (gint)((bytes + 3) / 4);
+  plane->bytes = bytes;
+
+  layout->width = MAX(layout->width, plane->width);
+  layout->height += rows;
+}
+
+gboolean color_convert_get_layout(const GstVideoInfo *info,
+                                  ReadbackLayout *layout) {
+  gint width = GST_VIDEO_INFO_WIDTH(info);
+  gint height = GST_VIDEO_INFO_HEIGHT(info);
+  gint chroma_width = (width + 1) / 2;
+  gint chroma_height = (height + 1) / 2;
+
+  memset(layout, 0, sizeof(ReadbackLayout));
+
+  switch (GST_VIDEO_INFO_FORMAT(info)) {
+  case GST_VIDEO_FORMAT_RGBA:
+  case GST_VIDEO_FORMAT_ABGR:
+  case GST_VIDEO_FORMAT_RGBx:
+  case GST_VIDEO_FORMAT_BGRx:
+    color_convert_add_plane(layout, (gsize)width * 4, height);
+    break;
+  case GST_VIDEO_FORMAT_RGB:
+    color_convert_add_plane(layout, (gsize)width * 3, height);
+    break;
+  case GST_VIDEO_FORMAT_NV12:
+    color_convert_add_plane(layout, width, height);
+    color_convert_add_plane(layout, (gsize)chroma_width * 2, chroma_height);
+    break;
+  case GST_VIDEO_FORMAT_I420:
+    color_convert_add_plane(layout, width, height);
+    color_convert_add_plane(layout, chroma_width, chroma_height);
+    color_convert_add_plane(layout, chroma_width, chroma_height);
+    break;
+  default:
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+ColorConvert *color_convert_new(GstGLContext *context) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  ColorConvert *convert;
+  GstGLShader *shader;
+  GstGLSLStage *vertex, *fragment;
+  const gchar *strings[2];
+  GError *error = NULL;
+
+  GST_DEBUG_CATEGORY_INIT(colorconvert_debug, "projectm_colorconvert", 0,
+                          "projectM GPU color conversion");
+
+  strings[0] = gst_gl_shader_string_get_highest_precision(
+      context, GST_GLSL_VERSION_NONE,
+      GST_GLSL_PROFILE_ES | GST_GLSL_PROFILE_COMPATIBILITY);
+  strings[1] = convert_fragment;
+
+  vertex = gst_glsl_stage_new_default_vertex(context);
+  fragment = gst_glsl_stage_new_with_strings(
+      context, GL_FRAGMENT_SHADER, GST_GLSL_VERSION_NONE,
+      GST_GLSL_PROFILE_ES | GST_GLSL_PROFILE_COMPATIBILITY, 2, strings);
+
+  shader = gst_gl_shader_new_link_with_stages(context, &error, vertex,
+                                              fragment, NULL);
+  if (!shader) {
+    GST_ERROR("failed to link color conversion shader: %s",
+              error ? error->message : "unknown error");
+    g_clear_error(&error);
+    return NULL;
+  }
+
+  convert = g_new0(ColorConvert, 1);
+  convert->context = gst_object_ref(context);
+  convert->shader = shader;
+
+  if (gl->GenVertexArrays) {
+    gl->GenVertexArrays(1, &convert->vao);
+    gl->BindVertexArray(convert->vao);
+  }
+
+  gl->GenBuffers(1, &convert->vbo);
+  gl->BindBuffer(GL_ARRAY_BUFFER, convert->vbo);
+  gl->BufferData(GL_ARRAY_BUFFER, sizeof(convert_vertices), convert_vertices,
+                 GL_STATIC_DRAW);
+  gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (gl->GenVertexArrays)
+    gl->BindVertexArray(0);
+
+  return convert;
+}
+
+void color_convert_free(ColorConvert *convert) {
+  const GstGLFuncs *gl;
+
+  if (!convert)
+    return;
+
+  gl = convert->context->gl_vtable;
+
+  if (convert->vbo)
+    gl->DeleteBuffers(1, &convert->vbo);
+  if (convert->vao)
+    gl->DeleteVertexArrays(1, &convert->vao);
+
+  gst_object_unref(convert->shader);
+  gst_object_unref(convert->context);
+  g_free(convert);
+}
+
+static void color_convert_set_swizzle(GstGLShader *shader,
+                                      GstVideoFormat format) {
+  /* source channel of each output byte */
+  static const guint rgba[] = {0, 1, 2, 3};
+  static const guint abgr[] = {3, 2, 1, 0};
+  static const guint bgrx[] = {2, 1, 0, 3};
+  const guint *perm = rgba;
+  GLfloat m[16] = {0};
+  guint k;
+
+  if (format == GST_VIDEO_FORMAT_ABGR)
+    perm = abgr;
+  else if (format == GST_VIDEO_FORMAT_BGRx)
+    perm = bgrx;
+
+  /* column major, column perm[k] feeds output row k */
+  for (k = 0; k < 4; k++)
+    m[perm[k] * 4 + k] = 1.0f;
+
+  gst_gl_shader_set_uniform_matrix_4fv(shader, "swizzle", 1, FALSE, m);
+}
+
+static void color_convert_set_matrix(GstGLShader *shader,
+                                     const GstVideoInfo *info) {
+  gdouble kr, kb, kg;
+  gdouble y_scale, c_scale, y_offset, c_offset;
+
+  if (!gst_video_color_matrix_get_Kr_Kb(info->colorimetry.matrix, &kr, &kb)) {
+    /* BT.601 */
+    kr = 0.299;
+    kb = 0.114;
+  }
+  kg = 1.0 - kr - kb;
+
+  if (info->colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255) {
+    y_scale = c_scale = 1.0;
+    y_offset = 0.0;
+  } else {
+    y_scale = 219.0 / 255.0;
+    c_scale = 224.0 / 255.0;
+    y_offset = 16.0 / 255.0;
+  }
+  c_offset = 128.0 / 255.0;
+
+  gst_gl_shader_set_uniform_4f(shader, "coeff_y", kr * y_scale, kg * y_scale,
+                               kb * y_scale, y_offset);
+  gst_gl_shader_set_uniform_4f(
+      shader, "coeff_u", -kr / (2.0 * (1.0 - kb)) * c_scale,
+      -kg / (2.0 * (1.0 - kb)) * c_scale, 0.5 * c_scale, c_offset);
+  gst_gl_shader_set_uniform_4f(
+      shader, "coeff_v", 0.5 * c_scale, -kg / (2.0 * (1.0 - kr)) * c_scale,
+      -kb / (2.0 * (1.0 - kr)) * c_scale, c_offset);
+}
+
+static void color_convert_draw_plane(ColorConvert *convert,
+                                     const ReadbackPlane *plane,
+                                     ConvertMode mode) {
+  const GstGLFuncs *gl = convert->context->gl_vtable;
+
+  gst_gl_shader_set_uniform_1i(convert->shader, "mode", mode);
+  gst_gl_shader_set_uniform_2f(convert->shader, "plane_size", plane->width,
+                               plane->rows);
+
+  gl->Viewport(0, plane->y, plane->width, plane->rows);
+  gl->DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+/* bind the shader sampling src into dest, for an output frame of the given
+ * size */
+static void color_convert_begin(ColorConvert *convert, RenderTarget *src,
+                                RenderTarget *dest, gint width, gint height,
+                                GLint *position, GLint *texcoord) {
+  const GstGLFuncs *gl = convert->context->gl_vtable;
+  GstGLShader *shader = convert->shader;
+
+  gl->BindFramebuffer(GL_FRAMEBUFFER, dest->fbo);
+  gl->Disable(GL_BLEND);
+  gl->Disable(GL_DEPTH_TEST);
+  gl->Disable(GL_SCISSOR_TEST);
+  gl->Disable(GL_CULL_FACE);
+
+  gst_gl_shader_use(shader);
+
+  gl->ActiveTexture(GL_TEXTURE0);
+  gl->BindTexture(GL_TEXTURE_2D, src->texture);
+  gst_gl_shader_set_uniform_1i(shader, "tex", 0);
+  gst_gl_shader_set_uniform_2f(shader, "size", width, height);
+
+  if (convert->vao)
+    gl->BindVertexArray(convert->vao);
+  gl->BindBuffer(GL_ARRAY_BUFFER, convert->vbo);
+
+  *position = gst_gl_shader_get_attribute_location(shader, "a_position");
+  *texcoord = gst_gl_shader_get_attribute_location(shader, "a_texcoord");
+  gl->VertexAttribPointer(*position, 2, GL_FLOAT, GL_FALSE,
+                          4 * sizeof(GLfloat), (void *)0);
+  gl->VertexAttribPointer(*texcoord, 2, GL_FLOAT, GL_FALSE,
+                          4 * sizeof(GLfloat), (void *)(2 * sizeof(GLfloat)));
+  gl->EnableVertexAttribArray(*position);
+  gl->EnableVertexAttribArray(*texcoord);
+}
+
+static void color_convert_end(ColorConvert *convert, GLint position,
+                              GLint texcoord) {
+  const GstGLFuncs *gl = convert->context->gl_vtable;
+
+  gl->DisableVertexAttribArray(position);
+  gl->DisableVertexAttribArray(texcoord);
+  gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+  if (convert->vao)
+    gl->BindVertexArray(0);
+
+  gl->BindTexture(GL_TEXTURE_2D, 0);
+  gst_gl_context_clear_shader(convert->context);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+gboolean color_convert_run(ColorConvert *convert, RenderTarget *src,
+                           const GstVideoInfo *info,
+                           const ReadbackLayout *layout, RenderTarget *dest) {
+  GstGLShader *shader = convert->shader;
+  GstVideoFormat format = GST_VIDEO_INFO_FORMAT(info);
+  GLint position, texcoord;
+
+  if (!render_target_ensure(dest, convert->context, layout->width,
+                            layout->height))
+    return FALSE;
+
+  color_convert_begin(convert, src, dest, GST_VIDEO_INFO_WIDTH(info),
+                      GST_VIDEO_INFO_HEIGHT(info), &position, &texcoord);
+
+  switch (format) {
+  case GST_VIDEO_FORMAT_RGB:
+    color_convert_draw_plane(convert, &layout->planes[0], CONVERT_MODE_RGB);
+    break;
+  case GST_VIDEO_FORMAT_NV12:
+    color_convert_set_matrix(shader, info);
+    color_convert_draw_plane(convert, &layout->planes[0], CONVERT_MODE_LUMA);
+    color_convert_draw_plane(convert, &layout->planes[1], CONVERT_MODE_CHROMA);
+    break;
+  case GST_VIDEO_FORMAT_I420:
+    color_convert_set_matrix(shader, info);
+    color_convert_draw_plane(convert, &layout->planes[0], CONVERT_MODE_LUMA);
+    gst_gl_shader_set_uniform_1f(shader, "chroma", 0.0f);
+    color_convert_draw_plane(convert, &layout->planes[1], CONVERT_MODE_PLANAR);
+    gst_gl_shader_set_uniform_1f(shader, "chroma", 1.0f);
+    color_convert_draw_plane(convert, &layout->planes[2], CONVERT_MODE_PLANAR);
+    break;
+  default:
+    color_convert_set_swizzle(shader, format);
+    color_convert_draw_plane(convert, &layout->planes[0],
+                             CONVERT_MODE_SWIZZLE);
+    break;
+  }
+
+  color_convert_end(convert, position, texcoord);
+
+  return TRUE;
+}
+
+void color_convert_copy(ColorConvert *convert, RenderTarget *src,
+                        RenderTarget *dest) {
+  ReadbackPlane plane = {0};
+  GLint position, texcoord;
+
+  plane.width = dest->width;
+  plane.rows = dest->height;
+
+  color_convert_begin(convert, src, dest, dest->width, dest->height,
+                      &position, &texcoord);
+  color_convert_set_swizzle(convert->shader, GST_VIDEO_FORMAT_RGBA);
+  color_convert_draw_plane(convert, &plane, CONVERT_MODE_SWIZZLE);
+  color_convert_end(convert, position, texcoord);
+}
@@ -0,0 +1,79 @@
+#ifndef __GST_PROJECTM_COLORCONVERT_H__
+#define __GST_PROJECTM_COLORCONVERT_H__
+
+#include <glib.h>
+#include <gst/gl/gl.h>
+#include <gst/video/video.h>
+
+#include "readback.h"
+#include "rendertarget.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Shader converting a rendered frame into the planes of a system memory
+ * video format, packed into an RGBA image that is read back as is.
+ */
+typedef struct _ColorConvert ColorConvert;
+
+/**
+ * @brief Check if frames can be converted to the format.
+ */
+gboolean color_convert_supports_format(GstVideoFormat format);
+
+/**
+ * @brief Get where the planes of a frame are in the converted image.
+ *
+ * @param info The video info of the frame, with a supported format.
+ * @param layout Filled with the layout of the planes.
+ * @return FALSE if the format is not supported.
+ */
+gboolean color_convert_get_layout(const GstVideoInfo *info,
+                                  ReadbackLayout *layout);
+
+/**
+ * @brief Compile the conversion shader. Must be called from the GL thread.
+ *
+ * @param context The OpenGL context.
+ * @return The converter, or NULL if the shader failed to compile.
+ */
+ColorConvert *color_convert_new(GstGLContext *context);
+
+/**
+ * @brief Free the converter. Must be called from the GL thread.
+ */
+void color_convert_free(ColorConvert *convert);
+
+/**
+ * @brief Convert a rendered frame, scaling it to the size of the video info.
+ * Must be called from the GL thread.
+ *
+ * The frame is flipped while converting, so the first row read back is the top
+ * of the frame as GStreamer expects, where GL renders bottom up.
+ *
+ * @param convert The converter.
+ * @param src The rendered frame.
+ * @param info The video info of the output frame.
+ * @param layout The layout of @info, from color_convert_get_layout().
+ * @param dest Target that receives the converted image, resized as needed.
+ * @return FALSE if the target could not be allocated.
+ */
+gboolean color_convert_run(ColorConvert *convert, RenderTarget *src,
+                           const GstVideoInfo *info,
+                           const ReadbackLayout *layout, RenderTarget *dest);
+
+/**
+ * @brief Copy a rendered frame into a target, flipped and scaled to the size
+ * of the target, for contexts that can't blit. Must be called from the GL
+ * thread.
+ *
+ * @param convert The converter.
+ * @param src The rendered frame.
+ * @param dest Target to draw into, e.g. wrapping a memory:GLMemory texture.
+ */
+void color_convert_copy(ColorConvert *convert, RenderTarget *src,
+                        RenderTarget *dest);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_COLORCONVERT_H__ */
@@ -33,6 +33,16 @@ G_BEGIN_DECLS
 #define DEFAULT_PRESET_LOCKED FALSE
 #define DEFAULT_ENABLE_PLAYLIST TRUE
 #define DEFAULT_SHUFFLE_PRESETS TRUE // depends on ENABLE_PLAYLIST
+#define DEFAULT_OFFLINE FALSE
+#define DEFAULT_PRESET_INDEX NULL
+#define DEFAULT_WATCH_PRESETS FALSE
+#define DEFAULT_CHECK_GL_ERRORS FALSE
+#define DEFAULT_PRESET_SEED 0
+#define DEFAULT_ANALYSIS_META FALSE
+#define DEFAULT_ANALYSIS_MESSAGES FALSE
+#define DEFAULT_PRESET_COSTS NULL
+#define DEFAULT_FRAME_BUDGET 0.0
+#define DEFAULT_TEXTURE_CACHE_SIZE 0
 
 G_END_DECLS
 
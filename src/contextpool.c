@@ -0,0 +1,204 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gl/gl.h>
+
+#include "contextpool.h"
+
+GST_DEBUG_CATEGORY_STATIC(contextpool_debug);
+#define GST_CAT_DEFAULT contextpool_debug
+
+typedef struct {
+  GstGLDisplay *display;
+  GstGLContext *context;
+  guint users; /* with pool_lock */
+
+  /* dispatch in submission order, tickets are handed out and served in
+   * sequence */
+  GMutex lock;
+  GCond cond;
+  guint64 next_ticket;
+  guint64 serving;
+} ContextPoolSlot;
+
+static GMutex pool_lock;
+static GPtrArray *pool_slots; /* ContextPoolSlot, freed without users */
+
+static void context_pool_init_debug(void) {
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)) {
+    GST_DEBUG_CATEGORY_INIT(contextpool_debug, "projectm_contextpool", 0,
+                            "projectM shared GL contexts");
+    g_once_init_leave(&initialized, 1);
+  }
+}
+
+/* with pool_lock */
+static ContextPoolSlot *context_pool_find_slot(GstGLContext *context) {
+  ContextPoolSlot *slot;
+  guint i;
+
+  if (!pool_slots)
+    return NULL;
+
+  for (i = 0; i < pool_slots->len; i++) {
+    slot = g_ptr_array_index(pool_slots, i);
+    if (slot->context == context)
+      return slot;
+  }
+
+  return NULL;
+}
+
+GstGLDisplay *context_pool_get_display(void) {
+  GstGLDisplay *display = NULL;
+
+  g_mutex_lock(&pool_lock);
+  if (pool_slots && pool_slots->len > 0)
+    display = gst_object_ref(
+        ((ContextPoolSlot *)g_ptr_array_index(pool_slots, 0))->display);
+  g_mutex_unlock(&pool_lock);
+
+  return display;
+}
+
+/* the least used of the first @size contexts that share GL objects with
+ * @other_context, with pool_lock */
+static ContextPoolSlot *context_pool_find_best(GstGLDisplay *display,
+                                               GstGLContext *other_context,
+                                               guint size, guint *count) {
+  ContextPoolSlot *slot, *best = NULL;
+  guint i;
+
+  *count = 0;
+  for (i = 0; i < pool_slots->len; i++) {
+    slot = g_ptr_array_index(pool_slots, i);
+    if (slot->display != display ||
+        (other_context &&
+         !gst_gl_context_can_share(slot->context, other_context)))
+      continue;
+    if ((*count)++ < size && (!best || slot->users < best->users))
+      best = slot;
+  }
+
+  return best;
+}
+
+GstGLContext *context_pool_acquire(GstGLDisplay *display,
+                                   GstGLContext *other_context, guint size,
+                                   GError **error) {
+  ContextPoolSlot *best;
+  GstGLContext *context = NULL, *created = NULL;
+  guint count;
+
+  g_return_val_if_fail(size > 0, NULL);
+
+  context_pool_init_debug();
+
+  g_mutex_lock(&pool_lock);
+  if (!pool_slots)
+    pool_slots = g_ptr_array_new();
+
+  best = context_pool_find_best(display, other_context, size, &count);
+  if (!best || (best->users > 0 && count < size)) {
+    // contexts are only created on demand, so a pool that is larger than the
+    // number of elements doesn't start idle GL threads. Creating one waits for
+    // its GL thread, other elements keep acquiring contexts meanwhile
+    g_mutex_unlock(&pool_lock);
+    if (!gst_gl_display_create_context(display, other_context, &created,
+                                       error))
+      return NULL;
+    g_mutex_lock(&pool_lock);
+
+    // another element may have added a context in the meantime
+    best = context_pool_find_best(display, other_context, size, &count);
+    if (!best || (best->users > 0 && count < size)) {
+      GST_OBJECT_LOCK(display);
+      gst_gl_display_add_context(display, created);
+      GST_OBJECT_UNLOCK(display);
+
+      best = g_new0(ContextPoolSlot, 1);
+      best->display = gst_object_ref(display);
+      best->context = g_steal_pointer(&created);
+      g_mutex_init(&best->lock);
+      g_cond_init(&best->cond);
+      g_ptr_array_add(pool_slots, best);
+
+      GST_INFO("created shared GL context %" GST_PTR_FORMAT ", %u of %u",
+               best->context, count + 1, size);
+    }
+  }
+
+  best->users++;
+  context = gst_object_ref(best->context);
+
+  GST_DEBUG("handing out GL context %" GST_PTR_FORMAT ", %u users", context,
+            best->users);
+  g_mutex_unlock(&pool_lock);
+
+  // the GL thread of a context that lost the race ends outside the lock
+  if (created) {
+    GST_DEBUG("dropping unneeded GL context %" GST_PTR_FORMAT, created);
+    gst_object_unref(created);
+  }
+
+  return context;
+}
+
+void context_pool_release(GstGLContext *context) {
+  ContextPoolSlot *slot, *unused = NULL;
+
+  g_mutex_lock(&pool_lock);
+  slot = context_pool_find_slot(context);
+  if (slot && slot->users > 0 && --slot->users == 0) {
+    // nothing dispatches to it any more, a process starting and stopping
+    // elements doesn't collect idle GL threads
+    g_ptr_array_remove_fast(pool_slots, slot);
+    unused = slot;
+  }
+  g_mutex_unlock(&pool_lock);
+
+  gst_object_unref(context);
+
+  // the GL thread ends with the last reference to the context, outside the
+  // lock as that waits for it
+  if (unused) {
+    GST_INFO("freeing unused shared GL context %" GST_PTR_FORMAT,
+             unused->context);
+    gst_object_unref(unused->context);
+    gst_object_unref(unused->display);
+    g_mutex_clear(&unused->lock);
+    g_cond_clear(&unused->cond);
+    g_free(unused);
+  }
+}
+
+void context_pool_thread_add(GstGLContext *context,
+                             GstGLContextThreadFunc func, gpointer data) {
+  ContextPoolSlot *slot;
+  guint64 ticket;
+
+  g_mutex_lock(&pool_lock);
+  slot = context_pool_find_slot(context);
+  g_mutex_unlock(&pool_lock);
+
+  if (!slot) {
+    gst_gl_context_thread_add(context, func, data);
+    return;
+  }
+
+  g_mutex_lock(&slot->lock);
+  ticket = slot->next_ticket++;
+  while (slot->serving != ticket)
+    g_cond_wait(&slot->cond, &slot->lock);
+  g_mutex_unlock(&slot->lock);
+
+  gst_gl_context_thread_add(context, func, data);
+
+  g_mutex_lock(&slot->lock);
+  slot->serving++;
+  g_cond_broadcast(&slot->cond);
+  g_mutex_unlock(&slot->lock);
+}
@@ -0,0 +1,60 @@
+#ifndef __GST_PROJECTM_CONTEXTPOOL_H__
+#define __GST_PROJECTM_CONTEXTPOOL_H__
+
+#include <glib.h>
+#include <gst/gl/gl.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Process wide set of GL contexts, each with its own GL thread, shared
+ * by all elements that opt in.
+ *
+ * Elements are spread over the contexts by load, and work dispatched to a
+ * context is run in the order it was submitted, so no element can starve the
+ * others sharing its GL thread. Contexts are created on demand and freed, with
+ * their GL thread, once no element uses them.
+ */
+
+/**
+ * @brief Get the display the pooled contexts were created on.
+ *
+ * @return A new reference to the display, or NULL if the pool holds no
+ * context.
+ */
+GstGLDisplay *context_pool_get_display(void);
+
+/**
+ * @brief Get a shared context of a display, creating one if fewer than @size
+ * exist for it and all are in use.
+ *
+ * Only contexts sharing GL objects with @other_context are handed out, so
+ * elements with different application contexts get separate contexts.
+ *
+ * @param display The display.
+ * @param other_context Context to share GL objects with, or NULL.
+ * @param size Maximum number of contexts per display and share group.
+ * @param error Set if a context can't be created.
+ * @return A new reference to the least used context, release it with
+ * context_pool_release(). NULL on error.
+ */
+GstGLContext *context_pool_acquire(GstGLDisplay *display,
+                                   GstGLContext *other_context, guint size,
+                                   GError **error);
+
+/**
+ * @brief Give back a context returned by context_pool_acquire(). The context
+ * is freed once its last user gave it back.
+ */
+void context_pool_release(GstGLContext *context);
+
+/**
+ * @brief Run a function on the GL thread of a pooled context, after all work
+ * submitted to the context before. Blocks until the function returned.
+ */
+void context_pool_thread_add(GstGLContext *context,
+                             GstGLContextThreadFunc func, gpointer data);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_CONTEXTPOOL_H__ */
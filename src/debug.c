@@ -7,44 +7,191 @@
 
 #include "debug.h"
 
-void gl_error_handler(GstGLContext *context, gpointer data) {
-  GLuint error = context->gl_vtable->GetError();
+GST_DEBUG_CATEGORY_STATIC(gl_debug);
+#define GST_CAT_DEFAULT gl_debug
 
+#ifndef GL_DEBUG_OUTPUT
+#define GL_DEBUG_OUTPUT 0x92E0
+#endif
+#ifndef GL_DEBUG_OUTPUT_SYNCHRONOUS
+#define GL_DEBUG_OUTPUT_SYNCHRONOUS 0x8242
+#endif
+#ifndef GL_DEBUG_CALLBACK_FUNCTION
+#define GL_DEBUG_CALLBACK_FUNCTION 0x8244
+#define GL_DEBUG_CALLBACK_USER_PARAM 0x8245
+#endif
+#ifndef GL_DEBUG_TYPE_ERROR
+#define GL_DEBUG_TYPE_ERROR 0x824C
+#endif
+#ifndef GL_DEBUG_SEVERITY_HIGH
+#define GL_DEBUG_SEVERITY_HIGH 0x9146
+#define GL_DEBUG_SEVERITY_MEDIUM 0x9147
+#define GL_DEBUG_SEVERITY_LOW 0x9148
+#endif
+
+#define GL_DEBUG_STATE_KEY "gst-projectm-gl-debug"
+
+typedef void(GSTGLAPI *GLDebugCallback)(GLenum source, GLenum type, GLuint id,
+                                        GLenum severity, GLsizei length,
+                                        const gchar *message,
+                                        gpointer user_data);
+
+typedef struct {
+  /* GL thread only, messages are synchronous */
+  guint depth;
+  guint errors;
+
+  /* installed before, e.g. by GStreamer itself with GST_GL_DEBUG */
+  GLDebugCallback chain;
+  gpointer chain_data;
+} GLDebugState;
+
+static void gl_debug_init_category(void) {
+  static gsize initialized = 0;
+
+  if (g_once_init_enter(&initialized)) {
+    GST_DEBUG_CATEGORY_INIT(gl_debug, "projectm_gl", 0,
+                            "projectM OpenGL errors and driver messages");
+    g_once_init_leave(&initialized, 1);
+  }
+}
+
+static const gchar *gl_error_to_string(guint error) {
   switch (error) {
-  case GL_NO_ERROR:
-    // No error
-    break;
   case GL_INVALID_ENUM:
-    g_error(
-        "OpenGL Error: GL_INVALID_ENUM - Enumeration parameter is not legal\n");
-    break;
+    return "GL_INVALID_ENUM - Enumeration parameter is not legal";
   case GL_INVALID_VALUE:
-    g_error("OpenGL Error: GL_INVALID_VALUE - Value parameter is not legal\n");
-    break;
+    return "GL_INVALID_VALUE - Value parameter is not legal";
   case GL_INVALID_OPERATION:
-    g_error("OpenGL Error: GL_INVALID_OPERATION - Set of state is not legal "
-            "for the parameters given\n");
-    break;
+    return "GL_INVALID_OPERATION - Set of state is not legal for the "
+           "parameters given";
   case GL_STACK_OVERFLOW:
-    g_error("OpenGL Error: GL_STACK_OVERFLOW - Stack pushing operation would "
-            "overflow\n");
-    break;
+    return "GL_STACK_OVERFLOW - Stack pushing operation would overflow";
   case GL_STACK_UNDERFLOW:
-    g_error("OpenGL Error: GL_STACK_UNDERFLOW - Stack popping operation would "
-            "underflow\n");
-    break;
+    return "GL_STACK_UNDERFLOW - Stack popping operation would underflow";
   case GL_OUT_OF_MEMORY:
-    g_error("OpenGL Error: GL_OUT_OF_MEMORY - Memory allocation failed\n");
-    break;
+    return "GL_OUT_OF_MEMORY - Memory allocation failed";
   case GL_INVALID_FRAMEBUFFER_OPERATION:
-    g_error("OpenGL Error: GL_INVALID_FRAMEBUFFER_OPERATION - Incomplete "
-            "framebuffer operation\n");
-    break;
+    return "GL_INVALID_FRAMEBUFFER_OPERATION - Incomplete framebuffer "
+           "operation";
   case GL_CONTEXT_LOST:
-    g_error("OpenGL Error: GL_CONTEXT_LOST - OpenGL context lost\n");
-    break;
+    return "GL_CONTEXT_LOST - OpenGL context lost";
   default:
-    g_error("OpenGL Error: Unknown error code - 0x%x\n", error);
-    break;
+    return "Unknown error code";
   }
-}
\ No newline at end of file
+}
+
+guint gl_error_handler(GstGLContext *context, gpointer data) {
+  GObject *object = data ? G_OBJECT(data) : NULL;
+  guint error, first = GL_NO_ERROR;
+  guint i;
+
+  gl_debug_init_category();
+
+  // several error flags can be set at once, each call clears one, a lost
+  // context keeps returning its error
+  for (i = 0; i < 8; i++) {
+    error = context->gl_vtable->GetError();
+    if (error == GL_NO_ERROR)
+      break;
+
+    GST_ERROR_OBJECT(object, "OpenGL Error: 0x%x %s", error,
+                     gl_error_to_string(error));
+    if (first == GL_NO_ERROR)
+      first = error;
+    if (error == GL_CONTEXT_LOST)
+      break;
+  }
+
+  return first;
+}
+
+gboolean gl_error_is_fatal(guint error) {
+  return error == GL_OUT_OF_MEMORY || error == GL_CONTEXT_LOST;
+}
+
+static void GSTGLAPI gl_debug_callback(GLenum source, GLenum type, GLuint id,
+                                       GLenum severity, GLsizei length,
+                                       const gchar *message,
+                                       gpointer user_data) {
+  GLDebugState *state = user_data;
+  GstDebugLevel level;
+
+  if (state->chain)
+    state->chain(source, type, id, severity, length, message,
+                 state->chain_data);
+
+  // other users of a shared context don't count against the element
+  if (type == GL_DEBUG_TYPE_ERROR && state->depth > 0)
+    state->errors++;
+
+  if (type == GL_DEBUG_TYPE_ERROR) {
+    level = GST_LEVEL_ERROR;
+  } else if (severity == GL_DEBUG_SEVERITY_HIGH) {
+    level = GST_LEVEL_WARNING;
+  } else if (severity == GL_DEBUG_SEVERITY_MEDIUM ||
+             severity == GL_DEBUG_SEVERITY_LOW) {
+    level = GST_LEVEL_DEBUG;
+  } else {
+    level = GST_LEVEL_LOG;
+  }
+
+  GST_CAT_LEVEL_LOG(gl_debug, level, NULL,
+                    "source 0x%x type 0x%x id %u severity 0x%x: %.*s", source,
+                    type, id, severity, (gint)length, message);
+}
+
+gboolean gl_debug_init(GstGLContext *context) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  GLDebugState *state;
+
+  gl_debug_init_category();
+
+  if (g_object_get_data(G_OBJECT(context), GL_DEBUG_STATE_KEY))
+    return TRUE;
+
+  if (!gl->DebugMessageCallback) {
+    GST_INFO("GL_KHR_debug not supported by %" GST_PTR_FORMAT, context);
+    return FALSE;
+  }
+
+  // the state lives as long as the context, so the callback never outlives it
+  state = g_new0(GLDebugState, 1);
+  g_object_set_data_full(G_OBJECT(context), GL_DEBUG_STATE_KEY, state,
+                         g_free);
+
+  if (gl->GetPointerv) {
+    gl->GetPointerv(GL_DEBUG_CALLBACK_FUNCTION, (gpointer *)&state->chain);
+    gl->GetPointerv(GL_DEBUG_CALLBACK_USER_PARAM, &state->chain_data);
+  }
+
+  // errors are reported inside the call causing them, so they can be told
+  // apart from the errors of other users of the context
+  gl->Enable(GL_DEBUG_OUTPUT);
+  gl->Enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  gl->DebugMessageCallback(gl_debug_callback, state);
+
+  GST_DEBUG("installed GL_KHR_debug callback on %" GST_PTR_FORMAT, context);
+
+  return TRUE;
+}
+
+void gl_debug_begin(GstGLContext *context) {
+  GLDebugState *state =
+      g_object_get_data(G_OBJECT(context), GL_DEBUG_STATE_KEY);
+
+  if (state && state->depth++ == 0)
+    state->errors = 0;
+}
+
+guint gl_debug_end(GstGLContext *context) {
+  GLDebugState *state =
+      g_object_get_data(G_OBJECT(context), GL_DEBUG_STATE_KEY);
+
+  if (!state || state->depth == 0)
+    return 0;
+
+  state->depth--;
+
+  return state->errors;
+}
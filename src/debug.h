@@ -21,13 +21,53 @@ G_BEGIN_DECLS
 #define GL_CONTEXT_LOST 0x0507
 
 /**
- * @brief Print the current OpenGL error to stderr.
+ * @brief Log and clear the pending OpenGL errors.
+ *
+ * glGetError() waits for the GL thread to catch up on many drivers, so this
+ * is too expensive to call on every frame by default.
+ *
+ * @param context The OpenGL context.
+ * @param data The GstObject to log the errors for, may be NULL.
+ * @return The first pending error, GL_NO_ERROR if there was none.
+ */
+guint gl_error_handler(GstGLContext *context, gpointer data);
+
+/**
+ * @brief Whether an OpenGL error leaves the context unusable.
+ */
+gboolean gl_error_is_fatal(guint error);
+
+/**
+ * @brief Route the GL_KHR_debug messages of a context into the debug log.
+ *
+ * Messages are reported synchronously, inside the GL call causing them, and
+ * passed on to a callback that was installed before. Only installed once per
+ * context, must be called from the GL thread.
+ *
+ * @param context The OpenGL context.
+ * @return FALSE if the context doesn't support GL_KHR_debug.
+ */
+gboolean gl_debug_init(GstGLContext *context);
+
+/**
+ * @brief Start counting the errors the driver reports for a context.
+ *
+ * Only errors raised between this and gl_debug_end() on the GL thread are
+ * counted, not those of other elements sharing the context. Calls nest.
+ *
+ * @param context The OpenGL context, with gl_debug_init() called on it.
+ */
+void gl_debug_begin(GstGLContext *context);
+
+/**
+ * @brief Stop counting errors started with gl_debug_begin().
  *
  * @param context The OpenGL context.
- * @param data Unused.
+ * @return The errors raised since the outermost gl_debug_begin(), 0 if
+ *         gl_debug_init() failed.
  */
-void gl_error_handler(GstGLContext *context, gpointer data);
+guint gl_debug_end(GstGLContext *context);
 
 G_END_DECLS
 
-#endif /* __GST_PROJECTM_DEBUG_H__ */
\ No newline at end of file
+#endif /* __GST_PROJECTM_DEBUG_H__ */
@@ -0,0 +1,83 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "dirwalk.h"
+
+struct _DirWalk {
+  GQueue queue; /* directories left to walk */
+  gchar *dir_path;
+  GDir *dir;
+  gchar *entry_path;
+};
+
+DirWalk *dir_walk_new(void) {
+  DirWalk *walk = g_new0(DirWalk, 1);
+
+  g_queue_init(&walk->queue);
+
+  return walk;
+}
+
+void dir_walk_free(DirWalk *walk) {
+  g_queue_clear_full(&walk->queue, g_free);
+  if (walk->dir)
+    g_dir_close(walk->dir);
+  g_free(walk->dir_path);
+  g_free(walk->entry_path);
+  g_free(walk);
+}
+
+void dir_walk_push(DirWalk *walk, const gchar *path) {
+  g_queue_push_tail(&walk->queue, g_strdup(path));
+}
+
+void dir_walk_skip(DirWalk *walk) {
+  g_clear_pointer(&walk->dir, g_dir_close);
+}
+
+DirWalkEvent dir_walk_next(DirWalk *walk, const gchar **path, GError **error) {
+  const gchar *name;
+
+  g_clear_pointer(&walk->entry_path, g_free);
+
+  while (walk->dir) {
+    name = g_dir_read_name(walk->dir);
+    if (!name) {
+      g_clear_pointer(&walk->dir, g_dir_close);
+      break;
+    }
+
+    walk->entry_path = g_build_filename(walk->dir_path, name, NULL);
+    *path = walk->entry_path;
+
+    if (dir_walk_is_subdir(walk->entry_path)) {
+      dir_walk_push(walk, walk->entry_path);
+      return DIR_WALK_SUBDIR;
+    }
+
+    // a symlinked directory is neither walked nor a file
+    if (g_file_test(walk->entry_path, G_FILE_TEST_IS_DIR)) {
+      g_clear_pointer(&walk->entry_path, g_free);
+      continue;
+    }
+
+    return DIR_WALK_FILE;
+  }
+
+  g_free(walk->dir_path);
+  walk->dir_path = g_queue_pop_head(&walk->queue);
+  if (!walk->dir_path)
+    return DIR_WALK_DONE;
+
+  *path = walk->dir_path;
+  walk->dir = g_dir_open(walk->dir_path, 0, error);
+
+  return walk->dir ? DIR_WALK_ENTER : DIR_WALK_ERROR;
+}
+
+gboolean dir_walk_is_subdir(const gchar *path) {
+  // symlinked directories could loop
+  return g_file_test(path, G_FILE_TEST_IS_DIR) &&
+         !g_file_test(path, G_FILE_TEST_IS_SYMLINK);
+}
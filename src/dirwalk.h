@@ -0,0 +1,66 @@
+#ifndef __GST_PROJECTM_DIRWALK_H__
+#define __GST_PROJECTM_DIRWALK_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Breadth first walk of directory trees, one entry at a time.
+ *
+ * Directories are listed in the order they were found, so the walk can be
+ * interrupted between entries and picked up again, and more directories can
+ * be queued at any time. Symlinked directories are not descended into.
+ */
+typedef struct _DirWalk DirWalk;
+
+typedef enum {
+  DIR_WALK_DONE,   /* no directories left */
+  DIR_WALK_ENTER,  /* a directory was opened, see dir_walk_skip() */
+  DIR_WALK_SUBDIR, /* a subdirectory, queued to be walked */
+  DIR_WALK_FILE,   /* any other entry */
+  DIR_WALK_ERROR,  /* a directory could not be opened */
+} DirWalkEvent;
+
+/**
+ * @brief Create a walk without directories.
+ */
+DirWalk *dir_walk_new(void);
+
+/**
+ * @brief Free the walk and the directories left in it.
+ */
+void dir_walk_free(DirWalk *walk);
+
+/**
+ * @brief Queue a directory to be walked after the ones queued before.
+ */
+void dir_walk_push(DirWalk *walk, const gchar *path);
+
+/**
+ * @brief Leave out the entries of the directory DIR_WALK_ENTER was returned
+ * for.
+ */
+void dir_walk_skip(DirWalk *walk);
+
+/**
+ * @brief Get the next event of the walk.
+ *
+ * @param walk The walk.
+ * @param path Set to the directory or entry of the event, valid until the
+ * next call.
+ * @param error Set for DIR_WALK_ERROR, may be NULL.
+ * @return The event, DIR_WALK_DONE until another directory is pushed.
+ */
+DirWalkEvent dir_walk_next(DirWalk *walk, const gchar **path, GError **error);
+
+/**
+ * @brief Whether a path is a directory the walk would descend into.
+ *
+ * Symlinked directories are not, they could loop.
+ */
+gboolean dir_walk_is_subdir(const gchar *path);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_DIRWALK_H__ */
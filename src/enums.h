@@ -24,9 +24,24 @@ enum {
   PROP_EASTER_EGG,
   PROP_PRESET_LOCKED,
   PROP_SHUFFLE_PRESETS,
-  PROP_ENABLE_PLAYLIST
+  PROP_ENABLE_PLAYLIST,
+  PROP_OFFLINE,
+  PROP_PRESET_INDEX,
+  PROP_WATCH_PRESETS,
+  PROP_CHECK_GL_ERRORS,
+  PROP_PRESET_SEED,
+  PROP_ANALYSIS_META,
+  PROP_ANALYSIS_MESSAGES,
+  PROP_PRESET_COSTS,
+  PROP_FRAME_BUDGET,
+  PROP_TEXTURE_CACHE_SIZE
 };
 
+/**
+ * @brief Bit of a property in a mask of changed properties
+ */
+#define PROP_BIT(id) (1u << (id))
+
 G_END_DECLS
 
 #endif /* __GST_PROJECTM_ENUMS_H__ */
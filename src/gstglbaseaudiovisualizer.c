@@ -34,45 +34,207 @@
 #include "config.h"
 #endif
 
+#include "colorconvert.h"
+#include "contextpool.h"
 #include "gstglbaseaudiovisualizer.h"
+#include "readback.h"
+#include "renderqueue.h"
+#include "renderstats.h"
+#include "rendertarget.h"
 #include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+#include <gst/video/gstvideopool.h>
+
+#if GST_GL_HAVE_PLATFORM_EGL && GST_CHECK_VERSION(1, 24, 0)
+#include <gst/gl/egl/gstgldisplay_egl.h>
+#define HAVE_SURFACELESS_DISPLAY 1
+#endif
 
 /**
  * SECTION:GstGLBaseAudioVisualizer
- * @short_description: #GstAudioVisualizer subclass for injecting OpenGL
+ * @short_description: #GstPMAudioVisualizer subclass for injecting OpenGL
  * resources in a pipeline
  * @title: GstGLBaseAudioVisualizer
- * @see_also: #GstAudioVisualizer
+ * @see_also: #GstPMAudioVisualizer
  *
- * Wrapper for GstAudioVisualizer for handling OpenGL contexts.
+ * Wrapper for GstPMAudioVisualizer for handling OpenGL contexts.
  *
  * #GstGLBaseAudioVisualizer handles the nitty gritty details of retrieving an
  * OpenGL context. It also provides `gl_start()` and `gl_stop()` virtual methods
  * that ensure an OpenGL context is available and current in the calling thread
  * for initializing and cleaning up OpenGL dependent resources. The `gl_render`
  * virtual method is used to perform OpenGL rendering.
+ *
+ * If downstream accepts memory:GLMemory caps, output buffers are allocated from
+ * a #GstGLBufferPool and the frame `gl_render` renders offscreen is copied
+ * into the output texture on the GPU. Otherwise the frame is converted and
+ * read back into buffers from a plain system memory pool. Either way it is
+ * flipped on the GPU: GL renders bottom up, GStreamer frames and GL textures
+ * start with the top row.
+ *
+ * #GstGLBaseAudioVisualizer:render-width and
+ * #GstGLBaseAudioVisualizer:render-height decouple the resolution `gl_render`
+ * renders at from the output size. The frame is then rendered into an
+ * intermediate framebuffer and scaled to the output size on the GPU.
+ *
+ * With #GstGLBaseAudioVisualizer:surfaceless set and no GL display shared by
+ * other elements, a surfaceless EGL display is used. Rendering then only
+ * needs an EGL driver (e.g. Mesa llvmpipe) and no window system.
+ *
+ * With #GstGLBaseAudioVisualizer:readback-depth greater than zero, readback
+ * is asynchronous: pixels are copied into a ring of pixel buffer objects and
+ * each frame is only output after that many later frames have been rendered,
+ * so the CPU does not wait for the GPU to finish the current frame.
+ *
+ * With #GstGLBaseAudioVisualizer:pipeline-depth greater than zero, frames are
+ * rendered on a thread of their own. The streaming thread hands over the audio
+ * of a frame and goes on with the next while it renders, output lags by up to
+ * that many frames. Pipelining is not supported together with renditions,
+ * frames are rendered on the streaming thread while a rendition is
+ * negotiated, so each rendition is scaled from the frame it belongs to.
+ *
+ * With #GstGLBaseAudioVisualizer:stats-interval set, the time spent in each
+ * stage of rendering a frame is measured and an element message named
+ * "projectm-stats" with the mean and maximum per stage is posted at that
+ * interval.
+ *
+ * Renditions (requested "src_%u" pads) are scaled on the GPU from the frame
+ * `gl_render` rendered, at the render size, so a ladder of output sizes costs
+ * a single render. Renditions in system memory are read back synchronously.
+ *
+ * With #GstGLBaseAudioVisualizer:shared-contexts set, the element doesn't get
+ * a GL context and thread of its own but shares one of a process wide set of
+ * that many contexts with the other elements that set it. Their frames are
+ * rendered in the order they were submitted.
+ *
+ * With #GstGLBaseAudioVisualizer:adaptive-quality set, the element lowers the
+ * #GstGLBaseAudioVisualizer:quality-level when rendering takes most of the
+ * frame duration or downstream QoS reports late frames, and raises it again
+ * once there is headroom. Each level renders at a smaller size, subclasses
+ * reduce their own detail by gst_gl_base_audio_visualizer_get_quality_scale().
+ * Frames that are already late are skipped before that, as long as QoS is
+ * enabled.
  */
 
 #define GST_CAT_DEFAULT gst_gl_base_audio_visualizer_debug
 GST_DEBUG_CATEGORY_STATIC(GST_CAT_DEFAULT);
 
+#define DEFAULT_READBACK_DEPTH 0
+#define DEFAULT_PIPELINE_DEPTH 0
+#define DEFAULT_RENDER_WIDTH 0
+#define DEFAULT_RENDER_HEIGHT 0
+#define DEFAULT_SURFACELESS FALSE
+#define DEFAULT_STATS_INTERVAL 0
+#define DEFAULT_SHARED_CONTEXTS 0
+#define DEFAULT_ADAPTIVE_QUALITY FALSE
+
+/* render size factor of each quality level, the last one is the lowest */
+static const gdouble quality_scales[] = {1.0, 0.8, 0.65, 0.5, 0.35};
+#define QUALITY_LEVEL_MAX (G_N_ELEMENTS(quality_scales) - 1)
+
+/* fraction of the frame duration spent rendering above which the quality is
+ * lowered, and below which it is raised again */
+#define QUALITY_LOAD_HIGH 0.85
+#define QUALITY_LOAD_LOW 0.5
+/* seconds the load has to stay beyond a threshold before the level changes,
+ * raising waits longer so the level doesn't flip back and forth */
+#define QUALITY_LOWER_DELAY 0.5
+#define QUALITY_RAISE_DELAY 3.0
+
 struct _GstGLBaseAudioVisualizerPrivate {
   GstGLContext *other_context;
 
   gint64 n_frames; /* total frames sent */
-  gboolean gl_result;
   gboolean gl_started;
 
+  /* negotiated caps carry the memory:GLMemory feature */
+  gboolean gl_memory_output;
+
+  /* create a surfaceless EGL display, with the context lock */
+  gboolean surfaceless;
+
+  /* size of the shared context pool to take the context from (0 for an own
+   * context) and whether it was, with the context lock */
+  guint shared_contexts;
+  gboolean pooled_context;
+
+  /* wraps the output texture for memory:GLMemory output */
+  RenderTarget output_target;
+
+  /* offscreen target that is read back for system memory output */
+  RenderTarget readback_target;
+
+  /* intermediate target when rendering at a different size than the output */
+  RenderTarget scale_target;
+
+  /* the target holding the last rendered frame at render size, GL thread */
+  RenderTarget *frame_target;
+
+  /* converts system memory output to its format before readback, created on
+   * first use, GL thread */
+  ColorConvert *convert;
+  RenderTarget convert_target;
+  /* planes of the system memory output in the converted image */
+  ReadbackLayout layout;
+
+  /* GstPMAudioVisualizerRendition -> RenderTarget, GL thread */
+  GHashTable *rendition_targets;
+
+  /* requested render size (with the object lock) and the one in use */
+  gint render_width_prop;
+  gint render_height_prop;
+  gint render_width;
+  gint render_height;
+
+  /* asynchronous readback, depth is protected by the object lock */
+  guint readback_depth;
+  ReadbackRing *readback_ring;
+  /* frames the ring holds back, with the object lock */
+  guint readback_delay;
+
+  /* pipelined rendering, the depth is protected by the object lock, the queue
+   * and the warning flag are used by the streaming thread */
+  guint pipeline_depth;
+  RenderQueue *render_queue;
+  gboolean warned_renditions;
+
+  /* adaptive quality, the flag and level are protected by the object lock,
+   * the rest is streaming thread only */
+  gboolean adaptive_quality;
+  guint quality_level;
+  gdouble quality_load;
+  guint quality_over;
+  guint quality_under;
+
+  /* stage timing, the interval (ms) is protected by the object lock */
+  guint stats_interval;
+  gboolean stats_active;
+  RenderStats stats;
+
   GRecMutex context_lock;
 };
 
 /* Properties */
-enum { PROP_0 };
+enum {
+  PROP_0,
+  PROP_READBACK_DEPTH,
+  PROP_RENDER_WIDTH,
+  PROP_RENDER_HEIGHT,
+  PROP_SURFACELESS,
+  PROP_STATS_INTERVAL,
+  PROP_SHARED_CONTEXTS,
+  PROP_ADAPTIVE_QUALITY,
+  PROP_QUALITY_LEVEL,
+  PROP_PIPELINE_DEPTH,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
 
 #define gst_gl_base_audio_visualizer_parent_class parent_class
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE(
     GstGLBaseAudioVisualizer, gst_gl_base_audio_visualizer,
-    GST_TYPE_AUDIO_VISUALIZER,
+    GST_TYPE_PM_AUDIO_VISUALIZER,
     G_ADD_PRIVATE(GstGLBaseAudioVisualizer)
         GST_DEBUG_CATEGORY_INIT(gst_gl_base_audio_visualizer_debug,
                                 "glbaseaudiovisualizer", 0,
@@ -94,14 +256,31 @@ static GstStateChangeReturn
 gst_gl_base_audio_visualizer_change_state(GstElement *element,
                                           GstStateChange transition);
 
-static gboolean gst_gl_base_audio_visualizer_render(GstAudioVisualizer *bscope,
-                                                    GstBuffer *audio,
-                                                    GstVideoFrame *video);
+static GstFlowReturn
+gst_gl_base_audio_visualizer_render(GstPMAudioVisualizer *bscope,
+                                    GstBuffer *audio, GstBuffer *video);
+static GstFlowReturn
+gst_gl_base_audio_visualizer_drain(GstPMAudioVisualizer *bscope,
+                                   GstBuffer *video);
+static void gst_gl_base_audio_visualizer_flush(GstPMAudioVisualizer *bscope);
+static GstFlowReturn
+gst_gl_base_audio_visualizer_pop_frame(GstPMAudioVisualizer *bscope,
+                                       gboolean drain, GstBuffer **video);
+static void gst_gl_base_audio_visualizer_update_output_delay(
+    GstGLBaseAudioVisualizer *glav);
 static void gst_gl_base_audio_visualizer_start(GstGLBaseAudioVisualizer *glav);
 static void gst_gl_base_audio_visualizer_stop(GstGLBaseAudioVisualizer *glav);
 static gboolean
-gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
+gst_gl_base_audio_visualizer_decide_allocation(GstPMAudioVisualizer *gstav,
                                                GstQuery *query);
+static gboolean gst_gl_base_audio_visualizer_decide_rendition_allocation(
+    GstPMAudioVisualizer *gstav, GstPMAudioVisualizerRendition *rendition,
+    GstQuery *query);
+static GstFlowReturn gst_gl_base_audio_visualizer_render_rendition(
+    GstPMAudioVisualizer *bscope, GstPMAudioVisualizerRendition *rendition,
+    GstBuffer *video);
+static void gst_gl_base_audio_visualizer_release_rendition(
+    GstPMAudioVisualizer *bscope, GstPMAudioVisualizerRendition *rendition);
 
 static gboolean
 gst_gl_base_audio_visualizer_default_setup(GstGLBaseAudioVisualizer *glav);
@@ -110,17 +289,19 @@ gst_gl_base_audio_visualizer_default_gl_start(GstGLBaseAudioVisualizer *glav);
 static void
 gst_gl_base_audio_visualizer_default_gl_stop(GstGLBaseAudioVisualizer *glav);
 static gboolean gst_gl_base_audio_visualizer_default_gl_render(
-    GstGLBaseAudioVisualizer *glav, GstBuffer *audio, GstVideoFrame *video);
+    GstGLBaseAudioVisualizer *glav, GstBuffer *audio, GstBuffer *video,
+    guint fbo);
 
 static gboolean gst_gl_base_audio_visualizer_find_gl_context_unlocked(
     GstGLBaseAudioVisualizer *glav);
 
-static gboolean gst_gl_base_audio_visualizer_setup(GstAudioVisualizer *gstav);
+static gboolean
+gst_gl_base_audio_visualizer_setup(GstPMAudioVisualizer *gstav);
 
 static void
 gst_gl_base_audio_visualizer_class_init(GstGLBaseAudioVisualizerClass *klass) {
   GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
-  GstAudioVisualizerClass *gstav_class = GST_AUDIO_VISUALIZER_CLASS(klass);
+  GstPMAudioVisualizerClass *gstav_class = GST_PM_AUDIO_VISUALIZER_CLASS(klass);
   GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
 
   gobject_class->finalize = gst_gl_base_audio_visualizer_finalize;
@@ -138,6 +319,103 @@ gst_gl_base_audio_visualizer_class_init(GstGLBaseAudioVisualizerClass *klass) {
   gstav_class->setup = GST_DEBUG_FUNCPTR(gst_gl_base_audio_visualizer_setup);
 
   gstav_class->render = GST_DEBUG_FUNCPTR(gst_gl_base_audio_visualizer_render);
+  gstav_class->drain = GST_DEBUG_FUNCPTR(gst_gl_base_audio_visualizer_drain);
+  gstav_class->flush = GST_DEBUG_FUNCPTR(gst_gl_base_audio_visualizer_flush);
+  gstav_class->pop_frame =
+      GST_DEBUG_FUNCPTR(gst_gl_base_audio_visualizer_pop_frame);
+  gstav_class->decide_rendition_allocation = GST_DEBUG_FUNCPTR(
+      gst_gl_base_audio_visualizer_decide_rendition_allocation);
+  gstav_class->render_rendition =
+      GST_DEBUG_FUNCPTR(gst_gl_base_audio_visualizer_render_rendition);
+  gstav_class->release_rendition =
+      GST_DEBUG_FUNCPTR(gst_gl_base_audio_visualizer_release_rendition);
+
+  g_object_class_install_property(
+      gobject_class, PROP_READBACK_DEPTH,
+      g_param_spec_uint(
+          "readback-depth", "Readback Depth",
+          "Number of frames read back asynchronously for system memory output. "
+          "Output lags rendering by this many frames, which lets the GPU and "
+          "CPU work in parallel. 0 reads every frame back synchronously.",
+          0, 16, DEFAULT_READBACK_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PIPELINE_DEPTH,
+      g_param_spec_uint(
+          "pipeline-depth", "Pipeline Depth",
+          "Number of frames rendered on a separate thread while the streaming "
+          "thread goes on with the next ones. Output lags by up to this many "
+          "frames. 0 renders every frame on the streaming thread, as do "
+          "elements with renditions.",
+          0, 16, DEFAULT_PIPELINE_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_RENDER_WIDTH,
+      g_param_spec_int(
+          "render-width", "Render Width",
+          "Width to render at, the frame is scaled to the output width on the "
+          "GPU. 0 renders at the output width, or keeps the output aspect "
+          "ratio if render-height is set.",
+          0, G_MAXINT, DEFAULT_RENDER_WIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_RENDER_HEIGHT,
+      g_param_spec_int(
+          "render-height", "Render Height",
+          "Height to render at, the frame is scaled to the output height on "
+          "the GPU. 0 renders at the output height, or keeps the output "
+          "aspect ratio if render-width is set.",
+          0, G_MAXINT, DEFAULT_RENDER_HEIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SURFACELESS,
+      g_param_spec_boolean(
+          "surfaceless", "Surfaceless",
+          "Render with a surfaceless EGL display that needs no window system "
+          "(X11, Wayland), unless another element shares its GL display. "
+          "Requires GStreamer 1.24 with EGL support.",
+          DEFAULT_SURFACELESS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint(
+          "stats-interval", "Stats Interval",
+          "Interval in milliseconds at which per-stage render timings are "
+          "posted as \"projectm-stats\" element messages. 0 disables timing.",
+          0, G_MAXUINT, DEFAULT_STATS_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SHARED_CONTEXTS,
+      g_param_spec_uint(
+          "shared-contexts", "Shared Contexts",
+          "Share a GL context and thread with the other elements of the "
+          "process that set this, out of at most this many. 0 creates a "
+          "context for the element, unless a neighbouring GL element has one. "
+          "Takes effect when the element starts.",
+          0, 64, DEFAULT_SHARED_CONTEXTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ADAPTIVE_QUALITY,
+      g_param_spec_boolean(
+          "adaptive-quality", "Adaptive Quality",
+          "Lower the render size and detail step by step when rendering can't "
+          "keep up with the framerate, and raise them again when it can. Has "
+          "no effect while QoS is disabled, e.g. for offline rendering.",
+          DEFAULT_ADAPTIVE_QUALITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  properties[PROP_QUALITY_LEVEL] = g_param_spec_uint(
+      "quality-level", "Quality Level",
+      "Current quality level picked by adaptive-quality, 0 is full quality.",
+      0, QUALITY_LEVEL_MAX, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property(gobject_class, PROP_QUALITY_LEVEL,
+                                  properties[PROP_QUALITY_LEVEL]);
 
   klass->supported_gl_api = GST_GL_API_ANY;
   klass->gl_start =
@@ -152,7 +430,27 @@ gst_gl_base_audio_visualizer_class_init(GstGLBaseAudioVisualizerClass *klass) {
 static void gst_gl_base_audio_visualizer_init(GstGLBaseAudioVisualizer *glav) {
   glav->priv = gst_gl_base_audio_visualizer_get_instance_private(glav);
   glav->priv->gl_started = FALSE;
-  glav->priv->gl_result = TRUE;
+  glav->priv->gl_memory_output = FALSE;
+  glav->priv->surfaceless = DEFAULT_SURFACELESS;
+  glav->priv->shared_contexts = DEFAULT_SHARED_CONTEXTS;
+  glav->priv->adaptive_quality = DEFAULT_ADAPTIVE_QUALITY;
+  glav->priv->quality_level = 0;
+  glav->priv->pooled_context = FALSE;
+  glav->priv->render_width_prop = DEFAULT_RENDER_WIDTH;
+  glav->priv->render_height_prop = DEFAULT_RENDER_HEIGHT;
+  glav->priv->render_width = 0;
+  glav->priv->render_height = 0;
+  glav->priv->readback_depth = DEFAULT_READBACK_DEPTH;
+  glav->priv->readback_ring = NULL;
+  glav->priv->readback_delay = 0;
+  glav->priv->pipeline_depth = DEFAULT_PIPELINE_DEPTH;
+  glav->priv->render_queue = NULL;
+  glav->priv->warned_renditions = FALSE;
+  glav->priv->stats_interval = DEFAULT_STATS_INTERVAL;
+  glav->priv->stats_active = FALSE;
+  glav->priv->frame_target = NULL;
+  glav->priv->rendition_targets =
+      g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
   glav->context = NULL;
   g_rec_mutex_init(&glav->priv->context_lock);
   gst_gl_base_audio_visualizer_start(glav);
@@ -160,8 +458,12 @@ static void gst_gl_base_audio_visualizer_init(GstGLBaseAudioVisualizer *glav) {
 
 static void gst_gl_base_audio_visualizer_finalize(GObject *object) {
   GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(object);
+
+  if (glav->priv->render_queue)
+    render_queue_free(glav->priv->render_queue);
   gst_gl_base_audio_visualizer_stop(glav);
 
+  g_hash_table_unref(glav->priv->rendition_targets);
   g_rec_mutex_clear(&glav->priv->context_lock);
 
   G_OBJECT_CLASS(parent_class)->finalize(object);
@@ -174,6 +476,47 @@ static void gst_gl_base_audio_visualizer_set_property(GObject *object,
   GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(object);
 
   switch (prop_id) {
+  case PROP_READBACK_DEPTH:
+    GST_OBJECT_LOCK(glav);
+    glav->priv->readback_depth = g_value_get_uint(value);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_PIPELINE_DEPTH:
+    GST_OBJECT_LOCK(glav);
+    glav->priv->pipeline_depth = g_value_get_uint(value);
+    GST_OBJECT_UNLOCK(glav);
+    gst_gl_base_audio_visualizer_update_output_delay(glav);
+    break;
+  case PROP_RENDER_WIDTH:
+    GST_OBJECT_LOCK(glav);
+    glav->priv->render_width_prop = g_value_get_int(value);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_RENDER_HEIGHT:
+    GST_OBJECT_LOCK(glav);
+    glav->priv->render_height_prop = g_value_get_int(value);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_SURFACELESS:
+    g_rec_mutex_lock(&glav->priv->context_lock);
+    glav->priv->surfaceless = g_value_get_boolean(value);
+    g_rec_mutex_unlock(&glav->priv->context_lock);
+    break;
+  case PROP_STATS_INTERVAL:
+    GST_OBJECT_LOCK(glav);
+    glav->priv->stats_interval = g_value_get_uint(value);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_SHARED_CONTEXTS:
+    g_rec_mutex_lock(&glav->priv->context_lock);
+    glav->priv->shared_contexts = g_value_get_uint(value);
+    g_rec_mutex_unlock(&glav->priv->context_lock);
+    break;
+  case PROP_ADAPTIVE_QUALITY:
+    GST_OBJECT_LOCK(glav);
+    glav->priv->adaptive_quality = g_value_get_boolean(value);
+    GST_OBJECT_UNLOCK(glav);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -187,12 +530,83 @@ static void gst_gl_base_audio_visualizer_get_property(GObject *object,
   GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(object);
 
   switch (prop_id) {
+  case PROP_READBACK_DEPTH:
+    GST_OBJECT_LOCK(glav);
+    g_value_set_uint(value, glav->priv->readback_depth);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_PIPELINE_DEPTH:
+    GST_OBJECT_LOCK(glav);
+    g_value_set_uint(value, glav->priv->pipeline_depth);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_RENDER_WIDTH:
+    GST_OBJECT_LOCK(glav);
+    g_value_set_int(value, glav->priv->render_width_prop);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_RENDER_HEIGHT:
+    GST_OBJECT_LOCK(glav);
+    g_value_set_int(value, glav->priv->render_height_prop);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_SURFACELESS:
+    g_rec_mutex_lock(&glav->priv->context_lock);
+    g_value_set_boolean(value, glav->priv->surfaceless);
+    g_rec_mutex_unlock(&glav->priv->context_lock);
+    break;
+  case PROP_STATS_INTERVAL:
+    GST_OBJECT_LOCK(glav);
+    g_value_set_uint(value, glav->priv->stats_interval);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_SHARED_CONTEXTS:
+    g_rec_mutex_lock(&glav->priv->context_lock);
+    g_value_set_uint(value, glav->priv->shared_contexts);
+    g_rec_mutex_unlock(&glav->priv->context_lock);
+    break;
+  case PROP_ADAPTIVE_QUALITY:
+    GST_OBJECT_LOCK(glav);
+    g_value_set_boolean(value, glav->priv->adaptive_quality);
+    GST_OBJECT_UNLOCK(glav);
+    break;
+  case PROP_QUALITY_LEVEL:
+    GST_OBJECT_LOCK(glav);
+    g_value_set_uint(value, glav->priv->quality_level);
+    GST_OBJECT_UNLOCK(glav);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
   }
 }
 
+/* drop the context, a shared one is given back to the pool, with the context
+ * lock */
+static void gst_gl_base_audio_visualizer_clear_context_unlocked(
+    GstGLBaseAudioVisualizer *glav) {
+  if (glav->context) {
+    if (glav->priv->pooled_context)
+      context_pool_release(glav->context);
+    else
+      gst_object_unref(glav->context);
+  }
+
+  glav->context = NULL;
+  glav->priv->pooled_context = FALSE;
+}
+
+/* run a function on the GL thread, a shared context serves the elements in
+ * turn, with the context lock */
+static void gst_gl_base_audio_visualizer_thread_add(
+    GstGLBaseAudioVisualizer *glav, GstGLContextThreadFunc func,
+    gpointer data) {
+  if (glav->priv->pooled_context)
+    context_pool_thread_add(glav->context, func, data);
+  else
+    gst_gl_context_thread_add(glav->context, func, data);
+}
+
 static void gst_gl_base_audio_visualizer_set_context(GstElement *element,
                                                      GstContext *context) {
   GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(element);
@@ -210,7 +624,7 @@ static void gst_gl_base_audio_visualizer_set_context(GstElement *element,
 
   if (old_display && new_display) {
     if (old_display != new_display) {
-      gst_clear_object(&glav->context);
+      gst_gl_base_audio_visualizer_clear_context_unlocked(glav);
       if (gst_gl_base_audio_visualizer_find_gl_context_unlocked(glav)) {
         // TODO does this need to be handled ?
         // gst_pad_mark_reconfigure (GST_BASE_SRC_PAD (glav));
@@ -250,6 +664,32 @@ static void gst_gl_base_audio_visualizer_gl_start(GstGLContext *context,
 static void
 gst_gl_base_audio_visualizer_default_gl_stop(GstGLBaseAudioVisualizer *glav) {}
 
+/* free the render targets and readback ring owned by the base class, GL
+ * thread */
+static void
+gst_gl_base_audio_visualizer_free_gl_resources(GstGLBaseAudioVisualizer *glav) {
+  GHashTableIter iter;
+  RenderTarget *target;
+
+  if (glav->priv->readback_ring) {
+    readback_ring_free(glav->priv->readback_ring);
+    glav->priv->readback_ring = NULL;
+  }
+  render_target_clear(&glav->priv->output_target, glav->context);
+  render_target_clear(&glav->priv->readback_target, glav->context);
+  render_target_clear(&glav->priv->scale_target, glav->context);
+  render_target_clear(&glav->priv->convert_target, glav->context);
+  glav->priv->frame_target = NULL;
+
+  color_convert_free(glav->priv->convert);
+  glav->priv->convert = NULL;
+
+  g_hash_table_iter_init(&iter, glav->priv->rendition_targets);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&target))
+    render_target_clear(target, glav->context);
+  g_hash_table_remove_all(glav->priv->rendition_targets);
+}
+
 static void gst_gl_base_audio_visualizer_gl_stop(GstGLContext *context,
                                                  gpointer data) {
   GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(data);
@@ -263,13 +703,81 @@ static void gst_gl_base_audio_visualizer_gl_stop(GstGLContext *context,
   if (glav->priv->gl_started)
     glav_class->gl_stop(glav);
 
+  gst_gl_base_audio_visualizer_free_gl_resources(glav);
+
   glav->priv->gl_started = FALSE;
 }
 
-static gboolean gst_gl_base_audio_visualizer_setup(GstAudioVisualizer *gstav) {
+/* pick the render size from the properties and the negotiated output size */
+static void gst_gl_base_audio_visualizer_update_render_size(
+    GstGLBaseAudioVisualizer *glav) {
+  GstPMAudioVisualizer *gstav = GST_PM_AUDIO_VISUALIZER(glav);
+  gint out_width = GST_VIDEO_INFO_WIDTH(&gstav->vinfo);
+  gint out_height = GST_VIDEO_INFO_HEIGHT(&gstav->vinfo);
+  gint width, height;
+  gdouble scale;
+
+  GST_OBJECT_LOCK(glav);
+  width = glav->priv->render_width_prop;
+  height = glav->priv->render_height_prop;
+  GST_OBJECT_UNLOCK(glav);
+
+  if (width == 0 && height == 0) {
+    width = out_width;
+    height = out_height;
+  } else if (width == 0) {
+    width = MAX(1, gst_util_uint64_scale_int(out_width, height, out_height));
+  } else if (height == 0) {
+    height = MAX(1, gst_util_uint64_scale_int(out_height, width, out_width));
+  }
+
+  // lower quality levels render smaller, unless the context can't scale
+  scale = quality_scales[glav->priv->quality_level];
+  if (scale < 1.0 &&
+      (!glav->context || render_target_can_blit(glav->context))) {
+    width = MAX(1, (gint)(width * scale));
+    height = MAX(1, (gint)(height * scale));
+  }
+
+  glav->priv->render_width = width;
+  glav->priv->render_height = height;
+
+  GST_DEBUG_OBJECT(glav, "rendering at %dx%d for %dx%d output", width, height,
+                   out_width, out_height);
+}
+
+/**
+ * gst_gl_base_audio_visualizer_get_render_size:
+ * @glav: a #GstGLBaseAudioVisualizer
+ * @width: (out): width of the framebuffer passed to `gl_render`
+ * @height: (out): height of the framebuffer passed to `gl_render`
+ *
+ * Get the size `gl_render` renders at, valid after `setup`.
+ */
+void gst_gl_base_audio_visualizer_get_render_size(
+    GstGLBaseAudioVisualizer *glav, gint *width, gint *height) {
+  *width = glav->priv->render_width;
+  *height = glav->priv->render_height;
+}
+
+static gboolean
+gst_gl_base_audio_visualizer_setup(GstPMAudioVisualizer *gstav) {
   GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(gstav);
   GstGLBaseAudioVisualizerClass *glav_class =
       GST_GL_BASE_AUDIO_VISUALIZER_GET_CLASS(gstav);
+  const GstVideoFormat video_format = GST_VIDEO_INFO_FORMAT(&gstav->vinfo);
+
+  if (!color_convert_get_layout(&gstav->vinfo, &glav->priv->layout)) {
+    GST_ERROR_OBJECT(glav, "Unsupported video format: %s",
+                     gst_video_format_to_string(video_format));
+    return FALSE;
+  }
+
+  // frames in flight were rendered for the old format
+  if (glav->priv->render_queue)
+    render_queue_clear(glav->priv->render_queue);
+
+  gst_gl_base_audio_visualizer_update_render_size(glav);
 
   // cascade setup to the derived plugin after gl initialization has been
   // completed
@@ -277,57 +785,495 @@ static gboolean gst_gl_base_audio_visualizer_setup(GstAudioVisualizer *gstav) {
 }
 
 static gboolean gst_gl_base_audio_visualizer_default_gl_render(
-    GstGLBaseAudioVisualizer *glav, GstBuffer *audio, GstVideoFrame *video) {
+    GstGLBaseAudioVisualizer *glav, GstBuffer *audio, GstBuffer *video,
+    guint fbo) {
   return TRUE;
 }
 
+/**
+ * gst_gl_base_audio_visualizer_get_quality_scale:
+ * @glav: a #GstGLBaseAudioVisualizer
+ *
+ * Get the factor of the current quality level, 1.0 at full quality. The
+ * render size already includes it, subclasses scale their own level of
+ * detail with it. Call from `gl_render`.
+ *
+ * Returns: the factor, in (0, 1]
+ */
+gdouble
+gst_gl_base_audio_visualizer_get_quality_scale(GstGLBaseAudioVisualizer *glav) {
+  return quality_scales[glav->priv->quality_level];
+}
+
+/* move to a quality level. Runs where frames are rendered: the streaming
+ * thread, or the render queue thread with pipeline-depth > 0. Frames are
+ * rendered one at a time and setup waits for the queue, so the render size
+ * isn't rewritten concurrently. */
+static void
+gst_gl_base_audio_visualizer_set_quality_level(GstGLBaseAudioVisualizer *glav,
+                                               guint level) {
+  GST_INFO_OBJECT(glav, "quality level %u -> %u, load %.2f",
+                  glav->priv->quality_level, level, glav->priv->quality_load);
+
+  GST_OBJECT_LOCK(glav);
+  glav->priv->quality_level = level;
+  GST_OBJECT_UNLOCK(glav);
+
+  gst_gl_base_audio_visualizer_update_render_size(glav);
+  glav->priv->quality_over = 0;
+  glav->priv->quality_under = 0;
+
+  g_object_notify_by_pspec(G_OBJECT(glav), properties[PROP_QUALITY_LEVEL]);
+}
+
+/* pick the quality level for the next frame from the time the last one took
+ * and downstream QoS, on the thread that rendered it, see
+ * gst_gl_base_audio_visualizer_set_quality_level() */
+static void
+gst_gl_base_audio_visualizer_update_quality(GstGLBaseAudioVisualizer *glav,
+                                            GstClockTime frame_time) {
+  GstPMAudioVisualizer *gstav = GST_PM_AUDIO_VISUALIZER(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  gint fps_n = GST_VIDEO_INFO_FPS_N(&gstav->vinfo);
+  gint fps_d = GST_VIDEO_INFO_FPS_D(&gstav->vinfo);
+  gdouble proportion = 1.0, fps, load;
+  gboolean adaptive;
+
+  GST_OBJECT_LOCK(glav);
+  adaptive = priv->adaptive_quality;
+  GST_OBJECT_UNLOCK(glav);
+
+  // without QoS every frame has to be rendered in full, however long it takes
+  if (!adaptive || fps_n <= 0 || fps_d <= 0 ||
+      !gst_pm_audio_visualizer_get_qos(gstav, &proportion)) {
+    if (priv->quality_level > 0)
+      gst_gl_base_audio_visualizer_set_quality_level(glav, 0);
+    priv->quality_load = 0.0;
+    return;
+  }
+
+  fps = (gdouble)fps_n / fps_d;
+  load = (gdouble)frame_time * fps / GST_SECOND;
+  priv->quality_load = priv->quality_load * 0.9 + load * 0.1;
+
+  if (priv->quality_load > QUALITY_LOAD_HIGH || proportion > 1.05) {
+    priv->quality_under = 0;
+    if (++priv->quality_over >= QUALITY_LOWER_DELAY * fps &&
+        priv->quality_level < QUALITY_LEVEL_MAX)
+      gst_gl_base_audio_visualizer_set_quality_level(glav,
+                                                     priv->quality_level + 1);
+  } else if (priv->quality_load < QUALITY_LOAD_LOW && proportion <= 1.0) {
+    priv->quality_over = 0;
+    if (++priv->quality_under >= QUALITY_RAISE_DELAY * fps &&
+        priv->quality_level > 0)
+      gst_gl_base_audio_visualizer_set_quality_level(glav,
+                                                     priv->quality_level - 1);
+  } else {
+    priv->quality_over = 0;
+    priv->quality_under = 0;
+  }
+}
+
+/**
+ * gst_gl_base_audio_visualizer_stats_begin:
+ * @glav: a #GstGLBaseAudioVisualizer
+ *
+ * Start timing a stage of the current frame, from the streaming thread or the
+ * GL thread while rendering.
+ *
+ * Returns: the start time to pass to gst_gl_base_audio_visualizer_stats_end(),
+ * or GST_CLOCK_TIME_NONE if timing is disabled.
+ */
+GstClockTime
+gst_gl_base_audio_visualizer_stats_begin(GstGLBaseAudioVisualizer *glav) {
+  return glav->priv->stats_active ? gst_util_get_timestamp()
+                                  : GST_CLOCK_TIME_NONE;
+}
+
+/**
+ * gst_gl_base_audio_visualizer_stats_end:
+ * @glav: a #GstGLBaseAudioVisualizer
+ * @stage: the stage that was timed
+ * @begin: the time returned by gst_gl_base_audio_visualizer_stats_begin()
+ *
+ * Record the time spent in @stage since @begin.
+ */
+void gst_gl_base_audio_visualizer_stats_end(GstGLBaseAudioVisualizer *glav,
+                                            RenderStatsStage stage,
+                                            GstClockTime begin) {
+  if (GST_CLOCK_TIME_IS_VALID(begin))
+    render_stats_add(&glav->priv->stats, stage,
+                     gst_util_get_timestamp() - begin);
+}
+
+/* enable or disable timing for the next frame and post the statistics once
+ * the interval is over, streaming thread */
+static void
+gst_gl_base_audio_visualizer_update_stats(GstGLBaseAudioVisualizer *glav) {
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  GstClockTime now, interval;
+  guint interval_ms;
+
+  GST_OBJECT_LOCK(glav);
+  interval_ms = priv->stats_interval;
+  GST_OBJECT_UNLOCK(glav);
+
+  if (interval_ms == 0) {
+    priv->stats_active = FALSE;
+    return;
+  }
+
+  now = gst_util_get_timestamp();
+  interval = interval_ms * GST_MSECOND;
+
+  if (!priv->stats_active) {
+    render_stats_reset(&priv->stats, now);
+    priv->stats_active = TRUE;
+  } else if (now - priv->stats.start >= interval) {
+    gst_element_post_message(
+        GST_ELEMENT(glav),
+        gst_message_new_element(GST_OBJECT(glav),
+                                render_stats_to_structure(&priv->stats, now)));
+    render_stats_reset(&priv->stats, now);
+  }
+}
+
+/* render a frame at the render size into the scale target, GL thread */
+static gboolean
+gst_gl_base_audio_visualizer_render_offscreen(GstGLBaseAudioVisualizer *glav,
+                                              GstBuffer *audio,
+                                              GstBuffer *video) {
+  GstGLBaseAudioVisualizerClass *klass =
+      GST_GL_BASE_AUDIO_VISUALIZER_GET_CLASS(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+
+  if (!render_target_ensure(&priv->scale_target, glav->context,
+                            priv->render_width, priv->render_height) ||
+      !klass->gl_render(glav, audio, video, priv->scale_target.fbo))
+    return FALSE;
+
+  priv->frame_target = &priv->scale_target;
+
+  return TRUE;
+}
+
+/* render a frame into the destination target, scaling it if the render size
+ * differs from the output size. The frame stays bottom up as GL renders it,
+ * GL thread */
+static gboolean
+gst_gl_base_audio_visualizer_render_to_target(GstGLBaseAudioVisualizer *glav,
+                                              GstBuffer *audio,
+                                              GstBuffer *video,
+                                              RenderTarget *dest) {
+  GstGLBaseAudioVisualizerClass *klass =
+      GST_GL_BASE_AUDIO_VISUALIZER_GET_CLASS(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  GstClockTime begin = gst_gl_base_audio_visualizer_stats_begin(glav);
+  gboolean ret = FALSE;
+
+  priv->frame_target = NULL;
+
+  if (priv->render_width == dest->width &&
+      priv->render_height == dest->height) {
+    ret = klass->gl_render(glav, audio, video, dest->fbo);
+    if (ret)
+      priv->frame_target = dest;
+  } else if (!render_target_can_blit(glav->context)) {
+    GST_ERROR_OBJECT(glav, "GL context can not scale %dx%d frames to %dx%d",
+                     priv->render_width, priv->render_height, dest->width,
+                     dest->height);
+  } else if (gst_gl_base_audio_visualizer_render_offscreen(glav, audio,
+                                                           video)) {
+    render_target_blit(&priv->scale_target, dest, glav->context, FALSE);
+    ret = TRUE;
+  }
+
+  gst_gl_base_audio_visualizer_stats_end(glav, RENDER_STATS_RENDER, begin);
+
+  return ret;
+}
+
+/* copy the rendered frame into an output texture, scaled to its size. GL
+ * renders bottom up while GStreamer GL textures start with the top row, so
+ * the copy is flipped, GL thread */
+static gboolean
+gst_gl_base_audio_visualizer_copy_flipped(GstGLBaseAudioVisualizer *glav,
+                                          RenderTarget *src,
+                                          RenderTarget *dest) {
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+
+  if (render_target_can_blit(glav->context)) {
+    render_target_blit(src, dest, glav->context, TRUE);
+    return TRUE;
+  }
+
+  // contexts without blitting draw it with the conversion shader
+  if (!priv->convert) {
+    priv->convert = color_convert_new(glav->context);
+    if (!priv->convert)
+      return FALSE;
+  }
+
+  color_convert_copy(priv->convert, src, dest);
+
+  return TRUE;
+}
+
+/* tell the base class how many frames output lags behind */
+static void gst_gl_base_audio_visualizer_update_output_delay(
+    GstGLBaseAudioVisualizer *glav) {
+  guint frames;
+
+  GST_OBJECT_LOCK(glav);
+  frames = glav->priv->readback_delay + glav->priv->pipeline_depth;
+  GST_OBJECT_UNLOCK(glav);
+
+  gst_pm_audio_visualizer_set_output_delay(GST_PM_AUDIO_VISUALIZER(glav),
+                                           frames);
+}
+
+/* create, replace or drop the readback ring to match the configured depth,
+ * GL thread */
+static void
+gst_gl_base_audio_visualizer_update_readback(GstGLBaseAudioVisualizer *glav) {
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  guint depth;
+
+  GST_OBJECT_LOCK(glav);
+  depth = priv->readback_depth;
+  GST_OBJECT_UNLOCK(glav);
+
+  if (priv->readback_ring &&
+      !readback_ring_matches(priv->readback_ring, depth, &priv->layout)) {
+    // frames still in flight are lost, this only happens when the readback
+    // depth or the format changes while playing
+    readback_ring_free(priv->readback_ring);
+    priv->readback_ring = NULL;
+  }
+
+  if (depth > 0 && !priv->readback_ring) {
+    if (readback_ring_is_supported(glav->context)) {
+      priv->readback_ring =
+          readback_ring_new(glav->context, depth, &priv->layout);
+    }
+    if (!priv->readback_ring) {
+      GST_WARNING_OBJECT(glav, "asynchronous readback not available, reading "
+                               "back synchronously");
+      GST_OBJECT_LOCK(glav);
+      priv->readback_depth = 0;
+      GST_OBJECT_UNLOCK(glav);
+      depth = 0;
+    }
+  }
+
+  GST_OBJECT_LOCK(glav);
+  priv->readback_delay = depth;
+  GST_OBJECT_UNLOCK(glav);
+
+  gst_gl_base_audio_visualizer_update_output_delay(glav);
+}
+
+/* render offscreen and copy the frame flipped into the texture of a
+ * memory:GLMemory buffer, GL thread */
+static GstFlowReturn
+gst_gl_base_audio_visualizer_render_gl_memory(GstGLBaseAudioVisualizer *glav,
+                                              GstBuffer *audio,
+                                              GstBuffer *video) {
+  GstPMAudioVisualizer *bscope = GST_PM_AUDIO_VISUALIZER(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstGLSyncMeta *sync_meta;
+  GstVideoFrame frame;
+  GstClockTime begin;
+  gboolean rendered;
+  guint texture;
+
+  // GL memory is mapped as texture, so nothing is transferred to or from
+  // system memory. The frame is overwritten completely, no need to read it.
+  if (!gst_video_frame_map(&frame, &bscope->vinfo, video,
+                           GST_MAP_WRITE | GST_MAP_GL)) {
+    GST_ERROR_OBJECT(glav, "failed to map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  texture = *(guint *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0);
+
+  priv->frame_target = NULL;
+  begin = gst_gl_base_audio_visualizer_stats_begin(glav);
+  rendered = gst_gl_base_audio_visualizer_render_offscreen(glav, audio, video);
+  gst_gl_base_audio_visualizer_stats_end(glav, RENDER_STATS_RENDER, begin);
+
+  if (!rendered ||
+      !render_target_wrap(&priv->output_target, glav->context, texture,
+                          GST_VIDEO_FRAME_WIDTH(&frame),
+                          GST_VIDEO_FRAME_HEIGHT(&frame)) ||
+      !gst_gl_base_audio_visualizer_copy_flipped(glav, &priv->scale_target,
+                                                 &priv->output_target))
+    ret = GST_FLOW_ERROR;
+
+  gst_video_frame_unmap(&frame);
+
+  // let downstream wait for the rendering to complete before using the
+  // texture
+  sync_meta = gst_buffer_get_gl_sync_meta(video);
+  if (sync_meta)
+    gst_gl_sync_meta_set_sync_point(sync_meta, glav->context);
+
+  return ret;
+}
+
+/* convert a rendered frame to the layout of a system memory video format,
+ * returns the target to read back from, GL thread */
+static RenderTarget *
+gst_gl_base_audio_visualizer_convert(GstGLBaseAudioVisualizer *glav,
+                                     RenderTarget *src,
+                                     const GstVideoInfo *info,
+                                     const ReadbackLayout *layout,
+                                     RenderTarget *dest) {
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+
+  // every format goes through the shader, it also flips the frame
+  if (!priv->convert) {
+    priv->convert = color_convert_new(glav->context);
+    if (!priv->convert)
+      return NULL;
+  }
+
+  if (!color_convert_run(priv->convert, src, info, layout, dest))
+    return NULL;
+
+  return dest;
+}
+
+/* render offscreen, convert and read back into a system memory buffer, GL
+ * thread */
+static GstFlowReturn
+gst_gl_base_audio_visualizer_render_system_memory(
+    GstGLBaseAudioVisualizer *glav, GstBuffer *audio, GstBuffer *video) {
+  GstPMAudioVisualizer *bscope = GST_PM_AUDIO_VISUALIZER(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  const GstGLFuncs *gl = glav->context->gl_vtable;
+  gint width = GST_VIDEO_INFO_WIDTH(&bscope->vinfo);
+  gint height = GST_VIDEO_INFO_HEIGHT(&bscope->vinfo);
+  GstFlowReturn ret = GST_FLOW_OK;
+  RenderTarget *target;
+  GstVideoFrame frame;
+  GstClockTime begin;
+
+  if (!render_target_ensure(&priv->readback_target, glav->context, width,
+                            height) ||
+      !gst_gl_base_audio_visualizer_render_to_target(glav, audio, video,
+                                                     &priv->readback_target))
+    return GST_FLOW_ERROR;
+
+  begin = gst_gl_base_audio_visualizer_stats_begin(glav);
+
+  target = gst_gl_base_audio_visualizer_convert(
+      glav, &priv->readback_target, &bscope->vinfo, &priv->layout,
+      &priv->convert_target);
+  if (!target) {
+    GST_ERROR_OBJECT(glav, "failed to convert frame to %s",
+                     gst_video_format_to_string(
+                         GST_VIDEO_INFO_FORMAT(&bscope->vinfo)));
+    return GST_FLOW_ERROR;
+  }
+
+  gst_gl_base_audio_visualizer_update_readback(glav);
+
+  if (!gst_video_frame_map(&frame, &bscope->vinfo, video, GST_MAP_WRITE)) {
+    GST_ERROR_OBJECT(glav, "failed to map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  gl->BindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+
+  if (priv->readback_ring) {
+    // queue the readback of this frame and output the oldest one, if it has
+    // been held back long enough
+    readback_ring_push(priv->readback_ring, GST_BUFFER_PTS(video),
+                       GST_BUFFER_DURATION(video));
+    if (!readback_ring_pop(priv->readback_ring, &frame, FALSE))
+      ret = GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED;
+  } else {
+    readback_layout_read(glav->context, &priv->layout, &frame);
+  }
+
+  gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  gst_video_frame_unmap(&frame);
+  gst_gl_base_audio_visualizer_stats_end(glav, RENDER_STATS_READBACK, begin);
+
+  return ret;
+}
+
 typedef struct {
   GstGLBaseAudioVisualizer *glav;
   GstBuffer *in_audio;
-  GstVideoFrame *out_video;
+  GstBuffer *out_video;
+  GstClockTime dispatched;
+  GstFlowReturn result; /* set by the GL thread */
 } GstGLRenderCallbackParams;
 
 static void
-gst_gl_base_audio_visualizer_gl_thread_render_callback(gpointer params) {
+gst_gl_base_audio_visualizer_gl_thread_render_callback(GstGLContext *context,
+                                                       gpointer params) {
   GstGLRenderCallbackParams *cb_params = (GstGLRenderCallbackParams *)params;
-  GstGLBaseAudioVisualizerClass *klass =
-      GST_GL_BASE_AUDIO_VISUALIZER_GET_CLASS(cb_params->glav);
+  GstGLBaseAudioVisualizer *glav = cb_params->glav;
+
+  gst_gl_base_audio_visualizer_stats_end(glav, RENDER_STATS_DISPATCH,
+                                         cb_params->dispatched);
 
   // inside gl thread: call virtual render function with audio and video
-  cb_params->glav->priv->gl_result = klass->gl_render(
-      cb_params->glav, cb_params->in_audio, cb_params->out_video);
+  if (glav->priv->gl_memory_output)
+    cb_params->result = gst_gl_base_audio_visualizer_render_gl_memory(
+        glav, cb_params->in_audio, cb_params->out_video);
+  else
+    cb_params->result = gst_gl_base_audio_visualizer_render_system_memory(
+        glav, cb_params->in_audio, cb_params->out_video);
 }
 
-static gboolean gst_gl_base_audio_visualizer_render(GstAudioVisualizer *bscope,
-                                                    GstBuffer *audio,
-                                                    GstVideoFrame *video) {
-  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(bscope);
+/* render one frame on the GL thread and wait for it, streaming thread or
+ * render queue thread */
+static GstFlowReturn
+gst_gl_base_audio_visualizer_render_frame(GstGLBaseAudioVisualizer *glav,
+                                          GstBuffer *audio, GstBuffer *video) {
   GstGLRenderCallbackParams cb_params;
-  GstGLWindow *window;
+  GstClockTime begin, locked, started;
+  GstFlowReturn ret;
+
+  gst_gl_base_audio_visualizer_update_stats(glav);
+  begin = gst_gl_base_audio_visualizer_stats_begin(glav);
+  started = gst_util_get_timestamp();
 
   g_rec_mutex_lock(&glav->priv->context_lock);
 
-  // wrap params into cb_params struct to pass them to the GL window/thread via
+  locked = gst_gl_base_audio_visualizer_stats_begin(glav);
+  gst_gl_base_audio_visualizer_stats_end(glav, RENDER_STATS_LOCK, begin);
+
+  // wrap params into cb_params struct to pass them to the GL thread via
   // userdata pointer
   cb_params.glav = glav;
   cb_params.in_audio = audio;
   cb_params.out_video = video;
+  cb_params.dispatched = locked;
+  cb_params.result = GST_FLOW_ERROR;
 
-  window = gst_gl_context_get_window(glav->context);
-
-  // dispatch render call through the gl thread
+  // dispatch render call through the gl thread, this works the same for
+  // window backed and surfaceless contexts
   // call is blocking, accessing audio and video params from gl thread *should*
   // be safe
-  gst_gl_window_send_message(
-      window,
-      GST_GL_WINDOW_CB(gst_gl_base_audio_visualizer_gl_thread_render_callback),
+  gst_gl_base_audio_visualizer_thread_add(
+      glav, gst_gl_base_audio_visualizer_gl_thread_render_callback,
       &cb_params);
-
-  gst_object_unref(window);
+  ret = cb_params.result;
 
   g_rec_mutex_unlock(&glav->priv->context_lock);
 
-  if (glav->priv->gl_result) {
+  gst_gl_base_audio_visualizer_stats_end(glav, RENDER_STATS_FRAME, begin);
+  gst_gl_base_audio_visualizer_update_quality(
+      glav, gst_util_get_timestamp() - started);
+
+  if (ret >= GST_FLOW_OK) {
     glav->priv->n_frames++;
   } else {
     // gl error
@@ -336,7 +1282,305 @@ static gboolean gst_gl_base_audio_visualizer_render(GstAudioVisualizer *bscope,
                       (("A GL error occurred")));
   }
 
-  return glav->priv->gl_result;
+  return ret;
+}
+
+static GstFlowReturn gst_gl_base_audio_visualizer_render_queued(
+    GstBuffer *audio, GstBuffer *video, gpointer user_data) {
+  return gst_gl_base_audio_visualizer_render_frame(
+      GST_GL_BASE_AUDIO_VISUALIZER(user_data), audio, video);
+}
+
+static GstFlowReturn
+gst_gl_base_audio_visualizer_render(GstPMAudioVisualizer *bscope,
+                                    GstBuffer *audio, GstBuffer *video) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(bscope);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  guint depth;
+
+  GST_OBJECT_LOCK(glav);
+  depth = priv->pipeline_depth;
+  GST_OBJECT_UNLOCK(glav);
+
+  // renditions are scaled from the frame right after render() returns, which
+  // a pipelined frame isn't yet
+  if (depth > 0 && gst_pm_audio_visualizer_has_renditions(bscope)) {
+    if (!priv->warned_renditions) {
+      GST_WARNING_OBJECT(glav, "pipeline-depth %u is not supported with "
+                               "renditions, rendering on the streaming thread",
+                         depth);
+      priv->warned_renditions = TRUE;
+    }
+    depth = 0;
+  }
+
+  // frames still in the queue are output before this one
+  if (depth == 0 &&
+      (!priv->render_queue || render_queue_is_empty(priv->render_queue)))
+    return gst_gl_base_audio_visualizer_render_frame(glav, audio, video);
+
+  if (!priv->render_queue)
+    priv->render_queue = render_queue_new(
+        gst_gl_base_audio_visualizer_render_queued, glav);
+
+  // the audio is only valid during this call, the output buffer is pushed by
+  // pop_frame once rendered
+  render_queue_push(priv->render_queue, gst_buffer_copy_deep(audio),
+                    gst_buffer_ref(video));
+  render_queue_wait(priv->render_queue, depth);
+
+  return GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED;
+}
+
+static GstFlowReturn
+gst_gl_base_audio_visualizer_pop_frame(GstPMAudioVisualizer *bscope,
+                                       gboolean drain, GstBuffer **video) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(bscope);
+  GstFlowReturn ret;
+
+  if (!glav->priv->render_queue)
+    return GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED;
+
+  if (drain)
+    render_queue_wait(glav->priv->render_queue, 0);
+
+  while (render_queue_pop(glav->priv->render_queue, video, &ret)) {
+    if (ret == GST_FLOW_OK)
+      return GST_FLOW_OK;
+
+    // held back by the readback ring, or failed
+    gst_clear_buffer(video);
+    if (ret != GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED)
+      return ret;
+  }
+
+  return GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED;
+}
+
+static void gst_gl_base_audio_visualizer_gl_drain(GstGLContext *context,
+                                                  gpointer data) {
+  GstGLRenderCallbackParams *cb_params = (GstGLRenderCallbackParams *)data;
+  GstGLBaseAudioVisualizer *glav = cb_params->glav;
+  GstPMAudioVisualizer *bscope = GST_PM_AUDIO_VISUALIZER(glav);
+  GstVideoFrame frame;
+
+  cb_params->result = GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED;
+
+  if (!glav->priv->readback_ring)
+    return;
+
+  if (!gst_video_frame_map(&frame, &bscope->vinfo, cb_params->out_video,
+                           GST_MAP_WRITE)) {
+    GST_ERROR_OBJECT(glav, "failed to map output buffer");
+    cb_params->result = GST_FLOW_ERROR;
+    return;
+  }
+
+  if (readback_ring_pop(glav->priv->readback_ring, &frame, TRUE))
+    cb_params->result = GST_FLOW_OK;
+
+  gst_video_frame_unmap(&frame);
+}
+
+static GstFlowReturn
+gst_gl_base_audio_visualizer_drain(GstPMAudioVisualizer *bscope,
+                                   GstBuffer *video) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(bscope);
+  GstGLRenderCallbackParams cb_params;
+  GstFlowReturn ret = GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED;
+
+  g_rec_mutex_lock(&glav->priv->context_lock);
+  if (glav->context && !glav->priv->gl_memory_output) {
+    cb_params.glav = glav;
+    cb_params.in_audio = NULL;
+    cb_params.out_video = video;
+    cb_params.result = GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED;
+    gst_gl_base_audio_visualizer_thread_add(
+        glav, gst_gl_base_audio_visualizer_gl_drain, &cb_params);
+    ret = cb_params.result;
+  }
+  g_rec_mutex_unlock(&glav->priv->context_lock);
+
+  return ret;
+}
+
+static void gst_gl_base_audio_visualizer_gl_flush(GstGLContext *context,
+                                                  gpointer data) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(data);
+
+  if (glav->priv->readback_ring)
+    readback_ring_clear(glav->priv->readback_ring);
+}
+
+static void gst_gl_base_audio_visualizer_flush(GstPMAudioVisualizer *bscope) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(bscope);
+
+  // the queue thread takes the context lock for each frame
+  if (glav->priv->render_queue)
+    render_queue_clear(glav->priv->render_queue);
+
+  g_rec_mutex_lock(&glav->priv->context_lock);
+  if (glav->context)
+    gst_gl_base_audio_visualizer_thread_add(
+        glav, gst_gl_base_audio_visualizer_gl_flush, glav);
+  g_rec_mutex_unlock(&glav->priv->context_lock);
+}
+
+/* scale and convert the frame that was just rendered into the output buffer of
+ * a rendition, GL thread */
+static GstFlowReturn gst_gl_base_audio_visualizer_render_rendition_unlocked(
+    GstGLBaseAudioVisualizer *glav, GstPMAudioVisualizerRendition *rendition,
+    GstBuffer *video) {
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  const GstGLFuncs *gl = glav->context->gl_vtable;
+  gint width = GST_VIDEO_INFO_WIDTH(&rendition->vinfo);
+  gint height = GST_VIDEO_INFO_HEIGHT(&rendition->vinfo);
+  RenderTarget *src = priv->frame_target;
+  RenderTarget *dest;
+  GstGLSyncMeta *sync_meta;
+  ReadbackLayout layout;
+  GstVideoFrame frame;
+  gboolean gl_memory;
+
+  if (!src) {
+    GST_ERROR_OBJECT(rendition->pad, "no rendered frame to scale");
+    return GST_FLOW_ERROR;
+  }
+
+  gl_memory =
+      gst_caps_features_contains(gst_caps_get_features(rendition->caps, 0),
+                                 GST_CAPS_FEATURE_MEMORY_GL_MEMORY);
+
+  dest = g_hash_table_lookup(priv->rendition_targets, rendition);
+  if (!dest) {
+    dest = g_new0(RenderTarget, 1);
+    g_hash_table_insert(priv->rendition_targets, rendition, dest);
+  }
+
+  if (gl_memory) {
+    if (!gst_video_frame_map(&frame, &rendition->vinfo, video,
+                             GST_MAP_WRITE | GST_MAP_GL)) {
+      GST_ERROR_OBJECT(rendition->pad, "failed to map output buffer");
+      return GST_FLOW_ERROR;
+    }
+
+    if (!render_target_wrap(dest, glav->context,
+                            *(guint *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0),
+                            width, height) ||
+        !gst_gl_base_audio_visualizer_copy_flipped(glav, src, dest)) {
+      gst_video_frame_unmap(&frame);
+      return GST_FLOW_ERROR;
+    }
+
+    gst_video_frame_unmap(&frame);
+
+    sync_meta = gst_buffer_get_gl_sync_meta(video);
+    if (sync_meta)
+      gst_gl_sync_meta_set_sync_point(sync_meta, glav->context);
+
+    return GST_FLOW_OK;
+  }
+
+  if (!color_convert_get_layout(&rendition->vinfo, &layout)) {
+    GST_ERROR_OBJECT(rendition->pad, "Unsupported video format: %s",
+                     gst_video_format_to_string(
+                         GST_VIDEO_INFO_FORMAT(&rendition->vinfo)));
+    return GST_FLOW_ERROR;
+  }
+
+  src = gst_gl_base_audio_visualizer_convert(glav, src, &rendition->vinfo,
+                                             &layout, dest);
+  if (!src) {
+    GST_ERROR_OBJECT(rendition->pad, "failed to convert frame");
+    return GST_FLOW_ERROR;
+  }
+
+  if (!gst_video_frame_map(&frame, &rendition->vinfo, video, GST_MAP_WRITE)) {
+    GST_ERROR_OBJECT(rendition->pad, "failed to map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  gl->BindFramebuffer(GL_FRAMEBUFFER, src->fbo);
+  readback_layout_read(glav->context, &layout, &frame);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  gst_video_frame_unmap(&frame);
+
+  return GST_FLOW_OK;
+}
+
+typedef struct {
+  GstGLBaseAudioVisualizer *glav;
+  GstPMAudioVisualizerRendition *rendition;
+  GstBuffer *out_video;
+  GstFlowReturn result; /* set by the GL thread */
+} GstGLRenditionCallbackParams;
+
+static void gst_gl_base_audio_visualizer_gl_render_rendition(
+    GstGLContext *context, gpointer data) {
+  GstGLRenditionCallbackParams *cb_params = data;
+
+  cb_params->result = gst_gl_base_audio_visualizer_render_rendition_unlocked(
+      cb_params->glav, cb_params->rendition, cb_params->out_video);
+}
+
+static GstFlowReturn gst_gl_base_audio_visualizer_render_rendition(
+    GstPMAudioVisualizer *bscope, GstPMAudioVisualizerRendition *rendition,
+    GstBuffer *video) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(bscope);
+  GstGLRenditionCallbackParams cb_params;
+  GstFlowReturn ret = GST_FLOW_ERROR;
+
+  // render() doesn't pipeline frames while there are renditions, the frame
+  // this rendition buffer belongs to is already rendered
+  g_rec_mutex_lock(&glav->priv->context_lock);
+  if (glav->context) {
+    cb_params.glav = glav;
+    cb_params.rendition = rendition;
+    cb_params.out_video = video;
+    cb_params.result = GST_FLOW_ERROR;
+    gst_gl_base_audio_visualizer_thread_add(
+        glav, gst_gl_base_audio_visualizer_gl_render_rendition, &cb_params);
+    ret = cb_params.result;
+  }
+  g_rec_mutex_unlock(&glav->priv->context_lock);
+
+  if (ret < GST_FLOW_OK)
+    GST_ELEMENT_ERROR(glav, RESOURCE, FAILED,
+                      ("failed to render %s", GST_PAD_NAME(rendition->pad)),
+                      ("A GL error occurred"));
+
+  return ret;
+}
+
+static void gst_gl_base_audio_visualizer_gl_release_rendition(
+    GstGLContext *context, gpointer data) {
+  GstGLRenditionCallbackParams *cb_params = data;
+  GstGLBaseAudioVisualizerPrivate *priv = cb_params->glav->priv;
+  RenderTarget *target;
+
+  target = g_hash_table_lookup(priv->rendition_targets, cb_params->rendition);
+  if (target) {
+    render_target_clear(target, context);
+    g_hash_table_remove(priv->rendition_targets, cb_params->rendition);
+  }
+}
+
+static void gst_gl_base_audio_visualizer_release_rendition(
+    GstPMAudioVisualizer *bscope, GstPMAudioVisualizerRendition *rendition) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(bscope);
+  GstGLRenditionCallbackParams cb_params;
+
+  // without a context, the targets were freed with the other GL resources
+  g_rec_mutex_lock(&glav->priv->context_lock);
+  if (glav->context) {
+    cb_params.glav = glav;
+    cb_params.rendition = rendition;
+    cb_params.out_video = NULL;
+    gst_gl_base_audio_visualizer_thread_add(
+        glav, gst_gl_base_audio_visualizer_gl_release_rendition, &cb_params);
+  }
+  g_rec_mutex_unlock(&glav->priv->context_lock);
 }
 
 static void gst_gl_base_audio_visualizer_start(GstGLBaseAudioVisualizer *glav) {
@@ -348,13 +1592,12 @@ static void gst_gl_base_audio_visualizer_stop(GstGLBaseAudioVisualizer *glav) {
 
   if (glav->context) {
     if (glav->priv->gl_started)
-      gst_gl_context_thread_add(glav->context,
-                                gst_gl_base_audio_visualizer_gl_stop, glav);
+      gst_gl_base_audio_visualizer_thread_add(
+          glav, gst_gl_base_audio_visualizer_gl_stop, glav);
 
-    gst_object_unref(glav->context);
+    gst_gl_base_audio_visualizer_clear_context_unlocked(glav);
   }
 
-  glav->context = NULL;
   g_rec_mutex_unlock(&glav->priv->context_lock);
 }
 
@@ -395,6 +1638,32 @@ _find_local_gl_context_unlocked(GstGLBaseAudioVisualizer *glav) {
   return FALSE;
 }
 
+/* open a surfaceless EGL display and offer it to the other elements, with the
+ * context lock */
+static gboolean gst_gl_base_audio_visualizer_open_surfaceless_unlocked(
+    GstGLBaseAudioVisualizer *glav) {
+#ifdef HAVE_SURFACELESS_DISPLAY
+  GstGLDisplayEGL *display_egl;
+
+  display_egl = gst_gl_display_egl_new_surfaceless();
+  if (!display_egl) {
+    GST_WARNING_OBJECT(glav, "failed to open a surfaceless EGL display");
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT(glav, "using surfaceless EGL display %" GST_PTR_FORMAT,
+                  display_egl);
+  glav->display = GST_GL_DISPLAY(display_egl);
+  gst_gl_element_propagate_display_context(GST_ELEMENT(glav), glav->display);
+
+  return TRUE;
+#else
+  GST_WARNING_OBJECT(glav, "surfaceless rendering needs GStreamer 1.24 or "
+                           "newer built with EGL support");
+  return FALSE;
+#endif
+}
+
 static gboolean gst_gl_base_audio_visualizer_find_gl_context_unlocked(
     GstGLBaseAudioVisualizer *glav) {
   GstGLBaseAudioVisualizerClass *klass =
@@ -409,6 +1678,18 @@ static gboolean gst_gl_base_audio_visualizer_find_gl_context_unlocked(
   if (!glav->context)
     new_context = TRUE;
 
+  // a display the application or another element already set takes
+  // precedence, then the one of the shared contexts, otherwise
+  // gst_gl_ensure_element_data() picks the default one
+  if (!glav->display && glav->priv->shared_contexts > 0) {
+    glav->display = context_pool_get_display();
+    if (glav->display)
+      gst_gl_element_propagate_display_context(GST_ELEMENT(glav),
+                                               glav->display);
+  }
+  if (!glav->display && glav->priv->surfaceless)
+    gst_gl_base_audio_visualizer_open_surfaceless_unlocked(glav);
+
   if (!gst_gl_ensure_element_data(glav, &glav->display,
                                   &glav->priv->other_context))
     return FALSE;
@@ -417,7 +1698,14 @@ static gboolean gst_gl_base_audio_visualizer_find_gl_context_unlocked(
 
   _find_local_gl_context_unlocked(glav);
 
-  if (!glav->context) {
+  if (!glav->context && glav->priv->shared_contexts > 0) {
+    glav->context =
+        context_pool_acquire(glav->display, glav->priv->other_context,
+                             glav->priv->shared_contexts, &error);
+    if (!glav->context)
+      goto context_error;
+    glav->priv->pooled_context = TRUE;
+  } else if (!glav->context) {
     GST_OBJECT_LOCK(glav->display);
     do {
       if (glav->context) {
@@ -442,8 +1730,8 @@ static gboolean gst_gl_base_audio_visualizer_find_gl_context_unlocked(
 
   if (new_context || !glav->priv->gl_started) {
     if (glav->priv->gl_started)
-      gst_gl_context_thread_add(glav->context,
-                                gst_gl_base_audio_visualizer_gl_stop, glav);
+      gst_gl_base_audio_visualizer_thread_add(
+          glav, gst_gl_base_audio_visualizer_gl_stop, glav);
 
     {
       if ((gst_gl_context_get_gl_api(glav->context) &
@@ -451,8 +1739,8 @@ static gboolean gst_gl_base_audio_visualizer_find_gl_context_unlocked(
         goto unsupported_gl_api;
     }
 
-    gst_gl_context_thread_add(glav->context,
-                              gst_gl_base_audio_visualizer_gl_start, glav);
+    gst_gl_base_audio_visualizer_thread_add(
+        glav, gst_gl_base_audio_visualizer_gl_start, glav);
 
     if (!glav->priv->gl_started)
       goto error;
@@ -481,9 +1769,7 @@ context_error: {
   } else {
     GST_ELEMENT_ERROR(glav, RESOURCE, NOT_FOUND, (NULL), (NULL));
   }
-  if (glav->context)
-    gst_object_unref(glav->context);
-  glav->context = NULL;
+  gst_gl_base_audio_visualizer_clear_context_unlocked(glav);
   return FALSE;
 }
 error: {
@@ -493,16 +1779,19 @@ error: {
 }
 }
 
+/* configure a GL pool for memory:GLMemory caps, or a system memory pool
+ * otherwise, for the caps of the query */
 static gboolean
-gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
-                                               GstQuery *query) {
-  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(gstav);
+gst_gl_base_audio_visualizer_configure_pool(GstGLBaseAudioVisualizer *glav,
+                                            GstQuery *query,
+                                            gboolean *gl_memory) {
   GstGLContext *context;
   GstBufferPool *pool = NULL;
   GstStructure *config;
   GstCaps *caps;
   guint min, max, size;
   gboolean update_pool;
+  gboolean gl_memory_output;
 
   g_rec_mutex_lock(&glav->priv->context_lock);
   if (!gst_gl_base_audio_visualizer_find_gl_context_unlocked(glav)) {
@@ -514,6 +1803,9 @@ gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
 
   gst_query_parse_allocation(query, &caps, NULL);
 
+  gl_memory_output = gst_caps_features_contains(
+      gst_caps_get_features(caps, 0), GST_CAPS_FEATURE_MEMORY_GL_MEMORY);
+
   if (gst_query_get_n_allocation_pools(query) > 0) {
     gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
 
@@ -528,21 +1820,29 @@ gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
     update_pool = FALSE;
   }
 
-  if (!pool || !GST_IS_GL_BUFFER_POOL(pool)) {
-    /* can't use this pool */
-    if (pool)
-      gst_object_unref(pool);
-    pool = gst_gl_buffer_pool_new(context);
+  if (gl_memory_output) {
+    if (!pool || !GST_IS_GL_BUFFER_POOL(pool)) {
+      /* can't use this pool */
+      if (pool)
+        gst_object_unref(pool);
+      pool = gst_gl_buffer_pool_new(context);
+    }
+  } else if (!pool) {
+    /* frames are read back into system memory, a GL pool would only add a
+     * download and an upload of stale texture contents per frame */
+    pool = gst_video_buffer_pool_new();
   }
   config = gst_buffer_pool_get_config(pool);
 
   gst_buffer_pool_config_set_params(config, caps, size, min, max);
   gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
-  if (gst_query_find_allocation_meta(query, GST_GL_SYNC_META_API_TYPE, NULL))
-    gst_buffer_pool_config_add_option(config,
-                                      GST_BUFFER_POOL_OPTION_GL_SYNC_META);
-  gst_buffer_pool_config_add_option(
-      config, GST_BUFFER_POOL_OPTION_VIDEO_GL_TEXTURE_UPLOAD_META);
+  if (GST_IS_GL_BUFFER_POOL(pool)) {
+    if (gst_query_find_allocation_meta(query, GST_GL_SYNC_META_API_TYPE, NULL))
+      gst_buffer_pool_config_add_option(config,
+                                        GST_BUFFER_POOL_OPTION_GL_SYNC_META);
+    gst_buffer_pool_config_add_option(
+        config, GST_BUFFER_POOL_OPTION_VIDEO_GL_TEXTURE_UPLOAD_META);
+  }
 
   gst_buffer_pool_set_config(pool, config);
 
@@ -554,6 +1854,41 @@ gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
   gst_object_unref(pool);
   gst_object_unref(context);
 
+  *gl_memory = gl_memory_output;
+
+  return TRUE;
+}
+
+static gboolean
+gst_gl_base_audio_visualizer_decide_allocation(GstPMAudioVisualizer *gstav,
+                                               GstQuery *query) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(gstav);
+  gboolean gl_memory_output;
+
+  if (!gst_gl_base_audio_visualizer_configure_pool(glav, query,
+                                                   &gl_memory_output))
+    return FALSE;
+
+  glav->priv->gl_memory_output = gl_memory_output;
+  GST_DEBUG_OBJECT(glav, "rendering to %s memory",
+                   gl_memory_output ? "GL" : "system");
+
+  return TRUE;
+}
+
+static gboolean gst_gl_base_audio_visualizer_decide_rendition_allocation(
+    GstPMAudioVisualizer *gstav, GstPMAudioVisualizerRendition *rendition,
+    GstQuery *query) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(gstav);
+  gboolean gl_memory;
+
+  // the memory type is taken from the caps of the rendition when rendering
+  if (!gst_gl_base_audio_visualizer_configure_pool(glav, query, &gl_memory))
+    return FALSE;
+
+  GST_DEBUG_OBJECT(rendition->pad, "scaling to %s memory",
+                   gl_memory ? "GL" : "system");
+
   return TRUE;
 }
 
@@ -573,6 +1908,22 @@ gst_gl_base_audio_visualizer_change_state(GstElement *element,
     return ret;
 
   switch (transition) {
+  case GST_STATE_CHANGE_PAUSED_TO_READY:
+    // the streaming thread is stopped, frames still queued are not output
+    if (glav->priv->render_queue) {
+      render_queue_free(glav->priv->render_queue);
+      glav->priv->render_queue = NULL;
+    }
+    break;
+  case GST_STATE_CHANGE_READY_TO_PAUSED:
+    // every stream starts at full quality
+    GST_OBJECT_LOCK(glav);
+    glav->priv->quality_level = 0;
+    GST_OBJECT_UNLOCK(glav);
+    glav->priv->quality_load = 0.0;
+    glav->priv->quality_over = 0;
+    glav->priv->quality_under = 0;
+    break;
   case GST_STATE_CHANGE_READY_TO_NULL:
     g_rec_mutex_lock(&glav->priv->context_lock);
     gst_clear_object(&glav->priv->other_context);
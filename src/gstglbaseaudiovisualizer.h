@@ -32,8 +32,9 @@
 #ifndef __GST_GL_BASE_AUDIO_VISUALIZER_H__
 #define __GST_GL_BASE_AUDIO_VISUALIZER_H__
 
+#include "gstpmaudiovisualizer.h"
+#include "renderstats.h"
 #include <gst/gl/gstgl_fwd.h>
-#include <gst/pbutils/gstaudiovisualizer.h>
 #include <gst/video/video-info.h>
 #include <stdint.h>
 
@@ -72,7 +73,7 @@ GType gst_gl_base_audio_visualizer_get_type(void);
  * The parent instance type of a base GL Audio Visualizer.
  */
 struct _GstGLBaseAudioVisualizer {
-  GstAudioVisualizer parent;
+  GstPMAudioVisualizer parent;
 
   /*< public >*/
   GstGLDisplay *display;
@@ -89,27 +90,44 @@ struct _GstGLBaseAudioVisualizer {
  * @supported_gl_api: the logical-OR of #GstGLAPI's supported by this element
  * @gl_start: called in the GL thread to setup the element GL state.
  * @gl_stop: called in the GL thread to clean up the element GL state.
- * @gl_render: called in the GL thread to fill the current video texture.
+ * @gl_render: called in the GL thread to render the frame for the timestamp of
+ * the (unmapped) video buffer into the given framebuffer. The framebuffer has
+ * the size returned by gst_gl_base_audio_visualizer_get_render_size(). It is
+ * an offscreen framebuffer the base class flips and scales into the output
+ * texture or reads back into the video buffer, render bottom up as usual.
  * @setup: called when the format changes (delegate from
- * GstAudioVisualizer.setup)
+ * GstPMAudioVisualizer.setup)
  *
  * The base class for OpenGL based audio visualizers.
  *
  */
 struct _GstGLBaseAudioVisualizerClass {
-  GstAudioVisualizerClass parent_class;
+  GstPMAudioVisualizerClass parent_class;
 
   /*< public >*/
   GstGLAPI supported_gl_api;
   gboolean (*gl_start)(GstGLBaseAudioVisualizer *glav);
   void (*gl_stop)(GstGLBaseAudioVisualizer *glav);
   gboolean (*gl_render)(GstGLBaseAudioVisualizer *glav, GstBuffer *audio,
-                        GstVideoFrame *video);
+                        GstBuffer *video, guint fbo);
   gboolean (*setup)(GstGLBaseAudioVisualizer *glav);
   /*< private >*/
   gpointer _padding[GST_PADDING];
 };
 
+void gst_gl_base_audio_visualizer_get_render_size(
+    GstGLBaseAudioVisualizer *glav, gint *width, gint *height);
+
+gdouble
+gst_gl_base_audio_visualizer_get_quality_scale(GstGLBaseAudioVisualizer *glav);
+
+GstClockTime
+gst_gl_base_audio_visualizer_stats_begin(GstGLBaseAudioVisualizer *glav);
+
+void gst_gl_base_audio_visualizer_stats_end(GstGLBaseAudioVisualizer *glav,
+                                            RenderStatsStage stage,
+                                            GstClockTime begin);
+
 G_END_DECLS
 
 #endif /* __GST_GL_BASE_AUDIO_VISUALIZER_H__ */
@@ -0,0 +1,1681 @@
+/* GStreamer
+ * Copyright (C) <2011> Stefan Kost <ensonic@users.sf.net>
+ * Copyright (C) <2015> Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The code in this file is based on code from
+ * GStreamer / gst-plugins-base / 1.22: gst-libs/gst/pbutils/gstaudiovisualizer.c
+ * Git Repository:
+ * https://github.com/GStreamer/gst-plugins-base/blob/master/gst-libs/gst/pbutils/gstaudiovisualizer.c
+ * Original copyright notice has been retained at the top of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/base/gstadapter.h>
+#include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
+
+#include "gstpmaudiovisualizer.h"
+
+/**
+ * SECTION:GstPMAudioVisualizer
+ * @short_description: Base class for visualizers.
+ * @title: GstPMAudioVisualizer
+ * @see_also: #GstAudioVisualizer
+ *
+ * A baseclass for scopes (visualizers). It takes care of re-fitting the
+ * audio-rate to video-rate and handles renegotiation (downstream video size
+ * changes).
+ *
+ * Unlike #GstAudioVisualizer, the output buffer is passed to the `render()`
+ * virtual method unmapped and uncleared. The subclass is expected to overwrite
+ * the whole frame, and can map it with the flags it needs (e.g. GST_MAP_GL).
+ * The CPU based shader effects of the original class are not available.
+ *
+ * If the element class has a "src_%u" request pad template, each requested
+ * pad is an additional output (a rendition) of the same frames, negotiated to
+ * its own size and format and with its own buffer pool. The frame is rendered
+ * once, the subclass fills the buffers of the renditions from it in
+ * `render_rendition()`. Renditions run at the framerate of the "src" pad.
+ */
+
+GST_DEBUG_CATEGORY_STATIC(pm_audio_visualizer_debug);
+#define GST_CAT_DEFAULT (pm_audio_visualizer_debug)
+
+static GstElementClass *parent_class = NULL;
+static gint private_offset = 0;
+
+static void
+gst_pm_audio_visualizer_class_init(GstPMAudioVisualizerClass *klass);
+static void gst_pm_audio_visualizer_init(GstPMAudioVisualizer *scope,
+                                         GstPMAudioVisualizerClass *g_class);
+static void gst_pm_audio_visualizer_dispose(GObject *object);
+static void gst_pm_audio_visualizer_finalize(GObject *object);
+
+static gboolean
+gst_pm_audio_visualizer_src_negotiate(GstPMAudioVisualizer *scope);
+static gboolean gst_pm_audio_visualizer_src_setcaps(GstPMAudioVisualizer *scope,
+                                                    GstCaps *caps);
+static gboolean
+gst_pm_audio_visualizer_sink_setcaps(GstPMAudioVisualizer *scope,
+                                     GstCaps *caps);
+
+static GstFlowReturn gst_pm_audio_visualizer_chain(GstPad *pad,
+                                                   GstObject *parent,
+                                                   GstBuffer *buffer);
+
+static gboolean gst_pm_audio_visualizer_src_event(GstPad *pad,
+                                                  GstObject *parent,
+                                                  GstEvent *event);
+static gboolean gst_pm_audio_visualizer_sink_event(GstPad *pad,
+                                                   GstObject *parent,
+                                                   GstEvent *event);
+
+static GstFlowReturn gst_pm_audio_visualizer_drain(GstPMAudioVisualizer *scope);
+static GstFlowReturn
+gst_pm_audio_visualizer_push_frames(GstPMAudioVisualizer *scope,
+                                    gboolean drain);
+static gboolean gst_pm_audio_visualizer_src_query(GstPad *pad,
+                                                  GstObject *parent,
+                                                  GstQuery *query);
+
+static GstStateChangeReturn
+gst_pm_audio_visualizer_change_state(GstElement *element,
+                                     GstStateChange transition);
+
+static GstPad *gst_pm_audio_visualizer_request_new_pad(GstElement *element,
+                                                       GstPadTemplate *templ,
+                                                       const gchar *name,
+                                                       const GstCaps *caps);
+static void gst_pm_audio_visualizer_release_pad(GstElement *element,
+                                                GstPad *pad);
+
+static gboolean
+gst_pm_audio_visualizer_do_bufferpool(GstPMAudioVisualizer *scope,
+                                      GstCaps *outcaps);
+
+static gboolean
+gst_pm_audio_visualizer_default_decide_allocation(GstPMAudioVisualizer *scope,
+                                                  GstQuery *query);
+static gboolean gst_pm_audio_visualizer_default_decide_rendition_allocation(
+    GstPMAudioVisualizer *scope, GstPMAudioVisualizerRendition *rendition,
+    GstQuery *query);
+
+struct _GstPMAudioVisualizerPrivate {
+  /* pads */
+  GstPad *srcpad, *sinkpad;
+
+  GstBufferPool *pool;
+  gboolean pool_active;
+  GstAllocator *allocator;
+  GstAllocationParams params;
+  GstQuery *query;
+
+  GstAdapter *adapter;
+
+  GstBuffer *inbuf;
+
+  guint spf; /* samples per video frame, rounded down */
+  guint64 frame_duration;
+  guint64 frame_count; /* frames consumed since the last resync */
+
+  /* QoS stuff */ /* with LOCK */
+  gboolean qos_enabled;
+  gdouble proportion;
+  GstClockTime earliest_time;
+
+  guint dropped; /* frames dropped / not dropped */
+  guint processed;
+
+  /* frames held back by the subclass before output, with LOCK */
+  guint output_delay;
+
+  /* configuration mutex */
+  GMutex config_lock;
+
+  /* requested src pads, with config_lock */
+  GPtrArray *renditions;
+  guint next_rendition; /* with LOCK */
+
+  GstSegment segment;
+};
+
+/* base class */
+
+GType gst_pm_audio_visualizer_get_type(void) {
+  static gsize pm_audio_visualizer_type = 0;
+
+  if (g_once_init_enter(&pm_audio_visualizer_type)) {
+    static const GTypeInfo pm_audio_visualizer_info = {
+        sizeof(GstPMAudioVisualizerClass),
+        NULL,
+        NULL,
+        (GClassInitFunc)gst_pm_audio_visualizer_class_init,
+        NULL,
+        NULL,
+        sizeof(GstPMAudioVisualizer),
+        0,
+        (GInstanceInitFunc)gst_pm_audio_visualizer_init,
+    };
+    GType _type;
+
+    _type = g_type_register_static(GST_TYPE_ELEMENT, "GstPMAudioVisualizer",
+                                   &pm_audio_visualizer_info,
+                                   G_TYPE_FLAG_ABSTRACT);
+
+    private_offset =
+        g_type_add_instance_private(_type, sizeof(GstPMAudioVisualizerPrivate));
+
+    g_once_init_leave(&pm_audio_visualizer_type, _type);
+  }
+  return (GType)pm_audio_visualizer_type;
+}
+
+static inline GstPMAudioVisualizerPrivate *
+gst_pm_audio_visualizer_get_instance_private(GstPMAudioVisualizer *self) {
+  return (G_STRUCT_MEMBER_P(self, private_offset));
+}
+
+static void
+gst_pm_audio_visualizer_class_init(GstPMAudioVisualizerClass *klass) {
+  GObjectClass *gobject_class = (GObjectClass *)klass;
+  GstElementClass *element_class = (GstElementClass *)klass;
+
+  if (private_offset != 0)
+    g_type_class_adjust_private_offset(klass, &private_offset);
+
+  parent_class = g_type_class_peek_parent(klass);
+
+  GST_DEBUG_CATEGORY_INIT(pm_audio_visualizer_debug, "pmaudiovisualizer", 0,
+                          "projectM audio visualisations base class");
+
+  gobject_class->dispose = gst_pm_audio_visualizer_dispose;
+  gobject_class->finalize = gst_pm_audio_visualizer_finalize;
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_release_pad);
+
+  klass->decide_allocation =
+      GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_default_decide_allocation);
+  klass->decide_rendition_allocation = GST_DEBUG_FUNCPTR(
+      gst_pm_audio_visualizer_default_decide_rendition_allocation);
+}
+
+static void gst_pm_audio_visualizer_init(GstPMAudioVisualizer *scope,
+                                         GstPMAudioVisualizerClass *g_class) {
+  GstPadTemplate *pad_template;
+
+  scope->priv = gst_pm_audio_visualizer_get_instance_private(scope);
+
+  /* create the sink and src pads */
+  pad_template =
+      gst_element_class_get_pad_template(GST_ELEMENT_CLASS(g_class), "sink");
+  g_return_if_fail(pad_template != NULL);
+  scope->priv->sinkpad = gst_pad_new_from_template(pad_template, "sink");
+  gst_pad_set_chain_function(scope->priv->sinkpad,
+                             GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_chain));
+  gst_pad_set_event_function(
+      scope->priv->sinkpad,
+      GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_sink_event));
+  gst_element_add_pad(GST_ELEMENT(scope), scope->priv->sinkpad);
+
+  pad_template =
+      gst_element_class_get_pad_template(GST_ELEMENT_CLASS(g_class), "src");
+  g_return_if_fail(pad_template != NULL);
+  scope->priv->srcpad = gst_pad_new_from_template(pad_template, "src");
+  gst_pad_set_event_function(
+      scope->priv->srcpad,
+      GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_src_event));
+  gst_pad_set_query_function(
+      scope->priv->srcpad,
+      GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_src_query));
+  gst_element_add_pad(GST_ELEMENT(scope), scope->priv->srcpad);
+
+  scope->priv->adapter = gst_adapter_new();
+  scope->priv->inbuf = gst_buffer_new();
+  g_mutex_init(&scope->priv->config_lock);
+  scope->priv->renditions = g_ptr_array_new();
+  scope->priv->next_rendition = 0;
+
+  /* reset the initial video state */
+  gst_video_info_init(&scope->vinfo);
+  scope->priv->frame_duration = GST_CLOCK_TIME_NONE;
+  scope->priv->output_delay = 0;
+  scope->priv->qos_enabled = TRUE;
+
+  /* reset the initial state */
+  gst_audio_info_init(&scope->ainfo);
+}
+
+/* drop the negotiated format and pool of a rendition */
+static void gst_pm_audio_visualizer_rendition_reset(
+    GstPMAudioVisualizerRendition *rendition) {
+  if (rendition->pool) {
+    gst_buffer_pool_set_active(rendition->pool, FALSE);
+    gst_object_unref(rendition->pool);
+    rendition->pool = NULL;
+  }
+  rendition->pool_active = FALSE;
+  gst_caps_replace(&rendition->caps, NULL);
+  rendition->need_negotiate = TRUE;
+}
+
+static void gst_pm_audio_visualizer_rendition_free(
+    GstPMAudioVisualizer *scope, GstPMAudioVisualizerRendition *rendition) {
+  GstPMAudioVisualizerClass *klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+
+  if (klass->release_rendition)
+    klass->release_rendition(scope, rendition);
+
+  gst_pm_audio_visualizer_rendition_reset(rendition);
+  g_free(rendition);
+}
+
+static void gst_pm_audio_visualizer_dispose(GObject *object) {
+  GstPMAudioVisualizer *scope = GST_PM_AUDIO_VISUALIZER(object);
+  guint i;
+
+  if (scope->priv->renditions) {
+    /* the pads themselves go away with the element */
+    for (i = 0; i < scope->priv->renditions->len; i++)
+      gst_pm_audio_visualizer_rendition_free(
+          scope, g_ptr_array_index(scope->priv->renditions, i));
+    g_ptr_array_unref(scope->priv->renditions);
+    scope->priv->renditions = NULL;
+  }
+
+  if (scope->priv->adapter) {
+    g_object_unref(scope->priv->adapter);
+    scope->priv->adapter = NULL;
+  }
+  if (scope->priv->inbuf) {
+    gst_buffer_unref(scope->priv->inbuf);
+    scope->priv->inbuf = NULL;
+  }
+
+  G_OBJECT_CLASS(parent_class)->dispose(object);
+}
+
+static void gst_pm_audio_visualizer_finalize(GObject *object) {
+  GstPMAudioVisualizer *scope = GST_PM_AUDIO_VISUALIZER(object);
+
+  g_mutex_clear(&scope->priv->config_lock);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_pm_audio_visualizer_reset(GstPMAudioVisualizer *scope) {
+  GstPMAudioVisualizerClass *klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+
+  if (klass->flush)
+    klass->flush(scope);
+
+  gst_adapter_clear(scope->priv->adapter);
+  scope->priv->frame_count = 0;
+  gst_segment_init(&scope->priv->segment, GST_FORMAT_UNDEFINED);
+
+  GST_OBJECT_LOCK(scope);
+  scope->priv->proportion = 1.0;
+  scope->priv->earliest_time = -1;
+  scope->priv->dropped = 0;
+  scope->priv->processed = 0;
+  GST_OBJECT_UNLOCK(scope);
+}
+
+static gboolean
+gst_pm_audio_visualizer_sink_setcaps(GstPMAudioVisualizer *scope,
+                                     GstCaps *caps) {
+  GstAudioInfo info;
+
+  if (!gst_audio_info_from_caps(&info, caps))
+    goto wrong_caps;
+
+  scope->ainfo = info;
+
+  GST_DEBUG_OBJECT(scope, "audio: channels %d, rate %d",
+                   GST_AUDIO_INFO_CHANNELS(&info), GST_AUDIO_INFO_RATE(&info));
+
+  if (!gst_pm_audio_visualizer_src_negotiate(scope)) {
+    goto not_negotiated;
+  }
+
+  return TRUE;
+
+  /* Errors */
+wrong_caps: {
+  GST_WARNING_OBJECT(scope, "could not parse caps");
+  return FALSE;
+}
+not_negotiated: {
+  GST_WARNING_OBJECT(scope, "failed to negotiate");
+  return FALSE;
+}
+}
+
+static gboolean gst_pm_audio_visualizer_src_setcaps(GstPMAudioVisualizer *scope,
+                                                    GstCaps *caps) {
+  GstVideoInfo info;
+  GstPMAudioVisualizerClass *klass;
+  GstCaps *current;
+  gboolean res;
+  guint i;
+
+  if (!gst_video_info_from_caps(&info, caps))
+    goto wrong_caps;
+
+  klass = GST_PM_AUDIO_VISUALIZER_CLASS(G_OBJECT_GET_CLASS(scope));
+
+  /* frames the subclass still holds back were rendered for the old caps and
+   * go out with them, the subclass keeps its state across the change */
+  current = gst_pad_get_current_caps(scope->priv->srcpad);
+  if (current) {
+    if (!gst_caps_is_equal(current, caps)) {
+      GST_DEBUG_OBJECT(scope, "renegotiating from %" GST_PTR_FORMAT, current);
+      gst_pm_audio_visualizer_drain(scope);
+    }
+    gst_caps_unref(current);
+  }
+
+  scope->vinfo = info;
+
+  scope->priv->frame_duration = gst_util_uint64_scale_int(
+      GST_SECOND, GST_VIDEO_INFO_FPS_D(&info), GST_VIDEO_INFO_FPS_N(&info));
+  scope->priv->spf =
+      gst_util_uint64_scale_int(GST_AUDIO_INFO_RATE(&scope->ainfo),
+                                GST_VIDEO_INFO_FPS_D(&info),
+                                GST_VIDEO_INFO_FPS_N(&info));
+  scope->req_spf = scope->priv->spf;
+  scope->priv->frame_count = 0;
+
+  if (klass->setup && !klass->setup(scope))
+    goto setup_failed;
+
+  GST_DEBUG_OBJECT(scope, "video: dimension %dx%d, framerate %d/%d",
+                   GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info),
+                   GST_VIDEO_INFO_FPS_N(&info), GST_VIDEO_INFO_FPS_D(&info));
+  GST_DEBUG_OBJECT(scope, "blocks: spf %u, req_spf %u", scope->priv->spf,
+                   scope->req_spf);
+
+  gst_pad_set_caps(scope->priv->srcpad, caps);
+
+  /* the renditions follow the size and framerate of the main output */
+  g_mutex_lock(&scope->priv->config_lock);
+  for (i = 0; i < scope->priv->renditions->len; i++) {
+    GstPMAudioVisualizerRendition *rendition =
+        g_ptr_array_index(scope->priv->renditions, i);
+    rendition->need_negotiate = TRUE;
+  }
+  g_mutex_unlock(&scope->priv->config_lock);
+
+  /* find a pool for the negotiated caps now */
+  res = gst_pm_audio_visualizer_do_bufferpool(scope, caps);
+
+  return res;
+
+  /* ERRORS */
+wrong_caps: {
+  GST_WARNING_OBJECT(scope, "wrong caps");
+  return FALSE;
+}
+setup_failed: {
+  GST_WARNING_OBJECT(scope, "failed to set up");
+  return FALSE;
+}
+}
+
+static gboolean
+gst_pm_audio_visualizer_src_negotiate(GstPMAudioVisualizer *scope) {
+  GstCaps *othercaps, *target;
+  GstStructure *structure;
+  GstCaps *templ;
+  gboolean ret;
+
+  templ = gst_pad_get_pad_template_caps(scope->priv->srcpad);
+
+  GST_DEBUG_OBJECT(scope, "performing negotiation");
+
+  /* see what the peer can do */
+  othercaps = gst_pad_peer_query_caps(scope->priv->srcpad, NULL);
+  if (othercaps) {
+    /* keep the peer's order of preference, so memory:GLMemory is picked if
+     * downstream lists it first */
+    target = gst_caps_intersect(othercaps, templ);
+    gst_caps_unref(othercaps);
+    gst_caps_unref(templ);
+
+    if (gst_caps_is_empty(target))
+      goto no_format;
+
+    target = gst_caps_truncate(target);
+  } else {
+    target = templ;
+  }
+
+  target = gst_caps_make_writable(target);
+  structure = gst_caps_get_structure(target, 0);
+  gst_structure_fixate_field_nearest_int(structure, "width", 320);
+  gst_structure_fixate_field_nearest_int(structure, "height", 200);
+  gst_structure_fixate_field_nearest_fraction(structure, "framerate", 25, 1);
+  if (gst_structure_has_field(structure, "pixel-aspect-ratio"))
+    gst_structure_fixate_field_nearest_fraction(structure, "pixel-aspect-ratio",
+                                                1, 1);
+
+  target = gst_caps_fixate(target);
+
+  GST_DEBUG_OBJECT(scope, "final caps are %" GST_PTR_FORMAT, target);
+
+  ret = gst_pm_audio_visualizer_src_setcaps(scope, target);
+  gst_caps_unref(target);
+
+  return ret;
+
+no_format: {
+  gst_caps_unref(target);
+  return FALSE;
+}
+}
+
+/* takes ownership of the pool, allocator and query */
+static gboolean
+gst_pm_audio_visualizer_set_allocation(GstPMAudioVisualizer *scope,
+                                       GstBufferPool *pool,
+                                       GstAllocator *allocator,
+                                       GstAllocationParams *params,
+                                       GstQuery *query) {
+  GstAllocator *oldalloc;
+  GstBufferPool *oldpool;
+  GstQuery *oldquery;
+  GstPMAudioVisualizerPrivate *priv = scope->priv;
+
+  GST_OBJECT_LOCK(scope);
+  oldpool = priv->pool;
+  priv->pool = pool;
+  priv->pool_active = FALSE;
+
+  oldalloc = priv->allocator;
+  priv->allocator = allocator;
+
+  oldquery = priv->query;
+  priv->query = query;
+
+  if (params)
+    priv->params = *params;
+  else
+    gst_allocation_params_init(&priv->params);
+  GST_OBJECT_UNLOCK(scope);
+
+  if (oldpool) {
+    GST_DEBUG_OBJECT(scope, "deactivating old pool %p", oldpool);
+    gst_buffer_pool_set_active(oldpool, FALSE);
+    gst_object_unref(oldpool);
+  }
+  if (oldalloc) {
+    gst_object_unref(oldalloc);
+  }
+  if (oldquery) {
+    gst_query_unref(oldquery);
+  }
+  return TRUE;
+}
+
+static gboolean
+gst_pm_audio_visualizer_do_bufferpool(GstPMAudioVisualizer *scope,
+                                      GstCaps *outcaps) {
+  GstQuery *query;
+  gboolean result = TRUE;
+  GstBufferPool *pool = NULL;
+  GstPMAudioVisualizerClass *klass;
+  GstAllocator *allocator;
+  GstAllocationParams params;
+
+  /* not passthrough, we need to allocate */
+  /* find a pool for the negotiated caps now */
+  GST_DEBUG_OBJECT(scope, "doing allocation query");
+  query = gst_query_new_allocation(outcaps, TRUE);
+
+  if (!gst_pad_peer_query(scope->priv->srcpad, query)) {
+    /* not a problem, we use the query defaults */
+    GST_DEBUG_OBJECT(scope, "allocation query failed");
+  }
+
+  klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+
+  GST_DEBUG_OBJECT(scope, "calling decide_allocation");
+  g_assert(klass->decide_allocation != NULL);
+  result = klass->decide_allocation(scope, query);
+
+  GST_DEBUG_OBJECT(scope, "ALLOCATION (%d) params: %" GST_PTR_FORMAT, result,
+                   query);
+
+  if (!result)
+    goto no_decide_allocation;
+
+  /* we got configuration from our peer or the decide_allocation method,
+   * parse them */
+  if (gst_query_get_n_allocation_params(query) > 0) {
+    gst_query_parse_nth_allocation_param(query, 0, &allocator, &params);
+  } else {
+    allocator = NULL;
+    gst_allocation_params_init(&params);
+  }
+
+  if (gst_query_get_n_allocation_pools(query) > 0)
+    gst_query_parse_nth_allocation_pool(query, 0, &pool, NULL, NULL, NULL);
+
+  /* now store */
+  result = gst_pm_audio_visualizer_set_allocation(scope, pool, allocator,
+                                                  &params, query);
+
+  return result;
+
+  /* Errors */
+no_decide_allocation: {
+  GST_WARNING_OBJECT(scope, "Subclass failed to decide allocation");
+  gst_query_unref(query);
+
+  return result;
+}
+}
+
+static gboolean
+gst_pm_audio_visualizer_default_decide_allocation(GstPMAudioVisualizer *scope,
+                                                  GstQuery *query) {
+  GstCaps *outcaps;
+  GstBufferPool *pool;
+  guint size, min, max;
+  GstAllocator *allocator;
+  GstAllocationParams params;
+  GstStructure *config;
+  gboolean update_allocator;
+  gboolean update_pool;
+
+  gst_query_parse_allocation(query, &outcaps, NULL);
+
+  /* we got configuration from our peer or the decide_allocation method,
+   * parse them */
+  if (gst_query_get_n_allocation_params(query) > 0) {
+    /* try the allocator */
+    gst_query_parse_nth_allocation_param(query, 0, &allocator, &params);
+    update_allocator = TRUE;
+  } else {
+    allocator = NULL;
+    gst_allocation_params_init(&params);
+    update_allocator = FALSE;
+  }
+
+  if (gst_query_get_n_allocation_pools(query) > 0) {
+    gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+    update_pool = TRUE;
+  } else {
+    GstVideoInfo vinfo;
+
+    /* the caps of the query, renditions have their own size */
+    gst_video_info_init(&vinfo);
+    gst_video_info_from_caps(&vinfo, outcaps);
+    pool = NULL;
+    size = GST_VIDEO_INFO_SIZE(&vinfo);
+    min = max = 0;
+    update_pool = FALSE;
+  }
+
+  if (pool == NULL) {
+    /* we did not get a pool, make one ourselves then */
+    pool = gst_video_buffer_pool_new();
+  }
+
+  config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_set_params(config, outcaps, size, min, max);
+  gst_buffer_pool_config_set_allocator(config, allocator, &params);
+  gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  gst_buffer_pool_set_config(pool, config);
+
+  if (update_allocator)
+    gst_query_set_nth_allocation_param(query, 0, allocator, &params);
+  else
+    gst_query_add_allocation_param(query, allocator, &params);
+
+  if (allocator)
+    gst_object_unref(allocator);
+
+  if (update_pool)
+    gst_query_set_nth_allocation_pool(query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool(query, pool, size, min, max);
+
+  if (pool)
+    gst_object_unref(pool);
+
+  return TRUE;
+}
+
+static gboolean gst_pm_audio_visualizer_default_decide_rendition_allocation(
+    GstPMAudioVisualizer *scope, GstPMAudioVisualizerRendition *rendition,
+    GstQuery *query) {
+  return gst_pm_audio_visualizer_default_decide_allocation(scope, query);
+}
+
+typedef struct {
+  GstPad *pad;
+  gboolean before_caps;
+} StickyEventsCopy;
+
+static gboolean gst_pm_audio_visualizer_copy_sticky_event(GstPad *pad,
+                                                          GstEvent **event,
+                                                          gpointer user_data) {
+  StickyEventsCopy *copy = user_data;
+  GstEventType type = GST_EVENT_TYPE(*event);
+
+  /* renditions have caps of their own, the order of the others is kept by
+   * storing stream-start before the caps and the rest after them */
+  if (type != GST_EVENT_CAPS && (type < GST_EVENT_CAPS) == copy->before_caps)
+    gst_pad_store_sticky_event(copy->pad, *event);
+
+  return TRUE;
+}
+
+static gboolean gst_pm_audio_visualizer_rendition_negotiate(
+    GstPMAudioVisualizer *scope, GstPMAudioVisualizerRendition *rendition) {
+  GstPMAudioVisualizerClass *klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+  GstCaps *othercaps, *target, *templ;
+  GstStructure *structure;
+  GstBufferPool *pool = NULL;
+  StickyEventsCopy copy;
+  GstVideoInfo info;
+  GstQuery *query;
+
+  templ = gst_pad_get_pad_template_caps(rendition->pad);
+
+  GST_DEBUG_OBJECT(rendition->pad, "performing negotiation");
+
+  othercaps = gst_pad_peer_query_caps(rendition->pad, NULL);
+  if (othercaps) {
+    target = gst_caps_intersect(othercaps, templ);
+    gst_caps_unref(othercaps);
+    gst_caps_unref(templ);
+
+    if (gst_caps_is_empty(target))
+      goto no_format;
+
+    target = gst_caps_truncate(target);
+  } else {
+    target = templ;
+  }
+
+  /* without constraints from downstream, a rendition is a copy of the main
+   * output */
+  target = gst_caps_make_writable(target);
+  structure = gst_caps_get_structure(target, 0);
+  gst_structure_fixate_field_nearest_int(structure, "width",
+                                         GST_VIDEO_INFO_WIDTH(&scope->vinfo));
+  gst_structure_fixate_field_nearest_int(structure, "height",
+                                         GST_VIDEO_INFO_HEIGHT(&scope->vinfo));
+  gst_structure_fixate_field_nearest_fraction(
+      structure, "framerate", GST_VIDEO_INFO_FPS_N(&scope->vinfo),
+      GST_VIDEO_INFO_FPS_D(&scope->vinfo));
+  if (gst_structure_has_field(structure, "pixel-aspect-ratio"))
+    gst_structure_fixate_field_nearest_fraction(structure, "pixel-aspect-ratio",
+                                                1, 1);
+
+  target = gst_caps_fixate(target);
+
+  if (!gst_video_info_from_caps(&info, target))
+    goto no_format;
+
+  /* every rendered frame is output on every pad */
+  if (gst_util_fraction_compare(GST_VIDEO_INFO_FPS_N(&info),
+                                GST_VIDEO_INFO_FPS_D(&info),
+                                GST_VIDEO_INFO_FPS_N(&scope->vinfo),
+                                GST_VIDEO_INFO_FPS_D(&scope->vinfo)) != 0)
+    goto wrong_framerate;
+
+  GST_DEBUG_OBJECT(rendition->pad, "final caps are %" GST_PTR_FORMAT, target);
+
+  copy.pad = rendition->pad;
+  copy.before_caps = TRUE;
+  gst_pad_sticky_events_foreach(scope->priv->srcpad,
+                                gst_pm_audio_visualizer_copy_sticky_event,
+                                &copy);
+  gst_pad_set_caps(rendition->pad, target);
+  copy.before_caps = FALSE;
+  gst_pad_sticky_events_foreach(scope->priv->srcpad,
+                                gst_pm_audio_visualizer_copy_sticky_event,
+                                &copy);
+
+  rendition->vinfo = info;
+  gst_caps_replace(&rendition->caps, target);
+
+  query = gst_query_new_allocation(target, TRUE);
+  gst_caps_unref(target);
+
+  if (!gst_pad_peer_query(rendition->pad, query)) {
+    /* not a problem, we use the query defaults */
+    GST_DEBUG_OBJECT(rendition->pad, "allocation query failed");
+  }
+
+  if (!klass->decide_rendition_allocation(scope, rendition, query)) {
+    GST_WARNING_OBJECT(rendition->pad,
+                       "Subclass failed to decide allocation");
+    gst_query_unref(query);
+    return FALSE;
+  }
+
+  if (gst_query_get_n_allocation_pools(query) > 0)
+    gst_query_parse_nth_allocation_pool(query, 0, &pool, NULL, NULL, NULL);
+  gst_query_unref(query);
+
+  if (rendition->pool) {
+    gst_buffer_pool_set_active(rendition->pool, FALSE);
+    gst_object_unref(rendition->pool);
+  }
+  rendition->pool = pool;
+  rendition->pool_active = FALSE;
+
+  return pool != NULL;
+
+  /* Errors */
+no_format: {
+  gst_caps_unref(target);
+  return FALSE;
+}
+wrong_framerate: {
+  GST_WARNING_OBJECT(rendition->pad,
+                     "downstream does not accept the framerate %d/%d",
+                     GST_VIDEO_INFO_FPS_N(&scope->vinfo),
+                     GST_VIDEO_INFO_FPS_D(&scope->vinfo));
+  gst_caps_unref(target);
+  return FALSE;
+}
+}
+
+/* negotiate the renditions that are linked and had their format or the main
+ * output change, with config_lock */
+static void
+gst_pm_audio_visualizer_negotiate_renditions(GstPMAudioVisualizer *scope) {
+  GstPMAudioVisualizerRendition *rendition;
+  guint i;
+
+  for (i = 0; i < scope->priv->renditions->len; i++) {
+    rendition = g_ptr_array_index(scope->priv->renditions, i);
+
+    if (gst_pad_check_reconfigure(rendition->pad))
+      rendition->need_negotiate = TRUE;
+
+    /* linking the pad marks it for reconfiguration */
+    if (!rendition->need_negotiate || !gst_pad_is_linked(rendition->pad))
+      continue;
+
+    rendition->need_negotiate = FALSE;
+    if (!gst_pm_audio_visualizer_rendition_negotiate(scope, rendition)) {
+      GST_ELEMENT_WARNING(scope, CORE, NEGOTIATION, (NULL),
+                          ("failed to negotiate %s, not rendering it",
+                           GST_PAD_NAME(rendition->pad)));
+      gst_caps_replace(&rendition->caps, NULL);
+    }
+  }
+}
+
+/* let the subclass finish the frame and push it, takes the buffer */
+static GstFlowReturn gst_pm_audio_visualizer_push(GstPMAudioVisualizer *scope,
+                                                  GstBuffer *outbuf) {
+  GstPMAudioVisualizerClass *klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+
+  if (klass->finish_frame) {
+    outbuf = gst_buffer_make_writable(outbuf);
+    klass->finish_frame(scope, outbuf);
+  }
+
+  return gst_pad_push(scope->priv->srcpad, outbuf);
+}
+
+static GstFlowReturn
+default_prepare_output_buffer(GstPMAudioVisualizer *scope,
+                              GstBuffer **outbuf) {
+  GstPMAudioVisualizerPrivate *priv;
+
+  priv = scope->priv;
+
+  g_assert(priv->pool != NULL);
+
+  /* we can't reuse the input buffer */
+  if (!priv->pool_active) {
+    GST_DEBUG_OBJECT(scope, "setting pool %p active", priv->pool);
+    if (!gst_buffer_pool_set_active(priv->pool, TRUE))
+      goto activate_failed;
+    priv->pool_active = TRUE;
+  }
+  GST_DEBUG_OBJECT(scope, "using pool alloc");
+
+  return gst_buffer_pool_acquire_buffer(priv->pool, outbuf, NULL);
+
+  /* ERRORS */
+activate_failed: {
+  GST_ELEMENT_ERROR(scope, RESOURCE, SETTINGS,
+                    ("failed to activate bufferpool"),
+                    ("failed to activate bufferpool"));
+  return GST_FLOW_ERROR;
+}
+}
+
+static GstFlowReturn
+gst_pm_audio_visualizer_prepare_rendition_buffer(
+    GstPMAudioVisualizer *scope, GstPMAudioVisualizerRendition *rendition,
+    GstBuffer **outbuf) {
+  if (!rendition->pool_active) {
+    GST_DEBUG_OBJECT(rendition->pad, "setting pool %p active", rendition->pool);
+    if (!gst_buffer_pool_set_active(rendition->pool, TRUE)) {
+      GST_ELEMENT_ERROR(scope, RESOURCE, SETTINGS,
+                        ("failed to activate bufferpool"),
+                        ("failed to activate bufferpool of %s",
+                         GST_PAD_NAME(rendition->pad)));
+      return GST_FLOW_ERROR;
+    }
+    rendition->pool_active = TRUE;
+  }
+
+  return gst_buffer_pool_acquire_buffer(rendition->pool, outbuf, NULL);
+}
+
+typedef struct {
+  GstPad *pad;
+  GstBuffer *buffer;
+} RenditionFrame;
+
+/* fill a buffer for each negotiated rendition from the frame that was just
+ * rendered, they are collected in @frames to be pushed without the lock, with
+ * config_lock */
+static GstFlowReturn
+gst_pm_audio_visualizer_render_renditions(GstPMAudioVisualizer *scope,
+                                          GstClockTime ts, GArray *frames) {
+  GstPMAudioVisualizerClass *klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+  GstPMAudioVisualizerRendition *rendition;
+  GstFlowReturn ret;
+  RenditionFrame frame;
+  GstBuffer *outbuf;
+  guint i;
+
+  if (!klass->render_rendition)
+    return GST_FLOW_OK;
+
+  for (i = 0; i < scope->priv->renditions->len; i++) {
+    rendition = g_ptr_array_index(scope->priv->renditions, i);
+    if (!rendition->caps)
+      continue;
+
+    ret = gst_pm_audio_visualizer_prepare_rendition_buffer(scope, rendition,
+                                                           &outbuf);
+    if (ret != GST_FLOW_OK)
+      return ret;
+
+    GST_BUFFER_PTS(outbuf) = ts;
+    GST_BUFFER_DURATION(outbuf) = scope->priv->frame_duration;
+
+    ret = klass->render_rendition(scope, rendition, outbuf);
+    if (ret != GST_FLOW_OK) {
+      gst_buffer_unref(outbuf);
+      if (ret == GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED)
+        continue;
+      return ret;
+    }
+
+    frame.pad = gst_object_ref(rendition->pad);
+    frame.buffer = outbuf;
+    g_array_append_val(frames, frame);
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* push the collected rendition buffers, without config_lock */
+static GstFlowReturn
+gst_pm_audio_visualizer_push_renditions(GstPMAudioVisualizer *scope,
+                                        GArray *frames) {
+  GstFlowReturn ret = GST_FLOW_OK, pad_ret;
+  RenditionFrame *frame;
+  guint i;
+
+  for (i = 0; i < frames->len; i++) {
+    frame = &g_array_index(frames, RenditionFrame, i);
+    pad_ret = gst_pad_push(frame->pad, frame->buffer);
+
+    /* a rendition that was unlinked, is flushing or at EOS does not stop the
+     * others, like a branch of a tee */
+    if (pad_ret <= GST_FLOW_NOT_NEGOTIATED && ret == GST_FLOW_OK)
+      ret = pad_ret;
+    else if (pad_ret != GST_FLOW_OK)
+      GST_DEBUG_OBJECT(frame->pad, "push returned %s",
+                       gst_flow_get_name(pad_ret));
+
+    gst_object_unref(frame->pad);
+  }
+  g_array_set_size(frames, 0);
+
+  return ret;
+}
+
+/* drop collected rendition buffers after an error */
+static void gst_pm_audio_visualizer_clear_renditions(GArray *frames) {
+  RenditionFrame *frame;
+  guint i;
+
+  for (i = 0; i < frames->len; i++) {
+    frame = &g_array_index(frames, RenditionFrame, i);
+    gst_buffer_unref(frame->buffer);
+    gst_object_unref(frame->pad);
+  }
+  g_array_set_size(frames, 0);
+}
+
+/* Number of samples belonging to the next video frame. The frame boundaries
+ * are computed from the frame count instead of adding up the rounded spf, so
+ * fractional framerates such as 30000/1001 don't drift: frames alternately
+ * get spf and spf + 1 samples. */
+static guint
+gst_pm_audio_visualizer_frame_samples(GstPMAudioVisualizer *scope) {
+  guint64 rate_d = (guint64)GST_AUDIO_INFO_RATE(&scope->ainfo) *
+                   GST_VIDEO_INFO_FPS_D(&scope->vinfo);
+  gint fps_n = GST_VIDEO_INFO_FPS_N(&scope->vinfo);
+  guint64 start, end;
+
+  if (fps_n <= 0)
+    return scope->priv->spf;
+
+  start = gst_util_uint64_scale(scope->priv->frame_count, rate_d, fps_n);
+  end = gst_util_uint64_scale(scope->priv->frame_count + 1, rate_d, fps_n);
+
+  return (guint)(end - start);
+}
+
+static GstFlowReturn gst_pm_audio_visualizer_chain(GstPad *pad,
+                                                   GstObject *parent,
+                                                   GstBuffer *buffer) {
+  GstFlowReturn ret = GST_FLOW_OK, rendition_ret;
+  GstPMAudioVisualizer *scope = GST_PM_AUDIO_VISUALIZER(parent);
+  GstPMAudioVisualizerClass *klass;
+  GArray *frames = NULL;
+  GstBuffer *inbuf;
+  guint64 dist, ts;
+  guint avail, sbpf, step;
+  gpointer adata;
+  gint bpf, rate;
+
+  klass = GST_PM_AUDIO_VISUALIZER_CLASS(G_OBJECT_GET_CLASS(scope));
+
+  GST_LOG_OBJECT(scope, "chainfunc called");
+
+  /* resync on DISCONT */
+  if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DISCONT)) {
+    gst_adapter_clear(scope->priv->adapter);
+    scope->priv->frame_count = 0;
+  }
+
+  /* Make sure have an output format */
+  if (gst_pad_check_reconfigure(scope->priv->srcpad)) {
+    if (!gst_pm_audio_visualizer_src_negotiate(scope)) {
+      gst_pad_mark_reconfigure(scope->priv->srcpad);
+      goto not_negotiated;
+    }
+  }
+
+  rate = GST_AUDIO_INFO_RATE(&scope->ainfo);
+  bpf = GST_AUDIO_INFO_BPF(&scope->ainfo);
+
+  if (bpf == 0) {
+    ret = GST_FLOW_NOT_NEGOTIATED;
+    goto beach;
+  }
+
+  gst_adapter_push(scope->priv->adapter, buffer);
+
+  frames = g_array_new(FALSE, FALSE, sizeof(RenditionFrame));
+
+  g_mutex_lock(&scope->priv->config_lock);
+
+  gst_pm_audio_visualizer_negotiate_renditions(scope);
+
+  /* this is what we consume for the next frame, the subclass may want to see
+   * more than that */
+  step = gst_pm_audio_visualizer_frame_samples(scope);
+  sbpf = MAX(step, scope->req_spf) * bpf;
+
+  inbuf = scope->priv->inbuf;
+  /* FIXME: the timestamp in the adapter would be different */
+  gst_buffer_copy_into(inbuf, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+
+  /* this is what we have */
+  avail = gst_adapter_available(scope->priv->adapter);
+  GST_LOG_OBJECT(scope, "avail: %u, bpf: %u", avail, sbpf);
+  while (avail >= sbpf) {
+    GstBuffer *outbuf;
+
+    /* get timestamp of the current adapter content */
+    ts = gst_adapter_prev_pts(scope->priv->adapter, &dist);
+    if (GST_CLOCK_TIME_IS_VALID(ts)) {
+      /* convert bytes to time */
+      ts += gst_util_uint64_scale_int(dist / bpf, GST_SECOND, rate);
+    }
+
+    /* check for QoS, don't compute buffers that are known to be late */
+    if (GST_CLOCK_TIME_IS_VALID(ts)) {
+      GstClockTime earliest_time;
+      gdouble proportion;
+      gboolean qos_enabled;
+      gint64 qostime;
+
+      qostime = gst_segment_to_running_time(&scope->priv->segment,
+                                            GST_FORMAT_TIME, ts) +
+                scope->priv->frame_duration;
+
+      GST_OBJECT_LOCK(scope);
+      qos_enabled = scope->priv->qos_enabled;
+      earliest_time = scope->priv->earliest_time;
+      proportion = scope->priv->proportion;
+      GST_OBJECT_UNLOCK(scope);
+
+      if (qos_enabled && GST_CLOCK_TIME_IS_VALID(earliest_time) &&
+          qostime <= earliest_time) {
+        GstClockTime stream_time, jitter;
+        GstMessage *qos_msg;
+
+        GST_DEBUG_OBJECT(scope,
+                         "QoS: skip ts: %" GST_TIME_FORMAT
+                         ", earliest: %" GST_TIME_FORMAT,
+                         GST_TIME_ARGS(qostime), GST_TIME_ARGS(earliest_time));
+
+        ++scope->priv->dropped;
+        stream_time = gst_segment_to_stream_time(&scope->priv->segment,
+                                                 GST_FORMAT_TIME, ts);
+        jitter = GST_CLOCK_DIFF(qostime, earliest_time);
+        qos_msg =
+            gst_message_new_qos(GST_OBJECT(scope), FALSE, qostime, stream_time,
+                                ts, scope->priv->frame_duration);
+        gst_message_set_qos_values(qos_msg, jitter, proportion, 1000000);
+        gst_message_set_qos_stats(qos_msg, GST_FORMAT_BUFFERS,
+                                  scope->priv->processed, scope->priv->dropped);
+        gst_element_post_message(GST_ELEMENT(scope), qos_msg);
+
+        goto skip;
+      }
+    }
+
+    ++scope->priv->processed;
+
+    g_mutex_unlock(&scope->priv->config_lock);
+    ret = default_prepare_output_buffer(scope, &outbuf);
+    g_mutex_lock(&scope->priv->config_lock);
+    /* recheck as the value could have changed */
+    sbpf = MAX(step, scope->req_spf) * bpf;
+
+    /* no buffer allocated, we don't care why. */
+    if (ret != GST_FLOW_OK)
+      break;
+
+    /* sync controlled properties */
+    if (GST_CLOCK_TIME_IS_VALID(ts))
+      gst_object_sync_values(GST_OBJECT(scope), ts);
+
+    GST_BUFFER_PTS(outbuf) = ts;
+    GST_BUFFER_DURATION(outbuf) = scope->priv->frame_duration;
+
+    /* this can fail as the data size we need could have changed */
+    if (!(adata = (gpointer)gst_adapter_map(scope->priv->adapter, sbpf))) {
+      gst_buffer_unref(outbuf);
+      break;
+    }
+
+    gst_buffer_replace_all_memory(
+        inbuf, gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, adata, sbpf, 0,
+                                      sbpf, NULL, NULL));
+
+    /* call class->render() vmethod, the subclass maps the output buffer */
+    if (klass->render) {
+      ret = klass->render(scope, inbuf, outbuf);
+      if (ret < GST_FLOW_OK) {
+        gst_adapter_unmap(scope->priv->adapter);
+        gst_buffer_unref(outbuf);
+        g_mutex_unlock(&scope->priv->config_lock);
+        goto beach;
+      }
+    }
+    gst_adapter_unmap(scope->priv->adapter);
+
+    /* the renditions are filled from the frame that was just rendered, also
+     * when the subclass holds it back */
+    rendition_ret =
+        gst_pm_audio_visualizer_render_renditions(scope, ts, frames);
+    if (rendition_ret != GST_FLOW_OK) {
+      gst_pm_audio_visualizer_clear_renditions(frames);
+      gst_buffer_unref(outbuf);
+      g_mutex_unlock(&scope->priv->config_lock);
+      ret = rendition_ret;
+      goto beach;
+    }
+
+    g_mutex_unlock(&scope->priv->config_lock);
+    if (ret == GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED) {
+      /* the subclass holds on to the frame, it is output later */
+      gst_buffer_unref(outbuf);
+      ret = GST_FLOW_OK;
+    } else {
+      ret = gst_pm_audio_visualizer_push(scope, outbuf);
+    }
+    rendition_ret = gst_pm_audio_visualizer_push_renditions(scope, frames);
+    if (ret == GST_FLOW_OK)
+      ret = rendition_ret;
+    if (ret == GST_FLOW_OK)
+      ret = gst_pm_audio_visualizer_push_frames(scope, FALSE);
+    g_mutex_lock(&scope->priv->config_lock);
+    outbuf = NULL;
+
+  skip:
+    /* only the samples of this frame are consumed, anything beyond is seen
+     * again by the next frame */
+    gst_adapter_flush(scope->priv->adapter, step * bpf);
+    scope->priv->frame_count++;
+
+    /* recheck as the value could have changed */
+    step = gst_pm_audio_visualizer_frame_samples(scope);
+    sbpf = MAX(step, scope->req_spf) * bpf;
+    avail = gst_adapter_available(scope->priv->adapter);
+    GST_LOG_OBJECT(scope, "avail: %u, bpf: %u", avail, sbpf);
+
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  g_mutex_unlock(&scope->priv->config_lock);
+
+beach:
+  if (frames)
+    g_array_unref(frames);
+
+  return ret;
+
+  /* ERRORS */
+not_negotiated: {
+  GST_DEBUG_OBJECT(scope, "Failed to renegotiate");
+  return GST_FLOW_NOT_NEGOTIATED;
+}
+}
+
+/**
+ * gst_pm_audio_visualizer_set_output_delay:
+ * @scope: a #GstPMAudioVisualizer
+ * @frames: number of frames the subclass holds back before output
+ *
+ * Informs the base class that output lags behind rendering by @frames frames,
+ * so it can be accounted for in the latency query.
+ */
+void gst_pm_audio_visualizer_set_output_delay(GstPMAudioVisualizer *scope,
+                                              guint frames) {
+  gboolean changed;
+
+  GST_OBJECT_LOCK(scope);
+  changed = scope->priv->output_delay != frames;
+  scope->priv->output_delay = frames;
+  GST_OBJECT_UNLOCK(scope);
+
+  if (changed) {
+    GST_DEBUG_OBJECT(scope, "output delay is now %u frames", frames);
+    gst_element_post_message(GST_ELEMENT(scope),
+                             gst_message_new_latency(GST_OBJECT(scope)));
+  }
+}
+
+/**
+ * gst_pm_audio_visualizer_set_qos_enabled:
+ * @scope: a #GstPMAudioVisualizer
+ * @enabled: new state
+ *
+ * Enable or disable skipping of frames that are known to be late. Disabled
+ * when every frame must be rendered, e.g. for reproducible offline renders.
+ */
+void gst_pm_audio_visualizer_set_qos_enabled(GstPMAudioVisualizer *scope,
+                                             gboolean enabled) {
+  GST_OBJECT_LOCK(scope);
+  scope->priv->qos_enabled = enabled;
+  GST_OBJECT_UNLOCK(scope);
+}
+
+/**
+ * gst_pm_audio_visualizer_get_qos:
+ * @scope: a #GstPMAudioVisualizer
+ * @proportion: (out): the proportion of the last QoS event, 1.0 if there was
+ * none
+ *
+ * Get how well downstream keeps up, values above 1.0 mean frames arrive too
+ * late.
+ *
+ * Returns: FALSE if QoS is disabled, @proportion is not set then.
+ */
+gboolean gst_pm_audio_visualizer_get_qos(GstPMAudioVisualizer *scope,
+                                         gdouble *proportion) {
+  gboolean enabled;
+
+  GST_OBJECT_LOCK(scope);
+  enabled = scope->priv->qos_enabled;
+  if (enabled)
+    *proportion = scope->priv->proportion;
+  GST_OBJECT_UNLOCK(scope);
+
+  return enabled;
+}
+
+/**
+ * gst_pm_audio_visualizer_has_renditions:
+ * @scope: a #GstPMAudioVisualizer
+ *
+ * Whether any rendition is negotiated, so `render_rendition()` is called for
+ * the frame being rendered. Call from `render()`, with the configuration
+ * locked.
+ *
+ * Returns: TRUE if a rendition has caps.
+ */
+gboolean gst_pm_audio_visualizer_has_renditions(GstPMAudioVisualizer *scope) {
+  GstPMAudioVisualizerRendition *rendition;
+  guint i;
+
+  for (i = 0; i < scope->priv->renditions->len; i++) {
+    rendition = g_ptr_array_index(scope->priv->renditions, i);
+    if (rendition->caps)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* push the output buffers the subclass finished since, without config_lock */
+static GstFlowReturn
+gst_pm_audio_visualizer_push_frames(GstPMAudioVisualizer *scope,
+                                    gboolean drain) {
+  GstPMAudioVisualizerClass *klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+  GstFlowReturn ret;
+  GstBuffer *outbuf;
+
+  if (!klass->pop_frame)
+    return GST_FLOW_OK;
+
+  while ((ret = klass->pop_frame(scope, drain, &outbuf)) == GST_FLOW_OK) {
+    GST_LOG_OBJECT(scope, "pushing finished frame %" GST_TIME_FORMAT,
+                   GST_TIME_ARGS(GST_BUFFER_PTS(outbuf)));
+
+    ret = gst_pm_audio_visualizer_push(scope, outbuf);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
+
+  return ret == GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED ? GST_FLOW_OK : ret;
+}
+
+/* push out the frames the subclass still holds back */
+static GstFlowReturn
+gst_pm_audio_visualizer_drain(GstPMAudioVisualizer *scope) {
+  GstPMAudioVisualizerClass *klass = GST_PM_AUDIO_VISUALIZER_GET_CLASS(scope);
+  GstFlowReturn ret;
+  GstBuffer *outbuf;
+
+  // frames still being rendered come before those held back for readback
+  ret = gst_pm_audio_visualizer_push_frames(scope, TRUE);
+  if (ret != GST_FLOW_OK || !klass->drain)
+    return ret;
+
+  g_mutex_lock(&scope->priv->config_lock);
+  while (scope->priv->pool) {
+    ret = default_prepare_output_buffer(scope, &outbuf);
+    if (ret != GST_FLOW_OK)
+      break;
+
+    ret = klass->drain(scope, outbuf);
+    if (ret != GST_FLOW_OK) {
+      gst_buffer_unref(outbuf);
+      if (ret == GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED)
+        ret = GST_FLOW_OK;
+      break;
+    }
+
+    GST_LOG_OBJECT(scope, "pushing drained frame %" GST_TIME_FORMAT,
+                   GST_TIME_ARGS(GST_BUFFER_PTS(outbuf)));
+
+    g_mutex_unlock(&scope->priv->config_lock);
+    ret = gst_pm_audio_visualizer_push(scope, outbuf);
+    g_mutex_lock(&scope->priv->config_lock);
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+  g_mutex_unlock(&scope->priv->config_lock);
+
+  return ret;
+}
+
+static gboolean gst_pm_audio_visualizer_src_event(GstPad *pad,
+                                                  GstObject *parent,
+                                                  GstEvent *event) {
+  gboolean res;
+  GstPMAudioVisualizer *scope;
+
+  scope = GST_PM_AUDIO_VISUALIZER(parent);
+
+  switch (GST_EVENT_TYPE(event)) {
+  case GST_EVENT_QOS: {
+    gdouble proportion;
+    GstClockTimeDiff diff;
+    GstClockTime timestamp;
+
+    if (pad != scope->priv->srcpad) {
+      /* only the main output decides which frames are skipped */
+      gst_event_unref(event);
+      res = TRUE;
+      break;
+    }
+
+    gst_event_parse_qos(event, NULL, &proportion, &diff, &timestamp);
+
+    /* save stuff for the _chain() function */
+    GST_OBJECT_LOCK(scope);
+    scope->priv->proportion = proportion;
+    if (diff >= 0)
+      /* we're late, this is a good estimate for next displayable
+       * frame (see part-qos.txt) */
+      scope->priv->earliest_time =
+          timestamp + 2 * diff + scope->priv->frame_duration;
+    else
+      scope->priv->earliest_time = timestamp + diff;
+    GST_OBJECT_UNLOCK(scope);
+
+    res = gst_pad_push_event(scope->priv->sinkpad, event);
+    break;
+  }
+  case GST_EVENT_RECONFIGURE:
+    /* don't forward */
+    gst_event_unref(event);
+    res = TRUE;
+    break;
+  default:
+    res = gst_pad_event_default(pad, parent, event);
+    break;
+  }
+
+  return res;
+}
+
+/* push an event on the main output and on the negotiated renditions, the
+ * others get the sticky events when they are negotiated */
+static gboolean
+gst_pm_audio_visualizer_push_src_event(GstPMAudioVisualizer *scope,
+                                       GstEvent *event) {
+  GstPMAudioVisualizerRendition *rendition;
+  GPtrArray *pads;
+  gboolean res;
+  guint i;
+
+  pads = g_ptr_array_new_with_free_func(gst_object_unref);
+  g_mutex_lock(&scope->priv->config_lock);
+  for (i = 0; i < scope->priv->renditions->len; i++) {
+    rendition = g_ptr_array_index(scope->priv->renditions, i);
+    if (rendition->caps)
+      g_ptr_array_add(pads, gst_object_ref(rendition->pad));
+  }
+  g_mutex_unlock(&scope->priv->config_lock);
+
+  /* the renditions are optional, only the main output's result counts */
+  for (i = 0; i < pads->len; i++)
+    gst_pad_push_event(g_ptr_array_index(pads, i), gst_event_ref(event));
+  res = gst_pad_push_event(scope->priv->srcpad, event);
+
+  g_ptr_array_unref(pads);
+
+  return res;
+}
+
+static gboolean gst_pm_audio_visualizer_sink_event(GstPad *pad,
+                                                   GstObject *parent,
+                                                   GstEvent *event) {
+  gboolean res;
+  GstPMAudioVisualizer *scope;
+
+  scope = GST_PM_AUDIO_VISUALIZER(parent);
+
+  switch (GST_EVENT_TYPE(event)) {
+  case GST_EVENT_CAPS: {
+    GstCaps *caps;
+
+    gst_event_parse_caps(event, &caps);
+    res = gst_pm_audio_visualizer_sink_setcaps(scope, caps);
+    gst_event_unref(event);
+    break;
+  }
+  case GST_EVENT_EOS:
+    gst_pm_audio_visualizer_drain(scope);
+    res = gst_pm_audio_visualizer_push_src_event(scope, event);
+    break;
+  case GST_EVENT_FLUSH_STOP:
+    gst_pm_audio_visualizer_reset(scope);
+    res = gst_pm_audio_visualizer_push_src_event(scope, event);
+    break;
+  case GST_EVENT_SEGMENT: {
+    /* the newsegment values are used to clip the input samples
+     * and to convert the incoming timestamps to running time so
+     * we can do QoS */
+    gst_event_copy_segment(event, &scope->priv->segment);
+
+    res = gst_pm_audio_visualizer_push_src_event(scope, event);
+    break;
+  }
+  default:
+    res = gst_pad_event_default(pad, parent, event);
+    break;
+  }
+
+  return res;
+}
+
+static gboolean gst_pm_audio_visualizer_src_query(GstPad *pad,
+                                                  GstObject *parent,
+                                                  GstQuery *query) {
+  gboolean res = FALSE;
+  GstPMAudioVisualizer *scope;
+
+  scope = GST_PM_AUDIO_VISUALIZER(parent);
+
+  switch (GST_QUERY_TYPE(query)) {
+  case GST_QUERY_LATENCY: {
+    /* We need to send the query upstream and add the returned latency to our
+     * own */
+    GstClockTime min_latency, max_latency;
+    gboolean us_live;
+    GstClockTime our_latency;
+    guint max_samples, output_delay;
+    gint rate = GST_AUDIO_INFO_RATE(&scope->ainfo);
+
+    if (rate == 0)
+      break;
+
+    if ((res = gst_pad_peer_query(scope->priv->sinkpad, query))) {
+      gst_query_parse_latency(query, &us_live, &min_latency, &max_latency);
+
+      GST_DEBUG_OBJECT(scope,
+                       "Peer latency: min %" GST_TIME_FORMAT
+                       " max %" GST_TIME_FORMAT,
+                       GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+
+      /* the max samples we must buffer buffer, frames with a fractional
+       * number of samples get up to spf + 1 */
+      max_samples = MAX(scope->req_spf, scope->priv->spf + 1);
+      our_latency = gst_util_uint64_scale_int(max_samples, GST_SECOND, rate);
+
+      /* frames the subclass holds back are output that much later */
+      GST_OBJECT_LOCK(scope);
+      output_delay = scope->priv->output_delay;
+      GST_OBJECT_UNLOCK(scope);
+      if (output_delay > 0 &&
+          GST_CLOCK_TIME_IS_VALID(scope->priv->frame_duration))
+        our_latency += output_delay * scope->priv->frame_duration;
+
+      GST_DEBUG_OBJECT(scope, "Our latency: %" GST_TIME_FORMAT,
+                       GST_TIME_ARGS(our_latency));
+
+      /* we add some latency but only if we need to buffer more than what
+       * upstream gives us */
+      min_latency += our_latency;
+      if (max_latency != -1)
+        max_latency += our_latency;
+
+      GST_DEBUG_OBJECT(scope,
+                       "Calculated total latency : min %" GST_TIME_FORMAT
+                       " max %" GST_TIME_FORMAT,
+                       GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+
+      gst_query_set_latency(query, TRUE, min_latency, max_latency);
+    }
+    break;
+  }
+  default:
+    res = gst_pad_query_default(pad, parent, query);
+    break;
+  }
+
+  return res;
+}
+
+static GstStateChangeReturn
+gst_pm_audio_visualizer_change_state(GstElement *element,
+                                     GstStateChange transition) {
+  GstStateChangeReturn ret;
+  GstPMAudioVisualizer *scope;
+
+  scope = GST_PM_AUDIO_VISUALIZER(element);
+
+  switch (transition) {
+  case GST_STATE_CHANGE_READY_TO_PAUSED:
+    gst_pm_audio_visualizer_reset(scope);
+    break;
+  default:
+    break;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+  switch (transition) {
+  case GST_STATE_CHANGE_PAUSED_TO_READY: {
+    guint i;
+
+    gst_pm_audio_visualizer_set_allocation(scope, NULL, NULL, NULL, NULL);
+
+    g_mutex_lock(&scope->priv->config_lock);
+    for (i = 0; i < scope->priv->renditions->len; i++)
+      gst_pm_audio_visualizer_rendition_reset(
+          g_ptr_array_index(scope->priv->renditions, i));
+    g_mutex_unlock(&scope->priv->config_lock);
+    break;
+  }
+  case GST_STATE_CHANGE_READY_TO_NULL:
+    break;
+  default:
+    break;
+  }
+
+  return ret;
+}
+
+static GstPad *gst_pm_audio_visualizer_request_new_pad(GstElement *element,
+                                                       GstPadTemplate *templ,
+                                                       const gchar *name,
+                                                       const GstCaps *caps) {
+  GstPMAudioVisualizer *scope = GST_PM_AUDIO_VISUALIZER(element);
+  GstPMAudioVisualizerRendition *rendition;
+  gchar *pad_name;
+  GstPad *pad;
+
+  GST_OBJECT_LOCK(scope);
+  if (name)
+    pad_name = g_strdup(name);
+  else
+    pad_name = g_strdup_printf("src_%u", scope->priv->next_rendition);
+  scope->priv->next_rendition++;
+  GST_OBJECT_UNLOCK(scope);
+
+  pad = gst_pad_new_from_template(templ, pad_name);
+  g_free(pad_name);
+
+  gst_pad_set_event_function(
+      pad, GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_src_event));
+  gst_pad_set_query_function(
+      pad, GST_DEBUG_FUNCPTR(gst_pm_audio_visualizer_src_query));
+
+  rendition = g_new0(GstPMAudioVisualizerRendition, 1);
+  rendition->pad = pad;
+  rendition->need_negotiate = TRUE;
+  gst_video_info_init(&rendition->vinfo);
+
+  /* nothing is rendered for the pad before it is linked, which can only
+   * happen once it was added */
+  g_mutex_lock(&scope->priv->config_lock);
+  g_ptr_array_add(scope->priv->renditions, rendition);
+  g_mutex_unlock(&scope->priv->config_lock);
+
+  if (!gst_element_add_pad(element, pad)) {
+    g_mutex_lock(&scope->priv->config_lock);
+    g_ptr_array_remove(scope->priv->renditions, rendition);
+    g_mutex_unlock(&scope->priv->config_lock);
+
+    g_free(rendition);
+    gst_object_unref(pad);
+    return NULL;
+  }
+
+  GST_DEBUG_OBJECT(scope, "added rendition %s", GST_PAD_NAME(pad));
+
+  return pad;
+}
+
+static void gst_pm_audio_visualizer_release_pad(GstElement *element,
+                                                GstPad *pad) {
+  GstPMAudioVisualizer *scope = GST_PM_AUDIO_VISUALIZER(element);
+  GstPMAudioVisualizerRendition *rendition = NULL, *candidate;
+  guint i;
+
+  g_mutex_lock(&scope->priv->config_lock);
+  for (i = 0; i < scope->priv->renditions->len; i++) {
+    candidate = g_ptr_array_index(scope->priv->renditions, i);
+    if (candidate->pad == pad) {
+      rendition = candidate;
+      g_ptr_array_remove_index(scope->priv->renditions, i);
+      break;
+    }
+  }
+  g_mutex_unlock(&scope->priv->config_lock);
+
+  if (!rendition)
+    return;
+
+  GST_DEBUG_OBJECT(scope, "releasing rendition %s", GST_PAD_NAME(pad));
+
+  gst_pm_audio_visualizer_rendition_free(scope, rendition);
+
+  gst_pad_set_active(pad, FALSE);
+  gst_element_remove_pad(element, pad);
+}
@@ -0,0 +1,178 @@
+/* GStreamer
+ * Copyright (C) <2011> Stefan Kost <ensonic@users.sf.net>
+ * Copyright (C) <2015> Luis de Bethencourt <luis@debethencourt.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The code in this file is based on code from
+ * GStreamer / gst-plugins-base / 1.22: gst-libs/gst/pbutils/gstaudiovisualizer.h
+ * Git Repository:
+ * https://github.com/GStreamer/gst-plugins-base/blob/master/gst-libs/gst/pbutils/gstaudiovisualizer.h
+ * Original copyright notice has been retained at the top of this file.
+ */
+
+#ifndef __GST_PM_AUDIO_VISUALIZER_H__
+#define __GST_PM_AUDIO_VISUALIZER_H__
+
+#include <gst/gst.h>
+
+#include <gst/audio/audio.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PM_AUDIO_VISUALIZER (gst_pm_audio_visualizer_get_type())
+#define GST_PM_AUDIO_VISUALIZER(obj)                                           \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_PM_AUDIO_VISUALIZER,             \
+                              GstPMAudioVisualizer))
+#define GST_PM_AUDIO_VISUALIZER_CLASS(klass)                                   \
+  (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_PM_AUDIO_VISUALIZER,              \
+                           GstPMAudioVisualizerClass))
+#define GST_PM_AUDIO_VISUALIZER_GET_CLASS(obj)                                 \
+  (G_TYPE_INSTANCE_GET_CLASS((obj), GST_TYPE_PM_AUDIO_VISUALIZER,              \
+                             GstPMAudioVisualizerClass))
+#define GST_IS_PM_AUDIO_VISUALIZER(obj)                                        \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_PM_AUDIO_VISUALIZER))
+#define GST_IS_PM_AUDIO_VISUALIZER_CLASS(klass)                                \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_PM_AUDIO_VISUALIZER))
+
+typedef struct _GstPMAudioVisualizer GstPMAudioVisualizer;
+typedef struct _GstPMAudioVisualizerClass GstPMAudioVisualizerClass;
+typedef struct _GstPMAudioVisualizerPrivate GstPMAudioVisualizerPrivate;
+typedef struct _GstPMAudioVisualizerRendition GstPMAudioVisualizerRendition;
+
+/**
+ * GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED:
+ *
+ * A #GstFlowReturn that can be returned from the render() and drain() virtual
+ * methods to indicate that no output frame was produced (yet).
+ */
+#define GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED GST_FLOW_CUSTOM_SUCCESS
+
+/**
+ * GstPMAudioVisualizer:
+ * @req_spf: min samples per frame wanted by the subclass
+ * @vinfo: the negotiated video info
+ * @ainfo: the negotiated audio info
+ *
+ * Fork of #GstAudioVisualizer that leaves mapping of the output buffer to the
+ * subclass. This allows writing to GL memory without a round trip through
+ * system memory.
+ */
+struct _GstPMAudioVisualizer {
+  GstElement parent;
+
+  guint req_spf;
+
+  /* video state */
+  GstVideoInfo vinfo;
+
+  /* audio state */
+  GstAudioInfo ainfo;
+
+  /*< private >*/
+  GstPMAudioVisualizerPrivate *priv;
+};
+
+/**
+ * GstPMAudioVisualizerRendition:
+ * @pad: the requested src pad
+ * @caps: the negotiated caps, NULL while not negotiated
+ * @vinfo: the negotiated video info
+ *
+ * An additional output of the rendered frames, at its own size and format.
+ * One is created for each requested "src_%u" pad, if the element class has a
+ * template for them.
+ */
+struct _GstPMAudioVisualizerRendition {
+  GstPad *pad;
+  GstCaps *caps;
+  GstVideoInfo vinfo;
+
+  /*< private >*/
+  GstBufferPool *pool;
+  gboolean pool_active;
+  gboolean need_negotiate;
+};
+
+/**
+ * GstPMAudioVisualizerClass:
+ * @setup: called whenever the format changes
+ * @render: called for each frame to render the audio buffer into the
+ * (unmapped) output buffer. Returns GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED if
+ * the buffer should not be pushed, e.g. because the frame is still in flight.
+ * @decide_allocation: instruct the subclass how to allocate the output buffers
+ * @drain: called at EOS to fill the output buffer with a frame still held back
+ * by the subclass. Called repeatedly until it returns
+ * GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED.
+ * @flush: discard all frames held back by the subclass
+ * @pop_frame: return a finished output buffer the subclass held on to after
+ * @render returned GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED, called after each
+ * @render until it returns GST_PM_AUDIO_VISUALIZER_FLOW_DROPPED. With @drain
+ * set, at EOS, it waits for frames that are still being rendered.
+ * @decide_rendition_allocation: like @decide_allocation, for the output
+ * buffers of a rendition
+ * @render_rendition: called after @render for each negotiated rendition, to
+ * fill its (unmapped) output buffer with the frame that was just rendered
+ * @release_rendition: free what the subclass keeps for a rendition, called
+ * when its pad is released
+ * @finish_frame: called with each writable output buffer right before it is
+ * pushed, in output order, e.g. to attach metadata to frames that were held
+ * back
+ */
+struct _GstPMAudioVisualizerClass {
+  GstElementClass parent_class;
+
+  /*< public >*/
+  gboolean (*setup)(GstPMAudioVisualizer *scope);
+  GstFlowReturn (*render)(GstPMAudioVisualizer *scope, GstBuffer *audio,
+                          GstBuffer *video);
+  gboolean (*decide_allocation)(GstPMAudioVisualizer *scope, GstQuery *query);
+  GstFlowReturn (*drain)(GstPMAudioVisualizer *scope, GstBuffer *video);
+  void (*flush)(GstPMAudioVisualizer *scope);
+  GstFlowReturn (*pop_frame)(GstPMAudioVisualizer *scope, gboolean drain,
+                             GstBuffer **video);
+  gboolean (*decide_rendition_allocation)(
+      GstPMAudioVisualizer *scope, GstPMAudioVisualizerRendition *rendition,
+      GstQuery *query);
+  GstFlowReturn (*render_rendition)(GstPMAudioVisualizer *scope,
+                                    GstPMAudioVisualizerRendition *rendition,
+                                    GstBuffer *video);
+  void (*release_rendition)(GstPMAudioVisualizer *scope,
+                            GstPMAudioVisualizerRendition *rendition);
+  void (*finish_frame)(GstPMAudioVisualizer *scope, GstBuffer *video);
+};
+
+GType gst_pm_audio_visualizer_get_type(void);
+
+void gst_pm_audio_visualizer_set_output_delay(GstPMAudioVisualizer *scope,
+                                              guint frames);
+
+void gst_pm_audio_visualizer_set_qos_enabled(GstPMAudioVisualizer *scope,
+                                             gboolean enabled);
+
+gboolean gst_pm_audio_visualizer_get_qos(GstPMAudioVisualizer *scope,
+                                         gdouble *proportion);
+
+gboolean gst_pm_audio_visualizer_has_renditions(GstPMAudioVisualizer *scope);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GstPMAudioVisualizer, gst_object_unref)
+
+G_END_DECLS
+
+#endif /* __GST_PM_AUDIO_VISUALIZER_H__ */
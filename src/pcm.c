@@ -0,0 +1,328 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "pcm.h"
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PCM_HAVE_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PCM_HAVE_NEON 1
+#endif
+
+#define PCM_S16_SCALE (1.0f / 32768.0f)
+#define PCM_S32_SCALE (1.0f / 2147483648.0f)
+
+/* -3 dB, for channels spread over both or mixed into one side */
+#define PCM_SQRT1_2 ((gfloat)(1.0 / G_SQRT2))
+
+static void pcm_channel_gains(GstAudioChannelPosition position, gfloat *left,
+                              gfloat *right) {
+  switch (position) {
+  case GST_AUDIO_CHANNEL_POSITION_MONO:
+    *left = *right = 1.0f;
+    break;
+  case GST_AUDIO_CHANNEL_POSITION_FRONT_LEFT:
+    *left = 1.0f;
+    *right = 0.0f;
+    break;
+  case GST_AUDIO_CHANNEL_POSITION_FRONT_RIGHT:
+    *left = 0.0f;
+    *right = 1.0f;
+    break;
+  case GST_AUDIO_CHANNEL_POSITION_FRONT_CENTER:
+    *left = *right = PCM_SQRT1_2;
+    break;
+  case GST_AUDIO_CHANNEL_POSITION_LFE1:
+  case GST_AUDIO_CHANNEL_POSITION_LFE2:
+    // the low frequency channel duplicates content of the main channels
+    *left = *right = 0.0f;
+    break;
+  case GST_AUDIO_CHANNEL_POSITION_REAR_LEFT:
+  case GST_AUDIO_CHANNEL_POSITION_SIDE_LEFT:
+  case GST_AUDIO_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER:
+  case GST_AUDIO_CHANNEL_POSITION_TOP_FRONT_LEFT:
+  case GST_AUDIO_CHANNEL_POSITION_TOP_REAR_LEFT:
+  case GST_AUDIO_CHANNEL_POSITION_TOP_SIDE_LEFT:
+  case GST_AUDIO_CHANNEL_POSITION_WIDE_LEFT:
+  case GST_AUDIO_CHANNEL_POSITION_SURROUND_LEFT:
+    *left = PCM_SQRT1_2;
+    *right = 0.0f;
+    break;
+  case GST_AUDIO_CHANNEL_POSITION_REAR_RIGHT:
+  case GST_AUDIO_CHANNEL_POSITION_SIDE_RIGHT:
+  case GST_AUDIO_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER:
+  case GST_AUDIO_CHANNEL_POSITION_TOP_FRONT_RIGHT:
+  case GST_AUDIO_CHANNEL_POSITION_TOP_REAR_RIGHT:
+  case GST_AUDIO_CHANNEL_POSITION_TOP_SIDE_RIGHT:
+  case GST_AUDIO_CHANNEL_POSITION_WIDE_RIGHT:
+  case GST_AUDIO_CHANNEL_POSITION_SURROUND_RIGHT:
+    *left = 0.0f;
+    *right = PCM_SQRT1_2;
+    break;
+  default:
+    *left = *right = 0.5f;
+    break;
+  }
+}
+
+void pcm_downmix_init(PcmDownmix *downmix, const GstAudioInfo *info) {
+  gint channels = GST_AUDIO_INFO_CHANNELS(info);
+  gfloat left_sum = 0.0f, right_sum = 0.0f;
+  gint c;
+
+  g_return_if_fail(channels > 0 && channels <= PCM_MAX_CHANNELS);
+
+  downmix->format = GST_AUDIO_INFO_FORMAT(info);
+  downmix->channels = channels;
+
+  // unused entries stay zero, the vectorized mix reads whole blocks
+  memset(downmix->left, 0, sizeof(downmix->left));
+  memset(downmix->right, 0, sizeof(downmix->right));
+
+  for (c = 0; c < channels; c++) {
+    if (GST_AUDIO_INFO_IS_UNPOSITIONED(info)) {
+      if (channels == 2) {
+        downmix->left[c] = c == 0 ? 1.0f : 0.0f;
+        downmix->right[c] = c == 1 ? 1.0f : 0.0f;
+      } else {
+        downmix->left[c] = downmix->right[c] = 1.0f / channels;
+      }
+    } else {
+      pcm_channel_gains(GST_AUDIO_INFO_POSITION(info, c), &downmix->left[c],
+                        &downmix->right[c]);
+    }
+    left_sum += downmix->left[c];
+    right_sum += downmix->right[c];
+  }
+
+  // keep full scale input at full scale in the mix
+  for (c = 0; c < channels; c++) {
+    if (left_sum > 1.0f)
+      downmix->left[c] /= left_sum;
+    if (right_sum > 1.0f)
+      downmix->right[c] /= right_sum;
+  }
+}
+
+static void pcm_convert_s16(const gint16 *src, gfloat *dest, gsize n) {
+  gsize i = 0;
+
+#if defined(PCM_HAVE_SSE2)
+  const __m128 scale = _mm_set1_ps(PCM_S16_SCALE);
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    // interleave each sample with itself and shift back to sign extend
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+#elif defined(PCM_HAVE_NEON)
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t s = vld1q_s16(src + i);
+    vst1q_f32(dest + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))),
+                                    PCM_S16_SCALE));
+    vst1q_f32(dest + i + 4,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))),
+                          PCM_S16_SCALE));
+  }
+#endif
+
+  for (; i < n; i++)
+    dest[i] = src[i] * PCM_S16_SCALE;
+}
+
+static void pcm_convert_s32(const gint32 *src, gfloat *dest, gsize n) {
+  gsize i = 0;
+
+#if defined(PCM_HAVE_SSE2)
+  const __m128 scale = _mm_set1_ps(PCM_S32_SCALE);
+
+  for (; i + 4 <= n; i += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(s), scale));
+  }
+#elif defined(PCM_HAVE_NEON)
+  for (; i + 4 <= n; i += 4)
+    vst1q_f32(dest + i,
+              vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), PCM_S32_SCALE));
+#endif
+
+  for (; i < n; i++)
+    dest[i] = src[i] * PCM_S32_SCALE;
+}
+
+#if defined(PCM_HAVE_SSE2)
+static inline gfloat pcm_hsum(__m128 v) {
+  __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 sums = _mm_add_ps(v, shuf);
+  shuf = _mm_movehl_ps(shuf, sums);
+  return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+#endif
+
+/* mix frames with 4 or more channels, one frame per iteration with the first
+ * four channels in a vector */
+static void pcm_mix_wide(const PcmDownmix *downmix, const gfloat *src,
+                         gfloat *dest, guint n_frames) {
+  const gint channels = downmix->channels;
+  guint i;
+  gint c;
+
+#if defined(PCM_HAVE_SSE2)
+  const __m128 left0 = _mm_loadu_ps(downmix->left);
+  const __m128 right0 = _mm_loadu_ps(downmix->right);
+  const __m128 left1 = _mm_loadu_ps(downmix->left + 4);
+  const __m128 right1 = _mm_loadu_ps(downmix->right + 4);
+
+  for (i = 0; i < n_frames; i++) {
+    const gfloat *frame = src + (gsize)i * channels;
+    __m128 x = _mm_loadu_ps(frame);
+    __m128 l = _mm_mul_ps(x, left0);
+    __m128 r = _mm_mul_ps(x, right0);
+    gfloat l_tail = 0.0f, r_tail = 0.0f;
+
+    // only 7.1 fills a second vector, don't read past the end of the frame
+    if (channels == 8) {
+      x = _mm_loadu_ps(frame + 4);
+      l = _mm_add_ps(l, _mm_mul_ps(x, left1));
+      r = _mm_add_ps(r, _mm_mul_ps(x, right1));
+    } else {
+      for (c = 4; c < channels; c++) {
+        l_tail += frame[c] * downmix->left[c];
+        r_tail += frame[c] * downmix->right[c];
+      }
+    }
+
+    dest[2 * i] = pcm_hsum(l) + l_tail;
+    dest[2 * i + 1] = pcm_hsum(r) + r_tail;
+  }
+#elif defined(PCM_HAVE_NEON)
+  const float32x4_t left0 = vld1q_f32(downmix->left);
+  const float32x4_t right0 = vld1q_f32(downmix->right);
+  const float32x4_t left1 = vld1q_f32(downmix->left + 4);
+  const float32x4_t right1 = vld1q_f32(downmix->right + 4);
+
+  for (i = 0; i < n_frames; i++) {
+    const gfloat *frame = src + (gsize)i * channels;
+    float32x4_t x = vld1q_f32(frame);
+    float32x4_t l = vmulq_f32(x, left0);
+    float32x4_t r = vmulq_f32(x, right0);
+    gfloat l_tail = 0.0f, r_tail = 0.0f;
+
+    // only 7.1 fills a second vector, don't read past the end of the frame
+    if (channels == 8) {
+      x = vld1q_f32(frame + 4);
+      l = vmlaq_f32(l, x, left1);
+      r = vmlaq_f32(r, x, right1);
+    } else {
+      for (c = 4; c < channels; c++) {
+        l_tail += frame[c] * downmix->left[c];
+        r_tail += frame[c] * downmix->right[c];
+      }
+    }
+
+    dest[2 * i] = vaddvq_f32(l) + l_tail;
+    dest[2 * i + 1] = vaddvq_f32(r) + r_tail;
+  }
+#else
+  for (i = 0; i < n_frames; i++) {
+    const gfloat *frame = src + (gsize)i * channels;
+    gfloat l = 0.0f, r = 0.0f;
+
+    for (c = 0; c < channels; c++) {
+      l += frame[c] * downmix->left[c];
+      r += frame[c] * downmix->right[c];
+    }
+
+    dest[2 * i] = l;
+    dest[2 * i + 1] = r;
+  }
+#endif
+}
+
+/* mix frames with up to 3 channels */
+static void pcm_mix_narrow(const PcmDownmix *downmix, const gfloat *src,
+                           gfloat *dest, guint n_frames) {
+  const gint channels = downmix->channels;
+  guint i;
+  gint c;
+
+  for (i = 0; i < n_frames; i++) {
+    const gfloat *frame = src + (gsize)i * channels;
+    gfloat l = 0.0f, r = 0.0f;
+
+    for (c = 0; c < channels; c++) {
+      l += frame[c] * downmix->left[c];
+      r += frame[c] * downmix->right[c];
+    }
+
+    dest[2 * i] = l;
+    dest[2 * i + 1] = r;
+  }
+}
+
+const gfloat *pcm_downmix_process(PcmDownmix *downmix, gconstpointer data,
+                                  guint n_frames) {
+  const gsize n_samples = (gsize)n_frames * downmix->channels;
+  const gboolean is_float = downmix->format == GST_AUDIO_FORMAT_F32;
+  const gboolean is_stereo = downmix->channels == 2 &&
+                             downmix->left[0] == 1.0f &&
+                             downmix->right[1] == 1.0f &&
+                             downmix->left[1] == 0.0f &&
+                             downmix->right[0] == 0.0f;
+  gsize needed = (gsize)n_frames * 2;
+  const gfloat *samples;
+  gfloat *stereo;
+
+  if (!is_float && !is_stereo)
+    needed += n_samples;
+
+  if (needed > downmix->buffer_size) {
+    g_free(downmix->buffer);
+    downmix->buffer = g_new(gfloat, needed);
+    downmix->buffer_size = needed;
+  }
+
+  stereo = downmix->buffer;
+
+  if (is_float && is_stereo)
+    return data;
+
+  // convert to float, straight into the output for plain stereo
+  if (is_float) {
+    samples = data;
+  } else {
+    gfloat *converted = is_stereo ? stereo : stereo + (gsize)n_frames * 2;
+
+    if (downmix->format == GST_AUDIO_FORMAT_S16)
+      pcm_convert_s16(data, converted, n_samples);
+    else
+      pcm_convert_s32(data, converted, n_samples);
+
+    samples = converted;
+  }
+
+  if (is_stereo)
+    return stereo;
+
+  if (downmix->channels >= 4)
+    pcm_mix_wide(downmix, samples, stereo, n_frames);
+  else
+    pcm_mix_narrow(downmix, samples, stereo, n_frames);
+
+  return stereo;
+}
+
+void pcm_downmix_clear(PcmDownmix *downmix) {
+  g_free(downmix->buffer);
+  downmix->buffer = NULL;
+  downmix->buffer_size = 0;
+}
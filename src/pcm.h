@@ -0,0 +1,57 @@
+#ifndef __GST_PROJECTM_PCM_H__
+#define __GST_PROJECTM_PCM_H__
+
+#include <glib.h>
+#include <gst/audio/audio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Maximum number of input channels (7.1).
+ */
+#define PCM_MAX_CHANNELS 8
+
+/**
+ * @brief State for converting interleaved audio to interleaved float stereo.
+ */
+typedef struct {
+  GstAudioFormat format;
+  gint channels;
+
+  /* gain of each input channel in the left and right output channel */
+  gfloat left[PCM_MAX_CHANNELS];
+  gfloat right[PCM_MAX_CHANNELS];
+
+  /* scratch memory for converted samples and the stereo output */
+  gfloat *buffer;
+  gsize buffer_size;
+} PcmDownmix;
+
+/**
+ * @brief Set up the downmix for the negotiated audio format.
+ *
+ * @param downmix The downmix state.
+ * @param info The audio info, F32, S16 or S32 in native endianness with 1 to
+ *             PCM_MAX_CHANNELS channels.
+ */
+void pcm_downmix_init(PcmDownmix *downmix, const GstAudioInfo *info);
+
+/**
+ * @brief Convert interleaved samples to interleaved float stereo.
+ *
+ * @param downmix The downmix state.
+ * @param data Interleaved input samples.
+ * @param n_frames Number of samples per channel.
+ * @return n_frames float stereo samples, valid until the next call.
+ */
+const gfloat *pcm_downmix_process(PcmDownmix *downmix, gconstpointer data,
+                                  guint n_frames);
+
+/**
+ * @brief Free the scratch memory of the downmix.
+ */
+void pcm_downmix_clear(PcmDownmix *downmix);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PCM_H__ */
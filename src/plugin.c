@@ -8,29 +8,79 @@
 #endif
 #include <gst/gl/gstglfuncs.h>
 #include <gst/gst.h>
-#include <gst/pbutils/gstaudiovisualizer.h>
 
 #include <projectM-4/projectM.h>
 
+#include "analysis.h"
 #include "caps.h"
 #include "config.h"
 #include "debug.h"
 #include "enums.h"
 #include "gstglbaseaudiovisualizer.h"
+#include "pcm.h"
 #include "plugin.h"
+#include "prefetch.h"
 #include "projectm.h"
+#include "statstracer.h"
+#include "texturecache.h"
 
 GST_DEBUG_CATEGORY_STATIC(gst_projectm_debug);
 #define GST_CAT_DEFAULT gst_projectm_debug
 
 struct _GstProjectMPrivate {
-  GLenum gl_format;
   projectm_handle handle;
+  projectm_playlist_handle playlist;
+  PresetPrefetch *prefetch;
+  // textures shared with the other instances, NULL if they aren't
+  TextureCacheUser *texture_cache;
+  // the first preset is loaded as soon as the scan found it
+  gboolean preset_pending;
+  // presets follow the schedule of the preset seed, slot of the current one
+  gboolean scheduled;
+  gboolean has_preset_slot;
+  guint64 preset_slot;
+
+  // properties set since the last frame, see PROP_BIT(), with the object lock
+  guint32 changed_props;
+
+  // window size, fps and mesh scale the instance currently uses, they follow
+  // the negotiated caps and the adaptive quality level of the base class
+  gint window_width;
+  gint window_height;
+  gint fps;
+  gdouble mesh_scale;
 
   GstClockTime first_frame_time;
   gboolean first_frame_received;
+
+  // samples fed to projectM, the clock in offline mode, and their rate
+  guint64 offline_samples;
+  gint audio_rate;
+
+  PcmDownmix downmix;
+
+  // frames in a row that had GL errors
+  guint gl_error_frames;
+
+  // analysis of the frames rendered but not output yet, oldest first, with
+  // the analysis lock
+  AudioAnalysis analysis;
+  GMutex analysis_lock;
+  GQueue analysis_frames;
 };
 
+typedef struct {
+  GstClockTime pts;
+  AudioAnalysisResult result;
+} AnalysisFrame;
+
+// analysed frames kept at most, those that are never output are dropped
+#define ANALYSIS_MAX_PENDING 64
+
+// frames in a row with GL errors after which the element gives up, each of
+// them skips to another preset
+#define GL_ERROR_MAX_FRAMES 30
+
 G_DEFINE_TYPE_WITH_CODE(GstProjectM, gst_projectm,
                         GST_TYPE_GL_BASE_AUDIO_VISUALIZER,
                         G_ADD_PRIVATE(GstProjectM)
@@ -45,11 +95,14 @@ void gst_projectm_set_property(GObject *object, guint property_id,
   const gchar *property_name = g_param_spec_get_name(pspec);
   GST_DEBUG_OBJECT(plugin, "set-property <%s>", property_name);
 
+  GST_OBJECT_LOCK(plugin);
   switch (property_id) {
   case PROP_PRESET_PATH:
+    g_free(plugin->preset_path);
     plugin->preset_path = g_strdup(g_value_get_string(value));
     break;
   case PROP_TEXTURE_DIR_PATH:
+    g_free(plugin->texture_dir_path);
     plugin->texture_dir_path = g_strdup(g_value_get_string(value));
     break;
   case PROP_BEAT_SENSITIVITY:
@@ -101,10 +154,57 @@ void gst_projectm_set_property(GObject *object, guint property_id,
   case PROP_SHUFFLE_PRESETS:
     plugin->shuffle_presets = g_value_get_boolean(value);
     break;
+  case PROP_OFFLINE:
+    plugin->offline = g_value_get_boolean(value);
+    break;
+  case PROP_PRESET_INDEX:
+    g_free(plugin->preset_index);
+    plugin->preset_index = g_value_dup_string(value);
+    break;
+  case PROP_WATCH_PRESETS:
+    plugin->watch_presets = g_value_get_boolean(value);
+    break;
+  case PROP_CHECK_GL_ERRORS:
+    plugin->check_gl_errors = g_value_get_boolean(value);
+    break;
+  case PROP_PRESET_SEED:
+    plugin->preset_seed = g_value_get_uint(value);
+    break;
+  case PROP_ANALYSIS_META:
+    plugin->analysis_meta = g_value_get_boolean(value);
+#ifndef AUDIO_ANALYSIS_HAVE_META
+    if (plugin->analysis_meta)
+      GST_WARNING_OBJECT(plugin, "analysis-meta needs GStreamer 1.20, no meta "
+                                 "will be attached");
+#endif
+    break;
+  case PROP_ANALYSIS_MESSAGES:
+    plugin->analysis_messages = g_value_get_boolean(value);
+    break;
+  case PROP_PRESET_COSTS:
+    g_free(plugin->preset_costs);
+    plugin->preset_costs = g_value_dup_string(value);
+    break;
+  case PROP_FRAME_BUDGET:
+    plugin->frame_budget = g_value_get_double(value);
+    break;
+  case PROP_TEXTURE_CACHE_SIZE:
+    plugin->texture_cache_size = g_value_get_uint(value);
+    break;
   default:
+    GST_OBJECT_UNLOCK(plugin);
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
-    break;
+    return;
   }
+
+  // a running instance picks the change up before the next frame
+  plugin->priv->changed_props |= PROP_BIT(property_id);
+  GST_OBJECT_UNLOCK(plugin);
+
+  // every frame has to be rendered for the output to be reproducible
+  if (property_id == PROP_OFFLINE)
+    gst_pm_audio_visualizer_set_qos_enabled(GST_PM_AUDIO_VISUALIZER(plugin),
+                                            !g_value_get_boolean(value));
 }
 
 void gst_projectm_get_property(GObject *object, guint property_id,
@@ -114,6 +214,7 @@ void gst_projectm_get_property(GObject *object, guint property_id,
   const gchar *property_name = g_param_spec_get_name(pspec);
   GST_DEBUG_OBJECT(plugin, "get-property <%s>", property_name);
 
+  GST_OBJECT_LOCK(plugin);
   switch (property_id) {
   case PROP_PRESET_PATH:
     g_value_set_string(value, plugin->preset_path);
@@ -161,10 +262,42 @@ void gst_projectm_get_property(GObject *object, guint property_id,
   case PROP_SHUFFLE_PRESETS:
     g_value_set_boolean(value, plugin->shuffle_presets);
     break;
+  case PROP_OFFLINE:
+    g_value_set_boolean(value, plugin->offline);
+    break;
+  case PROP_PRESET_INDEX:
+    g_value_set_string(value, plugin->preset_index);
+    break;
+  case PROP_WATCH_PRESETS:
+    g_value_set_boolean(value, plugin->watch_presets);
+    break;
+  case PROP_CHECK_GL_ERRORS:
+    g_value_set_boolean(value, plugin->check_gl_errors);
+    break;
+  case PROP_PRESET_SEED:
+    g_value_set_uint(value, plugin->preset_seed);
+    break;
+  case PROP_ANALYSIS_META:
+    g_value_set_boolean(value, plugin->analysis_meta);
+    break;
+  case PROP_ANALYSIS_MESSAGES:
+    g_value_set_boolean(value, plugin->analysis_messages);
+    break;
+  case PROP_PRESET_COSTS:
+    g_value_set_string(value, plugin->preset_costs);
+    break;
+  case PROP_FRAME_BUDGET:
+    g_value_set_double(value, plugin->frame_budget);
+    break;
+  case PROP_TEXTURE_CACHE_SIZE:
+    g_value_set_uint(value, plugin->texture_cache_size);
+    break;
   default:
+    GST_OBJECT_UNLOCK(plugin);
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
-    break;
+    return;
   }
+  GST_OBJECT_UNLOCK(plugin);
 }
 
 static void gst_projectm_init(GstProjectM *plugin) {
@@ -181,6 +314,18 @@ static void gst_projectm_init(GstProjectM *plugin) {
   plugin->preset_duration = DEFAULT_PRESET_DURATION;
   plugin->enable_playlist = DEFAULT_ENABLE_PLAYLIST;
   plugin->shuffle_presets = DEFAULT_SHUFFLE_PRESETS;
+  plugin->offline = DEFAULT_OFFLINE;
+  plugin->preset_index = DEFAULT_PRESET_INDEX;
+  plugin->watch_presets = DEFAULT_WATCH_PRESETS;
+  plugin->check_gl_errors = DEFAULT_CHECK_GL_ERRORS;
+  plugin->preset_seed = DEFAULT_PRESET_SEED;
+  plugin->analysis_meta = DEFAULT_ANALYSIS_META;
+  plugin->analysis_messages = DEFAULT_ANALYSIS_MESSAGES;
+  plugin->preset_costs = DEFAULT_PRESET_COSTS;
+  plugin->frame_budget = DEFAULT_FRAME_BUDGET;
+  plugin->texture_cache_size = DEFAULT_TEXTURE_CACHE_SIZE;
+  g_mutex_init(&plugin->priv->analysis_lock);
+  g_queue_init(&plugin->priv->analysis_frames);
 
   const gchar *meshSizeStr = DEFAULT_MESH_SIZE;
   gint width, height;
@@ -201,22 +346,262 @@ static void gst_projectm_init(GstProjectM *plugin) {
   plugin->easter_egg = DEFAULT_EASTER_EGG;
   plugin->preset_locked = DEFAULT_PRESET_LOCKED;
   plugin->priv->handle = NULL;
+  plugin->priv->playlist = NULL;
+  plugin->priv->prefetch = NULL;
+  plugin->priv->preset_pending = FALSE;
 }
 
 static void gst_projectm_finalize(GObject *object) {
   GstProjectM *plugin = GST_PROJECTM(object);
   g_free(plugin->preset_path);
   g_free(plugin->texture_dir_path);
+  g_free(plugin->preset_index);
+  g_free(plugin->preset_costs);
+  pcm_downmix_clear(&plugin->priv->downmix);
+  g_queue_clear_full(&plugin->priv->analysis_frames, g_free);
+  g_mutex_clear(&plugin->priv->analysis_lock);
   G_OBJECT_CLASS(gst_projectm_parent_class)->finalize(object);
 }
 
+/* a preset projectM can't load is reported, so broken presets show up before
+ * they would play on air. GL thread. */
+static void gst_projectm_preset_failed(const gchar *filename,
+                                       const gchar *message,
+                                       gpointer user_data) {
+  GstProjectM *plugin = GST_PROJECTM(user_data);
+
+  GST_ELEMENT_WARNING(plugin, RESOURCE, FAILED,
+                      ("Failed to load preset %s", filename), ("%s", message));
+}
+
+/* decode the textures of the next preset before projectM asks for them,
+ * prefetch worker thread */
+static void gst_projectm_preset_fetched(const gchar *filename,
+                                        const gchar *data,
+                                        gpointer user_data) {
+  GstProjectM *plugin = GST_PROJECTM(user_data);
+
+  texture_cache_user_prefetch(plugin->priv->texture_cache, data);
+}
+
+/* start taking presets from the preset path, on the GL thread */
+static void gst_projectm_presets_start(GstProjectM *plugin, gboolean initial) {
+  GstProjectMPrivate *priv = plugin->priv;
+  gchar *preset_path, *preset_index, *preset_costs;
+  gboolean shuffle, watch, offline, kick_off;
+  gdouble frame_budget;
+  guint seed;
+
+  GST_OBJECT_LOCK(plugin);
+  preset_path = g_strdup(plugin->preset_path);
+  preset_index = g_strdup(plugin->preset_index);
+  preset_costs = g_strdup(plugin->preset_costs);
+  frame_budget = plugin->frame_budget;
+  shuffle = plugin->shuffle_presets;
+  watch = plugin->watch_presets;
+  offline = plugin->offline;
+  // only the audio timestamps decide the schedule when rendering offline
+  seed = offline ? plugin->preset_seed : 0;
+  // a new preset path is shown right away, even without a preset duration
+  kick_off = !plugin->preset_locked &&
+             (!initial || plugin->preset_duration > 0.0);
+  GST_OBJECT_UNLOCK(plugin);
+
+  // presets are read from disk on a worker thread ahead of each switch, so
+  // the GL thread only has to load them from memory
+  priv->prefetch =
+      preset_prefetch_new(priv->playlist, shuffle, seed, preset_path,
+                          preset_index, preset_costs, frame_budget, watch);
+  preset_prefetch_set_failed_func(priv->prefetch, gst_projectm_preset_failed,
+                                  plugin);
+  // gl_stop stops the presets before it frees the texture cache
+  if (priv->texture_cache)
+    preset_prefetch_set_fetched_func(priv->prefetch,
+                                     gst_projectm_preset_fetched, plugin);
+  preset_prefetch_connect(priv->prefetch, priv->handle);
+
+  // the schedule loads the preset of the first frame itself
+  priv->scheduled = seed != 0;
+  priv->has_preset_slot = FALSE;
+
+  // kick off the first preset, rendering starts on the idle preset while
+  // the directory is scanned unless the output has to be reproducible
+  if (kick_off && !priv->scheduled)
+    priv->preset_pending =
+        !preset_prefetch_load_next(priv->prefetch, TRUE, offline && initial);
+
+  g_free(preset_path);
+  g_free(preset_index);
+  g_free(preset_costs);
+}
+
+static void gst_projectm_presets_stop(GstProjectM *plugin) {
+  if (plugin->priv->prefetch) {
+    preset_prefetch_free(plugin->priv->prefetch);
+    plugin->priv->prefetch = NULL;
+  }
+  plugin->priv->preset_pending = FALSE;
+  plugin->priv->scheduled = FALSE;
+}
+
+/* apply properties set since the last frame to the running instance */
+static void gst_projectm_apply_changes(GstProjectM *plugin) {
+  GstProjectMPrivate *priv = plugin->priv;
+  gboolean shuffle;
+  guint32 changed;
+
+  GST_OBJECT_LOCK(plugin);
+  changed = priv->changed_props;
+  priv->changed_props = 0;
+  if (changed)
+    projectm_apply_properties(plugin, priv->handle, changed);
+  if (priv->texture_cache && (changed & PROP_BIT(PROP_TEXTURE_DIR_PATH)))
+    texture_cache_user_set_texture_dir(priv->texture_cache,
+                                       plugin->texture_dir_path);
+  if (priv->texture_cache && (changed & PROP_BIT(PROP_TEXTURE_CACHE_SIZE)))
+    texture_cache_set_budget((guint64)plugin->texture_cache_size << 20);
+  shuffle = plugin->shuffle_presets;
+  GST_OBJECT_UNLOCK(plugin);
+
+  // the mesh was set at full size, the quality level is applied to it again
+  // on the next frame, with or without a playlist
+  if (changed & PROP_BIT(PROP_MESH_SIZE))
+    priv->mesh_scale = 1.0;
+
+  if (!changed || !priv->playlist)
+    return;
+
+  // the new presets replace the playlist, the instance and its shaders stay
+  if (changed & (PROP_BIT(PROP_PRESET_PATH) | PROP_BIT(PROP_PRESET_INDEX) |
+                 PROP_BIT(PROP_WATCH_PRESETS) | PROP_BIT(PROP_PRESET_SEED) |
+                 PROP_BIT(PROP_PRESET_COSTS) | PROP_BIT(PROP_FRAME_BUDGET))) {
+    GST_INFO_OBJECT(plugin, "Reloading presets");
+    gst_projectm_presets_stop(plugin);
+    projectm_playlist_clear(priv->playlist);
+    gst_projectm_presets_start(plugin, FALSE);
+  } else if (changed & PROP_BIT(PROP_SHUFFLE_PRESETS)) {
+    preset_prefetch_set_shuffle(priv->prefetch, shuffle);
+  }
+}
+
+/* follow the framerate, render size and quality level picked by the base
+ * class, they change with the caps without recreating the instance */
+static void gst_projectm_update_output(GstProjectM *plugin) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(plugin);
+  GstProjectMPrivate *priv = plugin->priv;
+  gdouble scale = gst_gl_base_audio_visualizer_get_quality_scale(glav);
+  gint width, height, fps;
+  gulong mesh_width, mesh_height;
+
+  fps = projectm_get_fps(&GST_PM_AUDIO_VISUALIZER(plugin)->vinfo);
+  if (fps != priv->fps) {
+    GST_DEBUG_OBJECT(plugin, "fps %d", fps);
+    projectm_set_fps(priv->handle, fps);
+    priv->fps = fps;
+  }
+
+  gst_gl_base_audio_visualizer_get_render_size(glav, &width, &height);
+  if (width != priv->window_width || height != priv->window_height) {
+    GST_DEBUG_OBJECT(plugin, "window size %dx%d", width, height);
+    projectm_set_window_size(priv->handle, width, height);
+    priv->window_width = width;
+    priv->window_height = height;
+  }
+
+  if (scale == priv->mesh_scale)
+    return;
+
+  GST_OBJECT_LOCK(plugin);
+  mesh_width = MAX(8, (gulong)(plugin->mesh_width * scale));
+  mesh_height = MAX(8, (gulong)(plugin->mesh_height * scale));
+  GST_OBJECT_UNLOCK(plugin);
+
+  // the mesh is the per vertex cost of a preset, it shrinks with the render
+  // size
+  GST_DEBUG_OBJECT(plugin, "mesh size %lux%lu", mesh_width, mesh_height);
+  projectm_set_mesh_size(priv->handle, mesh_width, mesh_height);
+  priv->mesh_scale = scale;
+}
+
 static void gst_projectm_gl_stop(GstGLBaseAudioVisualizer *src) {
   GstProjectM *plugin = GST_PROJECTM(src);
+  gst_projectm_presets_stop(plugin);
+  if (plugin->priv->playlist) {
+    projectm_playlist_destroy(plugin->priv->playlist);
+    plugin->priv->playlist = NULL;
+  }
   if (plugin->priv->handle) {
     GST_DEBUG_OBJECT(plugin, "Destroying ProjectM instance");
     projectm_destroy(plugin->priv->handle);
     plugin->priv->handle = NULL;
   }
+  // projectM doesn't use the shared textures any more
+  if (plugin->priv->texture_cache) {
+    texture_cache_user_free(plugin->priv->texture_cache);
+    plugin->priv->texture_cache = NULL;
+  }
+}
+
+#ifdef HAVE_PROJECTM_TEXTURE_LOAD_EVENT
+/* hand projectM the shared copy of a texture, GL thread. projectM doesn't
+ * delete textures it is given by id. */
+static void gst_projectm_texture_load(const char *texture_name,
+                                      projectm_texture_load_data *data,
+                                      void *user_data) {
+  GstProjectM *plugin = GST_PROJECTM(user_data);
+  guint texture, width, height;
+
+  // projectM loads the textures the cache can't find itself
+  texture = texture_cache_user_acquire(plugin->priv->texture_cache,
+                                       texture_name, &width, &height);
+  if (!texture)
+    return;
+
+  data->texture_id = texture;
+  data->width = width;
+  data->height = height;
+  data->channels = 4;
+}
+
+#ifdef HAVE_PROJECTM_TEXTURE_UNLOAD_EVENT
+static void gst_projectm_texture_unload(const char *texture_name,
+                                        void *user_data) {
+  GstProjectM *plugin = GST_PROJECTM(user_data);
+
+  texture_cache_user_release(plugin->priv->texture_cache, texture_name);
+}
+#endif
+#endif
+
+/* take textures from the process wide cache, GL thread. Without unload
+ * events, an instance holds the textures it used until it is stopped. */
+static void gst_projectm_texture_cache_start(GstProjectM *plugin) {
+  gchar *texture_dir;
+  guint size;
+
+  GST_OBJECT_LOCK(plugin);
+  size = plugin->texture_cache_size;
+  texture_dir = g_strdup(plugin->texture_dir_path);
+  GST_OBJECT_UNLOCK(plugin);
+
+  if (size > 0) {
+#ifdef HAVE_PROJECTM_TEXTURE_LOAD_EVENT
+    texture_cache_set_budget((guint64)size << 20);
+    plugin->priv->texture_cache = texture_cache_user_new(
+        GST_GL_BASE_AUDIO_VISUALIZER(plugin)->context, texture_dir);
+    projectm_set_texture_load_event_callback(
+        plugin->priv->handle, gst_projectm_texture_load, plugin);
+#ifdef HAVE_PROJECTM_TEXTURE_UNLOAD_EVENT
+    projectm_set_texture_unload_event_callback(
+        plugin->priv->handle, gst_projectm_texture_unload, plugin);
+#endif
+#else
+    GST_WARNING_OBJECT(plugin, "texture-cache-size needs a projectM with "
+                               "texture load events, textures are not shared");
+#endif
+  }
+
+  g_free(texture_dir);
 }
 
 static gboolean gst_projectm_gl_start(GstGLBaseAudioVisualizer *glav) {
@@ -234,50 +619,66 @@ static gboolean gst_projectm_gl_start(GstGLBaseAudioVisualizer *glav) {
 
   // Check if ProjectM instance exists, and create if not
   if (!plugin->priv->handle) {
+    // the new instance starts out with every property
+    GST_OBJECT_LOCK(plugin);
+    plugin->priv->changed_props = 0;
+    GST_OBJECT_UNLOCK(plugin);
+
+    // driver messages go to the log as they arrive, errors are picked up
+    // after each frame without waiting for the GPU
+    gl_debug_init(glav->context);
+    plugin->priv->gl_error_frames = 0;
+
     // Create ProjectM instance
-    plugin->priv->handle = projectm_init(plugin);
+    plugin->priv->handle = projectm_init(plugin, &plugin->priv->playlist);
     if (!plugin->priv->handle) {
       GST_ERROR_OBJECT(plugin, "ProjectM could not be initialized");
       return FALSE;
     }
-    gl_error_handler(glav->context, plugin);
+
+    // checked once regardless of check-gl-errors, it's not per frame
+    if (gl_error_is_fatal(gl_error_handler(glav->context, plugin)))
+      return FALSE;
+
+    // before the first preset asks for its textures
+    gst_projectm_texture_cache_start(plugin);
+
+    gst_gl_base_audio_visualizer_get_render_size(
+        glav, &plugin->priv->window_width, &plugin->priv->window_height);
+    plugin->priv->fps =
+        projectm_get_fps(&GST_PM_AUDIO_VISUALIZER(glav)->vinfo);
+    plugin->priv->mesh_scale = 1.0;
+
+    if (plugin->priv->playlist)
+      gst_projectm_presets_start(plugin, TRUE);
   }
 
   return TRUE;
 }
 
 static gboolean gst_projectm_setup(GstGLBaseAudioVisualizer *glav) {
-  GstAudioVisualizer *bscope = GST_AUDIO_VISUALIZER(glav);
-  GstProjectM *plugin = GST_PROJECTM(glav);
+  GstPMAudioVisualizer *bscope = GST_PM_AUDIO_VISUALIZER(glav);
+  GstProjectMPrivate *priv = GST_PROJECTM(glav)->priv;
+  gint rate = GST_AUDIO_INFO_RATE(&bscope->ainfo);
 
   // Calculate depth based on pixel stride and bits
   gint depth = bscope->vinfo.finfo->pixel_stride[0] *
                ((bscope->vinfo.finfo->bits >= 8) ? 8 : 1);
 
-  // Calculate required samples per frame
-  bscope->req_spf =
-      (bscope->ainfo.channels * bscope->ainfo.rate * 2) / bscope->vinfo.fps_n;
-
-  // get GStreamer video format and map it to the corresponding OpenGL pixel
-  // format
-  const GstVideoFormat video_format = GST_VIDEO_INFO_FORMAT(&bscope->vinfo);
-
-  // TODO: why is the reversed byte order needed when copying pixel data from
-  // OpenGL ?
-  switch (video_format) {
-  case GST_VIDEO_FORMAT_ABGR:
-    plugin->priv->gl_format = GL_RGBA;
-    break;
+  // The base class hands us exactly the samples belonging to each video
+  // frame, req_spf is left at its default so windows don't overlap and
+  // projectM doesn't analyze the same audio twice
 
-  case GST_VIDEO_FORMAT_RGBA:
-    // GL_ABGR_EXT does not seem to be well-supported, does not work on Windows
-    plugin->priv->gl_format = GL_ABGR_EXT;
-    break;
+  pcm_downmix_init(&priv->downmix, &bscope->ainfo);
 
-  default:
-    GST_ERROR_OBJECT(plugin, "Unsupported video format: %d", video_format);
-    return FALSE;
-  }
+  // renegotiation keeps the instance and its clock, the window size and fps
+  // are picked up with the next frame
+  if (priv->audio_rate > 0 && priv->audio_rate != rate)
+    priv->offline_samples = gst_util_uint64_scale_int(priv->offline_samples,
+                                                      rate, priv->audio_rate);
+  if (priv->audio_rate != rate)
+    audio_analysis_init(&priv->analysis, &bscope->ainfo);
+  priv->audio_rate = rate;
 
   // Log audio info
   GST_DEBUG_OBJECT(
@@ -297,16 +698,16 @@ static gboolean gst_projectm_setup(GstGLBaseAudioVisualizer *glav) {
 }
 
 static double get_seconds_since_first_frame(GstProjectM *plugin,
-                                            GstVideoFrame *frame) {
+                                            GstBuffer *frame) {
   if (!plugin->priv->first_frame_received) {
     // Store the timestamp of the first frame
-    plugin->priv->first_frame_time = GST_BUFFER_PTS(frame->buffer);
+    plugin->priv->first_frame_time = GST_BUFFER_PTS(frame);
     plugin->priv->first_frame_received = TRUE;
     return 0.0;
   }
 
   // Calculate elapsed time
-  GstClockTime current_time = GST_BUFFER_PTS(frame->buffer);
+  GstClockTime current_time = GST_BUFFER_PTS(frame);
   GstClockTime elapsed_time = current_time - plugin->priv->first_frame_time;
 
   // Convert to fractional seconds
@@ -315,62 +716,304 @@ static double get_seconds_since_first_frame(GstProjectM *plugin,
   return elapsed_seconds;
 }
 
+static double get_seconds_from_samples(GstProjectM *plugin,
+                                       const GstAudioInfo *info,
+                                       guint n_frames) {
+  // the frame is rendered at the time of its first sample, so the timestep is
+  // fixed by the audio and not by buffer timestamps or the clock
+  gdouble elapsed_seconds =
+      (gdouble)plugin->priv->offline_samples / GST_AUDIO_INFO_RATE(info);
+
+  plugin->priv->offline_samples += n_frames;
+
+  return elapsed_seconds;
+}
+
+/* switch to the preset scheduled for the frame, GL thread. Slots are
+ * preset-duration long and counted from timestamp zero, so the schedule
+ * doesn't depend on where rendering started. */
+static void gst_projectm_follow_schedule(GstProjectM *plugin,
+                                         GstBuffer *video) {
+  GstProjectMPrivate *priv = plugin->priv;
+  GstClockTime pts = GST_BUFFER_PTS(video);
+  gdouble duration;
+  guint64 slot = 0;
+
+  GST_OBJECT_LOCK(plugin);
+  duration = plugin->preset_duration;
+  GST_OBJECT_UNLOCK(plugin);
+
+  if (duration > 0.0 && GST_CLOCK_TIME_IS_VALID(pts))
+    slot = (guint64)(pts / (duration * GST_SECOND));
+
+  if (priv->has_preset_slot && slot == priv->preset_slot)
+    return;
+
+  GST_DEBUG_OBJECT(plugin, "preset slot %" G_GUINT64_FORMAT, slot);
+
+  // the first frame cuts to its preset, whatever played before
+  if (!preset_prefetch_load_slot(priv->prefetch, slot, !priv->has_preset_slot))
+    GST_WARNING_OBJECT(plugin, "no preset for slot %" G_GUINT64_FORMAT, slot);
+
+  priv->preset_slot = slot;
+  priv->has_preset_slot = TRUE;
+}
+
+static void gst_projectm_add_pcm(GstProjectM *plugin, const GstAudioInfo *info,
+                                 gconstpointer data, guint n_frames) {
+  gint channels = GST_AUDIO_INFO_CHANNELS(info);
+
+  // mono and stereo in a format projectM understands are passed as is, the
+  // rest goes through the downmix which always yields float stereo
+  if (channels <= 2) {
+    projectm_channels layout = channels == 1 ? PROJECTM_MONO : PROJECTM_STEREO;
+
+    switch (GST_AUDIO_INFO_FORMAT(info)) {
+    case GST_AUDIO_FORMAT_F32:
+      projectm_pcm_add_float(plugin->priv->handle, (const gfloat *)data,
+                             n_frames, layout);
+      return;
+    case GST_AUDIO_FORMAT_S16:
+      projectm_pcm_add_int16(plugin->priv->handle, (const gint16 *)data,
+                             n_frames, layout);
+      return;
+    default:
+      break;
+    }
+  }
+
+  projectm_pcm_add_float(
+      plugin->priv->handle,
+      pcm_downmix_process(&plugin->priv->downmix, data, n_frames), n_frames,
+      PROJECTM_STEREO);
+}
+
+/* analyse the audio of a frame, kept until the frame is output, GL thread */
+static void gst_projectm_analyse(GstProjectM *plugin, GstBuffer *video,
+                                 gconstpointer data, guint n_frames) {
+  GstPMAudioVisualizer *bscope = GST_PM_AUDIO_VISUALIZER(plugin);
+  GstProjectMPrivate *priv = plugin->priv;
+  AnalysisFrame *frame;
+
+  audio_analysis_process(&priv->analysis, &bscope->ainfo, data, n_frames,
+                         GST_BUFFER_DURATION(video));
+
+  frame = g_new(AnalysisFrame, 1);
+  frame->pts = GST_BUFFER_PTS(video);
+  frame->result = priv->analysis.result;
+
+  g_mutex_lock(&priv->analysis_lock);
+  g_queue_push_tail(&priv->analysis_frames, frame);
+  while (g_queue_get_length(&priv->analysis_frames) > ANALYSIS_MAX_PENDING)
+    g_free(g_queue_pop_head(&priv->analysis_frames));
+  g_mutex_unlock(&priv->analysis_lock);
+}
+
+static void gst_projectm_clear_analysis(GstProjectM *plugin) {
+  g_mutex_lock(&plugin->priv->analysis_lock);
+  g_queue_clear_full(&plugin->priv->analysis_frames, g_free);
+  g_queue_init(&plugin->priv->analysis_frames);
+  g_mutex_unlock(&plugin->priv->analysis_lock);
+}
+
+/* attach the analysis to a frame as it is output, streaming thread. The
+ * frame may have been held back by the base class, the analysis is looked up
+ * by its timestamp. */
+static void gst_projectm_finish_frame(GstPMAudioVisualizer *bscope,
+                                      GstBuffer *video) {
+  GstProjectM *plugin = GST_PROJECTM(bscope);
+  GstProjectMPrivate *priv = plugin->priv;
+  GstClockTime pts = GST_BUFFER_PTS(video);
+  AnalysisFrame *frame;
+  gboolean meta, messages;
+
+  // frames are output in the order they were rendered, older entries belong
+  // to frames that were never output
+  g_mutex_lock(&priv->analysis_lock);
+  while ((frame = g_queue_pop_head(&priv->analysis_frames))) {
+    if (frame->pts == pts)
+      break;
+    g_free(frame);
+  }
+  g_mutex_unlock(&priv->analysis_lock);
+
+  if (!frame)
+    return;
+
+  GST_OBJECT_LOCK(plugin);
+  meta = plugin->analysis_meta;
+  messages = plugin->analysis_messages;
+  GST_OBJECT_UNLOCK(plugin);
+
+  if (meta)
+    audio_analysis_meta_add(video, &frame->result);
+
+  if (messages) {
+    GstStructure *s = audio_analysis_to_structure(&frame->result,
+                                                  AUDIO_ANALYSIS_MESSAGE_NAME);
+
+    gst_structure_set(s, "timestamp", G_TYPE_UINT64, pts, "duration",
+                      G_TYPE_UINT64, GST_BUFFER_DURATION(video), NULL);
+    gst_element_post_message(GST_ELEMENT(plugin),
+                             gst_message_new_element(GST_OBJECT(plugin), s));
+  }
+
+  g_free(frame);
+}
+
+static void gst_projectm_flush(GstPMAudioVisualizer *bscope) {
+  GST_PM_AUDIO_VISUALIZER_CLASS(gst_projectm_parent_class)->flush(bscope);
+
+  // the flushed frames are never output
+  gst_projectm_clear_analysis(GST_PROJECTM(bscope));
+}
+
+/* look for GL errors caused by the last frame, given the errors the driver
+ * reported while rendering it, GL thread. A preset causing errors is skipped,
+ * the element only fails if the context is lost or the errors don't stop. */
+static gboolean gst_projectm_check_gl_errors(GstProjectM *plugin,
+                                             guint debug_errors) {
+  GstGLContext *context = GST_GL_BASE_AUDIO_VISUALIZER(plugin)->context;
+  GstProjectMPrivate *priv = plugin->priv;
+  guint error = GL_NO_ERROR;
+  gboolean check;
+
+  GST_OBJECT_LOCK(plugin);
+  check = plugin->check_gl_errors;
+  GST_OBJECT_UNLOCK(plugin);
+
+  if (check)
+    error = gl_error_handler(context, plugin);
+
+  if (error == GL_NO_ERROR && debug_errors == 0) {
+    priv->gl_error_frames = 0;
+    return TRUE;
+  }
+
+  if (gl_error_is_fatal(error)) {
+    GST_ERROR_OBJECT(plugin, "GL context is unusable");
+    return FALSE;
+  }
+
+  if (++priv->gl_error_frames >= GL_ERROR_MAX_FRAMES) {
+    GST_ERROR_OBJECT(plugin, "GL errors in %u frames in a row, giving up",
+                     priv->gl_error_frames);
+    return FALSE;
+  }
+
+  if (priv->gl_error_frames == 1)
+    GST_ELEMENT_WARNING(plugin, RESOURCE, FAILED,
+                        ("GL error while rendering, skipping the preset"),
+                        (NULL));
+
+  if (priv->prefetch)
+    preset_prefetch_load_next(priv->prefetch, TRUE, FALSE);
+
+  return TRUE;
+}
+
 // TODO: CLEANUP & ADD DEBUGGING
 static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
-                                    GstBuffer *audio, GstVideoFrame *video) {
+                                    GstBuffer *audio, GstBuffer *video,
+                                    guint fbo) {
   GstProjectM *plugin = GST_PROJECTM(glav);
+  GstPMAudioVisualizer *bscope = GST_PM_AUDIO_VISUALIZER(glav);
 
   GstMapInfo audioMap;
-  gboolean result = TRUE;
+  guint n_frames, debug_errors;
+  gboolean analyse, offline;
 
-  // get current gst (PTS) time and set projectM time
-  double seconds_since_first_frame =
-      get_seconds_since_first_frame(plugin, video);
-  projectm_set_frame_time(plugin->priv->handle, seconds_since_first_frame);
+  gst_projectm_apply_changes(plugin);
+  gst_projectm_update_output(plugin);
 
   // AUDIO
   gst_buffer_map(audio, &audioMap, GST_MAP_READ);
+  n_frames = audioMap.size / GST_AUDIO_INFO_BPF(&bscope->ainfo);
+
+  GST_OBJECT_LOCK(plugin);
+  analyse = plugin->analysis_meta || plugin->analysis_messages;
+  offline = plugin->offline;
+  GST_OBJECT_UNLOCK(plugin);
+
+  // the same audio projectM gets, attached to the frame once it is output
+  if (analyse)
+    gst_projectm_analyse(plugin, video, audioMap.data, n_frames);
+
+  // a scheduled stream keeps its clock in stream time too, so a part of it
+  // rendered on its own shows the same frames as the whole
+  if (offline && plugin->priv->scheduled &&
+      !plugin->priv->first_frame_received) {
+    if (GST_BUFFER_PTS_IS_VALID(video))
+      plugin->priv->offline_samples =
+          gst_util_uint64_scale_int(GST_BUFFER_PTS(video),
+                                    GST_AUDIO_INFO_RATE(&bscope->ainfo),
+                                    GST_SECOND);
+    plugin->priv->first_frame_received = TRUE;
+  }
 
-  // GST_DEBUG_OBJECT(plugin, "Audio Samples: %u, Offset: %lu, Offset End: %lu,
-  // Sample Rate: %d, FPS: %d, Required Samples Per Frame: %d",
-  //                  audioMap.size / 8, audio->offset, audio->offset_end,
-  //                  bscope->ainfo.rate, bscope->vinfo.fps_n, bscope->req_spf);
+  // offline, time advances by the audio consumed, otherwise it follows the
+  // gst (PTS) time of the output
+  double seconds_since_first_frame =
+      offline ? get_seconds_from_samples(plugin, &bscope->ainfo, n_frames)
+              : get_seconds_since_first_frame(plugin, video);
+  projectm_set_frame_time(plugin->priv->handle, seconds_since_first_frame);
 
-  projectm_pcm_add_int16(plugin->priv->handle, (gint16 *)audioMap.data,
-                         audioMap.size / 4, PROJECTM_STEREO);
+  GstClockTime audio_begin = gst_gl_base_audio_visualizer_stats_begin(glav);
+  gst_projectm_add_pcm(plugin, &bscope->ainfo, audioMap.data, n_frames);
+  gst_gl_base_audio_visualizer_stats_end(glav, RENDER_STATS_AUDIO, audio_begin);
 
-  // GST_DEBUG_OBJECT(plugin, "Audio Data: %d %d %d %d", ((gint16
-  // *)audioMap.data)[100], ((gint16 *)audioMap.data)[101], ((gint16
-  // *)audioMap.data)[102], ((gint16 *)audioMap.data)[103]);
+  if (plugin->priv->scheduled)
+    gst_projectm_follow_schedule(plugin, video);
+  else if (plugin->priv->preset_pending &&
+           preset_prefetch_load_next(plugin->priv->prefetch, TRUE, FALSE))
+    plugin->priv->preset_pending = FALSE;
 
   // VIDEO
-  const GstGLFuncs *glFunctions = glav->context->gl_vtable;
-
-  size_t windowWidth, windowHeight;
-
-  projectm_get_window_size(plugin->priv->handle, &windowWidth, &windowHeight);
-
-  projectm_opengl_render_frame(plugin->priv->handle);
-  gl_error_handler(glav->context, plugin);
-
-  glFunctions->ReadPixels(0, 0, windowWidth, windowHeight,
-                          plugin->priv->gl_format, GL_UNSIGNED_INT_8_8_8_8,
-                          (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(video, 0));
+  // the base class flips the offscreen frame into the output texture or reads
+  // it back to system memory
+  gl_debug_begin(glav->context);
+  projectm_opengl_render_frame_fbo(plugin->priv->handle, fbo);
+  debug_errors = gl_debug_end(glav->context);
 
   gst_buffer_unmap(audio, &audioMap);
 
+  if (!gst_projectm_check_gl_errors(plugin, debug_errors))
+    return FALSE;
+
   // GST_DEBUG_OBJECT(plugin, "Video Data: %d %d\n",
   // GST_VIDEO_FRAME_N_PLANES(video), ((uint8_t
   // *)(GST_VIDEO_FRAME_PLANE_DATA(video, 0)))[0]);
 
   // GST_DEBUG_OBJECT(plugin, "Rendered one frame");
 
-  return result;
+  return TRUE;
+}
+
+static GstStateChangeReturn
+gst_projectm_change_state(GstElement *element, GstStateChange transition) {
+  GstProjectM *plugin = GST_PROJECTM(element);
+
+  switch (transition) {
+  case GST_STATE_CHANGE_READY_TO_PAUSED:
+    // every stream starts its clock at zero, caps changes carry it over
+    plugin->priv->offline_samples = 0;
+    plugin->priv->audio_rate = 0;
+    plugin->priv->first_frame_received = FALSE;
+    plugin->priv->has_preset_slot = FALSE;
+    gst_projectm_clear_analysis(plugin);
+    break;
+  default:
+    break;
+  }
+
+  return GST_ELEMENT_CLASS(gst_projectm_parent_class)
+      ->change_state(element, transition);
 }
 
 static void gst_projectm_class_init(GstProjectMClass *klass) {
   GObjectClass *gobject_class = (GObjectClass *)klass;
   GstElementClass *element_class = (GstElementClass *)klass;
+  GstPMAudioVisualizerClass *pm_class = GST_PM_AUDIO_VISUALIZER_CLASS(klass);
   GstGLBaseAudioVisualizerClass *scope_class =
       GST_GL_BASE_AUDIO_VISUALIZER_CLASS(klass);
 
@@ -382,6 +1025,10 @@ static void gst_projectm_class_init(GstProjectMClass *klass) {
       GST_ELEMENT_CLASS(klass),
       gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS,
                            gst_caps_from_string(video_src_caps)));
+  gst_element_class_add_pad_template(
+      GST_ELEMENT_CLASS(klass),
+      gst_pad_template_new("src_%u", GST_PAD_SRC, GST_PAD_REQUEST,
+                           gst_caps_from_string(video_src_caps)));
   gst_element_class_add_pad_template(
       GST_ELEMENT_CLASS(klass),
       gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
@@ -516,19 +1163,133 @@ static void gst_projectm_class_init(GstProjectMClass *klass) {
           "and not locked. Playlist must be enabled for this to take effect.",
           DEFAULT_SHUFFLE_PRESETS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property(
+      gobject_class, PROP_OFFLINE,
+      g_param_spec_boolean(
+          "offline", "Offline",
+          "Renders for file output rather than playback. Time advances by the "
+          "audio samples consumed instead of following timestamps, and no "
+          "frame is skipped for QoS, so the same input yields the same frames. "
+          "Combine with sync=false on the sink to render as fast as possible.",
+          DEFAULT_OFFLINE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_INDEX,
+      g_param_spec_string(
+          "preset-index", "Preset Index",
+          "Specifies a file to keep an index of the preset directory in. "
+          "Directories that didn't change since the index was written are not "
+          "read again, and presets that failed to load are left out. The file "
+          "can be shared by several processes using the same presets.",
+          DEFAULT_PRESET_INDEX, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_WATCH_PRESETS,
+      g_param_spec_boolean(
+          "watch-presets", "Watch Presets",
+          "Watches the preset directory and adds or removes presets from the "
+          "playlist as files are added or removed, without scanning again.",
+          DEFAULT_WATCH_PRESETS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_CHECK_GL_ERRORS,
+      g_param_spec_boolean(
+          "check-gl-errors", "Check GL Errors",
+          "Polls glGetError() after every frame. This catches errors drivers "
+          "without GL_KHR_debug don't report, but waits for the GPU to finish "
+          "the frame on many drivers.",
+          DEFAULT_CHECK_GL_ERRORS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_SEED,
+      g_param_spec_uint(
+          "preset-seed", "Preset Seed",
+          "Switches presets on a schedule derived from this seed in offline "
+          "mode, 0 to let projectM switch them. The preset directory is "
+          "scanned completely first, and each preset-duration long slot of "
+          "buffer time, counted from zero, gets the same preset whenever it "
+          "is rendered. Parts of a stream rendered separately then show the "
+          "same presets at the same times.",
+          0, G_MAXUINT, DEFAULT_PRESET_SEED,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ANALYSIS_META,
+      g_param_spec_boolean(
+          "analysis-meta", "Analysis Meta",
+          "Attaches the analysis of the frame's audio (bass, mid, treble, "
+          "beat and a spectrum) to each output buffer as a custom meta named "
+          "\"" AUDIO_ANALYSIS_META_NAME "\". Requires GStreamer 1.20.",
+          DEFAULT_ANALYSIS_META, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ANALYSIS_MESSAGES,
+      g_param_spec_boolean(
+          "analysis-messages", "Analysis Messages",
+          "Posts the analysis of the frame's audio as a "
+          "\"" AUDIO_ANALYSIS_MESSAGE_NAME "\" element message for each "
+          "output buffer.",
+          DEFAULT_ANALYSIS_MESSAGES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_COSTS,
+      g_param_spec_string(
+          "preset-costs", "Preset Costs",
+          "Specifies a preset cost file written by projectm-profile. Presets "
+          "that failed to load when they were profiled are left out of the "
+          "playlist, as are presets slower than frame-budget.",
+          DEFAULT_PRESET_COSTS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_FRAME_BUDGET,
+      g_param_spec_double(
+          "frame-budget", "Frame Budget",
+          "Leaves presets out of the playlist whose 99th percentile frame "
+          "time in preset-costs is above this many milliseconds. 0 keeps "
+          "presets of any cost. Presets that weren't profiled are kept.",
+          0.0, 10000.0, DEFAULT_FRAME_BUDGET,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TEXTURE_CACHE_SIZE,
+      g_param_spec_uint(
+          "texture-cache-size", "Texture Cache Size",
+          "Shares preset textures between the projectm elements of the "
+          "process whose GL contexts share objects (shared-contexts), keeping "
+          "textures no preset uses up to this many MiB of GPU memory in "
+          "total. 0 gives every element its own copies. The size is process "
+          "wide, the last value set applies. Needs projectM with texture load "
+          "events.",
+          0, G_MAXUINT, DEFAULT_TEXTURE_CACHE_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gobject_class->finalize = gst_projectm_finalize;
 
+  element_class->change_state = GST_DEBUG_FUNCPTR(gst_projectm_change_state);
+
   scope_class->supported_gl_api = GST_GL_API_OPENGL3 | GST_GL_API_GLES2;
   scope_class->gl_start = GST_DEBUG_FUNCPTR(gst_projectm_gl_start);
   scope_class->gl_stop = GST_DEBUG_FUNCPTR(gst_projectm_gl_stop);
   scope_class->gl_render = GST_DEBUG_FUNCPTR(gst_projectm_render);
   scope_class->setup = GST_DEBUG_FUNCPTR(gst_projectm_setup);
+
+  pm_class->finish_frame = GST_DEBUG_FUNCPTR(gst_projectm_finish_frame);
+  pm_class->flush = GST_DEBUG_FUNCPTR(gst_projectm_flush);
 }
 
 static gboolean plugin_init(GstPlugin *plugin) {
   GST_DEBUG_CATEGORY_INIT(gst_projectm_debug, "projectm", 0,
                           "projectM visualizer plugin");
 
+  audio_analysis_meta_register();
+
+#ifndef GST_DISABLE_GST_TRACER_HOOKS
+  if (!gst_tracer_register(plugin, "projectmstats",
+                           GST_TYPE_PROJECTM_STATS_TRACER))
+    return FALSE;
+#endif
+
   return gst_element_register(plugin, "projectm", GST_RANK_NONE,
                               GST_TYPE_PROJECTM);
 }
@@ -31,12 +31,22 @@ struct _GstProjectM {
   gboolean preset_locked;
   gboolean enable_playlist;
   gboolean shuffle_presets;
+  gboolean offline;
+  gchar *preset_index;
+  gboolean watch_presets;
+  gboolean check_gl_errors;
+  guint preset_seed;
+  gboolean analysis_meta;
+  gboolean analysis_messages;
+  gchar *preset_costs;
+  gdouble frame_budget;
+  guint texture_cache_size;
 
   GstProjectMPrivate *priv;
 };
 
 struct _GstProjectMClass {
-  GstAudioVisualizerClass parent_class;
+  GstGLBaseAudioVisualizerClass parent_class;
 };
 
 static void gst_projectm_set_property(GObject *object, guint prop_id,
@@ -54,7 +64,8 @@ static gboolean gst_projectm_gl_start(GstGLBaseAudioVisualizer *glav);
 static void gst_projectm_gl_stop(GstGLBaseAudioVisualizer *glav);
 
 static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
-                                    GstBuffer *audio, GstVideoFrame *video);
+                                    GstBuffer *audio, GstBuffer *video,
+                                    guint fbo);
 
 static void gst_projectm_class_init(GstProjectMClass *klass);
 
@@ -0,0 +1,860 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "dirwalk.h"
+#include "prefetch.h"
+#include "presetcost.h"
+#include "presetindex.h"
+#include "presetwatch.h"
+
+GST_DEBUG_CATEGORY_STATIC(prefetch_debug);
+#define GST_CAT_DEFAULT prefetch_debug
+
+/* directory entries scanned between checks for fetch requests */
+#define SCAN_BATCH 64
+
+typedef enum {
+  PRESET_CHANGE_ADDED,
+  PRESET_CHANGE_REMOVED,
+  PRESET_CHANGE_FAILED,
+} PresetChangeType;
+
+typedef struct {
+  PresetChangeType type;
+  gchar *path;
+} PresetChange;
+
+struct _PresetPrefetch {
+  projectm_playlist_handle playlist;
+  projectm_handle handle;
+
+  GThread *thread;
+  PresetWatch *watch;
+  guint32 seed; /* presets follow the schedule of the seed, 0 for none */
+  gdouble frame_budget;
+  PresetPrefetchFailedFunc failed_func;
+  gpointer failed_data;
+
+  /* worker thread only */
+  GRand *rand;
+  gboolean scanning;
+  DirWalk *scan;
+  PresetIndexDir *scan_index_dir;
+  gchar *index_file;
+  PresetIndex *old_index; /* loaded from index_file until the scan is done */
+  PresetIndex *index;     /* what was scanned */
+  gboolean index_dirty;
+  gchar *costs_file;
+  PresetCosts *costs;
+  guint excluded; /* presets left out for their cost */
+
+  /* GL thread only */
+  const gchar *loading; /* preset being loaded */
+
+  GMutex lock;
+  GCond cond;
+
+  /* with lock */
+  gboolean shuffle;
+  gboolean quit;
+  gboolean wanted; /* the worker should fetch the next preset */
+  gboolean has_position;
+  guint position; /* playlist index of the current preset */
+  guint index;    /* playlist index of the fetched preset */
+  guint64 slot;   /* schedule slot to fetch the preset of */
+  guint64 fetched_slot;
+  gchar *filename;
+  gchar *data;
+  GQueue changes; /* PresetChange */
+  PresetPrefetchFetchedFunc fetched_func;
+  gpointer fetched_data;
+};
+
+static void preset_change_free(PresetChange *change) {
+  g_free(change->path);
+  g_free(change);
+}
+
+/* queue a change for the worker, with the lock */
+static void preset_prefetch_push_change(PresetPrefetch *prefetch,
+                                        PresetChangeType type,
+                                        const gchar *path) {
+  PresetChange *change = g_new0(PresetChange, 1);
+
+  change->type = type;
+  change->path = g_strdup(path);
+  g_queue_push_tail(&prefetch->changes, change);
+  g_cond_signal(&prefetch->cond);
+}
+
+/* pick the playlist entry to play after position */
+static guint preset_prefetch_pick(PresetPrefetch *prefetch, gboolean shuffle,
+                                  guint size, gboolean has_position,
+                                  guint position) {
+  guint index;
+
+  if (!has_position)
+    position = 0;
+
+  if (!shuffle || size < 2)
+    return has_position ? (position + 1) % size : 0;
+
+  // never pick the preset that is playing
+  if (!has_position)
+    return g_rand_int_range(prefetch->rand, 0, size);
+
+  index = g_rand_int_range(prefetch->rand, 0, size - 1);
+  return index >= position ? index + 1 : index;
+}
+
+/* pick the playlist entry of a schedule slot, the same for a given seed, slot
+ * and playlist whatever played before. attempt skips to the following entries
+ * when the picked one can't be read. */
+static guint preset_prefetch_pick_slot(guint32 seed, gboolean shuffle,
+                                       guint size, guint64 slot,
+                                       guint attempt) {
+  guint32 key[3] = {seed, (guint32)slot, (guint32)(slot >> 32)};
+  GRand *rand;
+  guint index;
+
+  if (!shuffle)
+    return (guint)((slot + attempt) % size);
+
+  rand = g_rand_new_with_seed_array(key, G_N_ELEMENTS(key));
+  index = g_rand_int_range(rand, 0, size);
+  g_rand_free(rand);
+
+  return (index + attempt) % size;
+}
+
+static gboolean preset_prefetch_is_preset(const gchar *name) {
+  gchar *lower = g_ascii_strdown(name, -1);
+  gboolean ret =
+      g_str_has_suffix(lower, ".milk") || g_str_has_suffix(lower, ".prjm");
+
+  g_free(lower);
+  return ret;
+}
+
+/* presets known to be broken stay out of the playlist */
+static gboolean preset_prefetch_is_playable(PresetStatus status) {
+  return status == PRESET_STATUS_UNKNOWN || status == PRESET_STATUS_OK;
+}
+
+/* presets that failed or were too slow when profiled stay out as well */
+static gboolean preset_prefetch_is_affordable(PresetPrefetch *prefetch,
+                                              const gchar *path, guint64 size,
+                                              gint64 mtime) {
+  const PresetCost *cost;
+
+  if (!prefetch->costs)
+    return TRUE;
+
+  // presets that weren't profiled are given the benefit of the doubt
+  cost = preset_costs_get(prefetch->costs, path, size, mtime);
+  if (!cost)
+    return TRUE;
+
+  if (cost->failed) {
+    GST_DEBUG("leaving out preset %s, it failed when profiled: %s", path,
+              cost->error ? cost->error : "unknown error");
+  } else if (prefetch->frame_budget > 0.0 &&
+             cost->frame_p99_ms > prefetch->frame_budget) {
+    GST_DEBUG("leaving out preset %s, %.2f ms per frame at %dx%d", path,
+              cost->frame_p99_ms, cost->width, cost->height);
+  } else {
+    return TRUE;
+  }
+
+  prefetch->excluded++;
+  return FALSE;
+}
+
+static void preset_prefetch_add_dir_preset(PresetPrefetch *prefetch,
+                                           const gchar *path,
+                                           PresetIndexEntry *known) {
+  PresetStatus status = PRESET_STATUS_UNKNOWN;
+  GStatBuf st;
+
+  if (g_stat(path, &st) != 0)
+    return;
+
+  // the status only holds for the file it was found for
+  if (known && known->size == (guint64)st.st_size &&
+      known->mtime == (gint64)st.st_mtime)
+    status = known->status;
+
+  preset_index_add_preset(prefetch->index, prefetch->scan_index_dir, path,
+                          st.st_size, st.st_mtime, status);
+
+  // the scan visits every file once, no need to check for duplicates. A
+  // schedule only depends on the files, not on what failed in other runs.
+  if ((prefetch->seed || preset_prefetch_is_playable(status)) &&
+      preset_prefetch_is_affordable(prefetch, path, st.st_size, st.st_mtime))
+    projectm_playlist_add_preset(prefetch->playlist, path, true);
+}
+
+/* take a directory from the loaded index if it didn't change since */
+static gboolean preset_prefetch_scan_indexed(PresetPrefetch *prefetch,
+                                             const gchar *path, gint64 mtime) {
+  PresetIndexDir *known;
+  guint i;
+
+  if (!prefetch->old_index)
+    return FALSE;
+
+  known = preset_index_get_dir(prefetch->old_index, path);
+  if (!known || known->mtime != mtime)
+    return FALSE;
+
+  prefetch->scan_index_dir = preset_index_add_dir(prefetch->index, path, mtime);
+
+  for (i = 0; i < known->subdirs->len; i++) {
+    const gchar *subdir = g_ptr_array_index(known->subdirs, i);
+    g_ptr_array_add(prefetch->scan_index_dir->subdirs, g_strdup(subdir));
+    dir_walk_push(prefetch->scan, subdir);
+  }
+
+  for (i = 0; i < known->presets->len; i++) {
+    PresetIndexEntry *entry = g_ptr_array_index(known->presets, i);
+
+    // broken presets are checked again in case they were fixed in place,
+    // every other file is trusted without touching it
+    if (!preset_prefetch_is_playable(entry->status)) {
+      preset_prefetch_add_dir_preset(prefetch, entry->path, entry);
+      continue;
+    }
+
+    preset_index_add_preset(prefetch->index, prefetch->scan_index_dir,
+                            entry->path, entry->size, entry->mtime,
+                            entry->status);
+    if (preset_prefetch_is_affordable(prefetch, entry->path, entry->size,
+                                      entry->mtime))
+      projectm_playlist_add_preset(prefetch->playlist, entry->path, true);
+  }
+
+  return TRUE;
+}
+
+/* scan up to SCAN_BATCH directory entries, returns FALSE when done */
+static gboolean preset_prefetch_scan(PresetPrefetch *prefetch) {
+  guint n;
+
+  for (n = 0; n < SCAN_BATCH; n++) {
+    GError *err = NULL;
+    const gchar *path;
+    GStatBuf st;
+
+    switch (dir_walk_next(prefetch->scan, &path, &err)) {
+    case DIR_WALK_DONE:
+      return FALSE;
+    case DIR_WALK_ERROR:
+      GST_WARNING("can't scan %s: %s", path, err->message);
+      g_clear_error(&err);
+      break;
+    case DIR_WALK_ENTER:
+      if (g_stat(path, &st) != 0) {
+        GST_WARNING("can't scan %s: %s", path, g_strerror(errno));
+        dir_walk_skip(prefetch->scan);
+        break;
+      }
+
+      if (prefetch->watch)
+        preset_watch_add_dir(prefetch->watch, path);
+
+      if (preset_prefetch_scan_indexed(prefetch, path, st.st_mtime)) {
+        dir_walk_skip(prefetch->scan);
+        break;
+      }
+
+      prefetch->scan_index_dir =
+          preset_index_add_dir(prefetch->index, path, st.st_mtime);
+      prefetch->index_dirty = TRUE;
+      break;
+    case DIR_WALK_SUBDIR:
+      g_ptr_array_add(prefetch->scan_index_dir->subdirs, g_strdup(path));
+      break;
+    case DIR_WALK_FILE:
+      if (preset_prefetch_is_preset(path))
+        preset_prefetch_add_dir_preset(
+            prefetch, path,
+            prefetch->old_index
+                ? preset_index_get_preset(prefetch->old_index, path)
+                : NULL);
+      break;
+    }
+  }
+
+  return TRUE;
+}
+
+static void preset_prefetch_save_index(PresetPrefetch *prefetch) {
+  GError *err = NULL;
+
+  if (!prefetch->index_file || !prefetch->index_dirty)
+    return;
+
+  if (preset_index_save(prefetch->index, prefetch->index_file, &err)) {
+    GST_INFO("saved preset index %s", prefetch->index_file);
+    prefetch->index_dirty = FALSE;
+  } else {
+    GST_WARNING("can't save preset index: %s", err->message);
+    g_clear_error(&err);
+  }
+}
+
+static void preset_prefetch_scan_done(PresetPrefetch *prefetch) {
+  guint size = projectm_playlist_size(prefetch->playlist);
+
+  GST_INFO("preset scan done, %u presets found, %u left out for their cost",
+           size, prefetch->excluded);
+
+  // directories are listed in no particular order
+  if (prefetch->seed)
+    projectm_playlist_sort(prefetch->playlist, 0, size,
+                           SORT_PREDICATE_FULL_PATH, SORT_ORDER_ASCENDING);
+
+  g_clear_pointer(&prefetch->old_index, preset_index_free);
+  preset_prefetch_save_index(prefetch);
+}
+
+static gboolean preset_prefetch_path_matches(const gchar *item,
+                                             const gchar *path) {
+  gsize len = strlen(path);
+
+  // the file itself or anything in the directory
+  return g_str_has_prefix(item, path) &&
+         (item[len] == '\0' || G_IS_DIR_SEPARATOR(item[len]));
+}
+
+/* drop the playlist entries under any of the paths */
+static void preset_prefetch_remove(PresetPrefetch *prefetch, GPtrArray *paths) {
+  guint size = projectm_playlist_size(prefetch->playlist);
+  char **items;
+  guint i, j;
+
+  if (paths->len == 0 || size == 0)
+    return;
+
+  items = projectm_playlist_items(prefetch->playlist, 0, size);
+  if (!items)
+    return;
+
+  for (i = size; i-- > 0;) {
+    for (j = 0; j < paths->len; j++) {
+      if (preset_prefetch_path_matches(items[i], g_ptr_array_index(paths, j)))
+        break;
+    }
+    if (j == paths->len)
+      continue;
+
+    GST_DEBUG("removing preset %s", items[i]);
+    projectm_playlist_remove_preset(prefetch->playlist, i);
+
+    // keep the positions on the same entries
+    g_mutex_lock(&prefetch->lock);
+    if (prefetch->has_position && i <= prefetch->position) {
+      if (prefetch->position == 0)
+        prefetch->has_position = FALSE;
+      else
+        prefetch->position--;
+    }
+    if (prefetch->data && i == prefetch->index) {
+      g_clear_pointer(&prefetch->filename, g_free);
+      g_clear_pointer(&prefetch->data, g_free);
+      prefetch->wanted = TRUE;
+    } else if (prefetch->data && i < prefetch->index) {
+      prefetch->index--;
+    }
+    g_mutex_unlock(&prefetch->lock);
+  }
+
+  projectm_playlist_free_string_array(items);
+}
+
+/* apply directory changes and load failures */
+static void preset_prefetch_apply(PresetPrefetch *prefetch, GQueue *changes) {
+  GPtrArray *removed = g_ptr_array_new();
+  PresetChange *change;
+  GList *l;
+
+  for (l = changes->head; l; l = l->next) {
+    GStatBuf st;
+    gchar *parent;
+
+    change = l->data;
+    parent = g_path_get_dirname(change->path);
+
+    switch (change->type) {
+    case PRESET_CHANGE_ADDED:
+      if (g_file_test(change->path, G_FILE_TEST_IS_DIR)) {
+        if (dir_walk_is_subdir(change->path)) {
+          dir_walk_push(prefetch->scan, change->path);
+          prefetch->scanning = TRUE;
+        }
+      } else if (preset_prefetch_is_preset(change->path) &&
+                 g_stat(change->path, &st) == 0 &&
+                 preset_prefetch_is_affordable(prefetch, change->path,
+                                               st.st_size, st.st_mtime)) {
+        GST_DEBUG("adding preset %s", change->path);
+        projectm_playlist_add_preset(prefetch->playlist, change->path, false);
+      }
+      // the directory is listed again on the next start
+      if (preset_index_invalidate_dir(prefetch->index, parent))
+        prefetch->index_dirty = TRUE;
+      break;
+    case PRESET_CHANGE_REMOVED:
+      g_ptr_array_add(removed, change->path);
+      if (preset_index_invalidate_dir(prefetch->index, parent))
+        prefetch->index_dirty = TRUE;
+      break;
+    case PRESET_CHANGE_FAILED:
+      // removing it would move the later slots of the schedule
+      if (!prefetch->seed)
+        g_ptr_array_add(removed, change->path);
+      if (preset_index_set_status(prefetch->index, change->path,
+                                  PRESET_STATUS_FAILED))
+        prefetch->index_dirty = TRUE;
+      break;
+    }
+
+    g_free(parent);
+  }
+
+  preset_prefetch_remove(prefetch, removed);
+  g_ptr_array_unref(removed);
+
+  while ((change = g_queue_pop_head(changes)))
+    preset_change_free(change);
+}
+
+static void preset_prefetch_load_index(PresetPrefetch *prefetch) {
+  GError *err = NULL;
+
+  if (!prefetch->index_file)
+    return;
+
+  prefetch->old_index = preset_index_load(prefetch->index_file, &err);
+  if (prefetch->old_index) {
+    GST_INFO("loaded preset index %s", prefetch->index_file);
+  } else {
+    GST_INFO("no preset index loaded: %s", err->message);
+    g_clear_error(&err);
+  }
+}
+
+static void preset_prefetch_load_costs(PresetPrefetch *prefetch) {
+  GError *err = NULL;
+
+  if (!prefetch->costs_file)
+    return;
+
+  prefetch->costs = preset_costs_load(prefetch->costs_file, &err);
+  if (prefetch->costs) {
+    GST_INFO("loaded the costs of %u presets from %s",
+             preset_costs_size(prefetch->costs), prefetch->costs_file);
+  } else {
+    GST_WARNING("no preset costs loaded, keeping every preset: %s",
+                err->message);
+    g_clear_error(&err);
+  }
+}
+
+static gpointer preset_prefetch_thread(gpointer user_data) {
+  PresetPrefetch *prefetch = user_data;
+
+  preset_prefetch_load_index(prefetch);
+  preset_prefetch_load_costs(prefetch);
+
+  g_mutex_lock(&prefetch->lock);
+
+  while (!prefetch->quit) {
+    gboolean has_position, shuffle;
+    guint position;
+    guint64 slot;
+    gchar *filename = NULL, *data = NULL;
+    guint size, attempt, index = 0;
+    PresetPrefetchFetchedFunc fetched_func;
+    gpointer fetched_data;
+
+    if (!g_queue_is_empty(&prefetch->changes)) {
+      GQueue changes = prefetch->changes;
+
+      g_queue_init(&prefetch->changes);
+      g_mutex_unlock(&prefetch->lock);
+      preset_prefetch_apply(prefetch, &changes);
+      g_mutex_lock(&prefetch->lock);
+      continue;
+    }
+
+    size = projectm_playlist_size(prefetch->playlist);
+
+    // fetch as soon as the scan found something, keep scanning otherwise. A
+    // schedule picks from the whole playlist, so it waits for the scan.
+    if (!prefetch->wanted ||
+        (prefetch->scanning && (size == 0 || prefetch->seed))) {
+      if (!prefetch->scanning) {
+        g_cond_wait(&prefetch->cond, &prefetch->lock);
+        continue;
+      }
+
+      g_mutex_unlock(&prefetch->lock);
+      prefetch->scanning = preset_prefetch_scan(prefetch);
+      if (!prefetch->scanning)
+        preset_prefetch_scan_done(prefetch);
+      g_mutex_lock(&prefetch->lock);
+      continue;
+    }
+
+    has_position = prefetch->has_position;
+    position = prefetch->position;
+    shuffle = prefetch->shuffle;
+    slot = prefetch->slot;
+    fetched_func = prefetch->fetched_func;
+    fetched_data = prefetch->fetched_data;
+
+    g_mutex_unlock(&prefetch->lock);
+
+    // reading the file is what would stall the GL thread, unreadable and
+    // empty files are skipped here so the switch doesn't fail later
+    for (attempt = 0; attempt < size && !data; attempt++) {
+      PresetStatus status = PRESET_STATUS_OK;
+      GError *err = NULL;
+      gsize length = 0;
+      char *item;
+
+      if (prefetch->seed)
+        index = preset_prefetch_pick_slot(prefetch->seed, shuffle, size, slot,
+                                          attempt);
+      else
+        index = preset_prefetch_pick(prefetch, shuffle, size, has_position,
+                                     position);
+      has_position = TRUE;
+      position = index;
+
+      item = projectm_playlist_item(prefetch->playlist, index);
+      if (!item)
+        continue;
+
+      g_free(filename);
+      filename = g_strdup(item);
+      projectm_playlist_free_string(item);
+
+      if (!g_file_get_contents(filename, &data, &length, &err)) {
+        GST_WARNING("skipping preset %s: %s", filename, err->message);
+        g_clear_error(&err);
+        status = PRESET_STATUS_UNREADABLE;
+      } else if (length == 0) {
+        GST_WARNING("skipping empty preset %s", filename);
+        g_clear_pointer(&data, g_free);
+        status = PRESET_STATUS_EMPTY;
+      }
+
+      if (preset_index_set_status(prefetch->index, filename, status))
+        prefetch->index_dirty = TRUE;
+    }
+
+    if (data)
+      GST_DEBUG("prefetched preset %u: %s", index, filename);
+    else if (size > 0)
+      GST_WARNING("no readable preset in the playlist");
+
+    // before the preset is handed over, it's freed once loaded
+    if (data && fetched_func)
+      fetched_func(filename, data, fetched_data);
+
+    g_mutex_lock(&prefetch->lock);
+    g_free(prefetch->filename);
+    g_free(prefetch->data);
+    prefetch->filename = data ? filename : NULL;
+    prefetch->data = data;
+    prefetch->index = index;
+    prefetch->fetched_slot = slot;
+    prefetch->wanted = FALSE;
+    g_cond_broadcast(&prefetch->cond);
+
+    if (!data)
+      g_free(filename);
+  }
+
+  g_mutex_unlock(&prefetch->lock);
+
+  // an unfinished scan would leave directories out of the index
+  if (!prefetch->scanning)
+    preset_prefetch_save_index(prefetch);
+
+  return NULL;
+}
+
+static void preset_prefetch_watch_changed(const gchar *path, gboolean added,
+                                          gpointer user_data) {
+  PresetPrefetch *prefetch = user_data;
+
+  g_mutex_lock(&prefetch->lock);
+  preset_prefetch_push_change(
+      prefetch, added ? PRESET_CHANGE_ADDED : PRESET_CHANGE_REMOVED, path);
+  g_mutex_unlock(&prefetch->lock);
+}
+
+PresetPrefetch *preset_prefetch_new(projectm_playlist_handle playlist,
+                                    gboolean shuffle, guint32 seed,
+                                    const gchar *path, const gchar *index_file,
+                                    const gchar *costs_file,
+                                    gdouble frame_budget, gboolean watch) {
+  PresetPrefetch *prefetch;
+
+  GST_DEBUG_CATEGORY_INIT(prefetch_debug, "projectm_prefetch", 0,
+                          "projectM preset prefetch");
+
+  prefetch = g_new0(PresetPrefetch, 1);
+  prefetch->playlist = playlist;
+  prefetch->shuffle = shuffle;
+  prefetch->seed = seed;
+  prefetch->fetched_slot = G_MAXUINT64;
+  prefetch->rand = g_rand_new();
+  prefetch->wanted = TRUE;
+  prefetch->index_file = g_strdup(index_file);
+  prefetch->index = preset_index_new();
+  prefetch->costs_file = g_strdup(costs_file);
+  prefetch->frame_budget = frame_budget;
+  prefetch->scan = dir_walk_new();
+  g_queue_init(&prefetch->changes);
+  g_mutex_init(&prefetch->lock);
+  g_cond_init(&prefetch->cond);
+
+  // from here on only the worker touches the playlist, it would load presets
+  // from disk itself if it stayed connected
+  projectm_playlist_connect(playlist, NULL);
+
+  if (path && g_file_test(path, G_FILE_TEST_IS_DIR)) {
+    dir_walk_push(prefetch->scan, path);
+    prefetch->scanning = TRUE;
+
+    if (watch)
+      prefetch->watch =
+          preset_watch_new(preset_prefetch_watch_changed, prefetch);
+  } else if (path) {
+    projectm_playlist_add_preset(playlist, path, false);
+  }
+
+  prefetch->thread =
+      g_thread_new("projectm-prefetch", preset_prefetch_thread, prefetch);
+
+  return prefetch;
+}
+
+void preset_prefetch_free(PresetPrefetch *prefetch) {
+  preset_prefetch_connect(prefetch, NULL);
+
+  // no more changes are queued once the watch is gone
+  if (prefetch->watch)
+    preset_watch_free(prefetch->watch);
+
+  g_mutex_lock(&prefetch->lock);
+  prefetch->quit = TRUE;
+  g_cond_broadcast(&prefetch->cond);
+  g_mutex_unlock(&prefetch->lock);
+
+  g_thread_join(prefetch->thread);
+
+  g_rand_free(prefetch->rand);
+  dir_walk_free(prefetch->scan);
+  g_queue_clear_full(&prefetch->changes, (GDestroyNotify)preset_change_free);
+  g_free(prefetch->index_file);
+  if (prefetch->old_index)
+    preset_index_free(prefetch->old_index);
+  preset_index_free(prefetch->index);
+  g_free(prefetch->costs_file);
+  if (prefetch->costs)
+    preset_costs_free(prefetch->costs);
+  g_mutex_clear(&prefetch->lock);
+  g_cond_clear(&prefetch->cond);
+  g_free(prefetch->filename);
+  g_free(prefetch->data);
+  g_free(prefetch);
+}
+
+static void preset_prefetch_switch_requested(bool is_hard_cut,
+                                             void *user_data) {
+  PresetPrefetch *prefetch = user_data;
+
+  // only the schedule switches presets
+  if (prefetch->seed)
+    return;
+
+  // never wait for the disk from inside the frame, if the worker isn't done
+  // yet the current preset keeps playing until the next request
+  if (!preset_prefetch_load_next(prefetch, is_hard_cut, FALSE))
+    GST_DEBUG("next preset not fetched yet");
+}
+
+static void preset_prefetch_switch_failed(const char *preset_filename,
+                                          const char *message,
+                                          void *user_data) {
+  PresetPrefetch *prefetch = user_data;
+
+  GST_WARNING("failed to switch preset: %s", message);
+
+  // loaded from memory, projectM doesn't know the file name
+  if (!prefetch->loading)
+    return;
+
+  if (prefetch->failed_func)
+    prefetch->failed_func(prefetch->loading, message, prefetch->failed_data);
+
+  g_mutex_lock(&prefetch->lock);
+  preset_prefetch_push_change(prefetch, PRESET_CHANGE_FAILED,
+                              prefetch->loading);
+  g_mutex_unlock(&prefetch->lock);
+}
+
+void preset_prefetch_set_shuffle(PresetPrefetch *prefetch, gboolean shuffle) {
+  g_mutex_lock(&prefetch->lock);
+  if (prefetch->shuffle != shuffle) {
+    prefetch->shuffle = shuffle;
+    // the fetched preset was picked the other way
+    g_clear_pointer(&prefetch->filename, g_free);
+    g_clear_pointer(&prefetch->data, g_free);
+    if (!prefetch->wanted) {
+      prefetch->wanted = TRUE;
+      g_cond_signal(&prefetch->cond);
+    }
+  }
+  g_mutex_unlock(&prefetch->lock);
+}
+
+void preset_prefetch_set_failed_func(PresetPrefetch *prefetch,
+                                     PresetPrefetchFailedFunc func,
+                                     gpointer user_data) {
+  prefetch->failed_func = func;
+  prefetch->failed_data = user_data;
+}
+
+void preset_prefetch_set_fetched_func(PresetPrefetch *prefetch,
+                                      PresetPrefetchFetchedFunc func,
+                                      gpointer user_data) {
+  g_mutex_lock(&prefetch->lock);
+  prefetch->fetched_func = func;
+  prefetch->fetched_data = user_data;
+  g_mutex_unlock(&prefetch->lock);
+}
+
+void preset_prefetch_connect(PresetPrefetch *prefetch, projectm_handle handle) {
+  if (prefetch->handle) {
+    projectm_set_preset_switch_requested_event_callback(prefetch->handle, NULL,
+                                                        NULL);
+    projectm_set_preset_switch_failed_event_callback(prefetch->handle, NULL,
+                                                     NULL);
+  }
+
+  prefetch->handle = handle;
+  if (!handle)
+    return;
+
+  projectm_set_preset_switch_requested_event_callback(
+      handle, preset_prefetch_switch_requested, prefetch);
+  projectm_set_preset_switch_failed_event_callback(
+      handle, preset_prefetch_switch_failed, prefetch);
+}
+
+/* switch to a preset read by the worker, takes the strings */
+static void preset_prefetch_load(PresetPrefetch *prefetch, gchar *filename,
+                                 gchar *data, gboolean hard_cut) {
+  GST_INFO("switching to preset %s (%s)", filename,
+           hard_cut ? "hard cut" : "soft cut");
+  prefetch->loading = filename;
+  projectm_load_preset_data(prefetch->handle, data, !hard_cut);
+  prefetch->loading = NULL;
+
+  g_free(filename);
+  g_free(data);
+}
+
+gboolean preset_prefetch_load_next(PresetPrefetch *prefetch, gboolean hard_cut,
+                                   gboolean wait) {
+  gchar *filename, *data;
+
+  g_return_val_if_fail(prefetch->handle != NULL, FALSE);
+
+  g_mutex_lock(&prefetch->lock);
+
+  while (wait && prefetch->wanted && !prefetch->quit)
+    g_cond_wait(&prefetch->cond, &prefetch->lock);
+
+  if (!prefetch->data) {
+    // nothing was readable last time, try again
+    if (!prefetch->wanted) {
+      prefetch->wanted = TRUE;
+      g_cond_signal(&prefetch->cond);
+    }
+    g_mutex_unlock(&prefetch->lock);
+    return FALSE;
+  }
+
+  filename = g_steal_pointer(&prefetch->filename);
+  data = g_steal_pointer(&prefetch->data);
+  prefetch->position = prefetch->index;
+  prefetch->has_position = TRUE;
+
+  // start on the one after right away
+  prefetch->wanted = TRUE;
+  g_cond_signal(&prefetch->cond);
+
+  g_mutex_unlock(&prefetch->lock);
+
+  preset_prefetch_load(prefetch, filename, data, hard_cut);
+
+  return TRUE;
+}
+
+gboolean preset_prefetch_load_slot(PresetPrefetch *prefetch, guint64 slot,
+                                   gboolean hard_cut) {
+  gchar *filename, *data;
+
+  g_return_val_if_fail(prefetch->handle != NULL, FALSE);
+  g_return_val_if_fail(prefetch->seed != 0, FALSE);
+
+  g_mutex_lock(&prefetch->lock);
+
+  // usually the slot was fetched while the one before played, a fetch for
+  // another slot is waited for and the slot fetched after it
+  prefetch->slot = slot;
+  while (!prefetch->quit &&
+         (prefetch->wanted || prefetch->fetched_slot != slot)) {
+    if (!prefetch->wanted) {
+      g_clear_pointer(&prefetch->filename, g_free);
+      g_clear_pointer(&prefetch->data, g_free);
+      prefetch->wanted = TRUE;
+      g_cond_signal(&prefetch->cond);
+    }
+    g_cond_wait(&prefetch->cond, &prefetch->lock);
+  }
+
+  if (!prefetch->data) {
+    g_mutex_unlock(&prefetch->lock);
+    return FALSE;
+  }
+
+  filename = g_steal_pointer(&prefetch->filename);
+  data = g_steal_pointer(&prefetch->data);
+  prefetch->position = prefetch->index;
+  prefetch->has_position = TRUE;
+
+  // fetch the next slot while this one plays
+  prefetch->slot = slot + 1;
+  prefetch->wanted = TRUE;
+  g_cond_signal(&prefetch->cond);
+
+  g_mutex_unlock(&prefetch->lock);
+
+  preset_prefetch_load(prefetch, filename, data, hard_cut);
+
+  return TRUE;
+}
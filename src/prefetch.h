@@ -0,0 +1,149 @@
+#ifndef __GST_PROJECTM_PREFETCH_H__
+#define __GST_PROJECTM_PREFETCH_H__
+
+#include <glib.h>
+
+#include <projectM-4/playlist.h>
+#include <projectM-4/projectM.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Loads the next playlist preset ahead of time on a worker thread.
+ *
+ * The prefetch replaces the playlist as the handler of projectM preset switch
+ * requests. The worker scans the preset directory into the playlist in the
+ * background, reusing an on-disk index for directories that didn't change,
+ * and optionally follows changes to the directory. While a preset plays, it
+ * picks the next playlist entry and reads it into memory, skipping files that
+ * can't be read. When projectM requests a switch, the GL thread only has to
+ * load the preset from memory.
+ *
+ * With a seed, presets follow a schedule instead: the caller asks for the
+ * preset of a slot, which is picked from the seed, the slot number and the
+ * complete, sorted playlist only. Any instance given the same seed and
+ * presets shows the same preset in the same slot, whatever it played before.
+ *
+ * With a cost database written by projectm-profile, the scan leaves out
+ * presets that failed to load when they were profiled, or took longer than
+ * the frame budget.
+ */
+typedef struct _PresetPrefetch PresetPrefetch;
+
+/**
+ * @brief Called on the GL thread when projectM fails to load a preset.
+ *
+ * @param filename The preset file.
+ * @param message What projectM reported.
+ * @param user_data The data passed to preset_prefetch_set_failed_func().
+ */
+typedef void (*PresetPrefetchFailedFunc)(const gchar *filename,
+                                         const gchar *message,
+                                         gpointer user_data);
+
+/**
+ * @brief Called on the worker thread with each preset it read ahead of time.
+ *
+ * @param filename The preset file.
+ * @param data The preset file contents.
+ * @param user_data The data passed to preset_prefetch_set_fetched_func().
+ */
+typedef void (*PresetPrefetchFetchedFunc)(const gchar *filename,
+                                          const gchar *data,
+                                          gpointer user_data);
+
+/**
+ * @brief Create the prefetch, start scanning and fetching the first preset.
+ *
+ * The playlist is disconnected from its projectM instance and belongs to the
+ * worker until the prefetch is freed. Presets are fetched as soon as the scan
+ * has found one, entries keep being appended while the scan goes on.
+ *
+ * @param playlist The playlist to take presets from.
+ * @param shuffle Pick presets at random rather than in playlist order.
+ * @param seed Follow the schedule of this seed, see
+ *             preset_prefetch_load_slot(). 0 to take switch requests from
+ *             projectM instead.
+ * @param path A preset file or a directory to scan recursively, or NULL.
+ * @param index_file Index of the directory listings, loaded so unchanged
+ *                   directories aren't read again and saved after the scan.
+ *                   NULL to always scan everything.
+ * @param costs_file Preset costs to filter the scanned presets with, or NULL.
+ * @param frame_budget Leave out presets whose 99th percentile frame time in
+ *                     the costs is above this many milliseconds, 0 to only
+ *                     leave out presets that failed.
+ * @param watch Keep the playlist up to date as presets are added to or
+ *              removed from the directory.
+ * @return The prefetch.
+ */
+PresetPrefetch *preset_prefetch_new(projectm_playlist_handle playlist,
+                                    gboolean shuffle, guint32 seed,
+                                    const gchar *path, const gchar *index_file,
+                                    const gchar *costs_file,
+                                    gdouble frame_budget, gboolean watch);
+
+/**
+ * @brief Stop the worker thread and free the prefetch.
+ */
+void preset_prefetch_free(PresetPrefetch *prefetch);
+
+/**
+ * @brief Change how the next presets are picked. Can be called from any
+ * thread.
+ */
+void preset_prefetch_set_shuffle(PresetPrefetch *prefetch, gboolean shuffle);
+
+/**
+ * @brief Set the function called when projectM fails to load a preset. Must
+ * be called before the first preset is loaded.
+ */
+void preset_prefetch_set_failed_func(PresetPrefetch *prefetch,
+                                     PresetPrefetchFailedFunc func,
+                                     gpointer user_data);
+
+/**
+ * @brief Set the function called with each preset read ahead of time. Can be
+ * called from any thread, presets fetched before are not passed to it.
+ */
+void preset_prefetch_set_fetched_func(PresetPrefetch *prefetch,
+                                      PresetPrefetchFetchedFunc func,
+                                      gpointer user_data);
+
+/**
+ * @brief Handle the preset switch requests of a projectM instance.
+ *
+ * @param prefetch The prefetch.
+ * @param handle The projectM instance, it must outlive the prefetch or be
+ *               disconnected by passing NULL.
+ */
+void preset_prefetch_connect(PresetPrefetch *prefetch, projectm_handle handle);
+
+/**
+ * @brief Switch to the prefetched preset. Must be called from the GL thread.
+ *
+ * @param prefetch The prefetch.
+ * @param hard_cut Switch immediately instead of blending.
+ * @param wait Wait for the worker if the preset hasn't been fetched yet.
+ * @return TRUE if a preset was loaded.
+ */
+gboolean preset_prefetch_load_next(PresetPrefetch *prefetch, gboolean hard_cut,
+                                   gboolean wait);
+
+/**
+ * @brief Switch to the preset of a schedule slot. Must be called from the GL
+ * thread, only with a seed.
+ *
+ * Waits for the scan to finish and the preset to be read, then starts fetching
+ * the preset of the following slot.
+ *
+ * @param prefetch The prefetch.
+ * @param slot The slot of the schedule.
+ * @param hard_cut Switch immediately instead of blending.
+ * @return TRUE if a preset was loaded.
+ */
+gboolean preset_prefetch_load_slot(PresetPrefetch *prefetch, guint64 slot,
+                                   gboolean hard_cut);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PREFETCH_H__ */
@@ -0,0 +1,156 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cachefile.h"
+#include "presetcost.h"
+
+#define COSTS_HEADER "gst-projectm-preset-costs 1"
+
+/* fields of a record: c, size, mtime, WxH, status, frame, p99, cpu, error,
+ * path */
+#define COSTS_FIELDS 10
+
+struct _PresetCosts {
+  GHashTable *presets; /* path -> PresetCost, owned */
+};
+
+static void preset_cost_free(PresetCost *cost) {
+  g_free(cost->path);
+  g_free(cost->error);
+  g_free(cost);
+}
+
+PresetCosts *preset_costs_new(void) {
+  PresetCosts *costs = g_new0(PresetCosts, 1);
+
+  costs->presets = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                         (GDestroyNotify)preset_cost_free);
+
+  return costs;
+}
+
+void preset_costs_free(PresetCosts *costs) {
+  g_hash_table_unref(costs->presets);
+  g_free(costs);
+}
+
+const PresetCost *preset_costs_get(PresetCosts *costs, const gchar *path,
+                                   guint64 size, gint64 mtime) {
+  PresetCost *cost = g_hash_table_lookup(costs->presets, path);
+
+  // the cost only holds for the file it was measured for
+  if (!cost || cost->size != size || cost->mtime != mtime)
+    return NULL;
+
+  return cost;
+}
+
+void preset_costs_set(PresetCosts *costs, const PresetCost *cost) {
+  PresetCost *copy = g_new(PresetCost, 1);
+
+  *copy = *cost;
+  copy->path = g_strdup(cost->path);
+  copy->error = g_strdup(cost->error);
+  g_hash_table_replace(costs->presets, copy->path, copy);
+}
+
+guint preset_costs_size(PresetCosts *costs) {
+  return g_hash_table_size(costs->presets);
+}
+
+static void preset_costs_load_record(gchar **fields, guint n_fields,
+                                     gpointer user_data) {
+  PresetCosts *costs = user_data;
+  PresetCost cost = {0};
+
+  if (n_fields != COSTS_FIELDS || !g_str_equal(fields[0], "c") ||
+      sscanf(fields[3], "%dx%d", &cost.width, &cost.height) != 2)
+    return;
+
+  cost.size = g_ascii_strtoull(fields[1], NULL, 10);
+  cost.mtime = g_ascii_strtoll(fields[2], NULL, 10);
+  cost.failed = !g_str_equal(fields[4], "ok");
+  cost.frame_ms = g_ascii_strtod(fields[5], NULL);
+  cost.frame_p99_ms = g_ascii_strtod(fields[6], NULL);
+  cost.cpu_ms = g_ascii_strtod(fields[7], NULL);
+  cost.error = *fields[8] ? g_strcompress(fields[8]) : NULL;
+  cost.path = g_strcompress(fields[9]);
+
+  preset_costs_set(costs, &cost);
+
+  g_free(cost.error);
+  g_free(cost.path);
+}
+
+PresetCosts *preset_costs_load(const gchar *filename, GError **error) {
+  PresetCosts *costs = preset_costs_new();
+
+  if (!cache_file_load(filename, COSTS_HEADER, "a preset cost file",
+                       COSTS_FIELDS, preset_costs_load_record, costs,
+                       error)) {
+    preset_costs_free(costs);
+    return NULL;
+  }
+
+  return costs;
+}
+
+static gint preset_costs_compare(gconstpointer a, gconstpointer b) {
+  const PresetCost *ca = *(const PresetCost *const *)a;
+  const PresetCost *cb = *(const PresetCost *const *)b;
+
+  return strcmp(ca->path, cb->path);
+}
+
+gboolean preset_costs_save(PresetCosts *costs, const gchar *filename,
+                           GError **error) {
+  GString *out = g_string_new(COSTS_HEADER "\n");
+  GPtrArray *sorted = g_ptr_array_new();
+  GHashTableIter iter;
+  PresetCost *cost;
+  gboolean ret;
+  guint i;
+
+  g_hash_table_iter_init(&iter, costs->presets);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&cost))
+    g_ptr_array_add(sorted, cost);
+
+  // in a stable order, so the files of two runs can be compared
+  g_ptr_array_sort(sorted, preset_costs_compare);
+
+  for (i = 0; i < sorted->len; i++) {
+    gchar frame[G_ASCII_DTOSTR_BUF_SIZE], p99[G_ASCII_DTOSTR_BUF_SIZE],
+        cpu[G_ASCII_DTOSTR_BUF_SIZE];
+    gchar *escaped_error, *escaped_path;
+
+    cost = g_ptr_array_index(sorted, i);
+    escaped_error = g_strescape(cost->error ? cost->error : "", NULL);
+    escaped_path = g_strescape(cost->path, NULL);
+
+    g_string_append_printf(
+        out,
+        "c\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT
+        "\t%dx%d\t%s\t%s\t%s\t%s\t%s\t%s\n",
+        cost->size, cost->mtime, cost->width, cost->height,
+        cost->failed ? "failed" : "ok",
+        g_ascii_formatd(frame, sizeof(frame), "%.3f", cost->frame_ms),
+        g_ascii_formatd(p99, sizeof(p99), "%.3f", cost->frame_p99_ms),
+        g_ascii_formatd(cpu, sizeof(cpu), "%.3f", cost->cpu_ms),
+        escaped_error, escaped_path);
+
+    g_free(escaped_error);
+    g_free(escaped_path);
+  }
+
+  g_ptr_array_unref(sorted);
+
+  ret = cache_file_save(filename, out, error);
+
+  g_string_free(out, TRUE);
+
+  return ret;
+}
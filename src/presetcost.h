@@ -0,0 +1,88 @@
+#ifndef __GST_PROJECTM_PRESETCOST_H__
+#define __GST_PROJECTM_PRESETCOST_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief What rendering a preset cost, measured by projectm-profile, with the
+ * size and modification time of the file it was measured for.
+ */
+typedef struct {
+  gchar *path;
+  guint64 size;
+  gint64 mtime;
+  /* render size it was measured at */
+  gint width;
+  gint height;
+  /* projectM could not load or render it, error says why */
+  gboolean failed;
+  gchar *error;
+  /* wall time per frame including waiting for the GPU, mean and 99th
+   * percentile, and CPU time per frame of all threads, in milliseconds */
+  gdouble frame_ms;
+  gdouble frame_p99_ms;
+  gdouble cpu_ms;
+} PresetCost;
+
+/**
+ * @brief Costs of preset files, saved to disk by the profiler and read by the
+ * element to leave out presets that don't fit its frame budget.
+ */
+typedef struct _PresetCosts PresetCosts;
+
+/**
+ * @brief Create an empty cost database.
+ */
+PresetCosts *preset_costs_new(void);
+
+/**
+ * @brief Load costs saved with preset_costs_save().
+ *
+ * @param filename The cost file.
+ * @param error Set if the file can't be read or holds no costs.
+ * @return The costs, or NULL on error.
+ */
+PresetCosts *preset_costs_load(const gchar *filename, GError **error);
+
+/**
+ * @brief Save the costs sorted by path, the file is replaced atomically.
+ *
+ * @param costs The costs.
+ * @param filename The cost file, missing parent directories are created.
+ * @param error Set if the file can't be written.
+ * @return TRUE on success.
+ */
+gboolean preset_costs_save(PresetCosts *costs, const gchar *filename,
+                           GError **error);
+
+void preset_costs_free(PresetCosts *costs);
+
+/**
+ * @brief Look up the cost of a preset file.
+ *
+ * @param costs The costs.
+ * @param path The preset file.
+ * @param size Size of the file now.
+ * @param mtime Modification time of the file now.
+ * @return The cost, owned by the database, or NULL if the file wasn't
+ *         measured or changed since.
+ */
+const PresetCost *preset_costs_get(PresetCosts *costs, const gchar *path,
+                                   guint64 size, gint64 mtime);
+
+/**
+ * @brief Add the cost of a preset, replacing the one of the same path. The
+ * strings are copied.
+ */
+void preset_costs_set(PresetCosts *costs, const PresetCost *cost);
+
+/**
+ * @brief Number of presets in the database.
+ */
+guint preset_costs_size(PresetCosts *costs);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PRESETCOST_H__ */
@@ -0,0 +1,205 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "cachefile.h"
+#include "presetindex.h"
+
+#define INDEX_HEADER "gst-projectm-preset-index 1"
+
+struct _PresetIndex {
+  GHashTable *dirs;    /* path -> PresetIndexDir, owned */
+  GHashTable *presets; /* path -> PresetIndexEntry, owned by their dir */
+};
+
+static const gchar *status_names[] = {"unknown", "ok", "unreadable", "empty",
+                                      "failed"};
+
+static PresetStatus preset_index_parse_status(const gchar *name) {
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(status_names); i++) {
+    if (g_str_equal(name, status_names[i]))
+      return i;
+  }
+
+  return PRESET_STATUS_UNKNOWN;
+}
+
+static void preset_index_entry_free(PresetIndexEntry *entry) {
+  g_free(entry->path);
+  g_free(entry);
+}
+
+static void preset_index_dir_free(PresetIndexDir *dir) {
+  g_free(dir->path);
+  g_ptr_array_unref(dir->subdirs);
+  g_ptr_array_unref(dir->presets);
+  g_free(dir);
+}
+
+PresetIndex *preset_index_new(void) {
+  PresetIndex *index = g_new0(PresetIndex, 1);
+
+  index->dirs = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                      (GDestroyNotify)preset_index_dir_free);
+  index->presets = g_hash_table_new(g_str_hash, g_str_equal);
+
+  return index;
+}
+
+void preset_index_free(PresetIndex *index) {
+  g_hash_table_unref(index->presets);
+  g_hash_table_unref(index->dirs);
+  g_free(index);
+}
+
+PresetIndexDir *preset_index_get_dir(PresetIndex *index, const gchar *path) {
+  return g_hash_table_lookup(index->dirs, path);
+}
+
+PresetIndexDir *preset_index_add_dir(PresetIndex *index, const gchar *path,
+                                     gint64 mtime) {
+  PresetIndexDir *dir = g_hash_table_lookup(index->dirs, path);
+  guint i;
+
+  if (dir) {
+    for (i = 0; i < dir->presets->len; i++) {
+      PresetIndexEntry *entry = g_ptr_array_index(dir->presets, i);
+      g_hash_table_remove(index->presets, entry->path);
+    }
+    g_hash_table_remove(index->dirs, path);
+  }
+
+  dir = g_new0(PresetIndexDir, 1);
+  dir->path = g_strdup(path);
+  dir->mtime = mtime;
+  dir->subdirs = g_ptr_array_new_with_free_func(g_free);
+  dir->presets =
+      g_ptr_array_new_with_free_func((GDestroyNotify)preset_index_entry_free);
+  g_hash_table_insert(index->dirs, dir->path, dir);
+
+  return dir;
+}
+
+PresetIndexEntry *preset_index_add_preset(PresetIndex *index,
+                                          PresetIndexDir *dir,
+                                          const gchar *path, guint64 size,
+                                          gint64 mtime, PresetStatus status) {
+  PresetIndexEntry *entry = g_new0(PresetIndexEntry, 1);
+
+  entry->path = g_strdup(path);
+  entry->size = size;
+  entry->mtime = mtime;
+  entry->status = status;
+  g_ptr_array_add(dir->presets, entry);
+  g_hash_table_replace(index->presets, entry->path, entry);
+
+  return entry;
+}
+
+PresetIndexEntry *preset_index_get_preset(PresetIndex *index,
+                                          const gchar *path) {
+  return g_hash_table_lookup(index->presets, path);
+}
+
+gboolean preset_index_set_status(PresetIndex *index, const gchar *path,
+                                 PresetStatus status) {
+  PresetIndexEntry *entry = g_hash_table_lookup(index->presets, path);
+
+  if (!entry || entry->status == status)
+    return FALSE;
+
+  entry->status = status;
+  return TRUE;
+}
+
+gboolean preset_index_invalidate_dir(PresetIndex *index, const gchar *path) {
+  PresetIndexDir *dir = g_hash_table_lookup(index->dirs, path);
+
+  // no directory has a zero modification time, it is never up to date
+  if (!dir || dir->mtime == 0)
+    return FALSE;
+
+  dir->mtime = 0;
+  return TRUE;
+}
+
+typedef struct {
+  PresetIndex *index;
+  PresetIndexDir *dir; /* the records of a directory follow it */
+} PresetIndexLoad;
+
+static void preset_index_load_record(gchar **fields, guint n_fields,
+                                     gpointer user_data) {
+  PresetIndexLoad *load = user_data;
+  gchar *path;
+
+  if (n_fields == 3 && g_str_equal(fields[0], "d")) {
+    path = g_strcompress(fields[2]);
+    load->dir = preset_index_add_dir(load->index, path,
+                                     g_ascii_strtoll(fields[1], NULL, 10));
+    g_free(path);
+  } else if (n_fields == 2 && g_str_equal(fields[0], "s") && load->dir) {
+    g_ptr_array_add(load->dir->subdirs, g_strcompress(fields[1]));
+  } else if (n_fields == 5 && g_str_equal(fields[0], "p") && load->dir) {
+    path = g_strcompress(fields[4]);
+    preset_index_add_preset(load->index, load->dir, path,
+                            g_ascii_strtoull(fields[1], NULL, 10),
+                            g_ascii_strtoll(fields[2], NULL, 10),
+                            preset_index_parse_status(fields[3]));
+    g_free(path);
+  }
+}
+
+PresetIndex *preset_index_load(const gchar *filename, GError **error) {
+  PresetIndexLoad load = {preset_index_new(), NULL};
+
+  if (!cache_file_load(filename, INDEX_HEADER, "a preset index", 6,
+                       preset_index_load_record, &load, error)) {
+    preset_index_free(load.index);
+    return NULL;
+  }
+
+  return load.index;
+}
+
+gboolean preset_index_save(PresetIndex *index, const gchar *filename,
+                           GError **error) {
+  GString *out = g_string_new(INDEX_HEADER "\n");
+  GHashTableIter iter;
+  PresetIndexDir *dir;
+  gboolean ret;
+  guint i;
+
+  g_hash_table_iter_init(&iter, index->dirs);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&dir)) {
+    gchar *escaped = g_strescape(dir->path, NULL);
+    g_string_append_printf(out, "d\t%" G_GINT64_FORMAT "\t%s\n", dir->mtime,
+                           escaped);
+    g_free(escaped);
+
+    for (i = 0; i < dir->subdirs->len; i++) {
+      escaped = g_strescape(g_ptr_array_index(dir->subdirs, i), NULL);
+      g_string_append_printf(out, "s\t%s\n", escaped);
+      g_free(escaped);
+    }
+
+    for (i = 0; i < dir->presets->len; i++) {
+      PresetIndexEntry *entry = g_ptr_array_index(dir->presets, i);
+      escaped = g_strescape(entry->path, NULL);
+      g_string_append_printf(out,
+                             "p\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT
+                             "\t%s\t%s\n",
+                             entry->size, entry->mtime,
+                             status_names[entry->status], escaped);
+      g_free(escaped);
+    }
+  }
+
+  ret = cache_file_save(filename, out, error);
+
+  g_string_free(out, TRUE);
+
+  return ret;
+}
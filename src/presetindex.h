@@ -0,0 +1,125 @@
+#ifndef __GST_PROJECTM_PRESETINDEX_H__
+#define __GST_PROJECTM_PRESETINDEX_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief What is known about a preset file.
+ */
+typedef enum {
+  PRESET_STATUS_UNKNOWN,    /* not read yet */
+  PRESET_STATUS_OK,         /* read, projectM did not reject it */
+  PRESET_STATUS_UNREADABLE, /* the file could not be read */
+  PRESET_STATUS_EMPTY,      /* the file is empty */
+  PRESET_STATUS_FAILED,     /* projectM failed to load it */
+} PresetStatus;
+
+/**
+ * @brief A preset file, with the size and modification time its status was
+ * found for.
+ */
+typedef struct {
+  gchar *path;
+  guint64 size;
+  gint64 mtime;
+  PresetStatus status;
+} PresetIndexEntry;
+
+/**
+ * @brief A scanned directory. The directory modification time changes when
+ * entries are added, removed or renamed, as long as it matches the listing is
+ * still valid and the directory doesn't need to be read again.
+ */
+typedef struct {
+  gchar *path;
+  gint64 mtime;
+  GPtrArray *subdirs; /* paths */
+  GPtrArray *presets; /* PresetIndexEntry */
+} PresetIndexDir;
+
+/**
+ * @brief Preset directory listings, saved to disk so the next start does not
+ * have to scan the preset directory again.
+ */
+typedef struct _PresetIndex PresetIndex;
+
+/**
+ * @brief Create an empty index.
+ */
+PresetIndex *preset_index_new(void);
+
+/**
+ * @brief Load an index saved with preset_index_save().
+ *
+ * @param filename The index file.
+ * @param error Set if the file can't be read or is not an index.
+ * @return The index, or NULL on error.
+ */
+PresetIndex *preset_index_load(const gchar *filename, GError **error);
+
+/**
+ * @brief Save the index, the file is replaced atomically.
+ *
+ * @param index The index.
+ * @param filename The index file, missing parent directories are created.
+ * @param error Set if the file can't be written.
+ * @return TRUE on success.
+ */
+gboolean preset_index_save(PresetIndex *index, const gchar *filename,
+                           GError **error);
+
+void preset_index_free(PresetIndex *index);
+
+/**
+ * @brief Look up a directory.
+ *
+ * @return The directory, owned by the index, or NULL.
+ */
+PresetIndexDir *preset_index_get_dir(PresetIndex *index, const gchar *path);
+
+/**
+ * @brief Add a directory, replacing an existing one with the same path.
+ *
+ * @return The empty directory, owned by the index.
+ */
+PresetIndexDir *preset_index_add_dir(PresetIndex *index, const gchar *path,
+                                     gint64 mtime);
+
+/**
+ * @brief Add a preset to a directory of the index.
+ *
+ * @return The entry, owned by the index.
+ */
+PresetIndexEntry *preset_index_add_preset(PresetIndex *index,
+                                          PresetIndexDir *dir,
+                                          const gchar *path, guint64 size,
+                                          gint64 mtime, PresetStatus status);
+
+/**
+ * @brief Look up a preset.
+ *
+ * @return The entry, owned by the index, or NULL.
+ */
+PresetIndexEntry *preset_index_get_preset(PresetIndex *index,
+                                          const gchar *path);
+
+/**
+ * @brief Update the status of a preset, if it is in the index.
+ *
+ * @return TRUE if the status changed.
+ */
+gboolean preset_index_set_status(PresetIndex *index, const gchar *path,
+                                 PresetStatus status);
+
+/**
+ * @brief Mark a directory as changed, it is read again on the next scan.
+ *
+ * @return TRUE if the directory is in the index and was not marked yet.
+ */
+gboolean preset_index_invalidate_dir(PresetIndex *index, const gchar *path);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PRESETINDEX_H__ */
@@ -0,0 +1,180 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <gst/gst.h>
+
+#include "presetwatch.h"
+
+GST_DEBUG_CATEGORY_STATIC(presetwatch_debug);
+#define GST_CAT_DEFAULT presetwatch_debug
+
+struct _PresetWatch {
+  PresetWatchFunc func;
+  gpointer user_data;
+
+  GThread *thread;
+  GMainContext *context;
+  GMainLoop *loop;
+
+  /* watch thread only */
+  GHashTable *monitors; /* path -> GFileMonitor */
+};
+
+typedef struct {
+  PresetWatch *watch;
+  gchar *path;
+} AddDirData;
+
+static void preset_watch_remove_dirs(PresetWatch *watch, const gchar *path) {
+  GHashTableIter iter;
+  const gchar *dir;
+  gsize len = strlen(path);
+
+  // the directory and everything below it
+  g_hash_table_iter_init(&iter, watch->monitors);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&dir, NULL)) {
+    if (g_str_has_prefix(dir, path) &&
+        (dir[len] == '\0' || G_IS_DIR_SEPARATOR(dir[len])))
+      g_hash_table_iter_remove(&iter);
+  }
+}
+
+static void preset_watch_changed(GFileMonitor *monitor, GFile *file,
+                                 GFile *other_file, GFileMonitorEvent event,
+                                 gpointer user_data) {
+  PresetWatch *watch = user_data;
+  gchar *path = g_file_get_path(file);
+  gchar *other_path = other_file ? g_file_get_path(other_file) : NULL;
+
+  switch (event) {
+  case G_FILE_MONITOR_EVENT_CREATED:
+  case G_FILE_MONITOR_EVENT_MOVED_IN:
+    GST_DEBUG("added %s", path);
+    watch->func(path, TRUE, watch->user_data);
+    break;
+  case G_FILE_MONITOR_EVENT_DELETED:
+  case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    GST_DEBUG("removed %s", path);
+    preset_watch_remove_dirs(watch, path);
+    watch->func(path, FALSE, watch->user_data);
+    break;
+  case G_FILE_MONITOR_EVENT_RENAMED:
+    if (!other_path)
+      break;
+    GST_DEBUG("renamed %s to %s", path, other_path);
+    preset_watch_remove_dirs(watch, path);
+    watch->func(path, FALSE, watch->user_data);
+    watch->func(other_path, TRUE, watch->user_data);
+    break;
+  default:
+    break;
+  }
+
+  g_free(path);
+  g_free(other_path);
+}
+
+static gboolean preset_watch_add_dir_cb(gpointer user_data) {
+  AddDirData *data = user_data;
+  PresetWatch *watch = data->watch;
+  GFileMonitor *monitor;
+  GError *err = NULL;
+  GFile *file;
+
+  if (g_hash_table_contains(watch->monitors, data->path))
+    return G_SOURCE_REMOVE;
+
+  file = g_file_new_for_path(data->path);
+  monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES, NULL,
+                                     &err);
+  g_object_unref(file);
+
+  if (!monitor) {
+    GST_WARNING("can't watch %s: %s", data->path, err->message);
+    g_clear_error(&err);
+    return G_SOURCE_REMOVE;
+  }
+
+  g_signal_connect(monitor, "changed", G_CALLBACK(preset_watch_changed), watch);
+  g_hash_table_insert(watch->monitors, g_strdup(data->path), monitor);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void preset_watch_add_dir_data_free(gpointer user_data) {
+  AddDirData *data = user_data;
+
+  g_free(data->path);
+  g_free(data);
+}
+
+void preset_watch_add_dir(PresetWatch *watch, const gchar *path) {
+  AddDirData *data = g_new0(AddDirData, 1);
+
+  data->watch = watch;
+  data->path = g_strdup(path);
+
+  // monitors report to the main context of the thread they were created in
+  g_main_context_invoke_full(watch->context, G_PRIORITY_DEFAULT,
+                             preset_watch_add_dir_cb, data,
+                             preset_watch_add_dir_data_free);
+}
+
+static void preset_watch_monitor_free(gpointer monitor) {
+  g_file_monitor_cancel(monitor);
+  g_object_unref(monitor);
+}
+
+static gpointer preset_watch_thread(gpointer user_data) {
+  PresetWatch *watch = user_data;
+
+  g_main_context_push_thread_default(watch->context);
+  g_main_loop_run(watch->loop);
+
+  // monitors must go away in the context they report to
+  g_hash_table_remove_all(watch->monitors);
+  g_main_context_pop_thread_default(watch->context);
+
+  return NULL;
+}
+
+PresetWatch *preset_watch_new(PresetWatchFunc func, gpointer user_data) {
+  PresetWatch *watch;
+
+  GST_DEBUG_CATEGORY_INIT(presetwatch_debug, "projectm_presetwatch", 0,
+                          "projectM preset directory watch");
+
+  watch = g_new0(PresetWatch, 1);
+  watch->func = func;
+  watch->user_data = user_data;
+  watch->context = g_main_context_new();
+  watch->loop = g_main_loop_new(watch->context, FALSE);
+  watch->monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          preset_watch_monitor_free);
+
+  watch->thread = g_thread_new("projectm-watch", preset_watch_thread, watch);
+
+  return watch;
+}
+
+static gboolean preset_watch_quit_cb(gpointer user_data) {
+  PresetWatch *watch = user_data;
+
+  g_main_loop_quit(watch->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+void preset_watch_free(PresetWatch *watch) {
+  g_main_context_invoke(watch->context, preset_watch_quit_cb, watch);
+  g_thread_join(watch->thread);
+
+  g_hash_table_unref(watch->monitors);
+  g_main_loop_unref(watch->loop);
+  g_main_context_unref(watch->context);
+  g_free(watch);
+}
@@ -0,0 +1,46 @@
+#ifndef __GST_PROJECTM_PRESETWATCH_H__
+#define __GST_PROJECTM_PRESETWATCH_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Watches preset directories for added and removed entries.
+ *
+ * The directories are monitored from a thread of their own. Changes are
+ * reported from that thread, renames as a removal and an addition.
+ */
+typedef struct _PresetWatch PresetWatch;
+
+/**
+ * @brief Called from the watch thread when an entry of a watched directory
+ * was added or removed.
+ *
+ * @param path The file or directory that changed.
+ * @param added TRUE if it was added, FALSE if it was removed.
+ * @param user_data The data passed to preset_watch_new().
+ */
+typedef void (*PresetWatchFunc)(const gchar *path, gboolean added,
+                                gpointer user_data);
+
+/**
+ * @brief Create a watch and start its thread.
+ */
+PresetWatch *preset_watch_new(PresetWatchFunc func, gpointer user_data);
+
+/**
+ * @brief Stop the watch thread and free the watch. No more changes are
+ * reported once this returns.
+ */
+void preset_watch_free(PresetWatch *watch);
+
+/**
+ * @brief Watch a directory, not recursively. Can be called from any thread,
+ * watching the same directory again has no effect.
+ */
+void preset_watch_add_dir(PresetWatch *watch, const gchar *path);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PRESETWATCH_H__ */
@@ -7,19 +7,22 @@
 #include <projectM-4/playlist.h>
 #include <projectM-4/projectM.h>
 
+#include "enums.h"
 #include "plugin.h"
 #include "projectm.h"
 
 GST_DEBUG_CATEGORY_STATIC(projectm_debug);
 #define GST_CAT_DEFAULT projectm_debug
 
-projectm_handle projectm_init(GstProjectM *plugin) {
+projectm_handle projectm_init(GstProjectM *plugin,
+                              projectm_playlist_handle *playlist_out) {
   projectm_handle handle = NULL;
   projectm_playlist_handle playlist = NULL;
+  gint render_width, render_height;
 
   GST_DEBUG_CATEGORY_INIT(projectm_debug, "projectm", 0, "ProjectM");
 
-  GstAudioVisualizer *bscope = GST_AUDIO_VISUALIZER(plugin);
+  GstPMAudioVisualizer *bscope = GST_PM_AUDIO_VISUALIZER(plugin);
 
   // Create ProjectM instance
   GST_DEBUG_OBJECT(plugin, "Creating projectM instance..");
@@ -71,49 +74,68 @@ projectm_handle projectm_init(GstProjectM *plugin) {
       plugin->aspect_correction, plugin->easter_egg, plugin->preset_locked,
       plugin->enable_playlist, plugin->shuffle_presets);
 
-  // Load preset file if path is provided
-  if (plugin->preset_path != NULL) {
-    int added_count =
-        projectm_playlist_add_path(playlist, plugin->preset_path, true, false);
-    GST_INFO("Loaded preset path: %s, presets found: %d", plugin->preset_path,
-             added_count);
-  }
+  // Set properties
+  GST_OBJECT_LOCK(plugin);
+  projectm_apply_properties(plugin, handle, G_MAXUINT32);
+  GST_OBJECT_UNLOCK(plugin);
+
+  projectm_set_fps(handle, projectm_get_fps(&bscope->vinfo));
+
+  // the base class scales to the output size if the render size differs
+  gst_gl_base_audio_visualizer_get_render_size(
+      GST_GL_BASE_AUDIO_VISUALIZER(plugin), &render_width, &render_height);
+  projectm_set_window_size(handle, render_width, render_height);
+
+  *playlist_out = playlist;
+
+  return handle;
+}
+
+gint projectm_get_fps(const GstVideoInfo *info) {
+  gint fps_n = GST_VIDEO_INFO_FPS_N(info);
+  gint fps_d = GST_VIDEO_INFO_FPS_D(info);
 
+  // projectM only takes whole frame rates, round e.g. 30000/1001 to 30
+  return fps_n > 0 && fps_d > 0 ? MAX(1, (fps_n + fps_d / 2) / fps_d) : fps_n;
+}
+
+void projectm_apply_properties(GstProjectM *plugin, projectm_handle handle,
+                               guint32 changed) {
   // Set texture search path if directory path is provided
-  if (plugin->texture_dir_path != NULL) {
+  if (changed & PROP_BIT(PROP_TEXTURE_DIR_PATH)) {
     const gchar *texturePaths[1] = {plugin->texture_dir_path};
-    projectm_set_texture_search_paths(handle, texturePaths, 1);
+    projectm_set_texture_search_paths(handle, texturePaths,
+                                      plugin->texture_dir_path != NULL);
   }
 
-  // Set properties
-  projectm_set_beat_sensitivity(handle, plugin->beat_sensitivity);
-  projectm_set_hard_cut_duration(handle, plugin->hard_cut_duration);
-  projectm_set_hard_cut_enabled(handle, plugin->hard_cut_enabled);
-  projectm_set_hard_cut_sensitivity(handle, plugin->hard_cut_sensitivity);
-  projectm_set_soft_cut_duration(handle, plugin->soft_cut_duration);
+  if (changed & PROP_BIT(PROP_BEAT_SENSITIVITY))
+    projectm_set_beat_sensitivity(handle, plugin->beat_sensitivity);
+  if (changed & PROP_BIT(PROP_HARD_CUT_DURATION))
+    projectm_set_hard_cut_duration(handle, plugin->hard_cut_duration);
+  if (changed & PROP_BIT(PROP_HARD_CUT_ENABLED))
+    projectm_set_hard_cut_enabled(handle, plugin->hard_cut_enabled);
+  if (changed & PROP_BIT(PROP_HARD_CUT_SENSITIVITY))
+    projectm_set_hard_cut_sensitivity(handle, plugin->hard_cut_sensitivity);
+  if (changed & PROP_BIT(PROP_SOFT_CUT_DURATION))
+    projectm_set_soft_cut_duration(handle, plugin->soft_cut_duration);
 
   // Set preset duration, or set to in infinite duration if zero
-  if (plugin->preset_duration > 0.0) {
-    projectm_set_preset_duration(handle, plugin->preset_duration);
-
-    // kick off the first preset
-    if (projectm_playlist_size(playlist) > 1 && !plugin->preset_locked) {
-      projectm_playlist_play_next(playlist, true);
+  if (changed & PROP_BIT(PROP_PRESET_DURATION)) {
+    if (plugin->preset_duration > 0.0) {
+      projectm_set_preset_duration(handle, plugin->preset_duration);
+    } else {
+      projectm_set_preset_duration(handle, 999999.0);
     }
-  } else {
-    projectm_set_preset_duration(handle, 999999.0);
   }
 
-  projectm_set_mesh_size(handle, plugin->mesh_width, plugin->mesh_height);
-  projectm_set_aspect_correction(handle, plugin->aspect_correction);
-  projectm_set_easter_egg(handle, plugin->easter_egg);
-  projectm_set_preset_locked(handle, plugin->preset_locked);
-
-  projectm_set_fps(handle, GST_VIDEO_INFO_FPS_N(&bscope->vinfo));
-  projectm_set_window_size(handle, GST_VIDEO_INFO_WIDTH(&bscope->vinfo),
-                           GST_VIDEO_INFO_HEIGHT(&bscope->vinfo));
-
-  return handle;
+  if (changed & PROP_BIT(PROP_MESH_SIZE))
+    projectm_set_mesh_size(handle, plugin->mesh_width, plugin->mesh_height);
+  if (changed & PROP_BIT(PROP_ASPECT_CORRECTION))
+    projectm_set_aspect_correction(handle, plugin->aspect_correction);
+  if (changed & PROP_BIT(PROP_EASTER_EGG))
+    projectm_set_easter_egg(handle, plugin->easter_egg);
+  if (changed & PROP_BIT(PROP_PRESET_LOCKED))
+    projectm_set_preset_locked(handle, plugin->preset_locked);
 }
 
 // void projectm_render(GstProjectM *plugin, gint16 *samples, gint sample_count)
@@ -4,14 +4,39 @@
 #include <glib.h>
 
 #include "plugin.h"
+#include <projectM-4/playlist.h>
 #include <projectM-4/projectM.h>
 
 G_BEGIN_DECLS
 
 /**
  * @brief Initialize ProjectM
+ *
+ * @param plugin The element, its properties configure the instance.
+ * @param playlist_out Set to the empty preset playlist, NULL if the playlist
+ *                     is disabled. The preset path is scanned by the caller.
  */
-projectm_handle projectm_init(GstProjectM *plugin);
+projectm_handle projectm_init(GstProjectM *plugin,
+                              projectm_playlist_handle *playlist_out);
+
+/**
+ * @brief Apply property values to a projectM instance. Only covers properties
+ * the instance takes as settings, the playlist is handled by the caller.
+ *
+ * @param plugin The element, its object lock must be held.
+ * @param handle The projectM instance.
+ * @param changed Mask of the changed properties, see PROP_BIT().
+ */
+void projectm_apply_properties(GstProjectM *plugin, projectm_handle handle,
+                               guint32 changed);
+
+/**
+ * @brief Get the frame rate passed to projectM for the negotiated video info.
+ *
+ * @param info The video info.
+ * @return The frame rate rounded to whole frames per second.
+ */
+gint projectm_get_fps(const GstVideoInfo *info);
 
 /**
  * @brief Render ProjectM
@@ -0,0 +1,283 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+
+#include "readback.h"
+
+GST_DEBUG_CATEGORY_STATIC(readback_debug);
+#define GST_CAT_DEFAULT readback_debug
+
+/* upper bound for waiting on a fence, mapping the buffer waits anyway */
+#define READBACK_FENCE_TIMEOUT (GST_SECOND / 2)
+
+#ifndef GL_PACK_ROW_LENGTH
+#define GL_PACK_ROW_LENGTH 0x0D02
+#endif
+#ifndef GL_BUFFER_SIZE
+#define GL_BUFFER_SIZE 0x8764
+#endif
+
+typedef struct {
+  GLuint pbo;
+  GLsync fence;
+  GstClockTime pts;
+  GstClockTime duration;
+} ReadbackSlot;
+
+struct _ReadbackRing {
+  GstGLContext *context;
+
+  ReadbackSlot *slots;
+  guint n_slots;
+  guint depth;
+
+  /* next slot to write and number of frames in flight */
+  guint head;
+  guint pending;
+
+  ReadbackLayout layout;
+  gsize stride;
+};
+
+/* GL_PACK_ROW_LENGTH is core in desktop GL, GLES only has it since 3.0 */
+static gboolean readback_has_pack_row_length(GstGLContext *context) {
+  return gst_gl_context_check_gl_version(
+             context, GST_GL_API_OPENGL | GST_GL_API_OPENGL3, 1, 0) ||
+         gst_gl_context_check_gl_version(context, GST_GL_API_GLES2, 3, 0);
+}
+
+void readback_layout_read(GstGLContext *context, const ReadbackLayout *layout,
+                          GstVideoFrame *frame) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  const ReadbackPlane *plane;
+  guint8 *dest, *row_pixels = NULL;
+  gint dest_stride;
+  guint p;
+  gint row;
+
+  for (p = 0; p < layout->n_planes; p++) {
+    plane = &layout->planes[p];
+    dest = GST_VIDEO_FRAME_PLANE_DATA(frame, p);
+    dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, p);
+
+    if (dest_stride == plane->width * 4) {
+      gl->ReadPixels(0, plane->y, plane->width, plane->rows, GL_RGBA,
+                     GL_UNSIGNED_BYTE, dest);
+      continue;
+    }
+
+    // padded rows of whole pixels are still read in one go
+    if (dest_stride > plane->width * 4 && dest_stride % 4 == 0 &&
+        readback_has_pack_row_length(context)) {
+      gl->PixelStorei(GL_PACK_ROW_LENGTH, dest_stride / 4);
+      gl->ReadPixels(0, plane->y, plane->width, plane->rows, GL_RGBA,
+                     GL_UNSIGNED_BYTE, dest);
+      gl->PixelStorei(GL_PACK_ROW_LENGTH, 0);
+      continue;
+    }
+
+    // the rows don't line up with the frame, read them one at a time
+    if (!row_pixels)
+      row_pixels = g_malloc((gsize)layout->width * 4);
+    for (row = 0; row < plane->rows; row++) {
+      gl->ReadPixels(0, plane->y + row, plane->width, 1, GL_RGBA,
+                     GL_UNSIGNED_BYTE, row_pixels);
+      memcpy(dest + row * dest_stride, row_pixels, plane->bytes);
+    }
+  }
+
+  g_free(row_pixels);
+}
+
+void readback_layout_copy(const ReadbackLayout *layout, const guint8 *pixels,
+                          gsize stride, GstVideoFrame *frame) {
+  const ReadbackPlane *plane;
+  const guint8 *src;
+  guint8 *dest;
+  gint dest_stride;
+  guint p;
+  gint row;
+
+  for (p = 0; p < layout->n_planes; p++) {
+    plane = &layout->planes[p];
+    src = pixels + plane->y * stride;
+    dest = GST_VIDEO_FRAME_PLANE_DATA(frame, p);
+    dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, p);
+
+    if ((gsize)dest_stride == stride) {
+      memcpy(dest, src, stride * plane->rows);
+    } else {
+      for (row = 0; row < plane->rows; row++)
+        memcpy(dest + row * dest_stride, src + row * stride, plane->bytes);
+    }
+  }
+}
+
+gboolean readback_ring_is_supported(GstGLContext *context) {
+  const GstGLFuncs *gl = context->gl_vtable;
+
+  return gl->GenBuffers && gl->BufferData && gl->GetBufferParameteriv &&
+         gl->MapBufferRange && gl->UnmapBuffer && gl->FenceSync &&
+         gl->ClientWaitSync && gl->DeleteSync;
+}
+
+ReadbackRing *readback_ring_new(GstGLContext *context, guint depth,
+                                const ReadbackLayout *layout) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  ReadbackRing *ring;
+  GLint size;
+  guint i;
+
+  GST_DEBUG_CATEGORY_INIT(readback_debug, "projectm_readback", 0,
+                          "projectM asynchronous readback");
+
+  g_return_val_if_fail(depth > 0, NULL);
+  g_return_val_if_fail(layout->width > 0 && layout->height > 0, NULL);
+
+  ring = g_new0(ReadbackRing, 1);
+  ring->context = gst_object_ref(context);
+  ring->depth = depth;
+  /* one more slot than the depth, the frame being read back right now */
+  ring->n_slots = depth + 1;
+  ring->slots = g_new0(ReadbackSlot, ring->n_slots);
+  ring->layout = *layout;
+  ring->stride = (gsize)layout->width * 4;
+
+  // a failed allocation leaves the buffer empty. The size is checked instead
+  // of glGetError(), which would clear errors the element still reports
+  for (i = 0; i < ring->n_slots; i++) {
+    size = 0;
+    gl->GenBuffers(1, &ring->slots[i].pbo);
+    gl->BindBuffer(GL_PIXEL_PACK_BUFFER, ring->slots[i].pbo);
+    gl->BufferData(GL_PIXEL_PACK_BUFFER, ring->stride * layout->height, NULL,
+                   GL_STREAM_READ);
+    gl->GetBufferParameteriv(GL_PIXEL_PACK_BUFFER, GL_BUFFER_SIZE, &size);
+    if ((gsize)size != ring->stride * layout->height)
+      break;
+  }
+  gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (i < ring->n_slots) {
+    GST_WARNING("failed to allocate %u pixel buffers of %dx%d", ring->n_slots,
+                layout->width, layout->height);
+    readback_ring_free(ring);
+    return NULL;
+  }
+
+  GST_DEBUG("created readback ring of %u pixel buffers of %dx%d",
+            ring->n_slots, layout->width, layout->height);
+
+  return ring;
+}
+
+void readback_ring_free(ReadbackRing *ring) {
+  const GstGLFuncs *gl = ring->context->gl_vtable;
+  guint i;
+
+  readback_ring_clear(ring);
+
+  for (i = 0; i < ring->n_slots; i++) {
+    if (ring->slots[i].pbo)
+      gl->DeleteBuffers(1, &ring->slots[i].pbo);
+  }
+
+  gst_object_unref(ring->context);
+  g_free(ring->slots);
+  g_free(ring);
+}
+
+gboolean readback_ring_matches(ReadbackRing *ring, guint depth,
+                               const ReadbackLayout *layout) {
+  return ring->depth == depth &&
+         memcmp(&ring->layout, layout, sizeof(ReadbackLayout)) == 0;
+}
+
+void readback_ring_push(ReadbackRing *ring, GstClockTime pts,
+                        GstClockTime duration) {
+  const GstGLFuncs *gl = ring->context->gl_vtable;
+  ReadbackSlot *slot;
+
+  g_return_if_fail(ring->pending < ring->n_slots);
+
+  slot = &ring->slots[ring->head];
+
+  // with a pixel pack buffer bound, glReadPixels only queues the copy and
+  // returns immediately
+  gl->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+  gl->ReadPixels(0, 0, ring->layout.width, ring->layout.height, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+  gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (slot->fence)
+    gl->DeleteSync(slot->fence);
+  slot->fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  slot->pts = pts;
+  slot->duration = duration;
+
+  ring->head = (ring->head + 1) % ring->n_slots;
+  ring->pending++;
+}
+
+gboolean readback_ring_pop(ReadbackRing *ring, GstVideoFrame *frame,
+                           gboolean drain) {
+  const GstGLFuncs *gl = ring->context->gl_vtable;
+  ReadbackSlot *slot;
+  guint8 *src;
+
+  if (ring->pending == 0 || (!drain && ring->pending <= ring->depth))
+    return FALSE;
+
+  slot = &ring->slots[(ring->head + ring->n_slots - ring->pending) %
+                      ring->n_slots];
+
+  if (slot->fence) {
+    GLenum status = gl->ClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                       READBACK_FENCE_TIMEOUT);
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+      GST_WARNING("readback of frame %" GST_TIME_FORMAT " not complete yet",
+                  GST_TIME_ARGS(slot->pts));
+
+    gl->DeleteSync(slot->fence);
+    slot->fence = NULL;
+  }
+
+  gl->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+  src = gl->MapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                           ring->stride * ring->layout.height, GL_MAP_READ_BIT);
+  if (src) {
+    readback_layout_copy(&ring->layout, src, ring->stride, frame);
+    gl->UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  } else {
+    GST_WARNING("failed to map pixel buffer of frame %" GST_TIME_FORMAT,
+                GST_TIME_ARGS(slot->pts));
+  }
+  gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  GST_BUFFER_PTS(frame->buffer) = slot->pts;
+  GST_BUFFER_DURATION(frame->buffer) = slot->duration;
+
+  ring->pending--;
+
+  return src != NULL;
+}
+
+void readback_ring_clear(ReadbackRing *ring) {
+  const GstGLFuncs *gl = ring->context->gl_vtable;
+  guint i;
+
+  for (i = 0; i < ring->n_slots; i++) {
+    if (ring->slots[i].fence) {
+      gl->DeleteSync(ring->slots[i].fence);
+      ring->slots[i].fence = NULL;
+    }
+  }
+
+  ring->head = 0;
+  ring->pending = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef __GST_PROJECTM_READBACK_H__
+#define __GST_PROJECTM_READBACK_H__
+
+#include <glib.h>
+#include <gst/gl/gl.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Rows of the read back pixels that hold one plane of a frame.
+ */
+typedef struct {
+  gint y;
+  gint rows;
+  gint width;  /* in read back pixels, 4 bytes each */
+  gsize bytes; /* bytes of each row that belong to the plane */
+} ReadbackPlane;
+
+/**
+ * @brief How the planes of a frame are packed into an RGBA image, which is
+ * read back as GL_RGBA / GL_UNSIGNED_BYTE. Planes follow each other in the
+ * order rows are read back, each row of a plane starting at the left edge.
+ */
+typedef struct {
+  gint width;
+  gint height;
+  guint n_planes;
+  ReadbackPlane planes[GST_VIDEO_MAX_PLANES];
+} ReadbackLayout;
+
+/**
+ * @brief Read the currently bound read framebuffer into a mapped video frame.
+ *
+ * @param context The OpenGL context.
+ * @param layout Where the planes of the frame are in the framebuffer.
+ * @param frame The video frame, mapped for writing.
+ */
+void readback_layout_read(GstGLContext *context, const ReadbackLayout *layout,
+                          GstVideoFrame *frame);
+
+/**
+ * @brief Copy read back pixels into a mapped video frame.
+ *
+ * @param layout Where the planes of the frame are in @pixels.
+ * @param pixels The pixels, rows @stride bytes apart.
+ * @param stride Bytes per row of @pixels.
+ * @param frame The video frame, mapped for writing.
+ */
+void readback_layout_copy(const ReadbackLayout *layout, const guint8 *pixels,
+                          gsize stride, GstVideoFrame *frame);
+
+/**
+ * @brief Ring of pixel buffer objects used to read frames back asynchronously.
+ *
+ * Each pushed frame is copied into a pixel buffer object by the GPU. The CPU
+ * only maps it once the frame has been held back for `depth` more frames, by
+ * which time the copy has usually completed and mapping does not stall.
+ */
+typedef struct _ReadbackRing ReadbackRing;
+
+/**
+ * @brief Check if the context can do asynchronous readback (pixel buffer
+ * objects, buffer mapping and fences).
+ *
+ * @param context The OpenGL context.
+ * @return TRUE if a ring can be created for the context.
+ */
+gboolean readback_ring_is_supported(GstGLContext *context);
+
+/**
+ * @brief Create a readback ring. Must be called from the GL thread.
+ *
+ * @param context The OpenGL context.
+ * @param depth Number of frames held back before a frame is returned.
+ * @param layout Where the planes of a frame are in the framebuffer.
+ * @return The ring, or NULL if the pixel buffers could not be allocated.
+ */
+ReadbackRing *readback_ring_new(GstGLContext *context, guint depth,
+                                const ReadbackLayout *layout);
+
+/**
+ * @brief Free a readback ring, pending frames are discarded. Must be called
+ * from the GL thread.
+ */
+void readback_ring_free(ReadbackRing *ring);
+
+/**
+ * @brief Check if the ring was created for the given configuration.
+ */
+gboolean readback_ring_matches(ReadbackRing *ring, guint depth,
+                               const ReadbackLayout *layout);
+
+/**
+ * @brief Start reading back the currently bound read framebuffer.
+ *
+ * @param ring The readback ring, must not be full.
+ * @param pts Timestamp of the frame, restored on the buffer it is copied into.
+ * @param duration Duration of the frame.
+ */
+void readback_ring_push(ReadbackRing *ring, GstClockTime pts,
+                        GstClockTime duration);
+
+/**
+ * @brief Copy the oldest frame into the planes of a mapped video frame.
+ *
+ * A frame is only returned once more than `depth` frames are pending, unless
+ * @drain is set. The timestamp and duration of the frame are set on the video
+ * frame's buffer.
+ *
+ * @param ring The readback ring.
+ * @param frame The video frame, mapped for writing.
+ * @param drain Return a frame if any is pending.
+ * @return TRUE if the frame was filled.
+ */
+gboolean readback_ring_pop(ReadbackRing *ring, GstVideoFrame *frame,
+                           gboolean drain);
+
+/**
+ * @brief Discard all pending frames.
+ */
+void readback_ring_clear(ReadbackRing *ring);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_READBACK_H__ */
@@ -0,0 +1,157 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "renderqueue.h"
+
+GST_DEBUG_CATEGORY_STATIC(renderqueue_debug);
+#define GST_CAT_DEFAULT renderqueue_debug
+
+typedef struct {
+  GstBuffer *audio;
+  GstBuffer *video;
+  GstFlowReturn ret;
+} RenderQueueFrame;
+
+struct _RenderQueue {
+  RenderQueueFunc func;
+  gpointer user_data;
+
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+
+  /* frames waiting to be rendered and rendered frames, oldest first */
+  GQueue pending;
+  GQueue done;
+  /* a frame is being rendered outside the lock */
+  gboolean rendering;
+  gboolean quit;
+};
+
+static void render_queue_frame_free(RenderQueueFrame *frame) {
+  gst_clear_buffer(&frame->audio);
+  gst_clear_buffer(&frame->video);
+  g_free(frame);
+}
+
+static gpointer render_queue_thread(gpointer data) {
+  RenderQueue *queue = data;
+  RenderQueueFrame *frame;
+
+  g_mutex_lock(&queue->lock);
+  while (!queue->quit) {
+    frame = g_queue_pop_head(&queue->pending);
+    if (!frame) {
+      g_cond_wait(&queue->cond, &queue->lock);
+      continue;
+    }
+
+    queue->rendering = TRUE;
+    g_mutex_unlock(&queue->lock);
+
+    frame->ret = queue->func(frame->audio, frame->video, queue->user_data);
+    gst_clear_buffer(&frame->audio);
+
+    g_mutex_lock(&queue->lock);
+    queue->rendering = FALSE;
+    g_queue_push_tail(&queue->done, frame);
+    g_cond_broadcast(&queue->cond);
+  }
+  g_mutex_unlock(&queue->lock);
+
+  return NULL;
+}
+
+RenderQueue *render_queue_new(RenderQueueFunc func, gpointer user_data) {
+  RenderQueue *queue;
+
+  GST_DEBUG_CATEGORY_INIT(renderqueue_debug, "projectm_renderqueue", 0,
+                          "projectM pipelined rendering");
+
+  queue = g_new0(RenderQueue, 1);
+  queue->func = func;
+  queue->user_data = user_data;
+  g_queue_init(&queue->pending);
+  g_queue_init(&queue->done);
+  g_mutex_init(&queue->lock);
+  g_cond_init(&queue->cond);
+  queue->thread = g_thread_new("projectm-render", render_queue_thread, queue);
+
+  return queue;
+}
+
+void render_queue_free(RenderQueue *queue) {
+  g_mutex_lock(&queue->lock);
+  queue->quit = TRUE;
+  g_cond_broadcast(&queue->cond);
+  g_mutex_unlock(&queue->lock);
+
+  g_thread_join(queue->thread);
+
+  GST_DEBUG("discarding %u queued and %u rendered frames",
+            queue->pending.length, queue->done.length);
+  g_queue_clear_full(&queue->pending, (GDestroyNotify)render_queue_frame_free);
+  g_queue_clear_full(&queue->done, (GDestroyNotify)render_queue_frame_free);
+  g_mutex_clear(&queue->lock);
+  g_cond_clear(&queue->cond);
+  g_free(queue);
+}
+
+void render_queue_push(RenderQueue *queue, GstBuffer *audio,
+                       GstBuffer *video) {
+  RenderQueueFrame *frame = g_new0(RenderQueueFrame, 1);
+
+  frame->audio = audio;
+  frame->video = video;
+
+  g_mutex_lock(&queue->lock);
+  g_queue_push_tail(&queue->pending, frame);
+  g_cond_broadcast(&queue->cond);
+  g_mutex_unlock(&queue->lock);
+}
+
+void render_queue_wait(RenderQueue *queue, guint max_pending) {
+  g_mutex_lock(&queue->lock);
+  while (queue->pending.length + (queue->rendering ? 1 : 0) > max_pending)
+    g_cond_wait(&queue->cond, &queue->lock);
+  g_mutex_unlock(&queue->lock);
+}
+
+gboolean render_queue_pop(RenderQueue *queue, GstBuffer **video,
+                          GstFlowReturn *ret) {
+  RenderQueueFrame *frame;
+
+  g_mutex_lock(&queue->lock);
+  frame = g_queue_pop_head(&queue->done);
+  g_mutex_unlock(&queue->lock);
+
+  if (!frame)
+    return FALSE;
+
+  *video = g_steal_pointer(&frame->video);
+  *ret = frame->ret;
+  render_queue_frame_free(frame);
+
+  return TRUE;
+}
+
+gboolean render_queue_is_empty(RenderQueue *queue) {
+  gboolean empty;
+
+  g_mutex_lock(&queue->lock);
+  empty = queue->pending.length == 0 && !queue->rendering &&
+          queue->done.length == 0;
+  g_mutex_unlock(&queue->lock);
+
+  return empty;
+}
+
+void render_queue_clear(RenderQueue *queue) {
+  render_queue_wait(queue, 0);
+
+  g_mutex_lock(&queue->lock);
+  GST_DEBUG("discarding %u rendered frames", queue->done.length);
+  g_queue_clear_full(&queue->done, (GDestroyNotify)render_queue_frame_free);
+  g_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,80 @@
+#ifndef __GST_PROJECTM_RENDERQUEUE_H__
+#define __GST_PROJECTM_RENDERQUEUE_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Frames rendered in order on a thread of their own.
+ *
+ * The streaming thread pushes the audio of a frame together with its output
+ * buffer and carries on, the rendered frames are popped later in the same
+ * order. This overlaps rendering with what happens up- and downstream.
+ */
+typedef struct _RenderQueue RenderQueue;
+
+/**
+ * @brief Render the audio of a frame into its output buffer.
+ *
+ * Called on the thread of the queue, one frame at a time.
+ */
+typedef GstFlowReturn (*RenderQueueFunc)(GstBuffer *audio, GstBuffer *video,
+                                         gpointer user_data);
+
+/**
+ * @brief Create a render queue and start its thread.
+ *
+ * @param func Function rendering each frame.
+ * @param user_data Passed to @func.
+ * @return The queue.
+ */
+RenderQueue *render_queue_new(RenderQueueFunc func, gpointer user_data);
+
+/**
+ * @brief Stop the thread and free the queue. The frame being rendered is
+ * finished, all others are discarded.
+ */
+void render_queue_free(RenderQueue *queue);
+
+/**
+ * @brief Queue a frame for rendering.
+ *
+ * @param queue The render queue.
+ * @param audio Audio of the frame, the queue takes ownership.
+ * @param video Output buffer of the frame, the queue takes ownership.
+ */
+void render_queue_push(RenderQueue *queue, GstBuffer *audio,
+                       GstBuffer *video);
+
+/**
+ * @brief Block until at most @max_pending frames are waiting to be rendered
+ * or being rendered.
+ */
+void render_queue_wait(RenderQueue *queue, guint max_pending);
+
+/**
+ * @brief Take the oldest rendered frame, without blocking.
+ *
+ * @param queue The render queue.
+ * @param video Set to the output buffer of the frame, owned by the caller.
+ * @param ret Set to what rendering the frame returned.
+ * @return FALSE if no rendered frame is waiting.
+ */
+gboolean render_queue_pop(RenderQueue *queue, GstBuffer **video,
+                          GstFlowReturn *ret);
+
+/**
+ * @brief Check if the queue holds no frames, rendered or not.
+ */
+gboolean render_queue_is_empty(RenderQueue *queue);
+
+/**
+ * @brief Wait for all queued frames to be rendered and discard them.
+ */
+void render_queue_clear(RenderQueue *queue);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_RENDERQUEUE_H__ */
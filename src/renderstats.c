@@ -0,0 +1,56 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "renderstats.h"
+
+static const gchar *stage_names[RENDER_STATS_N_STAGES] = {
+    "lock", "dispatch", "audio", "render", "readback", "frame"};
+
+void render_stats_reset(RenderStats *stats, GstClockTime now) {
+  memset(stats->values, 0, sizeof(stats->values));
+  stats->start = now;
+}
+
+void render_stats_add(RenderStats *stats, RenderStatsStage stage,
+                      GstClockTime duration) {
+  RenderStatsValue *value = &stats->values[stage];
+
+  value->count++;
+  value->total += duration;
+  if (duration > value->max)
+    value->max = duration;
+}
+
+const gchar *render_stats_stage_name(RenderStatsStage stage) {
+  g_return_val_if_fail(stage < RENDER_STATS_N_STAGES, NULL);
+
+  return stage_names[stage];
+}
+
+GstStructure *render_stats_to_structure(const RenderStats *stats,
+                                        GstClockTime now) {
+  GstStructure *s;
+  guint i;
+
+  s = gst_structure_new(RENDER_STATS_MESSAGE_NAME, "interval", G_TYPE_UINT64,
+                        (guint64)(now - stats->start), "frames", G_TYPE_UINT64,
+                        stats->values[RENDER_STATS_FRAME].count, NULL);
+
+  for (i = 0; i < RENDER_STATS_N_STAGES; i++) {
+    const RenderStatsValue *value = &stats->values[i];
+    gchar *mean = g_strconcat(stage_names[i], "-mean", NULL);
+    gchar *max = g_strconcat(stage_names[i], "-max", NULL);
+
+    gst_structure_set(s, mean, G_TYPE_UINT64,
+                      value->count ? value->total / value->count : 0, max,
+                      G_TYPE_UINT64, (guint64)value->max, NULL);
+
+    g_free(mean);
+    g_free(max);
+  }
+
+  return s;
+}
@@ -0,0 +1,85 @@
+#ifndef __GST_PROJECTM_RENDERSTATS_H__
+#define __GST_PROJECTM_RENDERSTATS_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Name of the element message carrying the statistics.
+ */
+#define RENDER_STATS_MESSAGE_NAME "projectm-stats"
+
+/**
+ * @brief Stages of rendering a frame that are timed.
+ */
+typedef enum {
+  /* waiting for the GL context lock */
+  RENDER_STATS_LOCK,
+  /* waiting for the GL thread to pick up the frame */
+  RENDER_STATS_DISPATCH,
+  /* feeding audio to the renderer, part of render */
+  RENDER_STATS_AUDIO,
+  /* rendering and scaling the frame */
+  RENDER_STATS_RENDER,
+  /* copying the frame to system memory, including waiting for the GPU */
+  RENDER_STATS_READBACK,
+  /* the whole frame, as seen by the streaming thread */
+  RENDER_STATS_FRAME,
+  RENDER_STATS_N_STAGES
+} RenderStatsStage;
+
+typedef struct {
+  guint64 count;
+  GstClockTime total;
+  GstClockTime max;
+} RenderStatsValue;
+
+/**
+ * @brief Per-stage durations accumulated over one reporting interval.
+ *
+ * Not thread safe, the element only updates it from the streaming thread or
+ * from the GL thread while the streaming thread waits for it.
+ */
+typedef struct {
+  RenderStatsValue values[RENDER_STATS_N_STAGES];
+  GstClockTime start;
+} RenderStats;
+
+/**
+ * @brief Start a new interval.
+ *
+ * @param stats The statistics.
+ * @param now Current time from gst_util_get_timestamp().
+ */
+void render_stats_reset(RenderStats *stats, GstClockTime now);
+
+/**
+ * @brief Record the duration of one stage.
+ */
+void render_stats_add(RenderStats *stats, RenderStatsStage stage,
+                      GstClockTime duration);
+
+/**
+ * @brief Get the name of a stage as used in the message fields.
+ */
+const gchar *render_stats_stage_name(RenderStatsStage stage);
+
+/**
+ * @brief Summarize the interval in a RENDER_STATS_MESSAGE_NAME structure.
+ *
+ * The structure has the interval length and frame count ("interval",
+ * "frames") and for each stage the mean and maximum duration in nanoseconds
+ * ("<stage>-mean", "<stage>-max").
+ *
+ * @param stats The statistics.
+ * @param now Current time from gst_util_get_timestamp().
+ * @return A new structure.
+ */
+GstStructure *render_stats_to_structure(const RenderStats *stats,
+                                        GstClockTime now);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_RENDERSTATS_H__ */
@@ -0,0 +1,111 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+
+#include "rendertarget.h"
+
+static gboolean render_target_attach(RenderTarget *target,
+                                     GstGLContext *context) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  GLenum status;
+
+  if (!target->fbo)
+    gl->GenFramebuffers(1, &target->fbo);
+
+  gl->BindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+  gl->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           target->texture, 0);
+  status = gl->CheckFramebufferStatus(GL_FRAMEBUFFER);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    GST_ERROR("framebuffer for texture %u is incomplete: 0x%x",
+              target->texture, status);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void render_target_free_texture(RenderTarget *target,
+                                       GstGLContext *context) {
+  if (target->texture && target->owns_texture)
+    context->gl_vtable->DeleteTextures(1, &target->texture);
+
+  target->texture = 0;
+  target->owns_texture = FALSE;
+}
+
+gboolean render_target_ensure(RenderTarget *target, GstGLContext *context,
+                              gint width, gint height) {
+  const GstGLFuncs *gl = context->gl_vtable;
+
+  if (target->texture && target->owns_texture && target->width == width &&
+      target->height == height)
+    return TRUE;
+
+  render_target_free_texture(target, context);
+
+  gl->GenTextures(1, &target->texture);
+  gl->BindTexture(GL_TEXTURE_2D, target->texture);
+  gl->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  gl->BindTexture(GL_TEXTURE_2D, 0);
+
+  target->owns_texture = TRUE;
+  target->width = width;
+  target->height = height;
+
+  return render_target_attach(target, context);
+}
+
+gboolean render_target_wrap(RenderTarget *target, GstGLContext *context,
+                            guint texture, gint width, gint height) {
+  if (target->texture == texture && !target->owns_texture &&
+      target->width == width && target->height == height)
+    return TRUE;
+
+  render_target_free_texture(target, context);
+
+  target->texture = texture;
+  target->width = width;
+  target->height = height;
+
+  return render_target_attach(target, context);
+}
+
+gboolean render_target_can_blit(GstGLContext *context) {
+  return context->gl_vtable->BlitFramebuffer != NULL;
+}
+
+void render_target_blit(RenderTarget *src, RenderTarget *dest,
+                        GstGLContext *context, gboolean flip) {
+  const GstGLFuncs *gl = context->gl_vtable;
+
+  // swapped destination rows mirror the image vertically
+  gl->BindFramebuffer(GL_READ_FRAMEBUFFER, src->fbo);
+  gl->BindFramebuffer(GL_DRAW_FRAMEBUFFER, dest->fbo);
+  gl->BlitFramebuffer(0, 0, src->width, src->height, 0,
+                      flip ? dest->height : 0, dest->width,
+                      flip ? 0 : dest->height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void render_target_clear(RenderTarget *target, GstGLContext *context) {
+  render_target_free_texture(target, context);
+
+  if (target->fbo) {
+    context->gl_vtable->DeleteFramebuffers(1, &target->fbo);
+    target->fbo = 0;
+  }
+
+  target->width = 0;
+  target->height = 0;
+}
@@ -0,0 +1,76 @@
+#ifndef __GST_PROJECTM_RENDERTARGET_H__
+#define __GST_PROJECTM_RENDERTARGET_H__
+
+#include <glib.h>
+#include <gst/gl/gl.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Framebuffer with a single RGBA texture as color attachment.
+ *
+ * The texture is either allocated by the render target or wraps an external
+ * texture, e.g. the one of a memory:GLMemory output buffer.
+ */
+typedef struct {
+  guint fbo;
+  guint texture;
+  gint width;
+  gint height;
+  gboolean owns_texture;
+} RenderTarget;
+
+/**
+ * @brief Make sure the target has its own texture of the given size. Must be
+ * called from the GL thread.
+ *
+ * @param target The render target.
+ * @param context The OpenGL context.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @return TRUE if the framebuffer is complete.
+ */
+gboolean render_target_ensure(RenderTarget *target, GstGLContext *context,
+                              gint width, gint height);
+
+/**
+ * @brief Attach an external texture to the target. Must be called from the GL
+ * thread.
+ *
+ * @param target The render target.
+ * @param context The OpenGL context.
+ * @param texture The texture, it is not freed with the target.
+ * @param width Texture width in pixels.
+ * @param height Texture height in pixels.
+ * @return TRUE if the framebuffer is complete.
+ */
+gboolean render_target_wrap(RenderTarget *target, GstGLContext *context,
+                            guint texture, gint width, gint height);
+
+/**
+ * @brief Check if the context can scale one target into another.
+ */
+gboolean render_target_can_blit(GstGLContext *context);
+
+/**
+ * @brief Scale the contents of one target into another with linear filtering.
+ * Must be called from the GL thread.
+ *
+ * @param src The target to read from.
+ * @param dest The target to draw into.
+ * @param context The OpenGL context.
+ * @param flip Mirror the image vertically, turning a frame rendered bottom up
+ *             into one that starts with its top row.
+ */
+void render_target_blit(RenderTarget *src, RenderTarget *dest,
+                        GstGLContext *context, gboolean flip);
+
+/**
+ * @brief Free the framebuffer and owned texture. Must be called from the GL
+ * thread.
+ */
+void render_target_clear(RenderTarget *target, GstGLContext *context);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_RENDERTARGET_H__ */
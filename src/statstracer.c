@@ -0,0 +1,141 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstglbaseaudiovisualizer.h"
+#include "renderstats.h"
+#include "statstracer.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_stats_tracer_debug);
+#define GST_CAT_DEFAULT gst_projectm_stats_tracer_debug
+
+#define DEFAULT_TRACER_INTERVAL 1000
+
+static GstTracerRecord *tr_stats;
+
+G_DEFINE_TYPE_WITH_CODE(
+    GstProjectMStatsTracer, gst_projectm_stats_tracer, GST_TYPE_TRACER,
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_stats_tracer_debug, "projectmstats", 0,
+                            "projectM stage timing tracer"));
+
+static void do_element_new(GstProjectMStatsTracer *self, GstClockTime ts,
+                           GstElement *element) {
+  guint interval;
+
+  if (!GST_IS_GL_BASE_AUDIO_VISUALIZER(element))
+    return;
+
+  // keep an interval set explicitly on the element
+  g_object_get(element, "stats-interval", &interval, NULL);
+  if (interval == 0)
+    g_object_set(element, "stats-interval", self->interval, NULL);
+}
+
+static void do_element_post_message_pre(GstProjectMStatsTracer *self,
+                                        GstClockTime ts, GstElement *element,
+                                        GstMessage *message) {
+  const GstStructure *s;
+  guint64 frames = 0, v[RENDER_STATS_N_STAGES * 2] = {0};
+  guint i;
+
+  if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_ELEMENT ||
+      !gst_message_has_name(message, RENDER_STATS_MESSAGE_NAME))
+    return;
+
+  s = gst_message_get_structure(message);
+  gst_structure_get_uint64(s, "frames", &frames);
+
+  for (i = 0; i < RENDER_STATS_N_STAGES; i++) {
+    const gchar *name = render_stats_stage_name(i);
+    gchar *mean = g_strconcat(name, "-mean", NULL);
+    gchar *max = g_strconcat(name, "-max", NULL);
+
+    gst_structure_get_uint64(s, mean, &v[i * 2]);
+    gst_structure_get_uint64(s, max, &v[i * 2 + 1]);
+
+    g_free(mean);
+    g_free(max);
+  }
+
+  G_STATIC_ASSERT(RENDER_STATS_N_STAGES == 6);
+  gst_tracer_record_log(tr_stats, GST_OBJECT_NAME(element), frames, v[0], v[1],
+                        v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10],
+                        v[11]);
+}
+
+static void gst_projectm_stats_tracer_constructed(GObject *object) {
+  GstProjectMStatsTracer *self = GST_PROJECTM_STATS_TRACER(object);
+  gchar *params, *str;
+  GstStructure *s;
+  gint interval;
+
+  G_OBJECT_CLASS(gst_projectm_stats_tracer_parent_class)->constructed(object);
+
+  g_object_get(self, "params", &params, NULL);
+  if (params) {
+    str = g_strdup_printf("projectmstats,%s", params);
+    s = gst_structure_from_string(str, NULL);
+    if (s) {
+      if (gst_structure_get_int(s, "interval", &interval) && interval > 0)
+        self->interval = interval;
+      gst_structure_free(s);
+    } else {
+      GST_WARNING_OBJECT(self, "could not parse params '%s'", params);
+    }
+    g_free(str);
+    g_free(params);
+  }
+
+  GST_DEBUG_OBJECT(self, "posting stats every %u ms", self->interval);
+}
+
+/* the value spec of a duration field in the record */
+static GstStructure *stats_value(const gchar *description) {
+  return gst_structure_new("value", "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+                           "description", G_TYPE_STRING, description, "min",
+                           G_TYPE_UINT64, G_GUINT64_CONSTANT(0), "max",
+                           G_TYPE_UINT64, G_MAXUINT64, NULL);
+}
+
+static void
+gst_projectm_stats_tracer_class_init(GstProjectMStatsTracerClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->constructed = gst_projectm_stats_tracer_constructed;
+
+  tr_stats = gst_tracer_record_new(
+      "projectm-stats.class", "element", GST_TYPE_STRUCTURE,
+      gst_structure_new("scope", "type", G_TYPE_GTYPE, G_TYPE_STRING,
+                        "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+                        GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+      "frames", GST_TYPE_STRUCTURE,
+      stats_value("frames rendered in the interval"), "lock-mean",
+      GST_TYPE_STRUCTURE, stats_value("mean wait for the GL context lock (ns)"),
+      "lock-max", GST_TYPE_STRUCTURE,
+      stats_value("max wait for the GL context lock (ns)"), "dispatch-mean",
+      GST_TYPE_STRUCTURE, stats_value("mean wait for the GL thread (ns)"),
+      "dispatch-max", GST_TYPE_STRUCTURE,
+      stats_value("max wait for the GL thread (ns)"), "audio-mean",
+      GST_TYPE_STRUCTURE, stats_value("mean time feeding audio (ns)"),
+      "audio-max", GST_TYPE_STRUCTURE,
+      stats_value("max time feeding audio (ns)"), "render-mean",
+      GST_TYPE_STRUCTURE, stats_value("mean render time (ns)"), "render-max",
+      GST_TYPE_STRUCTURE, stats_value("max render time (ns)"), "readback-mean",
+      GST_TYPE_STRUCTURE, stats_value("mean readback time (ns)"),
+      "readback-max", GST_TYPE_STRUCTURE,
+      stats_value("max readback time (ns)"), "frame-mean", GST_TYPE_STRUCTURE,
+      stats_value("mean time per frame (ns)"), "frame-max", GST_TYPE_STRUCTURE,
+      stats_value("max time per frame (ns)"), NULL);
+  GST_OBJECT_FLAG_SET(tr_stats, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void gst_projectm_stats_tracer_init(GstProjectMStatsTracer *self) {
+  GstTracer *tracer = GST_TRACER(self);
+
+  self->interval = DEFAULT_TRACER_INTERVAL;
+
+  gst_tracing_register_hook(tracer, "element-new",
+                            G_CALLBACK(do_element_new));
+  gst_tracing_register_hook(tracer, "element-post-message-pre",
+                            G_CALLBACK(do_element_post_message_pre));
+}
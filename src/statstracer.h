@@ -0,0 +1,38 @@
+#ifndef __GST_PROJECTM_STATS_TRACER_H__
+#define __GST_PROJECTM_STATS_TRACER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PROJECTM_STATS_TRACER (gst_projectm_stats_tracer_get_type())
+#define GST_PROJECTM_STATS_TRACER(obj)                                         \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_PROJECTM_STATS_TRACER,           \
+                              GstProjectMStatsTracer))
+
+typedef struct _GstProjectMStatsTracer GstProjectMStatsTracer;
+typedef struct _GstProjectMStatsTracerClass GstProjectMStatsTracerClass;
+
+/**
+ * @brief Tracer that enables stage timing on every projectm element and logs
+ * the "projectm-stats" messages as tracer records.
+ *
+ * Enable with GST_TRACERS="projectmstats" or
+ * GST_TRACERS="projectmstats(interval=500)" for a custom interval in
+ * milliseconds, and GST_DEBUG="GST_TRACER:7".
+ */
+struct _GstProjectMStatsTracer {
+  GstTracer parent;
+
+  guint interval;
+};
+
+struct _GstProjectMStatsTracerClass {
+  GstTracerClass parent_class;
+};
+
+GType gst_projectm_stats_tracer_get_type(void);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_STATS_TRACER_H__ */
@@ -0,0 +1,701 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+#include <gst/video/video.h>
+
+#include "dirwalk.h"
+#include "texturecache.h"
+
+GST_DEBUG_CATEGORY_STATIC(texture_cache_debug);
+#define GST_CAT_DEFAULT texture_cache_debug
+
+/* upper bound for decoding one texture */
+#define TEXTURE_DECODE_TIMEOUT (5 * GST_SECOND)
+
+/* the image files projectM looks for that GStreamer commonly decodes, tga,
+ * bmp and dds textures are left to projectM and loaded per instance */
+static const gchar *texture_extensions[] = {"jpg", "jpeg", "png"};
+
+typedef struct _TextureGroup TextureGroup;
+
+typedef struct {
+  gchar *path;
+  GLuint texture;
+  guint width;
+  guint height;
+  guint64 bytes;
+  guint refs;         /* users holding it */
+  GList *unused_link; /* in the unused queue of the group while refs is 0 */
+} TextureEntry;
+
+/* the textures of one GL share group */
+struct _TextureGroup {
+  GstGLContext *context; /* a context of the group */
+  GHashTable *entries;   /* path -> TextureEntry, owned */
+  GQueue unused;         /* entries without refs, least recently used first */
+  guint users;
+};
+
+/* a texture decoded by the worker, waiting to be uploaded */
+typedef struct {
+  gchar *path;
+  guint8 *pixels;
+  guint width;
+  guint height;
+  GList *link; /* in the decoded queue */
+} TextureImage;
+
+/* a texture to decode, the name is resolved on the worker */
+typedef struct {
+  gchar *texture_dir;
+  gchar *name;
+} TextureJob;
+
+/* what a user holds of an entry */
+typedef struct {
+  TextureEntry *entry;
+  guint count;
+} TextureRef;
+
+struct _TextureCacheUser {
+  GstGLContext *context;
+  TextureGroup *group;
+  gchar *texture_dir;
+  GHashTable *refs; /* name -> TextureRef, owned */
+};
+
+/* process wide, with the lock */
+static GMutex cache_lock;
+static GList *cache_groups;
+static GHashTable *cache_dirs;   /* directory -> (name -> path), scanned */
+static GHashTable *cache_failed; /* paths that couldn't be decoded */
+static guint64 cache_budget;
+static guint64 cache_total; /* bytes of the textures of all groups */
+static GThreadPool *cache_pool; /* decodes off the GL threads */
+static GHashTable *cache_decoded; /* path -> TextureImage, owned */
+static GQueue cache_decoded_queue; /* TextureImage, oldest first */
+static guint64 cache_decoded_total; /* bytes of the decoded images */
+
+static void texture_entry_free(TextureEntry *entry) {
+  g_free(entry->path);
+  g_free(entry);
+}
+
+static void texture_image_free(TextureImage *image) {
+  g_free(image->path);
+  g_free(image->pixels);
+  g_free(image);
+}
+
+/* lower case file name without a texture extension, NULL if it has none
+ * and one is required */
+static gchar *texture_cache_name(const gchar *file, gboolean need_extension) {
+  gchar *base = g_path_get_basename(file);
+  gchar *name = g_ascii_strdown(base, -1);
+  gchar *dot = strrchr(name, '.');
+  gboolean known = FALSE;
+  guint i;
+
+  g_free(base);
+
+  for (i = 0; dot && i < G_N_ELEMENTS(texture_extensions); i++)
+    known |= g_str_equal(dot + 1, texture_extensions[i]);
+
+  if (known) {
+    *dot = '\0';
+  } else if (need_extension) {
+    g_free(name);
+    return NULL;
+  }
+
+  return name;
+}
+
+static void texture_cache_scan(const gchar *path, GHashTable *files) {
+  DirWalk *walk = dir_walk_new();
+  const gchar *child;
+  DirWalkEvent event;
+  gchar *name;
+
+  dir_walk_push(walk, path);
+  while ((event = dir_walk_next(walk, &child, NULL)) != DIR_WALK_DONE) {
+    if (event != DIR_WALK_FILE || !(name = texture_cache_name(child, TRUE)))
+      continue;
+
+    // the first file of a name wins, the walk finds the ones closest to the
+    // texture directory first
+    if (g_hash_table_contains(files, name))
+      g_free(name);
+    else
+      g_hash_table_insert(files, name, g_strdup(child));
+  }
+
+  dir_walk_free(walk);
+}
+
+/* drop the listing of a directory and the files under it that failed to
+ * decode, they are scanned and tried again when next needed. With the lock */
+static void texture_cache_forget_dir(const gchar *texture_dir) {
+  GHashTableIter iter;
+  const gchar *path;
+  gchar *prefix;
+
+  if (!texture_dir)
+    return;
+
+  if (cache_dirs)
+    g_hash_table_remove(cache_dirs, texture_dir);
+
+  if (!cache_failed)
+    return;
+
+  prefix = g_str_has_suffix(texture_dir, G_DIR_SEPARATOR_S)
+               ? g_strdup(texture_dir)
+               : g_strconcat(texture_dir, G_DIR_SEPARATOR_S, NULL);
+  g_hash_table_iter_init(&iter, cache_failed);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&path, NULL)) {
+    if (g_str_has_prefix(path, prefix))
+      g_hash_table_iter_remove(&iter);
+  }
+  g_free(prefix);
+}
+
+/* the textures of a directory by name, scanned once on the decode worker,
+ * with the lock. NULL if it wasn't scanned yet and scan is FALSE, the lock is
+ * released while scanning. */
+static GHashTable *texture_cache_get_dir(const gchar *texture_dir,
+                                         gboolean scan) {
+  GHashTable *files;
+
+  if (!cache_dirs)
+    cache_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify)g_hash_table_unref);
+
+  files = g_hash_table_lookup(cache_dirs, texture_dir);
+  if (files || !scan)
+    return files;
+
+  files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_mutex_unlock(&cache_lock);
+  texture_cache_scan(texture_dir, files);
+  g_mutex_lock(&cache_lock);
+
+  if (g_hash_table_contains(cache_dirs, texture_dir)) {
+    g_hash_table_unref(files);
+    return g_hash_table_lookup(cache_dirs, texture_dir);
+  }
+
+  g_hash_table_insert(cache_dirs, g_strdup(texture_dir), files);
+  GST_INFO("%u textures in %s", g_hash_table_size(files), texture_dir);
+
+  return files;
+}
+
+/* decode an image file to tightly packed RGBA */
+static guint8 *texture_cache_decode(const gchar *path, guint *width,
+                                    guint *height) {
+  GstElement *pipeline, *src, *sink;
+  GstSample *sample = NULL;
+  GError *err = NULL;
+  guint8 *pixels = NULL;
+
+  pipeline = gst_parse_launch("filesrc name=src ! decodebin ! videoconvert ! "
+                              "video/x-raw,format=RGBA ! fakesink name=sink",
+                              &err);
+  if (!pipeline) {
+    GST_WARNING("can't decode textures: %s", err->message);
+    g_clear_error(&err);
+    return NULL;
+  }
+
+  src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+  sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  g_object_set(src, "location", path, NULL);
+  g_object_set(sink, "enable-last-sample", TRUE, NULL);
+
+  // a still image prerolls with its only frame
+  if (gst_element_set_state(pipeline, GST_STATE_PAUSED) !=
+          GST_STATE_CHANGE_FAILURE &&
+      gst_element_get_state(pipeline, NULL, NULL, TEXTURE_DECODE_TIMEOUT) ==
+          GST_STATE_CHANGE_SUCCESS)
+    g_object_get(sink, "last-sample", &sample, NULL);
+
+  if (sample) {
+    GstVideoInfo info;
+    GstVideoFrame frame;
+
+    if (gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) &&
+        gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample),
+                            GST_MAP_READ)) {
+      gsize row = GST_VIDEO_INFO_WIDTH(&info) * 4;
+      guint y;
+
+      *width = GST_VIDEO_INFO_WIDTH(&info);
+      *height = GST_VIDEO_INFO_HEIGHT(&info);
+      pixels = g_malloc(row * *height);
+      for (y = 0; y < *height; y++)
+        memcpy(pixels + y * row,
+               (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0) +
+                   y * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0),
+               row);
+
+      gst_video_frame_unmap(&frame);
+    }
+
+    gst_sample_unref(sample);
+  }
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(src);
+  gst_object_unref(sink);
+  gst_object_unref(pipeline);
+
+  return pixels;
+}
+
+/* TRUE if every share group has the texture, or there is none left to use
+ * it, with the lock */
+static gboolean texture_cache_is_uploaded(const gchar *path) {
+  GList *l;
+
+  for (l = cache_groups; l; l = l->next) {
+    TextureGroup *group = l->data;
+
+    if (!g_hash_table_contains(group->entries, path))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* take a decoded image out of the cache, with the lock */
+static TextureImage *texture_cache_take_image(const gchar *path) {
+  TextureImage *image;
+
+  if (!cache_decoded || !(image = g_hash_table_lookup(cache_decoded, path)))
+    return NULL;
+
+  g_hash_table_steal(cache_decoded, path);
+  g_queue_delete_link(&cache_decoded_queue, image->link);
+  cache_decoded_total -= (guint64)image->width * image->height * 4;
+
+  return image;
+}
+
+/* keep a decoded image until a GL thread uploads it, with the lock. Images
+ * no preset asked for in time make room for newer ones within the budget. */
+static void texture_cache_add_image(TextureImage *image) {
+  TextureImage *oldest;
+
+  if (!cache_decoded)
+    cache_decoded = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                          (GDestroyNotify)texture_image_free);
+
+  g_queue_push_tail(&cache_decoded_queue, image);
+  image->link = cache_decoded_queue.tail;
+  g_hash_table_insert(cache_decoded, image->path, image);
+  cache_decoded_total += (guint64)image->width * image->height * 4;
+
+  while (cache_decoded_total > cache_budget &&
+         (oldest = g_queue_peek_head(&cache_decoded_queue)) != image)
+    texture_image_free(texture_cache_take_image(oldest->path));
+}
+
+/* decode a texture on the worker, so the GL thread only uploads it */
+static void texture_cache_decode_job(gpointer data, gpointer user_data) {
+  TextureJob *job = data;
+  GHashTable *files;
+  gchar *key, *path = NULL;
+  guint8 *pixels;
+  guint width = 0, height = 0;
+
+  key = texture_cache_name(job->name, FALSE);
+
+  g_mutex_lock(&cache_lock);
+  files = texture_cache_get_dir(job->texture_dir, TRUE);
+  if (key)
+    path = g_strdup(g_hash_table_lookup(files, key));
+  // queued twice, or no element left to use it
+  if (path && ((cache_failed && g_hash_table_contains(cache_failed, path)) ||
+               (cache_decoded && g_hash_table_contains(cache_decoded, path)) ||
+               texture_cache_is_uploaded(path)))
+    g_clear_pointer(&path, g_free);
+  g_mutex_unlock(&cache_lock);
+
+  if (path) {
+    pixels = texture_cache_decode(path, &width, &height);
+
+    g_mutex_lock(&cache_lock);
+    if (!pixels) {
+      GST_WARNING("can't decode texture %s", path);
+      if (!cache_failed)
+        cache_failed =
+            g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_add(cache_failed, g_steal_pointer(&path));
+    } else if (cache_groups) {
+      TextureImage *image = g_new0(TextureImage, 1);
+
+      GST_DEBUG("decoded texture %s, %ux%u", path, width, height);
+      image->path = g_steal_pointer(&path);
+      image->pixels = pixels;
+      image->width = width;
+      image->height = height;
+      texture_cache_add_image(image);
+    } else {
+      g_free(pixels);
+    }
+    g_mutex_unlock(&cache_lock);
+  }
+
+  g_free(path);
+  g_free(key);
+  g_free(job->texture_dir);
+  g_free(job->name);
+  g_free(job);
+}
+
+/* decode a texture by name on the worker, with the lock */
+static void texture_cache_queue(const gchar *texture_dir, const gchar *name) {
+  TextureJob *job;
+
+  if (!cache_pool || !texture_dir)
+    return;
+
+  job = g_new0(TextureJob, 1);
+  job->texture_dir = g_strdup(texture_dir);
+  job->name = g_strdup(name);
+  g_thread_pool_push(cache_pool, job, NULL);
+}
+
+static GLuint texture_cache_upload(GstGLContext *context,
+                                   const guint8 *pixels, guint width,
+                                   guint height) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  GLint bound = 0;
+  GLuint texture = 0;
+
+  // called while projectM loads a preset, its bindings stay as they were
+  gl->GetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+
+  gl->GenTextures(1, &texture);
+  gl->BindTexture(GL_TEXTURE_2D, texture);
+  gl->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, pixels);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  gl->GenerateMipmap(GL_TEXTURE_2D);
+  gl->BindTexture(GL_TEXTURE_2D, bound);
+
+  // other contexts of the share group may use it right away
+  gl->Finish();
+
+  return texture;
+}
+
+static void texture_cache_delete(GstGLContext *context, GLuint texture) {
+  const GstGLFuncs *gl = context->gl_vtable;
+
+  gl->DeleteTextures(1, &texture);
+}
+
+/* delete unused textures of the group of the user until the cache fits its
+ * budget, with the lock. Other groups can only be evicted by their users. */
+static void texture_cache_evict(TextureCacheUser *user) {
+  TextureGroup *group = user->group;
+  TextureEntry *entry;
+
+  while (cache_total > cache_budget &&
+         (entry = g_queue_pop_head(&group->unused))) {
+    GST_DEBUG("evicting texture %s", entry->path);
+    entry->unused_link = NULL;
+    texture_cache_delete(user->context, entry->texture);
+    cache_total -= entry->bytes;
+    g_hash_table_remove(group->entries, entry->path);
+  }
+}
+
+static void texture_cache_unref_entry(TextureGroup *group,
+                                      TextureEntry *entry) {
+  if (--entry->refs > 0)
+    return;
+
+  g_queue_push_tail(&group->unused, entry);
+  entry->unused_link = group->unused.tail;
+}
+
+void texture_cache_set_budget(guint64 bytes) {
+  g_mutex_lock(&cache_lock);
+  cache_budget = bytes;
+  g_mutex_unlock(&cache_lock);
+}
+
+TextureCacheUser *texture_cache_user_new(GstGLContext *context,
+                                         const gchar *texture_dir) {
+  TextureCacheUser *user;
+  TextureGroup *group = NULL;
+  GList *l;
+
+  GST_DEBUG_CATEGORY_INIT(texture_cache_debug, "projectm_texturecache", 0,
+                          "projectM texture cache");
+
+  user = g_new0(TextureCacheUser, 1);
+  user->context = gst_object_ref(context);
+  user->texture_dir = g_strdup(texture_dir);
+  user->refs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  g_mutex_lock(&cache_lock);
+
+  // the directory may have changed since another element scanned it
+  texture_cache_forget_dir(texture_dir);
+
+  // one worker for all groups, decoding is mostly bound by the disk
+  if (!cache_pool)
+    cache_pool =
+        g_thread_pool_new(texture_cache_decode_job, NULL, 1, FALSE, NULL);
+
+  for (l = cache_groups; l; l = l->next) {
+    TextureGroup *known = l->data;
+
+    if (known->context == context ||
+        gst_gl_context_can_share(context, known->context)) {
+      group = known;
+      break;
+    }
+  }
+
+  if (!group) {
+    group = g_new0(TextureGroup, 1);
+    group->context = gst_object_ref(context);
+    group->entries = g_hash_table_new_full(
+        g_str_hash, g_str_equal, NULL, (GDestroyNotify)texture_entry_free);
+    g_queue_init(&group->unused);
+    cache_groups = g_list_prepend(cache_groups, group);
+    GST_DEBUG("new share group for %" GST_PTR_FORMAT, context);
+  }
+
+  group->users++;
+  user->group = group;
+
+  g_mutex_unlock(&cache_lock);
+
+  return user;
+}
+
+void texture_cache_user_free(TextureCacheUser *user) {
+  TextureGroup *group = user->group;
+  GThreadPool *pool = NULL;
+  GHashTableIter iter;
+  TextureRef *ref;
+  TextureEntry *entry;
+  TextureImage *image;
+
+  g_mutex_lock(&cache_lock);
+
+  g_hash_table_iter_init(&iter, user->refs);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&ref))
+    texture_cache_unref_entry(group, ref->entry);
+  g_hash_table_remove_all(user->refs);
+
+  if (--group->users > 0) {
+    texture_cache_evict(user);
+  } else {
+    // without users no context of the group is left to delete them later
+    g_hash_table_iter_init(&iter, group->entries);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+      texture_cache_delete(user->context, entry->texture);
+      cache_total -= entry->bytes;
+    }
+
+    cache_groups = g_list_remove(cache_groups, group);
+    g_queue_clear(&group->unused);
+    g_hash_table_unref(group->entries);
+    gst_object_unref(group->context);
+    g_free(group);
+  }
+
+  if (!cache_groups) {
+    pool = g_steal_pointer(&cache_pool);
+    while ((image = g_queue_peek_head(&cache_decoded_queue)))
+      texture_image_free(texture_cache_take_image(image->path));
+    g_clear_pointer(&cache_dirs, g_hash_table_unref);
+    g_clear_pointer(&cache_failed, g_hash_table_unref);
+  }
+
+  g_mutex_unlock(&cache_lock);
+
+  // jobs still queued find no group and return, the worker ends on its own
+  if (pool)
+    g_thread_pool_free(pool, FALSE, FALSE);
+
+  g_hash_table_unref(user->refs);
+  gst_object_unref(user->context);
+  g_free(user->texture_dir);
+  g_free(user);
+}
+
+void texture_cache_user_set_texture_dir(TextureCacheUser *user,
+                                        const gchar *texture_dir) {
+  g_mutex_lock(&cache_lock);
+  g_free(user->texture_dir);
+  user->texture_dir = g_strdup(texture_dir);
+  texture_cache_forget_dir(texture_dir);
+  g_mutex_unlock(&cache_lock);
+}
+
+guint texture_cache_user_acquire(TextureCacheUser *user, const gchar *name,
+                                 guint *width, guint *height) {
+  TextureGroup *group = user->group;
+  TextureEntry *entry;
+  TextureImage *image;
+  TextureRef *ref;
+  GHashTable *files;
+  gchar *key, *path = NULL;
+  GLuint texture;
+
+  g_mutex_lock(&cache_lock);
+
+  ref = g_hash_table_lookup(user->refs, name);
+  if (ref) {
+    ref->count++;
+    *width = ref->entry->width;
+    *height = ref->entry->height;
+    texture = ref->entry->texture;
+    g_mutex_unlock(&cache_lock);
+    return texture;
+  }
+
+  // the directory is scanned by the worker, not on the GL thread
+  key = texture_cache_name(name, FALSE);
+  files = user->texture_dir ? texture_cache_get_dir(user->texture_dir, FALSE)
+                            : NULL;
+  if (files && key)
+    path = g_strdup(g_hash_table_lookup(files, key));
+  else if (!files)
+    texture_cache_queue(user->texture_dir, name);
+  g_free(key);
+
+  // projectM loads the ones that aren't found itself
+  if (!path || (cache_failed && g_hash_table_contains(cache_failed, path))) {
+    g_mutex_unlock(&cache_lock);
+    g_free(path);
+    return 0;
+  }
+
+  entry = g_hash_table_lookup(group->entries, path);
+  if (!entry) {
+    image = texture_cache_take_image(path);
+
+    // not decoded ahead of time: rather than stalling the GL thread, and the
+    // other elements sharing it, projectM loads this one itself and later
+    // presets get the shared copy
+    if (!image) {
+      texture_cache_queue(user->texture_dir, name);
+      g_mutex_unlock(&cache_lock);
+      g_free(path);
+      return 0;
+    }
+
+    g_mutex_unlock(&cache_lock);
+    texture = texture_cache_upload(user->context, image->pixels,
+                                   image->width, image->height);
+    g_mutex_lock(&cache_lock);
+
+    // another user of the group may have loaded it in the meantime
+    entry = g_hash_table_lookup(group->entries, path);
+    if (entry) {
+      texture_cache_delete(user->context, texture);
+    } else {
+      entry = g_new0(TextureEntry, 1);
+      entry->path = g_strdup(path);
+      entry->texture = texture;
+      entry->width = image->width;
+      entry->height = image->height;
+      // with the mipmaps
+      entry->bytes = (guint64)entry->width * entry->height * 4 * 4 / 3;
+      g_hash_table_insert(group->entries, entry->path, entry);
+      cache_total += entry->bytes;
+      GST_INFO("loaded texture %s, %ux%u, %" G_GUINT64_FORMAT " kB cached",
+               path, entry->width, entry->height, cache_total / 1024);
+    }
+
+    texture_image_free(image);
+  }
+
+  if (entry->unused_link) {
+    g_queue_delete_link(&group->unused, entry->unused_link);
+    entry->unused_link = NULL;
+  }
+  entry->refs++;
+
+  ref = g_new0(TextureRef, 1);
+  ref->entry = entry;
+  ref->count = 1;
+  g_hash_table_insert(user->refs, g_strdup(name), ref);
+
+  texture_cache_evict(user);
+
+  *width = entry->width;
+  *height = entry->height;
+  texture = entry->texture;
+
+  g_mutex_unlock(&cache_lock);
+  g_free(path);
+
+  return texture;
+}
+
+void texture_cache_user_prefetch(TextureCacheUser *user,
+                                 const gchar *preset) {
+  GHashTable *names =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  const gchar *p = preset;
+  GHashTableIter iter;
+  gchar *name;
+
+  // shaders sample textures as sampler_name, or sampler_fw_name and the like
+  // to pick filtering and wrapping
+  while ((p = strstr(p, "sampler_"))) {
+    const gchar *start = p + strlen("sampler_"), *end = start;
+
+    while (g_ascii_isalnum(*end) || *end == '_')
+      end++;
+    if (end - start > 3 && start[2] == '_' &&
+        (start[0] == 'f' || start[0] == 'p') &&
+        (start[1] == 'c' || start[1] == 'w'))
+      start += 3;
+    // built in samplers aren't in the texture directory, the worker skips
+    // them
+    if (end > start)
+      g_hash_table_add(names, g_ascii_strdown(start, end - start));
+    p = end;
+  }
+
+  g_mutex_lock(&cache_lock);
+  g_hash_table_iter_init(&iter, names);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&name, NULL))
+    texture_cache_queue(user->texture_dir, name);
+  g_mutex_unlock(&cache_lock);
+
+  g_hash_table_unref(names);
+}
+
+void texture_cache_user_release(TextureCacheUser *user, const gchar *name) {
+  TextureRef *ref;
+
+  g_mutex_lock(&cache_lock);
+
+  ref = g_hash_table_lookup(user->refs, name);
+  if (ref && --ref->count == 0) {
+    texture_cache_unref_entry(user->group, ref->entry);
+    g_hash_table_remove(user->refs, name);
+    texture_cache_evict(user);
+  }
+
+  g_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,90 @@
+#ifndef __GST_PROJECTM_TEXTURECACHE_H__
+#define __GST_PROJECTM_TEXTURECACHE_H__
+
+#include <glib.h>
+#include <gst/gl/gl.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Process wide cache of preset textures, shared by all projectM
+ * instances whose GL contexts share objects.
+ *
+ * Each texture is read from the texture directory and decoded on a worker
+ * thread, uploaded once per GL share group and handed to every instance that
+ * asks for it by name. The GL thread only uploads textures decoded ahead of
+ * time, others are left to projectM once and decoded for the next preset.
+ * Textures no instance uses any more are kept for the next preset until the
+ * memory budget is exceeded, then the least recently used ones are deleted.
+ * Textures in use are never deleted, the budget can be exceeded by them.
+ * Only jpg and png textures are shared, projectM loads the other formats per
+ * instance.
+ */
+typedef struct _TextureCacheUser TextureCacheUser;
+
+/**
+ * @brief Set the GPU memory the cache may take, for all users.
+ *
+ * @param bytes The budget in bytes.
+ */
+void texture_cache_set_budget(guint64 bytes);
+
+/**
+ * @brief Start using the cache. Must be called from the GL thread of the
+ * context.
+ *
+ * @param context The GL context the textures are used in.
+ * @param texture_dir The directory to look for textures in, or NULL.
+ * @return The user, free it with texture_cache_user_free().
+ */
+TextureCacheUser *texture_cache_user_new(GstGLContext *context,
+                                         const gchar *texture_dir);
+
+/**
+ * @brief Release every texture of the user. Must be called from the GL
+ * thread, after the textures are no longer used.
+ */
+void texture_cache_user_free(TextureCacheUser *user);
+
+/**
+ * @brief Change the directory textures are looked up in. Textures the user
+ * holds stay valid.
+ *
+ * The directory is scanned again, as is the directory given to
+ * texture_cache_user_new(), so files added or fixed since are found.
+ */
+void texture_cache_user_set_texture_dir(TextureCacheUser *user,
+                                        const gchar *texture_dir);
+
+/**
+ * @brief Get a texture by the name a preset refers to it with, uploading it if
+ * it was decoded. Must be called from the GL thread.
+ *
+ * @param user The user.
+ * @param name The texture name, without directory or extension.
+ * @param width Set to the width of the texture.
+ * @param height Set to the height of the texture.
+ * @return The RGBA texture, held until released, or 0 if there is no such
+ *         file, it can't be decoded or isn't decoded yet.
+ */
+guint texture_cache_user_acquire(TextureCacheUser *user, const gchar *name,
+                                 guint *width, guint *height);
+
+/**
+ * @brief Decode the textures a preset refers to in the background, so they
+ * are ready once it is loaded. Can be called from any thread.
+ *
+ * @param user The user.
+ * @param preset The preset file contents.
+ */
+void texture_cache_user_prefetch(TextureCacheUser *user, const gchar *preset);
+
+/**
+ * @brief Give back a texture returned by texture_cache_user_acquire(). Must
+ * be called from the GL thread.
+ */
+void texture_cache_user_release(TextureCacheUser *user, const gchar *name);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_TEXTURECACHE_H__ */
@@ -83,7 +83,7 @@ case "$1" in
     "--output-video")
         GST_DEBUG=3 gst-launch-1.0 -v \
             filesrc location="test/audio/upbeat-future-bass.mp3" ! decodebin ! audioconvert ! \
-            projectm preset="test/presets/250-wavecode.milk.milk" ! videoscale ! videoconvert ! video/x-raw,width=1280,height=720 ! \
+            projectm preset="test/presets/250-wavecode.milk.milk" ! video/x-raw,width=1280,height=720 ! videoconvert ! \
             x264enc ! mp4mux ! filesink location="test/output/test_video.mp4"
         ;;
 
@@ -0,0 +1,254 @@
+/*
+ * Renders a frame that is red in its top half and blue in its bottom half
+ * through the GL audio visualizer base class, and checks that row 0 of the
+ * output is the top for system memory and memory:GLMemory output. Exits with
+ * 77, skipped, when no GL context can be created.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "src/gstglbaseaudiovisualizer.h"
+
+#define TEST_SKIP 77
+
+#define TEST_VIDEO_CAPS                                                        \
+  GST_VIDEO_CAPS_MAKE_WITH_FEATURES(GST_CAPS_FEATURE_MEMORY_GL_MEMORY,         \
+                                    "RGBA")                                    \
+  ", texture-target = (string) " GST_GL_TEXTURE_TARGET_2D_STR                  \
+  "; " GST_VIDEO_CAPS_MAKE("{ RGBA, RGB, NV12, I420 }")
+
+typedef struct {
+  GstGLBaseAudioVisualizer parent;
+} TestVisualizer;
+
+typedef struct {
+  GstGLBaseAudioVisualizerClass parent_class;
+} TestVisualizerClass;
+
+G_DEFINE_TYPE(TestVisualizer, test_visualizer,
+              GST_TYPE_GL_BASE_AUDIO_VISUALIZER)
+
+/* GL rows count from the bottom, the top half is the one with the higher
+ * rows */
+static gboolean test_visualizer_gl_render(GstGLBaseAudioVisualizer *glav,
+                                          GstBuffer *audio, GstBuffer *video,
+                                          guint fbo) {
+  const GstGLFuncs *gl = glav->context->gl_vtable;
+  gint width, height;
+
+  gst_gl_base_audio_visualizer_get_render_size(glav, &width, &height);
+
+  gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
+  gl->Viewport(0, 0, width, height);
+  gl->ClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+  gl->Clear(GL_COLOR_BUFFER_BIT);
+  gl->Enable(GL_SCISSOR_TEST);
+  gl->Scissor(0, height / 2, width, height - height / 2);
+  gl->ClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+  gl->Clear(GL_COLOR_BUFFER_BIT);
+  gl->Disable(GL_SCISSOR_TEST);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  return TRUE;
+}
+
+static void test_visualizer_class_init(TestVisualizerClass *klass) {
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstGLBaseAudioVisualizerClass *glav_class =
+      GST_GL_BASE_AUDIO_VISUALIZER_CLASS(klass);
+
+  gst_element_class_add_pad_template(
+      element_class,
+      gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+                           gst_caps_from_string(TEST_VIDEO_CAPS)));
+  gst_element_class_add_pad_template(
+      element_class,
+      gst_pad_template_new(
+          "sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+          gst_caps_from_string("audio/x-raw, format = (string) " GST_AUDIO_NE(
+              S16) ", layout = (string) interleaved, rate = (int) [ 1, MAX ], "
+                   "channels = (int) [ 1, 8 ]")));
+  gst_element_class_set_static_metadata(element_class, "Orientation test",
+                                        "Visualization", "Top red, bottom blue",
+                                        "gst-projectm");
+
+  glav_class->supported_gl_api = GST_GL_API_OPENGL3 | GST_GL_API_GLES2;
+  glav_class->gl_render = test_visualizer_gl_render;
+}
+
+static void test_visualizer_init(TestVisualizer *visualizer) {}
+
+typedef struct {
+  gboolean checked;
+  gboolean top_first;
+  gchar *format;
+} TestResult;
+
+/* red is bright in V and dark in U, blue the other way round */
+static gboolean test_is_red_chroma(guint8 u, guint8 v) {
+  return v > 200 && u < 128;
+}
+
+static gboolean test_is_blue_chroma(guint8 u, guint8 v) {
+  return u > 200 && v < 160;
+}
+
+static gboolean test_check_frame(GstVideoFrame *frame) {
+  gint last = GST_VIDEO_FRAME_HEIGHT(frame) - 1;
+  gint last_chroma = (GST_VIDEO_FRAME_HEIGHT(frame) + 1) / 2 - 1;
+  const guint8 *top, *bottom, *top_u, *top_v, *bottom_u, *bottom_v;
+
+#define ROW(plane, row)                                                        \
+  ((const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, plane) +                  \
+   (row) * GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane))
+
+  switch (GST_VIDEO_FRAME_FORMAT(frame)) {
+  case GST_VIDEO_FORMAT_RGBA:
+  case GST_VIDEO_FORMAT_RGB:
+    top = ROW(0, 0);
+    bottom = ROW(0, last);
+    return top[0] > 200 && top[2] < 50 && bottom[0] < 50 && bottom[2] > 200;
+  case GST_VIDEO_FORMAT_NV12:
+    top = ROW(1, 0);
+    bottom = ROW(1, last_chroma);
+    return ROW(0, 0)[0] > ROW(0, last)[0] &&
+           test_is_red_chroma(top[0], top[1]) &&
+           test_is_blue_chroma(bottom[0], bottom[1]);
+  case GST_VIDEO_FORMAT_I420:
+    top_u = ROW(1, 0);
+    top_v = ROW(2, 0);
+    bottom_u = ROW(1, last_chroma);
+    bottom_v = ROW(2, last_chroma);
+    return ROW(0, 0)[0] > ROW(0, last)[0] &&
+           test_is_red_chroma(top_u[0], top_v[0]) &&
+           test_is_blue_chroma(bottom_u[0], bottom_v[0]);
+  default:
+    return FALSE;
+  }
+
+#undef ROW
+}
+
+static void test_handoff(GstElement *sink, GstBuffer *buffer, GstPad *pad,
+                         gpointer user_data) {
+  TestResult *result = user_data;
+  GstCaps *caps;
+  GstVideoInfo info;
+  GstVideoFrame frame;
+
+  if (result->checked)
+    return;
+
+  caps = gst_pad_get_current_caps(pad);
+  if (caps && gst_video_info_from_caps(&info, caps) &&
+      gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ)) {
+    result->top_first = test_check_frame(&frame);
+    result->format = g_strdup(gst_video_format_to_string(
+        GST_VIDEO_INFO_FORMAT(&info)));
+    result->checked = TRUE;
+    gst_video_frame_unmap(&frame);
+  }
+  gst_clear_caps(&caps);
+}
+
+static gboolean test_run(const gchar *description) {
+  GstElement *pipeline, *sink;
+  GstMessage *msg;
+  GError *err = NULL;
+  TestResult result = {0};
+  gboolean ok;
+
+  pipeline = gst_parse_launch(description, &err);
+  if (!pipeline) {
+    fprintf(stderr, "FAIL %s: %s\n", description, err->message);
+    g_clear_error(&err);
+    return FALSE;
+  }
+
+  sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  g_object_set(sink, "signal-handoffs", TRUE, NULL);
+  g_signal_connect(sink, "handoff", G_CALLBACK(test_handoff), &result);
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered(GST_ELEMENT_BUS(pipeline), 30 * GST_SECOND,
+                                   GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+    gst_message_parse_error(msg, &err, NULL);
+    fprintf(stderr, "FAIL %s: %s\n", description, err->message);
+    g_clear_error(&err);
+  }
+  ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS && result.checked &&
+       result.top_first;
+  if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)
+    printf("%s %s: %s\n", ok ? "PASS" : "FAIL", result.format,
+           result.checked ? (result.top_first ? "row 0 is the top"
+                                              : "row 0 is not the top")
+                          : "no frame");
+  gst_clear_message(&msg);
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(sink);
+  gst_object_unref(pipeline);
+  g_free(result.format);
+
+  return ok;
+}
+
+/* the tests need a GL context, not a particular window system */
+static gboolean test_has_gl(void) {
+  GstGLDisplay *display = gst_gl_display_new();
+  GstGLContext *context = gst_gl_context_new(display);
+  gboolean ok = gst_gl_context_create(context, NULL, NULL);
+
+  gst_object_unref(context);
+  gst_object_unref(display);
+
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  static const gchar *outputs[] = {
+      "video/x-raw, format=RGBA",
+      "video/x-raw, format=RGB",
+      "video/x-raw, format=NV12",
+      "video/x-raw, format=I420",
+      "video/x-raw(memory:GLMemory), format=RGBA ! gldownload ! "
+      "video/x-raw, format=RGBA",
+  };
+  /* rendered at the output size, and smaller and scaled up */
+  static const gchar *render_sizes[] = {"", "render-width=32 render-height=24"};
+  gboolean ok = TRUE;
+  guint i, j;
+
+  gst_init(&argc, &argv);
+
+  if (!test_has_gl()) {
+    printf("SKIP no GL context\n");
+    return TEST_SKIP;
+  }
+
+  gst_element_register(NULL, "orientationtest", GST_RANK_NONE,
+                       test_visualizer_get_type());
+
+  for (i = 0; i < G_N_ELEMENTS(render_sizes); i++) {
+    for (j = 0; j < G_N_ELEMENTS(outputs); j++) {
+      gchar *description = g_strdup_printf(
+          "audiotestsrc num-buffers=8 ! "
+          "audio/x-raw, format=S16LE, channels=2, rate=44100 ! "
+          "orientationtest %s ! %s, width=64, height=48, framerate=30/1 ! "
+          "fakesink name=sink",
+          render_sizes[i], outputs[j]);
+
+      ok &= test_run(description);
+      g_free(description);
+    }
+  }
+
+  return ok ? 0 : 1;
+}